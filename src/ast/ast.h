@@ -63,6 +63,37 @@ static const char *expression_type_values[] = {
         "WHILE_EXPRESSION"
 };
 
+/**
+ * Operators of prefix and infix expressions, as OPERATOR(name, literal, token).
+ * The parser resolves the operator token to one of these once, so consumers of the
+ * AST can dispatch on a small enum instead of comparing strings.
+ */
+#define OPERATOR_LIST(OPERATOR)                 \
+    OPERATOR(OPERATOR_PLUS, "+", PLUS)          \
+    OPERATOR(OPERATOR_MINUS, "-", MINUS)        \
+    OPERATOR(OPERATOR_BANG, "!", BANG)          \
+    OPERATOR(OPERATOR_ASTERISK, "*", ASTERISK)  \
+    OPERATOR(OPERATOR_SLASH, "/", SLASH)        \
+    OPERATOR(OPERATOR_PERCENT, "%", PERCENT)    \
+    OPERATOR(OPERATOR_LT, "<", LT)              \
+    OPERATOR(OPERATOR_GT, ">", GT)              \
+    OPERATOR(OPERATOR_EQ, "==", EQ)             \
+    OPERATOR(OPERATOR_NOT_EQ, "!=", NOT_EQ)     \
+    OPERATOR(OPERATOR_AND, "&&", AND)           \
+    OPERATOR(OPERATOR_OR, "||", OR)
+
+#define OPERATOR_ENUM(name, literal, tok) name,
+#define OPERATOR_LITERAL(name, literal, tok) literal,
+
+typedef enum : char {
+    OPERATOR_LIST(OPERATOR_ENUM)
+    OPERATOR_COUNT
+} ast_operator;
+
+static const char *operator_literals[] = {
+    OPERATOR_LIST(OPERATOR_LITERAL)
+};
+
 typedef struct {
     ast_node_type type;
 
@@ -111,7 +142,7 @@ typedef struct {
     ast_expression  expression;
     token *         token;
     ast_expression *right;
-    char *          operator;
+    ast_operator    operator;
 } ast_prefix_expression;
 
 typedef struct {
@@ -119,7 +150,7 @@ typedef struct {
     token *         token;
     ast_expression *left;
     ast_expression *right;
-    char *          operator;
+    ast_operator    operator;
 } ast_infix_expression;
 
 typedef struct {
@@ -206,5 +237,6 @@ typedef struct {
 
 #define ast_get_statement_type_name(type) statement_type_values[type]
 #define ast_get_expression_type_name(type) expression_type_values[type]
+#define ast_get_operator_literal(op) operator_literals[op]
 
 #endif //AST_H
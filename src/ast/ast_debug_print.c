@@ -95,7 +95,7 @@ void ast_debug_print_node(FILE *out, ast_node *node, const int level) {
                 case PREFIX_EXPRESSION: {
                     const ast_prefix_expression *prefix = (ast_prefix_expression *)node;
                     indent(out, level + 1);
-                    fprintf(out, "Operator: %s\n", prefix->operator);
+                    fprintf(out, "Operator: %s\n", ast_get_operator_literal(prefix->operator));
                     indent(out, level + 1);
                     fprintf(out, "Right:\n");
                     ast_debug_print_node(out, (ast_node *)prefix->right, level + 2);
@@ -104,7 +104,7 @@ void ast_debug_print_node(FILE *out, ast_node *node, const int level) {
                 case INFIX_EXPRESSION: {
                     const ast_infix_expression *infix = (ast_infix_expression *)node;
                     indent(out, level + 1);
-                    fprintf(out, "Operator: %s\n", infix->operator);
+                    fprintf(out, "Operator: %s\n", ast_get_operator_literal(infix->operator));
                     indent(out, level + 1);
                     fprintf(out, "Left:\n");
                     ast_debug_print_node(out, (ast_node *)infix->left, level + 2);
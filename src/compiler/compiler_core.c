@@ -2,16 +2,21 @@
 #include <err.h>
 #include <stdarg.h>
 #include <stdlib.h>
+#include <string.h>
+#include "../datastructures/hashmap.h"
 #include "../object/object.h"
 #include "../opcode/opcode.h"
 #include "../object/builtins.h"
 #include "node_compiler.h"
 #include "compiler_core.h"
 #include "compiler_utils.h"
+#include "peephole.h"
 #include "scope.h"
 
 #define CONSTANTS_POOL_INIT_SIZE 16
 
+static void index_constant(compiler *, size_t);
+
 /***************************************************************
 ********************** INIT FUNCTIONS **************************
  ***************************************************************/
@@ -20,8 +25,10 @@ compiler *compiler_init(void) {
     if (compiler == NULL) {
         err(EXIT_FAILURE, "Could not allocate memory for compiler");
     }
-    compiler->constants_pool = nullptr;
-    compiler->symbol_table   = symbol_table_init();
+    compiler->constants_pool          = nullptr;
+    compiler->constant_slots          = nullptr;
+    compiler->constant_slots_capacity = 0;
+    compiler->symbol_table            = symbol_table_init();
     for (size_t i = 0; i < get_builtins_count(); i++) {
         const char *builtin_name = (char *) get_builtins_name(i);
         if (builtin_name == NULL) {
@@ -29,7 +36,15 @@ compiler *compiler_init(void) {
         }
         symbol_define_builtin(compiler->symbol_table, i, builtin_name);
     }
-    compiler->scope_index         = 0;
+    compiler->scope_index               = 0;
+    compiler->fold_constants            = false;
+    compiler->peephole                  = false;
+    compiler->optimize_ir               = false;
+    compiler->optimize_loops            = false;
+    compiler->inline_functions          = nullptr;
+    compiler->global_constants          = nullptr;
+    compiler->global_constants_capacity = 0;
+    compiler->instruction_format        = INSTRUCTIONS_BYTES;
     compiler->scopes              = arraylist_create(16, _scope_free);
     compilation_scope *main_scope = scope_init();
     arraylist_add(compiler->scopes, main_scope);
@@ -42,20 +57,186 @@ compiler *compiler_init_with_state(const symbol_table *symbol_table, arraylist *
     symbol_table_free(compiler->symbol_table);
     compiler->symbol_table   = symbol_table_copy(symbol_table);
     compiler->constants_pool = arraylist_clone(constants, _copy_object, nullptr);
+    for (size_t i = 0; i < compiler->constants_pool->size; i++)
+        index_constant(compiler, i);
     return compiler;
 }
 
+/**
+ * Choose how much optimizing to do: 0 compiles the AST as it is, 1 folds constants and
+ * runs the peephole optimizer, and 2 also optimizes each function in the IR on the way
+ * to bytecode and moves invariant code out of while loops.
+ */
+void compiler_set_optimization_level(compiler *compiler, const int level) {
+    compiler->fold_constants = level >= 1;
+    compiler->peephole       = level >= 1;
+    compiler->optimize_ir    = level >= 2;
+    compiler->optimize_loops = level >= 2;
+}
+
+/**
+ * Choose the format of the bytecode get_bytecode returns. Compiling is always done in
+ * bytes, the program and its functions are only aligned once they are finished.
+ */
+void compiler_set_instruction_format(compiler *compiler, const instruction_format format) {
+    compiler->instruction_format = format;
+}
+
 /***************************************************************
 ********************** HELPER FUNCTIONS ************************
  ***************************************************************/
+static bool is_shared_constant(const object_object *obj) {
+    return obj->type == OBJECT_INT || obj->type == OBJECT_STRING || obj->type == OBJECT_COMPILED_FUNCTION ||
+           (obj->type == OBJECT_CLOSURE && ((object_closure *) obj)->free_variables_count == 0);
+}
+
+/** A closure in the pool captures nothing, so it is the same as any other closure of the same function. */
+static object_object *constant_function(object_object *obj) {
+    return obj->type == OBJECT_CLOSURE ? (object_object *) ((object_closure *) obj)->fn : obj;
+}
+
+static size_t constant_hash(object_object *obj) {
+    const object_compiled_fn *fn;
+    size_t                    hash;
+    switch (obj->type) {
+        case OBJECT_INT:
+            hash = int_hash_function(&((object_int *) obj)->value);
+            break;
+        case OBJECT_STRING:
+            hash = string_n_hash_function(object_string_value((object_string *) obj), ((object_string *) obj)->length);
+            break;
+        default:
+            fn   = (object_compiled_fn *) constant_function(obj);
+            hash = string_n_hash_function((char *) fn->instructions->bytes, fn->instructions->length);
+            hash = (hash * 31 + fn->num_locals) * 31 + fn->num_args;
+            break;
+    }
+    return hash * 31 + obj->type;
+}
+
+/**
+ * Whether two constants can share a slot. Functions have to agree on their locals and
+ * arguments as well as their code, because the VM checks both when they are called.
+ */
+static bool constant_equals(object_object *a, object_object *b) {
+    const object_compiled_fn *fn_a, *fn_b;
+    if (a->type != b->type)
+        return false;
+    switch (a->type) {
+        case OBJECT_INT:
+            return ((object_int *) a)->value == ((object_int *) b)->value;
+        case OBJECT_STRING:
+            return ((object_string *) a)->length == ((object_string *) b)->length &&
+                   memcmp(object_string_value((object_string *) a), object_string_value((object_string *) b),
+                          ((object_string *) a)->length) == 0;
+        default:
+            fn_a = (object_compiled_fn *) constant_function(a);
+            fn_b = (object_compiled_fn *) constant_function(b);
+            return fn_a->num_locals == fn_b->num_locals && fn_a->num_args == fn_b->num_args &&
+                   fn_a->instructions->length == fn_b->instructions->length &&
+                   memcmp(fn_a->instructions->bytes, fn_b->instructions->bytes, fn_a->instructions->length) == 0;
+    }
+}
+
+/**
+ * Find the slot holding a constant equal to `obj`, or the empty slot it would go in.
+ */
+static size_t find_constant_slot(const compiler *compiler, object_object *obj) {
+    const size_t mask = compiler->constant_slots_capacity - 1;
+    size_t       slot = constant_hash(obj) & mask;
+    while (compiler->constant_slots[slot] != 0 &&
+           !constant_equals(arraylist_get(compiler->constants_pool, compiler->constant_slots[slot] - 1), obj))
+        slot = (slot + 1) & mask;
+    return slot;
+}
+
+static void grow_constant_slots(compiler *compiler) {
+    const size_t  old_capacity = compiler->constant_slots_capacity;
+    const size_t *old_slots    = compiler->constant_slots;
+    compiler->constant_slots_capacity = old_capacity ? old_capacity * 2 : CONSTANTS_POOL_INIT_SIZE * 2;
+    compiler->constant_slots          = calloc(compiler->constant_slots_capacity, sizeof(size_t));
+    if (compiler->constant_slots == NULL) {
+        err(EXIT_FAILURE, "malloc failed");
+    }
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old_slots[i] != 0) {
+            object_object *obj = arraylist_get(compiler->constants_pool, old_slots[i] - 1);
+            compiler->constant_slots[find_constant_slot(compiler, obj)] = old_slots[i];
+        }
+    }
+    free((void *) old_slots);
+}
+
+/**
+ * Add the pool's constant at `index` to the index, unless an equal one is already in it.
+ */
+static void index_constant(compiler *compiler, const size_t index) {
+    object_object *obj = arraylist_get(compiler->constants_pool, index);
+    if (!is_shared_constant(obj))
+        return;
+    if (2 * (index + 1) > compiler->constant_slots_capacity)
+        grow_constant_slots(compiler);
+    const size_t slot = find_constant_slot(compiler, obj);
+    if (compiler->constant_slots[slot] == 0)
+        compiler->constant_slots[slot] = index + 1;
+}
+
+/**
+ * Remove the pool's constant at `index` from the index, shifting back the entries
+ * that probed past it so every lookup still finds them.
+ */
+static void unindex_constant(const compiler *compiler, const size_t index) {
+    object_object *obj = arraylist_get(compiler->constants_pool, index);
+    if (!is_shared_constant(obj) || compiler->constant_slots_capacity == 0)
+        return;
+    const size_t mask = compiler->constant_slots_capacity - 1;
+    size_t       hole = find_constant_slot(compiler, obj);
+    if (compiler->constant_slots[hole] != index + 1)
+        return;
+    compiler->constant_slots[hole] = 0;
+    for (size_t slot = (hole + 1) & mask; compiler->constant_slots[slot] != 0; slot = (slot + 1) & mask) {
+        object_object *moved = arraylist_get(compiler->constants_pool, compiler->constant_slots[slot] - 1);
+        const size_t   home  = constant_hash(moved) & mask;
+        // entries whose home lies cyclically after the hole can't move in front of it
+        if (hole <= slot ? hole < home && home <= slot : hole < home || home <= slot)
+            continue;
+        compiler->constant_slots[hole] = compiler->constant_slots[slot];
+        compiler->constant_slots[slot] = 0;
+        hole                           = slot;
+    }
+}
+
+/**
+ * Add a constant to the pool and return its index. Ints, strings and functions that
+ * are already in the pool aren't added again, `obj` is freed and the existing
+ * constant's index is returned instead.
+ */
 size_t add_constant(compiler *compiler, object_object *obj) {
     if (compiler->constants_pool == NULL) {
         compiler->constants_pool = arraylist_create(CONSTANTS_POOL_INIT_SIZE, object_free);
     }
+    if (is_shared_constant(obj) && compiler->constant_slots_capacity > 0) {
+        const size_t existing = compiler->constant_slots[find_constant_slot(compiler, obj)];
+        if (existing != 0) {
+            object_free(obj);
+            return existing - 1;
+        }
+    }
     arraylist_add(compiler->constants_pool, obj);
+    index_constant(compiler, compiler->constants_pool->size - 1);
     return compiler->constants_pool->size - 1;
 }
 
+/**
+ * Free the constants added after the first `count`.
+ */
+void compiler_drop_constants(compiler *compiler, const size_t count) {
+    while (compiler->constants_pool != NULL && compiler->constants_pool->size > count) {
+        unindex_constant(compiler, compiler->constants_pool->size - 1);
+        object_free(arraylist_pop(compiler->constants_pool));
+    }
+}
+
 compiler_error compile(compiler *compiler, ast_node *node) {
     compiler_error error;
     compiler_error none_error = {COMPILER_ERROR_NONE, nullptr};
@@ -89,6 +270,9 @@ compiler_error compile(compiler *compiler, ast_node *node) {
 instructions *compiler_leave_scope(compiler *compiler) {
     const compilation_scope *scope = get_top_scope(compiler);
     instructions *           ins   = opcode_copy_instructions(scope->instructions);
+    widen_far_jumps(ins, scope->far_jumps);
+    if (compiler->peephole)
+        peephole_optimize(ins);
     arraylist_remove_and_free(compiler->scopes, compiler->scope_index);
     compiler->scope_index--;
     symbol_table *table    = compiler->symbol_table;
@@ -97,6 +281,18 @@ instructions *compiler_leave_scope(compiler *compiler) {
     return ins;
 }
 
+/**
+ * Drop the top level instructions compiled so far, and any scopes a failed compile
+ * left open, keeping the symbol table and constants so the rest of a program can be
+ * compiled and run a piece at a time.
+ */
+void compiler_reset(compiler *compiler) {
+    while (compiler->scope_index > 0)
+        instructions_free(compiler_leave_scope(compiler));
+    arraylist_remove_and_free(compiler->scopes, 0);
+    arraylist_add(compiler->scopes, scope_init());
+}
+
 void compiler_enter_scope(compiler *compiler) {
     compilation_scope *scope = scope_init();
     arraylist_add(compiler->scopes, scope);
@@ -115,6 +311,9 @@ void compiler_free(compiler *compiler) {
         compiler->constants_pool = nullptr;
     }
     symbol_table_free(compiler->symbol_table);
+    arraylist_destroy(compiler->inline_functions);
+    free(compiler->constant_slots);
+    free(compiler->global_constants);
     free(compiler);
 }
 
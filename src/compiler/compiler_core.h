@@ -19,13 +19,35 @@ typedef struct {
     instructions *      instructions;
     emitted_instruction last_instruction;
     emitted_instruction prev_instruction;
+    size_t              block_depth;  // block statements the code being compiled is in
+    size_t              loop_depth;   // while loops the code being compiled is in
+    size_t              loop_symbols; // the symbol table's count when the outermost of them started
+    arraylist *         hoisted;      // invariant expressions computed in front of those loops, see loop_optimization.h
+    arraylist *         far_jumps;    // of far_jump, compact jumps to widen once the code is complete
 } compilation_scope;
 
+/** A single instruction that loads a constant: OP_TRUE, OP_FALSE or OP_CONSTANT and its index. */
 typedef struct {
-    arraylist *   constants_pool;
-    symbol_table *symbol_table;
-    arraylist *   scopes;
-    size_t        scope_index;
+    Opcode opcode;
+    size_t constant;
+    bool   known;
+} constant_load;
+
+typedef struct {
+    arraylist *        constants_pool;
+    size_t *           constant_slots; // open addressed index of the pool's ints, strings and functions, as index + 1
+    size_t             constant_slots_capacity;
+    symbol_table *     symbol_table;
+    arraylist *        scopes;
+    size_t             scope_index;
+    bool               fold_constants;   // fold constant operators and propagate constant globals
+    bool               peephole;         // run the peephole optimizer over each function and the program
+    bool               optimize_ir;      // compile_optimized goes through the IR and its passes
+    bool               optimize_loops;   // hoist invariant code out of while loops, count them with fused instructions
+    arraylist *        inline_functions; // small functions bound by let, which the IR copies into their callers
+    constant_load *    global_constants; // indexed by global slot, what each constant global was set to
+    size_t             global_constants_capacity;
+    instruction_format instruction_format; // what get_bytecode hands to the VM
 } compiler;
 
 typedef struct {
@@ -36,7 +58,8 @@ typedef struct {
 typedef enum compiler_error_code {
     COMPILER_ERROR_NONE,
     COMPILER_UNKNOWN_OPERATOR,
-    COMPILER_UNDEFINED_VARIABLE
+    COMPILER_UNDEFINED_VARIABLE,
+    COMPILER_OPERAND_TOO_LARGE
 } compiler_error_code;
 
 typedef struct {
@@ -47,7 +70,8 @@ typedef struct {
 static const char *compiler_errors[] = {
         "COMPILER_ERROR_NONE",
         "COMPILER_UNKNOWN_OPERATOR",
-        "COMPILER_UNDEFINED_VARIABLE"
+        "COMPILER_UNDEFINED_VARIABLE",
+        "COMPILER_OPERAND_TOO_LARGE"
 };
 
 
@@ -59,10 +83,16 @@ compiler *compiler_init_with_state(const symbol_table *symbol_table, arraylist *
 
 void compiler_free(compiler *);
 
+void compiler_set_optimization_level(compiler *, int);
+
+void compiler_set_instruction_format(compiler *, instruction_format);
+
 compiler_error compile(compiler *, ast_node *);
 
 size_t add_constant(compiler *, object_object *);
 
+void compiler_drop_constants(compiler *, size_t);
+
 bytecode *get_bytecode(const compiler *);
 
 void bytecode_free(bytecode *);
@@ -71,4 +101,6 @@ void compiler_enter_scope(compiler *);
 
 instructions *compiler_leave_scope(compiler *);
 
+void compiler_reset(compiler *);
+
 #endif //COMPILER_H
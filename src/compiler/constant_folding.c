@@ -0,0 +1,261 @@
+//
+// Created by dgood on 1/23/25.
+//
+
+#include "constant_folding.h"
+
+#include <err.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../opcode/opcode.h"
+#include "instructions.h"
+#include "scope.h"
+
+fold_mark fold_begin(const compiler *compiler) {
+    const compilation_scope *scope = get_top_scope(compiler);
+    return (fold_mark){
+            scope->instructions->length,
+            compiler->constants_pool != NULL ? compiler->constants_pool->size : 0,
+            scope->last_instruction,
+            scope->prev_instruction
+    };
+}
+
+/**
+ * Decode the instruction at `position` if it loads a constant. Returns the position
+ * just past it, or 0 when it is something else.
+ */
+static size_t read_constant_load(const instructions *ins, const size_t position, constant_load *load) {
+    if (position >= ins->length)
+        return 0;
+    size_t operands[MAX_OPERANDS];
+    load->opcode = vm_instruction_decode(ins->bytes + position, operands);
+    if (load->opcode != OP_CONSTANT && load->opcode != OP_TRUE && load->opcode != OP_FALSE)
+        return 0;
+    load->constant = load->opcode == OP_CONSTANT ? operands[0] : 0;
+    load->known    = true;
+    return position + opcode_instruction_length(ins->bytes + position);
+}
+
+static object_object *constant_value(const compiler *compiler, const constant_load *load) {
+    switch (load->opcode) {
+        case OP_TRUE:
+            return (object_object *) object_create_bool(true);
+        case OP_FALSE:
+            return (object_object *) object_create_bool(false);
+        default:
+            return arraylist_get(compiler->constants_pool, load->constant);
+    }
+}
+
+static object_object *fold_integers(const Opcode op, const long left, const long right) {
+    long result;
+    switch (op) {
+        case OP_ADD:
+            if (__builtin_add_overflow(left, right, &result))
+                return nullptr;
+            break;
+        case OP_SUB:
+            if (__builtin_sub_overflow(left, right, &result))
+                return nullptr;
+            break;
+        case OP_MUL:
+            if (__builtin_mul_overflow(left, right, &result))
+                return nullptr;
+            break;
+        case OP_DIV:
+            // left for the VM to report
+            if (right == 0 || (left == LONG_MIN && right == -1))
+                return nullptr;
+            result = left / right;
+            break;
+        case OP_MOD:
+            if (right == 0)
+                return nullptr;
+            result = right == -1 ? 0 : left % right;
+            break;
+        case OP_GREATER_THAN:
+            return (object_object *) object_create_bool(left > right);
+        case OP_EQUAL:
+            return (object_object *) object_create_bool(left == right);
+        case OP_NOT_EQUAL:
+            return (object_object *) object_create_bool(left != right);
+        default:
+            return nullptr;
+    }
+    return (object_object *) object_create_int(result);
+}
+
+static object_object *fold_strings(object_string *left, object_string *right) {
+    const size_t length = left->length + right->length;
+    char *       value  = malloc(length + 1);
+    if (value == NULL) {
+        err(EXIT_FAILURE, "malloc failed");
+    }
+    memcpy(value, object_string_value(left), left->length);
+    memcpy(value + left->length, object_string_value(right), right->length);
+    value[length]         = 0;
+    object_string *result = object_create_string(nullptr, 0);
+    result->value         = value;
+    result->length        = length;
+    return (object_object *) result;
+}
+
+/**
+ * Evaluate an operator the way the VM would, or return NULL for anything the VM would
+ * reject or that depends on how it behaves at runtime, so those errors still happen
+ * when the program runs.
+ */
+static object_object *fold_infix(const Opcode op, object_object *left, object_object *right) {
+    if (left->type == OBJECT_INT && right->type == OBJECT_INT)
+        return fold_integers(op, ((object_int *) left)->value, ((object_int *) right)->value);
+    if (left->type == OBJECT_STRING && right->type == OBJECT_STRING && op == OP_ADD)
+        return fold_strings((object_string *) left, (object_string *) right);
+    if (left->type == OBJECT_BOOL && right->type == OBJECT_BOOL) {
+        const bool equal = ((object_bool *) left)->value == ((object_bool *) right)->value;
+        if (op == OP_EQUAL)
+            return (object_object *) object_create_bool(equal);
+        if (op == OP_NOT_EQUAL)
+            return (object_object *) object_create_bool(!equal);
+    }
+    return nullptr;
+}
+
+static object_object *fold_prefix(const Opcode op, object_object *operand) {
+    if (op == OP_MINUS && operand->type == OBJECT_INT && ((object_int *) operand)->value != LONG_MIN)
+        return (object_object *) object_create_int(-((object_int *) operand)->value);
+    if (op == OP_BANG && operand->type == OBJECT_BOOL)
+        return (object_object *) object_create_bool(!((object_bool *) operand)->value);
+    return nullptr;
+}
+
+/**
+ * Apply an operator to constants, with `right` NULL for a prefix operator. Returns NULL
+ * when the operator has to be left to the VM.
+ */
+object_object *fold_operator(const Opcode op, object_object *left, object_object *right) {
+    return right == NULL ? fold_prefix(op, left) : fold_infix(op, left, right);
+}
+
+static object_object *fold_operands(const compiler *compiler, const fold_mark *mark, const Opcode op) {
+    const instructions *ins = get_current_instructions(compiler);
+    constant_load       first, second;
+    const size_t        next = read_constant_load(ins, mark->position, &first);
+    if (next == 0)
+        return nullptr;
+    if (op == OP_MINUS || op == OP_BANG) {
+        return next == ins->length ? fold_operator(op, constant_value(compiler, &first), nullptr) : nullptr;
+    }
+    if (read_constant_load(ins, next, &second) != ins->length)
+        return nullptr;
+    return fold_operator(op, constant_value(compiler, &first), constant_value(compiler, &second));
+}
+
+/** Drop the code and constants compiled since `mark`. */
+void fold_rollback(compiler *compiler, const fold_mark *mark) {
+    compilation_scope *scope    = get_top_scope(compiler);
+    scope->instructions->length = mark->position;
+    scope->last_instruction     = mark->last_instruction;
+    scope->prev_instruction     = mark->prev_instruction;
+    compiler_drop_constants(compiler, mark->constant_count);
+}
+
+/** Whether the code compiled since `mark` is a single load of a constant. */
+bool fold_is_constant(const compiler *compiler, const fold_mark *mark) {
+    const instructions *ins = get_current_instructions(compiler);
+    constant_load       load;
+    const size_t        end = read_constant_load(ins, mark->position, &load);
+    return end != 0 && end == ins->length;
+}
+
+/**
+ * Emit an operator whose operands were compiled since `mark`. When the operands are
+ * constants and folding is enabled, their code is replaced by a load of the result
+ * instead. Returns the position of the emitted instruction.
+ */
+size_t emit_folded(compiler *compiler, const fold_mark *mark, const Opcode op) {
+    object_object *result = compiler->fold_constants ? fold_operands(compiler, mark, op) : nullptr;
+    if (result == NULL)
+        return emit(compiler, op, nullptr);
+
+    fold_rollback(compiler, mark);
+    if (result->type == OBJECT_BOOL)
+        return emit(compiler, ((object_bool *) result)->value ? OP_TRUE : OP_FALSE, nullptr);
+    return emit(compiler, OP_CONSTANT, (size_t[]){add_constant(compiler, result)});
+}
+
+static void record_global(compiler *compiler, const size_t index, const constant_load *load) {
+    if (index >= compiler->global_constants_capacity) {
+        size_t capacity = compiler->global_constants_capacity ? compiler->global_constants_capacity : 16;
+        while (capacity <= index)
+            capacity *= 2;
+        compiler->global_constants = reallocarray(compiler->global_constants, capacity, sizeof(constant_load));
+        if (compiler->global_constants == NULL) {
+            err(EXIT_FAILURE, "malloc failed");
+        }
+        memset(compiler->global_constants + compiler->global_constants_capacity, 0,
+               (capacity - compiler->global_constants_capacity) * sizeof(constant_load));
+        compiler->global_constants_capacity = capacity;
+    }
+    compiler->global_constants[index] = *load;
+}
+
+/**
+ * Remember what a global was set to when its value, compiled since `mark`, is a single
+ * constant, so later reads of it can load the constant directly. Only a let that is a
+ * statement of the program itself is recorded: it runs exactly once, before anything
+ * after it, and no other let defines the same slot. A let in a block, such as an if's
+ * branch or a loop's body, may run any number of times, including not at all.
+ */
+void fold_record_global(compiler *compiler, const fold_mark *mark, const symbol *sym) {
+    if (!compiler->fold_constants || sym->scope != GLOBAL || get_top_scope(compiler)->block_depth > 0)
+        return;
+    const instructions *ins = get_current_instructions(compiler);
+    constant_load       load;
+    const size_t        end = read_constant_load(ins, mark->position, &load);
+    if (end == 0 || end != ins->length)
+        return;
+    record_global(compiler, sym->index, &load);
+}
+
+/** Like fold_record_global, for a global whose value is already known to be `value`. */
+void fold_record_global_value(compiler *compiler, const symbol *sym, object_object *value) {
+    if (!compiler->fold_constants || sym->scope != GLOBAL)
+        return;
+    constant_load load = {OP_CONSTANT, 0, true};
+    switch (value->type) {
+        case OBJECT_BOOL:
+            load.opcode = ((object_bool *) value)->value ? OP_TRUE : OP_FALSE;
+            break;
+        case OBJECT_INT:
+        case OBJECT_STRING:
+            load.constant = add_constant(compiler, object_copy_object(value));
+            break;
+        default:
+            return;
+    }
+    record_global(compiler, sym->index, &load);
+}
+
+/** The constant a global recorded by fold_record_global holds, or NULL if it isn't known. */
+object_object *fold_global_value(const compiler *compiler, const symbol *sym) {
+    if (!compiler->fold_constants || sym->scope != GLOBAL || sym->index >= compiler->global_constants_capacity)
+        return nullptr;
+    const constant_load *load = &compiler->global_constants[sym->index];
+    return load->known ? constant_value(compiler, load) : nullptr;
+}
+
+/**
+ * Load a global recorded by fold_record_global as the constant it holds. Returns false
+ * if the global isn't known to be constant.
+ */
+bool load_constant_global(const compiler *compiler, const symbol *sym) {
+    if (!compiler->fold_constants || sym->scope != GLOBAL || sym->index >= compiler->global_constants_capacity)
+        return false;
+    const constant_load *load = &compiler->global_constants[sym->index];
+    if (!load->known)
+        return false;
+    emit(compiler, load->opcode, load->opcode == OP_CONSTANT ? (size_t[]){load->constant} : nullptr);
+    return true;
+}
@@ -0,0 +1,39 @@
+//
+// Created by dgood on 1/23/25.
+//
+
+#ifndef CONSTANT_FOLDING_H
+#define CONSTANT_FOLDING_H
+#include "compiler_core.h"
+
+/**
+ * The state of the current scope before an operator's operands were compiled. If the
+ * operands turn out to be constants, their code and constants are dropped back to this
+ * point and replaced by the operator's result.
+ */
+typedef struct {
+    size_t              position;
+    size_t              constant_count;
+    emitted_instruction last_instruction;
+    emitted_instruction prev_instruction;
+} fold_mark;
+
+fold_mark fold_begin(const compiler *);
+
+size_t emit_folded(compiler *, const fold_mark *, Opcode);
+
+void fold_rollback(compiler *, const fold_mark *);
+
+bool fold_is_constant(const compiler *, const fold_mark *);
+
+object_object *fold_operator(Opcode, object_object *, object_object *);
+
+void fold_record_global(compiler *, const fold_mark *, const symbol *);
+
+void fold_record_global_value(compiler *, const symbol *, object_object *);
+
+object_object *fold_global_value(const compiler *, const symbol *);
+
+bool load_constant_global(const compiler *, const symbol *);
+
+#endif //CONSTANT_FOLDING_H
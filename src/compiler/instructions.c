@@ -4,8 +4,13 @@
 #include "instructions.h"
 
 #include <err.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "../opcode/opcode.h"
+#include "compiler_utils.h"
+#include "constant_folding.h"
+#include "peephole.h"
 #include "scope.h"
 
 
@@ -27,6 +32,11 @@ void remove_last_instruction(const compiler *compiler) {
 size_t add_instructions(const compiler *compiler, instructions *ins) {
     const compilation_scope *scope       = get_top_scope(compiler);
     const size_t             new_ins_pos = scope->instructions->length;
+    // far jumps from code that was dropped again don't apply to what replaces it
+    for (size_t i = scope->far_jumps != NULL ? scope->far_jumps->size : 0; i-- > 0;) {
+        if (((far_jump *) arraylist_get(scope->far_jumps, i))->position >= new_ins_pos)
+            arraylist_remove_and_free(scope->far_jumps, i);
+    }
     concat_instructions(scope->instructions, ins);
     instructions_free(ins);
     return new_ins_pos;
@@ -47,12 +57,50 @@ void replace_instruction(const compiler *compiler, const size_t position, const
     }
 }
 
-void change_operand(const compiler *compiler, const size_t op_pos, const size_t operand) {
-    const compilation_scope *scope   = get_top_scope(compiler);
-    const Opcode             op      = scope->instructions->bytes[op_pos];
-    instructions *           new_ins = opcode_make_instruction(op, (size_t[]){operand});
+/**
+ * Set the operand of the instruction at `op_pos`, keeping the form it was emitted in.
+ * A compact jump to a target further off than it reaches is made wide instead once the
+ * scope's code is complete, when nothing holds on to positions in it any more, see
+ * widen_far_jumps. Returns false, leaving it alone, if the operand doesn't fit otherwise.
+ */
+bool change_operand(const compiler *compiler, const size_t op_pos, const size_t operand) {
+    compilation_scope *scope = get_top_scope(compiler);
+    const bool         wide  = scope->instructions->bytes[op_pos] == OP_WIDE;
+    const Opcode       op    = scope->instructions->bytes[op_pos + wide];
+    if (!wide && opcode_is_jump(op) && !opcode_operands_fit(op, (size_t[]){operand}, false) &&
+        opcode_operands_fit(op, (size_t[]){operand}, true)) {
+        far_jump *jump = malloc(sizeof(*jump));
+        if (jump == NULL) {
+            err(EXIT_FAILURE, "malloc failed");
+        }
+        *jump = (far_jump){op_pos, operand};
+        if (scope->far_jumps == NULL)
+            scope->far_jumps = arraylist_create(ARRAYLIST_INITIAL_CAPACITY, free);
+        arraylist_add(scope->far_jumps, jump);
+        return true;
+    }
+    if (!opcode_operands_fit(op, (size_t[]){operand}, wide))
+        return false;
+    instructions *new_ins = wide ? opcode_make_wide_instruction(op, (size_t[]){operand})
+                                 : opcode_make_instruction(op, (size_t[]){operand});
     replace_instruction(compiler, op_pos, new_ins);
     instructions_free(new_ins);
+    return true;
+}
+
+/**
+ * Emit a jump whose target is set later with change_operand. A jump forward from past
+ * where a compact one can reach is made wide.
+ */
+size_t emit_jump(const compiler *compiler, const Opcode op) {
+    return emit(compiler, op, (size_t[]){get_current_instructions(compiler)->length});
+}
+
+/** The error for an operand that is too large for even the wide form of `op`, or for the VM. */
+compiler_error operand_too_large(const Opcode op, const size_t operand) {
+    return (compiler_error){COMPILER_OPERAND_TOO_LARGE,
+                            get_err_msg("Operand %zu is too large for %s", operand,
+                                        opcode_definition_lookup(op)->name)};
 }
 
 void replace_last_pop_with_return(const compiler *compiler) {
@@ -67,7 +115,8 @@ void replace_last_pop_with_return(const compiler *compiler) {
 void load_symbol(const compiler *compiler, const symbol *symbol) {
     switch (symbol->scope) {
         case GLOBAL:
-            emit(compiler, OP_GET_GLOBAL, (size_t[]){symbol->index});
+            if (!load_constant_global(compiler, symbol))
+                emit(compiler, OP_GET_GLOBAL, (size_t[]){symbol->index});
             break;
         case LOCAL:
             emit(compiler, OP_GET_LOCAL, (size_t[]){symbol->index});
@@ -84,13 +133,122 @@ void load_symbol(const compiler *compiler, const symbol *symbol) {
     }
 }
 
+/**
+ * Start compiling a while loop, giving the variables its body lets, `names`, a slot of
+ * their own for the loop that starts out with the value they have before it. The lets
+ * store into that slot on every iteration, where the condition and the code after the
+ * loop read it, and a slot from before the loop is still only ever set once. Variables
+ * an enclosing loop already gave a slot keep it.
+ */
+void enter_loop(const compiler *compiler, const arraylist *names) {
+    compilation_scope *scope = get_top_scope(compiler);
+    symbol_table *     table = compiler->symbol_table;
+    if (scope->loop_depth++ == 0)
+        scope->loop_symbols = table->symbol_count;
+    for (size_t i = 0; i < names->size; i++) {
+        const char *name      = arraylist_get(names, i);
+        bool        duplicate = false;
+        for (size_t j = 0; j < i && !duplicate; j++)
+            duplicate = strcmp(name, arraylist_get(names, j)) == 0;
+        const symbol *own = hashtable_get(table->store, (void *) name);
+        if (duplicate || (own != NULL && (own->scope == GLOBAL || own->scope == LOCAL) &&
+                          own->index >= scope->loop_symbols))
+            continue;
+        const symbol *outer = symbol_resolve(table, name);
+        if (outer == NULL)
+            continue;
+        load_symbol(compiler, outer);
+        const symbol *sym = symbol_define(table, name);
+        emit(compiler, sym->scope == GLOBAL ? OP_SET_GLOBAL : OP_SET_LOCAL, (size_t[]){sym->index});
+    }
+}
+
+/** The symbol a let of `name` stores into, the loop's slot for it inside a loop. */
+symbol *define_let(const compiler *compiler, const char *name) {
+    const compilation_scope *scope = get_top_scope(compiler);
+    if (scope->loop_depth > 0)
+        return symbol_redefine(compiler->symbol_table, name, scope->loop_symbols);
+    return symbol_define(compiler->symbol_table, name);
+}
+
+/**
+ * Finish a while loop whose body starts at `body`, after the OP_POP dropping the value
+ * of the iteration before. The body's own value is left in its place, OP_LOOP goes back
+ * to the condition at `start`, and the condition's jump out, at `exit_jump`, lands after it.
+ */
+compiler_error leave_loop(const compiler *compiler, const size_t start, const size_t exit_jump, const size_t body) {
+    get_top_scope(compiler)->loop_depth--;
+    if (get_current_instructions(compiler)->length > body && last_instruction_is(compiler, OP_POP))
+        remove_last_instruction(compiler);
+    else
+        emit(compiler, OP_NULL, nullptr);
+    emit(compiler, OP_LOOP, (size_t[]){start});
+    const size_t after = get_current_instructions(compiler)->length;
+    if (!change_operand(compiler, exit_jump, after))
+        return operand_too_large(OP_JUMP_NOT_TRUTHY, after);
+    return (compiler_error){COMPILER_ERROR_NONE, nullptr};
+}
+
+/** A copy of a function with its instructions aligned, or nullptr if they can't be. */
+static object_compiled_fn *align_function(const object_compiled_fn *fn) {
+    instructions *aligned = opcode_align_instructions(fn->instructions);
+    if (aligned == NULL)
+        return nullptr;
+    object_compiled_fn *copy = object_create_compiled_fn(aligned, fn->num_locals, fn->num_args);
+    instructions_free(aligned);
+    return copy;
+}
+
+/**
+ * Align the program and the functions in its constants. The constants are shared with
+ * the compiler's pool, so each function is replaced with an aligned copy rather than
+ * being changed where it is.
+ */
+static bool align_bytecode(bytecode *bytecode) {
+    instructions *aligned = opcode_align_instructions(bytecode->instructions);
+    if (aligned == NULL)
+        return false;
+    instructions_free(bytecode->instructions);
+    bytecode->instructions = aligned;
+    for (size_t i = 0; bytecode->constants_pool != NULL && i < bytecode->constants_pool->size; i++) {
+        object_object *     constant = arraylist_get(bytecode->constants_pool, i);
+        object_compiled_fn *fn       = nullptr;
+        if (constant->type == OBJECT_COMPILED_FUNCTION)
+            fn = align_function((object_compiled_fn *) constant);
+        else if (constant->type == OBJECT_CLOSURE)
+            fn = align_function(((object_closure *) constant)->fn);
+        else
+            continue;
+        if (fn == NULL)
+            return false;
+        object_object *replacement = (object_object *) fn;
+        if (constant->type == OBJECT_CLOSURE) {
+            replacement = (object_object *) object_create_closure(fn, nullptr);
+            object_free(fn);
+        }
+        arraylist_set(bytecode->constants_pool, i, replacement);
+    }
+    return true;
+}
+
+/**
+ * The finished program and its constants, in the compiler's instruction format. Returns
+ * nullptr if they can't all be aligned, which takes an operand too large for 24 bits.
+ */
 bytecode *get_bytecode(const compiler *compiler) {
     bytecode *               bytecode = malloc(sizeof(*bytecode));
     const compilation_scope *scope    = get_top_scope(compiler);
     bytecode->instructions            = opcode_copy_instructions(scope->instructions);
+    widen_far_jumps(bytecode->instructions, scope->far_jumps);
+    if (compiler->peephole)
+        peephole_optimize(bytecode->instructions);
     bytecode->constants_pool          = compiler->constants_pool
                                    ? arraylist_clone(compiler->constants_pool, _object_copy_object, object_free)
                                    : nullptr;
+    if (compiler->instruction_format == INSTRUCTIONS_ALIGNED && !align_bytecode(bytecode)) {
+        bytecode_free(bytecode);
+        return nullptr;
+    }
     return bytecode;
 }
 
@@ -12,8 +12,13 @@ instructions * get_current_instructions(const compiler *compiler);
 bool last_instruction_is(const compiler *compiler, Opcode opcode);
 void remove_last_instruction(const compiler *compiler);
 void replace_instruction(const compiler *compiler, size_t position, const instructions *ins);
-void change_operand(const compiler *compiler, size_t op_pos, size_t operand);
+bool change_operand(const compiler *compiler, size_t op_pos, size_t operand);
+size_t emit_jump(const compiler *compiler, Opcode op);
+compiler_error operand_too_large(Opcode op, size_t operand);
 void replace_last_pop_with_return(const compiler *compiler);
 void load_symbol(const compiler * compiler, const symbol *symbol);
 size_t emit(const compiler *, Opcode, size_t *);
+symbol *define_let(const compiler *compiler, const char *name);
+void enter_loop(const compiler *compiler, const arraylist *names);
+compiler_error leave_loop(const compiler *compiler, size_t start, size_t exit_jump, size_t body);
 #endif //INSTRUCTIONS_H
@@ -0,0 +1,443 @@
+//
+// Created by dgood on 1/23/25.
+//
+
+#include "loop_optimization.h"
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../object/builtins.h"
+#include "../opcode/opcode.h"
+#include "constant_folding.h"
+#include "instructions.h"
+#include "node_compiler.h"
+#include "scope.h"
+
+/** What find_invariants is looking through, and what it found so far. */
+typedef struct {
+    compiler *       compiler;
+    const arraylist *names;        // the variables the loop lets, whose value changes between iterations
+    bool             in_condition; // the condition runs at least once, the body maybe never
+    bool             clean;        // nothing so far can have failed or had an effect
+    arraylist *      speculated;   // hoisted in front of the loop, whether it iterates or not
+    arraylist *      guarded;      // hoisted behind a first test of the condition
+    ast_expression * limit;        // the bound a counted loop's condition compares with, which gets a slot
+} loop_analysis;
+
+static const symbol *hoisted_slot(const compilation_scope *scope, const ast_expression *expression) {
+    for (size_t i = 0; scope->hoisted != NULL && i < scope->hoisted->size; i++) {
+        const hoisted_expression *hoisted = arraylist_get(scope->hoisted, i);
+        if (hoisted->expression == expression)
+            return hoisted->slot;
+    }
+    return nullptr;
+}
+
+static bool is_let_in_loop(const loop_analysis *analysis, const char *name) {
+    for (size_t i = 0; i < analysis->names->size; i++) {
+        if (strcmp(arraylist_get(analysis->names, i), name) == 0)
+            return true;
+    }
+    return false;
+}
+
+/** Whether `call` calls a builtin without side effects, one the program hasn't bound the name of to something else. */
+static bool is_pure_call(const loop_analysis *analysis, const ast_call_expression *call) {
+    if (call->function->expression_type != IDENTIFIER_EXPRESSION)
+        return false;
+    const char *name = ((ast_identifier *) call->function)->value;
+    if (is_let_in_loop(analysis, name))
+        return false;
+    const symbol *sym = symbol_resolve(analysis->compiler->symbol_table, name);
+    return sym != NULL && sym->scope == BUILTIN && get_builtins(get_builtins_name(sym->index))->pure;
+}
+
+/** Whether `expression` is known to be a bool, the only operand besides null that '!' doesn't fail on. */
+static bool is_bool(const ast_expression *expression) {
+    if (expression->expression_type == BOOLEAN_EXPRESSION)
+        return true;
+    return expression->expression_type == PREFIX_EXPRESSION &&
+           ((ast_prefix_expression *) expression)->operator == OPERATOR_BANG &&
+           is_bool(((ast_prefix_expression *) expression)->right);
+}
+
+/**
+ * Whether `expression` has the same value on every iteration of the loop. `safe` is set
+ * if it also can't fail or have an effect, so that computing it when the loop wouldn't
+ * have changes nothing.
+ */
+static bool is_invariant(const loop_analysis *analysis, const ast_expression *expression, bool *safe) {
+    const ast_infix_expression *infix_exp;
+    const ast_array_literal *   array_exp;
+    const ast_call_expression * call_exp;
+    bool                        operand_safe;
+    *safe = true;
+    if (hoisted_slot(get_top_scope(analysis->compiler), expression) != NULL)
+        return true;
+    switch (expression->expression_type) {
+        case INTEGER_EXPRESSION:
+        case BOOLEAN_EXPRESSION:
+        case STRING_EXPRESSION:
+            return true;
+        case IDENTIFIER_EXPRESSION:
+            return !is_let_in_loop(analysis, ((ast_identifier *) expression)->value) &&
+                   symbol_resolve(analysis->compiler->symbol_table, ((ast_identifier *) expression)->value) != NULL;
+        case PREFIX_EXPRESSION:
+            if (!prefix_opcodes[((ast_prefix_expression *) expression)->operator].defined ||
+                !is_invariant(analysis, ((ast_prefix_expression *) expression)->right, safe))
+                return false;
+            *safe = *safe && is_bool(expression);
+            return true;
+        case INFIX_EXPRESSION:
+            infix_exp = (ast_infix_expression *) expression;
+            if (!is_invariant(analysis, infix_exp->left, safe) ||
+                !is_invariant(analysis, infix_exp->right, &operand_safe))
+                return false;
+            if (infix_exp->operator == OPERATOR_AND || infix_exp->operator == OPERATOR_OR) {
+                *safe = *safe && operand_safe;
+                return true;
+            }
+            *safe = false;
+            return infix_opcodes[infix_exp->operator].defined;
+        case INDEX_EXPRESSION:
+            *safe = false;
+            return is_invariant(analysis, ((ast_index_expression *) expression)->left, &operand_safe) &&
+                   is_invariant(analysis, ((ast_index_expression *) expression)->index, &operand_safe);
+        case ARRAY_LITERAL:
+            array_exp = (ast_array_literal *) expression;
+            for (size_t i = 0; i < array_exp->elements->size; i++) {
+                if (!is_invariant(analysis, arraylist_get(array_exp->elements, i), &operand_safe))
+                    return false;
+                *safe = *safe && operand_safe;
+            }
+            return true;
+        case CALL_EXPRESSION:
+            call_exp = (ast_call_expression *) expression;
+            if (!is_pure_call(analysis, call_exp))
+                return false;
+            for (const list_node *arg = call_exp->arguments->head; arg != NULL; arg = arg->next) {
+                if (!is_invariant(analysis, arg->data, &operand_safe))
+                    return false;
+                *safe = *safe && operand_safe;
+            }
+            return true;
+        default:
+            return false;
+    }
+}
+
+/** Whether `expression` reads a variable or calls a builtin, rather than only combining literals the folding handles. */
+static bool reads_state(const ast_expression *expression) {
+    const ast_array_literal *array_exp;
+    switch (expression->expression_type) {
+        case IDENTIFIER_EXPRESSION:
+        case CALL_EXPRESSION:
+            return true;
+        case PREFIX_EXPRESSION:
+            return reads_state(((ast_prefix_expression *) expression)->right);
+        case INFIX_EXPRESSION:
+            return reads_state(((ast_infix_expression *) expression)->left) ||
+                   reads_state(((ast_infix_expression *) expression)->right);
+        case INDEX_EXPRESSION:
+            return reads_state(((ast_index_expression *) expression)->left) ||
+                   reads_state(((ast_index_expression *) expression)->index);
+        case ARRAY_LITERAL:
+            array_exp = (ast_array_literal *) expression;
+            for (size_t i = 0; i < array_exp->elements->size; i++) {
+                if (reads_state(arraylist_get(array_exp->elements, i)))
+                    return true;
+            }
+            return false;
+        default:
+            return false;
+    }
+}
+
+static void find_invariants(loop_analysis *, ast_expression *, bool);
+
+static void find_block_invariants(loop_analysis *analysis, const ast_block_statement *block, const bool unconditional) {
+    for (size_t i = 0; i < block->statement_count; i++) {
+        ast_statement *statement = block->statements[i];
+        switch (statement->statement_type) {
+            case LET_STATEMENT:
+                find_invariants(analysis, ((ast_let_statement *) statement)->value, unconditional);
+                break;
+            case RETURN_STATEMENT:
+                find_invariants(analysis, ((ast_return_statement *) statement)->return_value, unconditional);
+                break;
+            case EXPRESSION_STATEMENT:
+                find_invariants(analysis, ((ast_expression_statement *) statement)->expression, unconditional);
+                break;
+            case BLOCK_STATEMENT:
+                find_block_invariants(analysis, (ast_block_statement *) statement, unconditional);
+                break;
+        }
+    }
+}
+
+/**
+ * Look for the largest invariant expressions in `expression`, in the order they run.
+ * Safe ones can be hoisted from anywhere. The rest can only be when they would have run
+ * on the first iteration, `unconditional`, with nothing able to fail or have an effect
+ * before them, so that running them first fails the same way.
+ */
+static void find_invariants(loop_analysis *analysis, ast_expression *expression, const bool unconditional) {
+    const ast_infix_expression *infix_exp;
+    const ast_if_expression *   if_exp;
+    const ast_call_expression * call_exp;
+    const ast_array_literal *   array_exp;
+    bool                        safe;
+    if (expression->expression_type != IDENTIFIER_EXPRESSION && reads_state(expression) &&
+        is_invariant(analysis, expression, &safe) &&
+        hoisted_slot(get_top_scope(analysis->compiler), expression) == NULL &&
+        (safe || (analysis->clean && unconditional))) {
+        arraylist_add(safe || analysis->in_condition ? analysis->speculated : analysis->guarded, expression);
+        return;
+    }
+    switch (expression->expression_type) {
+        case PREFIX_EXPRESSION:
+            find_invariants(analysis, ((ast_prefix_expression *) expression)->right, unconditional);
+            if (((ast_prefix_expression *) expression)->operator != OPERATOR_BANG)
+                analysis->clean = false;
+            break;
+        case INFIX_EXPRESSION:
+            infix_exp = (ast_infix_expression *) expression;
+            if (infix_exp->operator == OPERATOR_AND || infix_exp->operator == OPERATOR_OR) {
+                find_invariants(analysis, infix_exp->left, unconditional);
+                find_invariants(analysis, infix_exp->right, false);
+                break;
+            }
+            const bool swap = infix_opcodes[infix_exp->operator].swap;
+            find_invariants(analysis, swap ? infix_exp->right : infix_exp->left, unconditional);
+            find_invariants(analysis, swap ? infix_exp->left : infix_exp->right, unconditional);
+            analysis->clean = false;
+            break;
+        case IF_EXPRESSION:
+            if_exp = (ast_if_expression *) expression;
+            find_invariants(analysis, if_exp->condition, unconditional);
+            find_block_invariants(analysis, if_exp->consequence, false);
+            if (if_exp->alternative != NULL)
+                find_block_invariants(analysis, if_exp->alternative, false);
+            break;
+        case WHILE_EXPRESSION:
+            find_invariants(analysis, ((ast_while_expression *) expression)->condition, false);
+            find_block_invariants(analysis, ((ast_while_expression *) expression)->body, false);
+            break;
+        case CALL_EXPRESSION:
+            call_exp = (ast_call_expression *) expression;
+            find_invariants(analysis, call_exp->function, unconditional);
+            for (const list_node *arg = call_exp->arguments->head; arg != NULL; arg = arg->next)
+                find_invariants(analysis, arg->data, unconditional);
+            if (!is_pure_call(analysis, call_exp))
+                analysis->clean = false;
+            break;
+        case ARRAY_LITERAL:
+            array_exp = (ast_array_literal *) expression;
+            for (size_t i = 0; i < array_exp->elements->size; i++)
+                find_invariants(analysis, arraylist_get(array_exp->elements, i), unconditional);
+            break;
+        case INDEX_EXPRESSION:
+            find_invariants(analysis, ((ast_index_expression *) expression)->left, unconditional);
+            find_invariants(analysis, ((ast_index_expression *) expression)->index, unconditional);
+            analysis->clean = false;
+            break;
+        case HASH_LITERAL:
+            // its pairs are compiled in key order, and building it fails on keys that can't be hashed
+            analysis->clean = false;
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * The slot a variable of the function being compiled, or a hoisted expression, is in,
+ * for instructions that read their operands from slots directly. Variables of outer
+ * functions and builtins have none.
+ */
+static const symbol *operand_slot(const compiler *compiler, const ast_expression *expression) {
+    const symbol *slot = hoisted_slot(get_top_scope(compiler), expression);
+    if (slot != NULL || expression->expression_type != IDENTIFIER_EXPRESSION)
+        return slot;
+    slot = hashtable_get(compiler->symbol_table->store, ((ast_identifier *) expression)->value);
+    return slot != NULL && (slot->scope == GLOBAL || slot->scope == LOCAL) ? slot : nullptr;
+}
+
+/**
+ * If the loop counts a variable up to an invariant bound, i < n, the bound gets a slot
+ * of its own unless it's already in one, even when it's a literal, so that the condition
+ * compiles to OP_LESS_THAN. The bound runs first, so it can always be hoisted.
+ */
+static void find_limit(loop_analysis *analysis, ast_expression *condition) {
+    if (condition->expression_type != INFIX_EXPRESSION)
+        return;
+    const ast_infix_expression *infix_exp = (ast_infix_expression *) condition;
+    if (infix_exp->operator != OPERATOR_LT && infix_exp->operator != OPERATOR_GT)
+        return;
+    ast_expression *counter = infix_exp->operator == OPERATOR_LT ? infix_exp->left : infix_exp->right;
+    ast_expression *bound   = infix_exp->operator == OPERATOR_LT ? infix_exp->right : infix_exp->left;
+    bool            safe;
+    if (counter->expression_type != IDENTIFIER_EXPRESSION ||
+        !is_let_in_loop(analysis, ((ast_identifier *) counter)->value) || !is_invariant(analysis, bound, &safe))
+        return;
+    if (operand_slot(analysis->compiler, bound) != NULL)
+        return;
+    analysis->limit = bound;
+    arraylist_add(analysis->speculated, bound);
+}
+
+/** A slot for a hoisted value, named so that no program can refer to it. */
+static symbol *define_hidden(symbol_table *table) {
+    char name[16];
+    snprintf(name, sizeof(name), "$%u", table->symbol_count);
+    return symbol_define(table, name);
+}
+
+/**
+ * Compile each of `expressions` into a slot of its own, which the loop loads instead.
+ * One that folds to a constant is left in the loop, loading it is as cheap, unless it's
+ * the bound the loop's condition compares with. Returns how many were hoisted in `count`.
+ */
+static compiler_error hoist(compiler *compiler, const arraylist *expressions, const ast_expression *limit,
+                            size_t *count) {
+    compilation_scope *scope = get_top_scope(compiler);
+    *count                   = 0;
+    for (size_t i = 0; i < expressions->size; i++) {
+        ast_expression *expression = arraylist_get(expressions, i);
+        const fold_mark mark       = fold_begin(compiler);
+        compiler_error  error      = compile(compiler, (ast_node *) expression);
+        if (error.error_code != COMPILER_ERROR_NONE)
+            return error;
+        if (expression != limit && fold_is_constant(compiler, &mark)) {
+            fold_rollback(compiler, &mark);
+            continue;
+        }
+        const symbol *slot = define_hidden(compiler->symbol_table);
+        emit(compiler, slot->scope == GLOBAL ? OP_SET_GLOBAL : OP_SET_LOCAL, (size_t[]){slot->index});
+        hoisted_expression *hoisted = malloc(sizeof(*hoisted));
+        if (hoisted == NULL) {
+            err(EXIT_FAILURE, "malloc failed");
+        }
+        hoisted->expression = expression;
+        hoisted->slot       = slot;
+        if (scope->hoisted == NULL)
+            scope->hoisted = arraylist_create(ARRAYLIST_INITIAL_CAPACITY, free);
+        arraylist_add(scope->hoisted, hoisted);
+        (*count)++;
+    }
+    return (compiler_error){COMPILER_ERROR_NONE, nullptr};
+}
+
+/**
+ * Move the code in a while loop that computes the same value on every iteration in
+ * front of it, after enter_loop gave the variables it lets, `names`, their slots. What
+ * can't fail or have an effect is computed there whether the loop iterates or not.
+ * What can is hoisted only from where the first iteration would have run it before
+ * anything else could fail: from the condition straight away, and from the body after
+ * testing the condition once, which then enters the body directly.
+ */
+compiler_error loop_hoist_invariants(compiler *compiler, const ast_while_expression *while_exp,
+                                     const arraylist *names, loop_preheader *preheader) {
+    const compilation_scope *scope = get_top_scope(compiler);
+    compiler_error           error = {COMPILER_ERROR_NONE, nullptr};
+    preheader->hoisted             = scope->hoisted != NULL ? scope->hoisted->size : 0;
+    preheader->guarded             = false;
+    if (!compiler->optimize_loops)
+        return error;
+
+    loop_analysis analysis = {
+            compiler, names, true, true,
+            arraylist_create(ARRAYLIST_INITIAL_CAPACITY, nullptr),
+            arraylist_create(ARRAYLIST_INITIAL_CAPACITY, nullptr),
+            nullptr
+    };
+    find_limit(&analysis, while_exp->condition);
+    if (analysis.limit == NULL)
+        find_invariants(&analysis, while_exp->condition, true);
+    analysis.in_condition = false;
+    analysis.clean        = true;
+    find_block_invariants(&analysis, while_exp->body, true);
+
+    size_t count;
+    error = hoist(compiler, analysis.speculated, analysis.limit, &count);
+    if (error.error_code == COMPILER_ERROR_NONE && analysis.guarded->size > 0) {
+        const fold_mark mark = fold_begin(compiler);
+        error                = compile(compiler, (ast_node *) while_exp->condition);
+        if (error.error_code == COMPILER_ERROR_NONE) {
+            preheader->guard_jump = emit_jump(compiler, OP_JUMP_NOT_TRUTHY);
+            error                 = hoist(compiler, analysis.guarded, nullptr, &count);
+        }
+        if (error.error_code == COMPILER_ERROR_NONE && count == 0) {
+            fold_rollback(compiler, &mark);
+        } else if (error.error_code == COMPILER_ERROR_NONE) {
+            preheader->guarded    = true;
+            preheader->entry_jump = emit_jump(compiler, OP_JUMP);
+        }
+    }
+    arraylist_destroy(analysis.speculated);
+    arraylist_destroy(analysis.guarded);
+    return error;
+}
+
+/** Finish the loop's preheader once the loop is compiled, its test jumping out past the loop. */
+compiler_error loop_finish(const compiler *compiler, const loop_preheader *preheader) {
+    const size_t after = get_current_instructions(compiler)->length;
+    if (preheader->guarded && !change_operand(compiler, preheader->guard_jump, after))
+        return operand_too_large(OP_JUMP_NOT_TRUTHY, after);
+    return (compiler_error){COMPILER_ERROR_NONE, nullptr};
+}
+
+/** Stop loading the expressions hoisted after the first `count`, their loop being compiled. */
+void loop_forget_hoisted(const compiler *compiler, const size_t count) {
+    const compilation_scope *scope = get_top_scope(compiler);
+    while (scope->hoisted != NULL && scope->hoisted->size > count)
+        free(arraylist_pop(scope->hoisted));
+}
+
+/** If `expression` was hoisted out of the loops being compiled, load it from its slot. */
+bool loop_load_hoisted(const compiler *compiler, const ast_expression *expression) {
+    const symbol *slot = hoisted_slot(get_top_scope(compiler), expression);
+    if (slot == NULL)
+        return false;
+    load_symbol(compiler, slot);
+    return true;
+}
+
+/**
+ * Compile a < b in a loop as OP_LESS_THAN, when both are in slots of the function being
+ * compiled, which the instruction compares without loading them.
+ */
+bool loop_emit_less_than(const compiler *compiler, const ast_infix_expression *infix_exp) {
+    if (!compiler->optimize_loops || get_top_scope(compiler)->loop_depth == 0 ||
+        (infix_exp->operator != OPERATOR_LT && infix_exp->operator != OPERATOR_GT))
+        return false;
+    const bool    less  = infix_exp->operator == OPERATOR_LT;
+    const symbol *left  = operand_slot(compiler, less ? infix_exp->left : infix_exp->right);
+    const symbol *right = operand_slot(compiler, less ? infix_exp->right : infix_exp->left);
+    if (left == NULL || right == NULL)
+        return false;
+    emit(compiler, left->scope == GLOBAL ? OP_LESS_THAN_GLOBAL : OP_LESS_THAN_LOCAL,
+         (size_t[]){left->index, right->index});
+    return true;
+}
+
+/**
+ * Compile let i = i + 1 in a loop, where i is stored to again on every iteration, as
+ * OP_INCREMENT, which adds the constant to the variable where it is.
+ */
+bool loop_emit_increment(compiler *compiler, const ast_let_statement *let_stmt, const symbol *sym) {
+    if (!compiler->optimize_loops || get_top_scope(compiler)->loop_depth == 0 ||
+        let_stmt->value->expression_type != INFIX_EXPRESSION)
+        return false;
+    const ast_infix_expression *infix_exp = (ast_infix_expression *) let_stmt->value;
+    if (infix_exp->operator != OPERATOR_PLUS || infix_exp->left->expression_type != IDENTIFIER_EXPRESSION ||
+        strcmp(((ast_identifier *) infix_exp->left)->value, let_stmt->name->value) != 0 ||
+        infix_exp->right->expression_type != INTEGER_EXPRESSION)
+        return false;
+    const object_int *step     = object_create_int(((ast_integer *) infix_exp->right)->value);
+    const size_t      constant = add_constant(compiler, (object_object *) step);
+    emit(compiler, sym->scope == GLOBAL ? OP_INCREMENT_GLOBAL : OP_INCREMENT_LOCAL, (size_t[]){sym->index, constant});
+    return true;
+}
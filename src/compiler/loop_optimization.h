@@ -0,0 +1,43 @@
+//
+// Created by dgood on 1/23/25.
+//
+
+#ifndef LOOP_OPTIMIZATION_H
+#define LOOP_OPTIMIZATION_H
+#include "compiler_core.h"
+
+/**
+ * An expression computed in front of the loops it is in, because its value is the same
+ * on every iteration, and the slot the loops load that value from instead.
+ */
+typedef struct {
+    const ast_expression *expression;
+    const symbol *        slot;
+} hoisted_expression;
+
+/**
+ * The code in front of a loop. Expressions that may only run once the loop is known to
+ * iterate are computed after a first test of its condition, which then jumps straight
+ * into the body.
+ */
+typedef struct {
+    size_t hoisted;    // how many expressions the scope had hoisted before this loop
+    bool   guarded;    // whether the condition is tested in front of the loop
+    size_t guard_jump; // that test's jump out of the loop
+    size_t entry_jump; // the jump past the loop's own test into its body
+} loop_preheader;
+
+compiler_error loop_hoist_invariants(compiler *, const ast_while_expression *, const arraylist *names,
+                                     loop_preheader *);
+
+compiler_error loop_finish(const compiler *, const loop_preheader *);
+
+void loop_forget_hoisted(const compiler *, size_t);
+
+bool loop_load_hoisted(const compiler *, const ast_expression *);
+
+bool loop_emit_less_than(const compiler *, const ast_infix_expression *);
+
+bool loop_emit_increment(compiler *, const ast_let_statement *, const symbol *);
+
+#endif //LOOP_OPTIMIZATION_H
@@ -8,9 +8,171 @@
 #include "../opcode/opcode.h"
 #include "compiler_core.h"
 #include "compiler_utils.h"
+#include "constant_folding.h"
 #include "instructions.h"
+#include "loop_optimization.h"
 #include "scope.h"
 
+const operator_opcode infix_opcodes[OPERATOR_COUNT] = {
+        [OPERATOR_PLUS]     = {OP_ADD, true, false},
+        [OPERATOR_MINUS]    = {OP_SUB, true, false},
+        [OPERATOR_ASTERISK] = {OP_MUL, true, false},
+        [OPERATOR_SLASH]    = {OP_DIV, true, false},
+        [OPERATOR_PERCENT]  = {OP_MOD, true, false},
+        [OPERATOR_LT]       = {OP_GREATER_THAN, true, true},
+        [OPERATOR_GT]       = {OP_GREATER_THAN, true, false},
+        [OPERATOR_EQ]       = {OP_EQUAL, true, false},
+        [OPERATOR_NOT_EQ]   = {OP_NOT_EQUAL, true, false},
+};
+
+const operator_opcode prefix_opcodes[OPERATOR_COUNT] = {
+        [OPERATOR_MINUS] = {OP_MINUS, true, false},
+        [OPERATOR_BANG]  = {OP_BANG, true, false},
+};
+
+static void collect_let_names(arraylist *, const ast_block_statement *);
+
+/** Add the names the lets inside `expression` bind to `names`, leaving out functions' own lets. */
+static void collect_expression_let_names(arraylist *names, ast_expression *expression) {
+    const ast_if_expression *if_exp;
+    arraylist *              elements;
+    switch (expression->expression_type) {
+        case PREFIX_EXPRESSION:
+            collect_expression_let_names(names, ((ast_prefix_expression *) expression)->right);
+            break;
+        case INFIX_EXPRESSION:
+            collect_expression_let_names(names, ((ast_infix_expression *) expression)->left);
+            collect_expression_let_names(names, ((ast_infix_expression *) expression)->right);
+            break;
+        case IF_EXPRESSION:
+            if_exp = (ast_if_expression *) expression;
+            collect_expression_let_names(names, if_exp->condition);
+            collect_let_names(names, if_exp->consequence);
+            if (if_exp->alternative != NULL)
+                collect_let_names(names, if_exp->alternative);
+            break;
+        case WHILE_EXPRESSION:
+            collect_expression_let_names(names, ((ast_while_expression *) expression)->condition);
+            collect_let_names(names, ((ast_while_expression *) expression)->body);
+            break;
+        case CALL_EXPRESSION:
+            collect_expression_let_names(names, ((ast_call_expression *) expression)->function);
+            for (const list_node *arg = ((ast_call_expression *) expression)->arguments->head; arg != NULL;
+                 arg = arg->next)
+                collect_expression_let_names(names, arg->data);
+            break;
+        case ARRAY_LITERAL:
+            elements = ((ast_array_literal *) expression)->elements;
+            for (size_t i = 0; i < elements->size; i++)
+                collect_expression_let_names(names, arraylist_get(elements, i));
+            break;
+        case INDEX_EXPRESSION:
+            collect_expression_let_names(names, ((ast_index_expression *) expression)->left);
+            collect_expression_let_names(names, ((ast_index_expression *) expression)->index);
+            break;
+        default:
+            break;
+    }
+}
+
+static void collect_let_names(arraylist *names, const ast_block_statement *block) {
+    for (size_t i = 0; i < block->statement_count; i++) {
+        ast_statement *statement = block->statements[i];
+        switch (statement->statement_type) {
+            case LET_STATEMENT:
+                collect_expression_let_names(names, ((ast_let_statement *) statement)->value);
+                arraylist_add(names, ((ast_let_statement *) statement)->name->value);
+                break;
+            case RETURN_STATEMENT:
+                collect_expression_let_names(names, ((ast_return_statement *) statement)->return_value);
+                break;
+            case EXPRESSION_STATEMENT:
+                collect_expression_let_names(names, ((ast_expression_statement *) statement)->expression);
+                break;
+            case BLOCK_STATEMENT:
+                collect_let_names(names, (ast_block_statement *) statement);
+                break;
+        }
+    }
+}
+
+static compiler_error compile_loop(compiler *compiler, const ast_while_expression *while_exp,
+                                   loop_preheader *preheader) {
+    arraylist *names = arraylist_create(ARRAYLIST_INITIAL_CAPACITY, nullptr);
+    collect_let_names(names, while_exp->body);
+    enter_loop(compiler, names);
+
+    emit(compiler, OP_NULL, nullptr);
+    compiler_error error = loop_hoist_invariants(compiler, while_exp, names, preheader);
+    arraylist_destroy(names);
+    if (error.error_code != COMPILER_ERROR_NONE)
+        return error;
+    const size_t start = get_current_instructions(compiler)->length;
+    error              = compile(compiler, (ast_node *) while_exp->condition);
+    if (error.error_code != COMPILER_ERROR_NONE)
+        return error;
+    const size_t exit_jump = emit_jump(compiler, OP_JUMP_NOT_TRUTHY);
+    const size_t body      = get_current_instructions(compiler)->length;
+    if (preheader->guarded && !change_operand(compiler, preheader->entry_jump, body))
+        return operand_too_large(OP_JUMP, body);
+    emit(compiler, OP_POP, nullptr);
+    error = compile(compiler, (ast_node *) while_exp->body);
+    if (error.error_code != COMPILER_ERROR_NONE)
+        return error;
+    error = leave_loop(compiler, start, exit_jump, body + 1);
+    if (error.error_code != COMPILER_ERROR_NONE)
+        return error;
+    return loop_finish(compiler, preheader);
+}
+
+/**
+ * Compile a while loop. Its value is that of the body's last iteration, or null, and
+ * stays on the stack while the loop runs, each iteration replacing it. At -O2 the code
+ * in front of it computes what doesn't change between iterations.
+ */
+static compiler_error compile_while(compiler *compiler, const ast_while_expression *while_exp) {
+    loop_preheader       preheader;
+    const compiler_error error = compile_loop(compiler, while_exp, &preheader);
+    loop_forget_hoisted(compiler, preheader.hoisted);
+    return error;
+}
+
+/**
+ * Leave the value of an if's branch, whose code starts at `start`, on the stack: that of
+ * the expression it ends in, or null if it is empty or ends in a let, like leave_loop
+ * does for a while's body.
+ */
+static void leave_branch(const compiler *compiler, const size_t start) {
+    if (get_current_instructions(compiler)->length > start && last_instruction_is(compiler, OP_POP))
+        remove_last_instruction(compiler);
+    else
+        emit(compiler, OP_NULL, nullptr);
+}
+
+/**
+ * Compile && or ||, which only evaluate their right operand when the left one doesn't
+ * already decide the result.
+ */
+static compiler_error compile_logical(compiler *compiler, const ast_infix_expression *infix_exp) {
+    const bool     and   = infix_exp->operator == OPERATOR_AND;
+    compiler_error error = compile(compiler, (ast_node *) infix_exp->left);
+    if (error.error_code != COMPILER_ERROR_NONE)
+        return error;
+    const size_t decided = emit_jump(compiler, and ? OP_JUMP_NOT_TRUTHY : OP_JUMP_TRUTHY);
+    error                = compile(compiler, (ast_node *) infix_exp->right);
+    if (error.error_code != COMPILER_ERROR_NONE)
+        return error;
+    const size_t jmp_pos = emit_jump(compiler, OP_JUMP);
+    size_t       after   = get_current_instructions(compiler)->length;
+    if (!change_operand(compiler, decided, after))
+        return operand_too_large(and ? OP_JUMP_NOT_TRUTHY : OP_JUMP_TRUTHY, after);
+    emit(compiler, and ? OP_FALSE : OP_TRUE, nullptr);
+    after = get_current_instructions(compiler)->length;
+    if (!change_operand(compiler, jmp_pos, after))
+        return operand_too_large(OP_JUMP, after);
+    return (compiler_error){COMPILER_ERROR_NONE, nullptr};
+}
+
 compiler_error compile_expression_node(compiler *compiler, ast_expression *expression_node) {
     compiler_error          error;
     compiler_error          none_error = {COMPILER_ERROR_NONE, nullptr};
@@ -31,60 +193,47 @@ compiler_error compile_expression_node(compiler *compiler, ast_expression *expre
     ast_call_expression *   call_exp;
     size_t                  constant_idx;
     size_t                  op_jmp_false_pos, after_consequence_pos, jmp_pos, after_alternative_pos;
+    size_t                  branch_start;
     compilation_scope *     scope;
+    const operator_opcode * op;
+    fold_mark               mark;
+    if (loop_load_hoisted(compiler, expression_node))
+        return none_error;
     switch (expression_node->expression_type) {
         case INFIX_EXPRESSION:
             infix_exp = (ast_infix_expression *) expression_node;
-            if (strcmp(infix_exp->operator, "<") == 0) {
-                error = compile(compiler, (ast_node *) infix_exp->right);
-                if (error.error_code != COMPILER_ERROR_NONE)
-                    return error;
-                error = compile(compiler, (ast_node *) infix_exp->left);
-                if (error.error_code != COMPILER_ERROR_NONE)
-                    return error;
-                emit(compiler, OP_GREATER_THAN, nullptr);
+            if (infix_exp->operator == OPERATOR_AND || infix_exp->operator == OPERATOR_OR)
+                return compile_logical(compiler, infix_exp);
+            if (loop_emit_less_than(compiler, infix_exp))
                 break;
+            op = &infix_opcodes[infix_exp->operator];
+            if (!op->defined) {
+                error.error_code = COMPILER_UNKNOWN_OPERATOR;
+                error.msg        = get_err_msg("Unknown operator %s", ast_get_operator_literal(infix_exp->operator));
+                return error;
             }
-            error = compile(compiler, (ast_node *) infix_exp->left);
+            mark  = fold_begin(compiler);
+            error = compile(compiler, (ast_node *) (op->swap ? infix_exp->right : infix_exp->left));
             if (error.error_code != COMPILER_ERROR_NONE)
                 return error;
-            error = compile(compiler, (ast_node *) infix_exp->right);
+            error = compile(compiler, (ast_node *) (op->swap ? infix_exp->left : infix_exp->right));
             if (error.error_code != COMPILER_ERROR_NONE)
                 return error;
-            if (strcmp(infix_exp->operator, "+") == 0)
-                emit(compiler, OP_ADD, nullptr);
-            else if (strcmp(infix_exp->operator, "-") == 0)
-                emit(compiler, OP_SUB, nullptr);
-            else if (strcmp(infix_exp->operator, "*") == 0)
-                emit(compiler, OP_MUL, nullptr);
-            else if (strcmp(infix_exp->operator, "/") == 0)
-                emit(compiler, OP_DIV, nullptr);
-            else if (strcmp(infix_exp->operator, ">") == 0)
-                emit(compiler, OP_GREATER_THAN, nullptr);
-            else if (strcmp(infix_exp->operator, "==") == 0)
-                emit(compiler, OP_EQUAL, nullptr);
-            else if (strcmp(infix_exp->operator, "!=") == 0)
-                emit(compiler, OP_NOT_EQUAL, nullptr);
-            else {
-                error.error_code = COMPILER_UNKNOWN_OPERATOR;
-                error.msg        = get_err_msg("Unknown operator %s", infix_exp->operator);
-                return error;
-            }
+            emit_folded(compiler, &mark, op->opcode);
             break;
         case PREFIX_EXPRESSION:
             prefix_exp = (ast_prefix_expression *) expression_node;
-            error = compile(compiler, (ast_node *) prefix_exp->right);
-            if (error.error_code != COMPILER_ERROR_NONE)
-                return error;
-            if (strcmp(prefix_exp->operator, "-") == 0)
-                emit(compiler, OP_MINUS, nullptr);
-            else if (strcmp(prefix_exp->operator, "!") == 0)
-                emit(compiler, OP_BANG, nullptr);
-            else {
+            op         = &prefix_opcodes[prefix_exp->operator];
+            if (!op->defined) {
                 error.error_code = COMPILER_UNKNOWN_OPERATOR;
-                error.msg        = get_err_msg("Unknown operator %s", prefix_exp->operator);
+                error.msg        = get_err_msg("Unknown operator %s", ast_get_operator_literal(prefix_exp->operator));
                 return error;
             }
+            mark  = fold_begin(compiler);
+            error = compile(compiler, (ast_node *) prefix_exp->right);
+            if (error.error_code != COMPILER_ERROR_NONE)
+                return error;
+            emit_folded(compiler, &mark, op->opcode);
             break;
         case INTEGER_EXPRESSION:
             int_exp = (ast_integer *) expression_node;
@@ -111,28 +260,32 @@ compiler_error compile_expression_node(compiler *compiler, ast_expression *expre
             error = compile(compiler, (ast_node *) if_exp->condition);
             if (error.error_code != COMPILER_ERROR_NONE)
                 return error;
-            op_jmp_false_pos = emit(compiler, OP_JUMP_NOT_TRUTHY, (size_t[]){9999});
+            op_jmp_false_pos = emit_jump(compiler, OP_JUMP_NOT_TRUTHY);
+            branch_start     = get_current_instructions(compiler)->length;
             error            = compile(compiler, (ast_node *) if_exp->consequence);
             if (error.error_code != COMPILER_ERROR_NONE)
                 return error;
-            if (last_instruction_is(compiler, OP_POP))
-                remove_last_instruction(compiler);
-            jmp_pos               = emit(compiler, OP_JUMP, (size_t[]){9999});
+            leave_branch(compiler, branch_start);
+            jmp_pos               = emit_jump(compiler, OP_JUMP);
             scope                 = get_top_scope(compiler);
             after_consequence_pos = scope->instructions->length;
-            change_operand(compiler, op_jmp_false_pos, after_consequence_pos);
+            if (!change_operand(compiler, op_jmp_false_pos, after_consequence_pos))
+                return operand_too_large(OP_JUMP_NOT_TRUTHY, after_consequence_pos);
             if (if_exp->alternative == NULL) {
                 emit(compiler, OP_NULL, nullptr);
             } else {
-                error = compile(compiler, (ast_node *) if_exp->alternative);
+                branch_start = get_current_instructions(compiler)->length;
+                error        = compile(compiler, (ast_node *) if_exp->alternative);
                 if (error.error_code != COMPILER_ERROR_NONE)
                     return error;
-                if (last_instruction_is(compiler, OP_POP))
-                    remove_last_instruction(compiler);
+                leave_branch(compiler, branch_start);
             }
             after_alternative_pos = scope->instructions->length;
-            change_operand(compiler, jmp_pos, after_alternative_pos);
+            if (!change_operand(compiler, jmp_pos, after_alternative_pos))
+                return operand_too_large(OP_JUMP, after_alternative_pos);
             break;
+        case WHILE_EXPRESSION:
+            return compile_while(compiler, (ast_while_expression *) expression_node);
         case IDENTIFIER_EXPRESSION:
             ident_exp = (ast_identifier *) expression_node;
             symbol *sym = symbol_resolve(compiler->symbol_table, ident_exp->value);
@@ -203,6 +356,10 @@ compiler_error compile_expression_node(compiler *compiler, ast_expression *expre
             arraylist *free_symbols = arraylist_clone(compiler->symbol_table->free_symbols, _copy_symbol, symbol_free);
             size_t num_locals = compiler->symbol_table->symbol_count;
             size_t free_symbols_count = free_symbols->size;
+            if (free_symbols_count > MAX_FREE_VARIABLES) {
+                arraylist_destroy(free_symbols, symbol_free);
+                return operand_too_large(OP_CLOSURE, free_symbols_count);
+            }
             instructions *ins = compiler_leave_scope(compiler);
             for (size_t i = 0; i < free_symbols->size; i++) {
                 symbol *s = arraylist_get(free_symbols, i);
@@ -226,6 +383,8 @@ compiler_error compile_expression_node(compiler *compiler, ast_expression *expre
                 if (error.error_code != COMPILER_ERROR_NONE)
                     return error;
             }
+            if (!opcode_operands_fit(OP_CALL, (size_t[]){call_exp->arguments->size}, true))
+                return operand_too_large(OP_CALL, call_exp->arguments->size);
             emit(compiler, OP_CALL, (size_t[]){call_exp->arguments->size});
             break;
         default:
@@ -243,6 +402,7 @@ compiler_error compile_statement_node(compiler *compiler, ast_statement *stateme
     ast_return_statement *    ret_stmt;
     symbol *                  sym;
     size_t                    i;
+    fold_mark                 mark;
     switch (statement_node->statement_type) {
         case EXPRESSION_STATEMENT:
             expression_stmt = (ast_expression_statement *) statement_node;
@@ -253,18 +413,22 @@ compiler_error compile_statement_node(compiler *compiler, ast_statement *stateme
             break;
         case BLOCK_STATEMENT:
             block_stmt = (ast_block_statement *) statement_node;
-            for (i = 0; i < block_stmt->statement_count; i++) {
+            error      = none_error;
+            get_top_scope(compiler)->block_depth++;
+            for (i = 0; i < block_stmt->statement_count && error.error_code == COMPILER_ERROR_NONE; i++)
                 error = compile(compiler, (ast_node *) block_stmt->statements[i]);
-                if (error.error_code != COMPILER_ERROR_NONE)
-                    return error;
-            }
-            break;
+            get_top_scope(compiler)->block_depth--;
+            return error;
         case LET_STATEMENT:
             let_stmt = (ast_let_statement *) statement_node;
-            sym   = symbol_define(compiler->symbol_table, let_stmt->name->value);
+            sym = define_let(compiler, let_stmt->name->value);
+            if (loop_emit_increment(compiler, let_stmt, sym))
+                break;
+            mark  = fold_begin(compiler);
             error = compile(compiler, (ast_node *) let_stmt->value);
             if (error.error_code != COMPILER_ERROR_NONE)
                 return error;
+            fold_record_global(compiler, &mark, sym);
             if (sym->scope == GLOBAL)
                 emit(compiler, OP_SET_GLOBAL, (size_t[]){sym->index});
             else
@@ -6,6 +6,19 @@
 #define NODE_COMPILER_H
 #include "compiler_core.h"
 
+/**
+ * What an operator compiles to. Operators with `swap` set have their operands
+ * compiled in reverse order, so that a < b is emitted as b > a.
+ */
+typedef struct {
+    Opcode opcode;
+    bool   defined;
+    bool   swap;
+} operator_opcode;
+
+extern const operator_opcode infix_opcodes[OPERATOR_COUNT];
+extern const operator_opcode prefix_opcodes[OPERATOR_COUNT];
+
 compiler_error compile_expression_node(compiler *compiler, ast_expression *expression_node);
 compiler_error compile_statement_node(compiler *compiler, ast_statement *statement_node);
 
@@ -0,0 +1,299 @@
+//
+// Created by dgood on 1/23/25.
+//
+
+#include "peephole.h"
+
+#include <err.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Passes are repeated until nothing changes, each one can expose more to the next. */
+#define PEEPHOLE_MAX_PASSES 8
+
+typedef struct {
+    Opcode opcode;
+    size_t operands[MAX_OPERANDS];
+    size_t position; // where the instruction was before this pass
+    bool   wide;     // stays wide, so that jumps never need more room than they had
+    bool   removed;
+} peephole_instruction;
+
+typedef struct {
+    peephole_instruction *code;
+    size_t                count;
+    size_t *              index_at; // instruction index at each byte position, and count at the end
+    bool *                targeted; // whether a jump lands on each instruction
+} peephole_block;
+
+static void *allocate(const size_t count, const size_t size) {
+    void *p = calloc(count + 1, size);
+    if (p == NULL) {
+        err(EXIT_FAILURE, "malloc failed");
+    }
+    return p;
+}
+
+static void decode(const instructions *ins, peephole_block *block) {
+    block->code     = allocate(ins->length, sizeof(*block->code));
+    block->index_at = allocate(ins->length, sizeof(*block->index_at));
+    block->count    = 0;
+    for (size_t pos = 0; pos < ins->length; pos += opcode_instruction_length(ins->bytes + pos)) {
+        peephole_instruction *in = &block->code[block->count];
+        in->opcode               = vm_instruction_decode(ins->bytes + pos, in->operands);
+        in->position             = pos;
+        in->wide                 = ins->bytes[pos] == OP_WIDE;
+        block->index_at[pos]     = block->count++;
+    }
+    block->index_at[ins->length] = block->count;
+
+    block->targeted = allocate(block->count, sizeof(*block->targeted));
+    for (size_t i = 0; i < block->count; i++) {
+        if (opcode_is_jump(block->code[i].opcode))
+            block->targeted[block->index_at[block->code[i].operands[0]]] = true;
+    }
+}
+
+static size_t jump_target(const peephole_block *block, const size_t i) {
+    return block->index_at[block->code[i].operands[0]];
+}
+
+/**
+ * Point jumps that land on an unconditional jump at wherever that one goes. Cycles
+ * are cut off after as many hops as there are instructions.
+ */
+static bool thread_jumps(const peephole_block *block) {
+    bool changed = false;
+    for (size_t i = 0; i < block->count; i++) {
+        if (!opcode_is_jump(block->code[i].opcode))
+            continue;
+        size_t target = jump_target(block, i);
+        for (size_t hops = 0; hops < block->count && target < block->count && target != i &&
+                              block->code[target].opcode == OP_JUMP; hops++) {
+            if (block->code[target].operands[0] == block->code[i].operands[0])
+                break;
+            block->code[i].operands[0] = block->code[target].operands[0];
+            target                     = jump_target(block, i);
+            changed                    = true;
+        }
+    }
+    return changed;
+}
+
+/**
+ * Whether the instruction right before `i` always runs before it and leaves a bool or
+ * null on the stack, the only operands OP_BANG doesn't fail on.
+ */
+static bool follows_bool(const peephole_block *block, const size_t i) {
+    if (i == 0 || block->targeted[i] || block->code[i - 1].removed)
+        return false;
+    switch (block->code[i - 1].opcode) {
+        case OP_TRUE:
+        case OP_FALSE:
+        case OP_NULL:
+        case OP_EQUAL:
+        case OP_NOT_EQUAL:
+        case OP_GREATER_THAN:
+        case OP_LESS_THAN_GLOBAL:
+        case OP_LESS_THAN_LOCAL:
+        case OP_BANG:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * Rewrite pairs of instructions. The second of a pair must not be a jump target, a
+ * jump straight to it would skip the first one.
+ */
+static bool rewrite_pairs(const peephole_block *block) {
+    bool changed = false;
+    for (size_t i = 0; i + 1 < block->count; i++) {
+        peephole_instruction *first  = &block->code[i];
+        peephole_instruction *second = &block->code[i + 1];
+        if (first->removed || second->removed || block->targeted[i + 1])
+            continue;
+        switch (first->opcode) {
+            case OP_TRUE:
+                // the condition always holds, so neither instruction does anything
+                if (second->opcode != OP_JUMP_NOT_TRUTHY)
+                    continue;
+                first->removed  = true;
+                second->removed = true;
+                break;
+            case OP_FALSE:
+                if (second->opcode != OP_JUMP_NOT_TRUTHY)
+                    continue;
+                first->removed  = true;
+                second->opcode  = OP_JUMP;
+                break;
+            case OP_BANG:
+                // only when OP_BANG can't fail, OP_JUMP_TRUTHY takes any operand
+                if (second->opcode != OP_JUMP_NOT_TRUTHY || !follows_bool(block, i))
+                    continue;
+                first->removed  = true;
+                second->opcode  = OP_JUMP_TRUTHY;
+                break;
+            case OP_SET_GLOBAL:
+            case OP_SET_LOCAL:
+                // keep a copy of the value instead of loading it straight back
+                if (second->opcode != (first->opcode == OP_SET_GLOBAL ? OP_GET_GLOBAL : OP_GET_LOCAL) ||
+                    second->operands[0] != first->operands[0])
+                    continue;
+                second->opcode = first->opcode;
+                first->opcode  = OP_DUP;
+                break;
+            default:
+                continue;
+        }
+        changed = true;
+    }
+    return changed;
+}
+
+/**
+ * Remove what follows a return or an unconditional jump, OP_LOOP included, up to the
+ * next instruction a jump lands on, and jumps to the instruction right after them.
+ */
+static bool remove_unreachable(const peephole_block *block) {
+    bool changed = false;
+    for (size_t i = 0; i < block->count; i++) {
+        const Opcode op = block->code[i].opcode;
+        if (block->code[i].removed || (op != OP_RETURN_VALUE && op != OP_RETURN && op != OP_JUMP && op != OP_LOOP))
+            continue;
+        for (size_t j = i + 1; j < block->count && !block->targeted[j] && !block->code[j].removed; j++) {
+            block->code[j].removed = true;
+            changed                = true;
+        }
+    }
+    for (size_t i = 0; i < block->count; i++) {
+        if (block->code[i].removed || block->code[i].opcode != OP_JUMP)
+            continue;
+        const size_t target = jump_target(block, i);
+        size_t       next   = i + 1;
+        while (next < target && block->code[next].removed)
+            next++;
+        if (next == target) {
+            block->code[i].removed = true;
+            changed                = true;
+        }
+    }
+    return changed;
+}
+
+/**
+ * Work out where each instruction that is left will start, and the end as the position
+ * after the last one. A removed instruction gets the position of the next one kept.
+ * Returns the length of the instructions.
+ */
+static size_t relocate(const peephole_block *block, size_t *relocated) {
+    size_t length = 0;
+    for (size_t i = 0; i < block->count; i++) {
+        if (!block->code[i].removed)
+            length += opcode_instruction_width(block->code[i].opcode, block->code[i].wide);
+    }
+    relocated[block->count] = length;
+    for (size_t i = block->count, end = length; i-- > 0;) {
+        if (!block->code[i].removed)
+            end -= opcode_instruction_width(block->code[i].opcode, block->code[i].wide);
+        relocated[i] = end;
+    }
+    return length;
+}
+
+/**
+ * Write the instructions that are left back, moving every jump to where its target
+ * ended up. A jump to a removed instruction lands on the next one that was kept.
+ */
+static void encode(instructions *ins, const peephole_block *block) {
+    size_t *relocated = allocate(block->count, sizeof(*relocated));
+    relocate(block, relocated);
+
+    size_t pos = 0;
+    for (size_t i = 0; i < block->count; i++) {
+        const peephole_instruction *in = &block->code[i];
+        if (in->removed)
+            continue;
+        size_t operands[MAX_OPERANDS];
+        memcpy(operands, in->operands, sizeof(operands));
+        if (opcode_is_jump(in->opcode))
+            operands[0] = relocated[jump_target(block, i)];
+        instructions *encoded = in->wide ? opcode_make_wide_instruction(in->opcode, operands)
+                                         : opcode_make_instruction(in->opcode, operands);
+        memcpy(ins->bytes + pos, encoded->bytes, encoded->length);
+        pos += encoded->length;
+        instructions_free(encoded);
+    }
+    ins->length = pos;
+    free(relocated);
+}
+
+/**
+ * Rewrite short instruction sequences in place into cheaper ones: jumps to jumps are
+ * threaded, constant conditions and `!` before a conditional jump are folded into the
+ * jump, a store followed by a load of the same variable keeps a copy instead, and
+ * code nothing can reach is dropped. The instructions never grow.
+ */
+void peephole_optimize(instructions *ins) {
+    for (size_t pass = 0; pass < PEEPHOLE_MAX_PASSES && ins->length > 0; pass++) {
+        peephole_block block;
+        decode(ins, &block);
+        bool changed = thread_jumps(&block);
+        changed |= rewrite_pairs(&block);
+        changed |= remove_unreachable(&block);
+        if (changed)
+            encode(ins, &block);
+        free(block.code);
+        free(block.index_at);
+        free(block.targeted);
+        if (!changed)
+            break;
+    }
+}
+
+/**
+ * Point the compact jumps in `far_jumps`, left with a placeholder operand, at their
+ * targets in the wide form, and widen every other jump that can't reach its target
+ * any more once the code after them has moved.
+ */
+void widen_far_jumps(instructions *ins, const arraylist *far_jumps) {
+    if (far_jumps == NULL || far_jumps->size == 0)
+        return;
+    peephole_block block;
+    decode(ins, &block);
+    for (size_t i = 0; i < far_jumps->size; i++) {
+        const far_jump *jump = arraylist_get(far_jumps, i);
+        if (jump->position >= ins->length)
+            continue;
+        peephole_instruction *in = &block.code[block.index_at[jump->position]];
+        in->operands[0]          = jump->target;
+        in->wide                 = true;
+    }
+    size_t *relocated = allocate(block.count, sizeof(*relocated));
+    size_t  length    = 0;
+    for (bool widened = true; widened;) {
+        widened = false;
+        length  = relocate(&block, relocated);
+        for (size_t i = 0; i < block.count; i++) {
+            peephole_instruction *in = &block.code[i];
+            if (in->wide || !opcode_is_jump(in->opcode) ||
+                opcode_operands_fit(in->opcode, (size_t[]){relocated[jump_target(&block, i)]}, false))
+                continue;
+            in->wide = true;
+            widened  = true;
+        }
+    }
+    free(relocated);
+    if (length > ins->length) {
+        ins->bytes = realloc(ins->bytes, length);
+        if (ins->bytes == NULL) {
+            err(EXIT_FAILURE, "malloc failed");
+        }
+        ins->capacity = length;
+    }
+    encode(ins, &block);
+    free(block.code);
+    free(block.index_at);
+    free(block.targeted);
+}
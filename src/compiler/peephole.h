@@ -0,0 +1,20 @@
+//
+// Created by dgood on 1/23/25.
+//
+
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+#include "../datastructures/arraylist.h"
+#include "../opcode/opcode.h"
+
+/** A compact jump at `position` to `target`, which is further off than it can reach. */
+typedef struct {
+    size_t position;
+    size_t target;
+} far_jump;
+
+void peephole_optimize(instructions *);
+
+void widen_far_jumps(instructions *, const arraylist *);
+
+#endif //PEEPHOLE_H
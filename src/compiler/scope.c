@@ -19,6 +19,12 @@ compilation_scope *scope_init() {
     scope->instructions->bytes    = nullptr;
     scope->instructions->length   = 0;
     scope->instructions->capacity = 0;
+    scope->instructions->format   = INSTRUCTIONS_BYTES;
+    scope->block_depth            = 0;
+    scope->loop_depth             = 0;
+    scope->loop_symbols           = 0;
+    scope->hoisted                = nullptr;
+    scope->far_jumps              = nullptr;
     return scope;
 }
 
@@ -34,6 +40,10 @@ void scope_free(compilation_scope *scope) {
         instructions_free(scope->instructions);
         scope->instructions = nullptr;
     }
+    if (scope->hoisted)
+        arraylist_destroy(scope->hoisted);
+    if (scope->far_jumps)
+        arraylist_destroy(scope->far_jumps);
     free(scope);
 }
 
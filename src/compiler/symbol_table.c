@@ -39,6 +39,18 @@ symbol *symbol_define(symbol_table *table, const char *name) {
     return s;
 }
 
+/**
+ * Define `name` again, keeping the slot it already has in this table if that was
+ * defined from the `first` symbol on. A loop's lets use this to store into the same
+ * slot on every iteration.
+ */
+symbol *symbol_redefine(symbol_table *table, const char *name, const size_t first) {
+    symbol *s = hashtable_get(table->store, (void *) name);
+    if (s != NULL && (s->scope == GLOBAL || s->scope == LOCAL) && s->index >= first)
+        return s;
+    return symbol_define(table, name);
+}
+
 symbol *symbol_define_function(symbol_table *table, char *name) {
     symbol *s = symbol_init(name, FUNCTION_SCOPE, 0);
     char *  n = strdup(name);
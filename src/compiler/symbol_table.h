@@ -46,6 +46,8 @@ symbol_table *enclosed_symbol_table_init(symbol_table *);
 
 symbol *symbol_define(symbol_table *, const char *);
 
+symbol *symbol_redefine(symbol_table *, const char *, size_t);
+
 symbol *symbol_define_builtin(const symbol_table *table, const size_t index,
                               const char *        name);
 
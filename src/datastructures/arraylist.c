@@ -10,11 +10,16 @@
 #include <string.h>
 #include "../logging/log.h"
 
-static arraylist *active_lists[1024];
-static size_t     active_count = 0;
+#define ARRAYLIST_TRACKED_MAX 1024
+
+// Debug bookkeeping of the lists each thread has created. Lists past the first
+// ARRAYLIST_TRACKED_MAX live ones, or freed on another thread, are simply not listed.
+static thread_local arraylist *active_lists[ARRAYLIST_TRACKED_MAX];
+static thread_local size_t     active_count = 0;
 
 void track_arraylist(arraylist *list) {
-    active_lists[active_count++] = list;
+    if (active_count < ARRAYLIST_TRACKED_MAX)
+        active_lists[active_count++] = list;
 }
 
 void untrack_arraylist(arraylist *list) {
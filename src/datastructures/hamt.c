@@ -0,0 +1,298 @@
+//
+// Created by dgood on 1/14/25.
+//
+
+#include "hamt.h"
+#include <err.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HASH_BITS (sizeof(size_t) * 8)
+
+#define fragment(hash, shift) (((hash) >> (shift)) & HAMT_MASK)
+#define entry_index(bitmap, bit) ((uint32_t) __builtin_popcount((bitmap) & ((bit) - 1)))
+
+static hamt_node *node_create(const uint32_t size) {
+    hamt_node *node = malloc(sizeof(*node));
+    if (node == NULL) {
+        err(EXIT_FAILURE, "malloc failed");
+    }
+    node->entries = calloc(size > 0 ? size : 1, sizeof(hamt_entry));
+    if (node->entries == NULL) {
+        err(EXIT_FAILURE, "malloc failed");
+    }
+    node->refcount  = 1;
+    node->bitmap    = 0;
+    node->size      = size;
+    node->collision = false;
+    return node;
+}
+
+static void node_release(const hamt *trie, hamt_node *node) {
+    if (node == NULL || --node->refcount > 0) {
+        return;
+    }
+    for (uint32_t i = 0; i < node->size; i++) {
+        hamt_entry *entry = &node->entries[i];
+        if (entry->child != NULL) {
+            node_release(trie, entry->child);
+            continue;
+        }
+        if (trie->free_key) {
+            trie->free_key(entry->key);
+        }
+        if (trie->free_value) {
+            trie->free_value(entry->value);
+        }
+    }
+    free(node->entries);
+    free(node);
+}
+
+static void copy_entry(const hamt *trie, hamt_entry *dest, const hamt_entry *src) {
+    if (src->child != NULL) {
+        src->child->refcount++;
+        dest->child = src->child;
+        dest->key   = nullptr;
+        dest->value = nullptr;
+        return;
+    }
+    dest->child = nullptr;
+    dest->key   = trie->copy_key ? trie->copy_key(src->key) : src->key;
+    dest->value = trie->copy_value ? trie->copy_value(src->value) : src->value;
+}
+
+static void release_entry(const hamt *trie, const hamt_entry *entry) {
+    if (entry->child != NULL) {
+        node_release(trie, entry->child);
+        return;
+    }
+    if (trie->free_key) {
+        trie->free_key(entry->key);
+    }
+    if (trie->free_value) {
+        trie->free_value(entry->value);
+    }
+}
+
+/**
+ * Copy `node`, leaving room for `extra` more entries. A gap is left at `gap` when
+ * extra is non zero, so the caller can put the new entry in place.
+ */
+static hamt_node *node_clone(const hamt *trie, const hamt_node *node, const uint32_t extra, const uint32_t gap) {
+    hamt_node *clone = node_create(node->size + extra);
+    clone->bitmap    = node->bitmap;
+    clone->collision = node->collision;
+    for (uint32_t i = 0, j = 0; i < node->size; i++, j++) {
+        if (extra > 0 && i == gap) {
+            j++;
+        }
+        copy_entry(trie, &clone->entries[j], &node->entries[i]);
+    }
+    return clone;
+}
+
+/**
+ * Build the smallest sub-trie holding two keys whose hashes agree on every fragment
+ * before `shift`.
+ */
+static hamt_node *merge_pair(const hamt *trie, const unsigned int shift,
+                             const size_t hash1, void *key1, void *value1,
+                             const size_t hash2, void *key2, void *value2) {
+    hamt_node *node;
+    if (shift >= HASH_BITS) {
+        node                   = node_create(2);
+        node->collision        = true;
+        node->entries[0].key   = key1;
+        node->entries[0].value = value1;
+        node->entries[1].key   = key2;
+        node->entries[1].value = value2;
+        return node;
+    }
+    const uint32_t frag1 = fragment(hash1, shift);
+    const uint32_t frag2 = fragment(hash2, shift);
+    if (frag1 == frag2) {
+        node                   = node_create(1);
+        node->bitmap           = 1U << frag1;
+        node->entries[0].child = merge_pair(trie, shift + HAMT_BITS, hash1, key1, value1, hash2, key2, value2);
+        return node;
+    }
+    node                = node_create(2);
+    node->bitmap        = (1U << frag1) | (1U << frag2);
+    const uint32_t idx1 = frag1 < frag2 ? 0 : 1;
+    node->entries[idx1].key       = key1;
+    node->entries[idx1].value     = value1;
+    node->entries[1 - idx1].key   = key2;
+    node->entries[1 - idx1].value = value2;
+    return node;
+}
+
+static hamt_node *node_set(const hamt *trie, const hamt_node *node, const unsigned int shift,
+                           const size_t hash, void *key, void *value, bool *added) {
+    hamt_node *clone;
+    if (node->collision) {
+        for (uint32_t i = 0; i < node->size; i++) {
+            if (trie->key_equals(node->entries[i].key, key)) {
+                clone = node_clone(trie, node, 0, 0);
+                release_entry(trie, &clone->entries[i]);
+                clone->entries[i].key   = key;
+                clone->entries[i].value = value;
+                return clone;
+            }
+        }
+        clone                              = node_clone(trie, node, 1, node->size);
+        clone->entries[node->size].key     = key;
+        clone->entries[node->size].value   = value;
+        *added                             = true;
+        return clone;
+    }
+
+    const uint32_t bit = 1U << fragment(hash, shift);
+    const uint32_t idx = entry_index(node->bitmap, bit);
+    if ((node->bitmap & bit) == 0) {
+        clone = node_clone(trie, node, 1, idx);
+        clone->bitmap |= bit;
+        clone->entries[idx].key   = key;
+        clone->entries[idx].value = value;
+        *added                    = true;
+        return clone;
+    }
+
+    const hamt_entry *entry = &node->entries[idx];
+    hamt_node *       child;
+    if (entry->child != NULL) {
+        child = node_set(trie, entry->child, shift + HAMT_BITS, hash, key, value, added);
+    } else if (trie->key_equals(entry->key, key)) {
+        clone = node_clone(trie, node, 0, 0);
+        release_entry(trie, &clone->entries[idx]);
+        clone->entries[idx].key   = key;
+        clone->entries[idx].value = value;
+        return clone;
+    } else {
+        void *old_key   = trie->copy_key ? trie->copy_key(entry->key) : entry->key;
+        void *old_value = trie->copy_value ? trie->copy_value(entry->value) : entry->value;
+        child           = merge_pair(trie, shift + HAMT_BITS, trie->hash_func(entry->key), old_key, old_value,
+                                     hash, key, value);
+        *added = true;
+    }
+    clone = node_clone(trie, node, 0, 0);
+    release_entry(trie, &clone->entries[idx]);
+    clone->entries[idx].key   = nullptr;
+    clone->entries[idx].value = nullptr;
+    clone->entries[idx].child = child;
+    return clone;
+}
+
+/**
+ * Create a new, empty trie.
+ */
+hamt *hamt_create(size_t (*hash_func)(void *),
+                  bool (*  key_equals)(void *, void *),
+                  void *(* copy_key)(void *),
+                  void *(* copy_value)(void *),
+                  void (*  free_key)(void *),
+                  void (*  free_value)(void *)) {
+    hamt *trie = malloc(sizeof(*trie));
+    if (trie == NULL) {
+        err(EXIT_FAILURE, "malloc failed");
+    }
+    trie->refcount   = 1;
+    trie->count      = 0;
+    trie->root       = node_create(0);
+    trie->hash_func  = hash_func;
+    trie->key_equals = key_equals;
+    trie->copy_key   = copy_key;
+    trie->copy_value = copy_value;
+    trie->free_key   = free_key;
+    trie->free_value = free_value;
+    return trie;
+}
+
+/**
+ * Return a new trie with `key` mapped to `value`. The new trie takes ownership of
+ * both, the source trie is left untouched.
+ */
+hamt *hamt_set(const hamt *trie, void *key, void *value) {
+    hamt *result = malloc(sizeof(*result));
+    if (result == NULL) {
+        err(EXIT_FAILURE, "malloc failed");
+    }
+    memcpy(result, trie, sizeof(*result));
+    bool added       = false;
+    result->refcount = 1;
+    result->root     = node_set(trie, trie->root, 0, trie->hash_func(key), key, value, &added);
+    if (added) {
+        result->count++;
+    }
+    return result;
+}
+
+/**
+ * Return the value associated with the given key, or NULL if not found.
+ */
+void *hamt_get(const hamt *trie, void *key) {
+    const size_t     hash  = trie->hash_func(key);
+    const hamt_node *node  = trie->root;
+    unsigned int     shift = 0;
+    while (node != NULL) {
+        if (node->collision) {
+            for (uint32_t i = 0; i < node->size; i++) {
+                if (trie->key_equals(node->entries[i].key, key)) {
+                    return node->entries[i].value;
+                }
+            }
+            return nullptr;
+        }
+        const uint32_t bit = 1U << fragment(hash, shift);
+        if ((node->bitmap & bit) == 0) {
+            return nullptr;
+        }
+        const hamt_entry *entry = &node->entries[entry_index(node->bitmap, bit)];
+        if (entry->child == NULL) {
+            return trie->key_equals(entry->key, key) ? entry->value : nullptr;
+        }
+        node = entry->child;
+        shift += HAMT_BITS;
+    }
+    return nullptr;
+}
+
+size_t hamt_count(const hamt *trie) {
+    return trie->count;
+}
+
+static void collect_keys(const hamt_node *node, arraylist *keys) {
+    for (uint32_t i = 0; i < node->size; i++) {
+        if (node->entries[i].child != NULL) {
+            collect_keys(node->entries[i].child, keys);
+        } else {
+            arraylist_add(keys, node->entries[i].key);
+        }
+    }
+}
+
+/**
+ * Return the keys of the trie in trie order, or NULL if the trie is empty.
+ * The list does not own the keys.
+ */
+arraylist *hamt_get_keys(const hamt *trie) {
+    if (trie->count == 0) {
+        return nullptr;
+    }
+    arraylist *keys = arraylist_create(trie->count, nullptr);
+    collect_keys(trie->root, keys);
+    return keys;
+}
+
+hamt *hamt_retain(hamt *trie) {
+    trie->refcount++;
+    return trie;
+}
+
+void hamt_free(hamt *trie) {
+    if (trie == NULL || --trie->refcount > 0) {
+        return;
+    }
+    node_release(trie, trie->root);
+    free(trie);
+}
@@ -0,0 +1,84 @@
+//
+// Created by dgood on 1/14/25.
+//
+
+#ifndef HAMT_H
+#define HAMT_H
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "arraylist.h"
+
+#define HAMT_BITS  5
+#define HAMT_WIDTH (1 << HAMT_BITS)
+#define HAMT_MASK  (HAMT_WIDTH - 1)
+
+struct hamt_node;
+
+/**
+ * A slot of a trie node: either a key/value pair, or a pointer to a sub-node
+ * when `child` is set.
+ */
+typedef struct {
+    void *            key;
+    void *            value;
+    struct hamt_node *child;
+} hamt_entry;
+
+/**
+ * Bitmap indexed trie node. Bit i of `bitmap` is set when the node has an entry for
+ * hash fragment i; entries are stored densely in fragment order. Collision nodes hold
+ * keys whose hashes are equal in every bit, and are searched linearly.
+ */
+typedef struct hamt_node {
+    size_t      refcount;
+    uint32_t    bitmap;
+    uint32_t    size;
+    bool        collision;
+    hamt_entry *entries;
+} hamt_node;
+
+/**
+ * Persistent (immutable) hash array mapped trie. hamt_set returns a new trie that
+ * shares every node off the updated path with the old one, so inserts and lookups
+ * are O(log32 n) and old versions stay valid.
+ */
+typedef struct {
+    size_t     refcount;
+    size_t     count;
+    hamt_node *root;
+
+    size_t (*hash_func)(void *);
+
+    bool (*key_equals)(void *, void *);
+
+    void *(*copy_key)(void *);   // Function to copy a key when a node is path copied
+    void *(*copy_value)(void *); // Function to copy a value when a node is path copied
+    void (*free_key)(void *);
+
+    void (*free_value)(void *);
+} hamt;
+
+hamt *hamt_create(size_t (*hash_func)(void *),
+                  bool (*  key_equals)(void *, void *),
+                  void *(* copy_key)(void *),
+                  void *(* copy_value)(void *),
+                  void (*  free_key)(void *),
+                  void (*  free_value)(void *));
+
+hamt *hamt_set(const hamt *, void *, void *);
+
+void *hamt_get(const hamt *, void *);
+
+size_t hamt_count(const hamt *);
+
+arraylist *hamt_get_keys(const hamt *);
+
+hamt *hamt_retain(hamt *);
+
+void hamt_free(hamt *);
+
+#endif //HAMT_H
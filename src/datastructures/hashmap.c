@@ -304,6 +304,16 @@ size_t string_hash_function(void *key) {
     return hash;
 }
 
+/**
+ * Same hash as string_hash_function, for strings that are not NUL terminated.
+ */
+size_t string_n_hash_function(const char *str, const size_t length) {
+    unsigned long hash = 5381;
+    for (size_t i = 0; i < length; i++)
+        hash = ((hash << 5) + hash) + (unsigned char) str[i];
+    return hash;
+}
+
 bool string_equals(void *key1, void *key2) {
     char *strkey1 = key1;
     char *strkey2 = key2;
@@ -64,6 +64,8 @@ hashtable *hashtable_clone(const hashtable *src, void * (*key_copy)(void *), voi
 
 size_t string_hash_function(void *key);
 
+size_t string_n_hash_function(const char *, size_t);
+
 bool string_equals(void *, void *);
 
 size_t int_hash_function(void *);
@@ -0,0 +1,346 @@
+//
+// Created by dgood on 1/18/25.
+//
+
+#include "int_buffer.h"
+#include <err.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/**
+ * Create a new, empty buffer with room for `capacity` integers.
+ */
+int_buffer *int_buffer_create(size_t capacity) {
+    if (capacity < INT_BUFFER_INITIAL_CAPACITY) {
+        capacity = INT_BUFFER_INITIAL_CAPACITY;
+    }
+    int_buffer *buffer = malloc(sizeof(*buffer) + capacity * sizeof(int64_t));
+    if (buffer == NULL) {
+        err(EXIT_FAILURE, "malloc failed");
+    }
+    buffer->refcount = 1;
+    buffer->used     = 0;
+    buffer->capacity = capacity;
+    return buffer;
+}
+
+/**
+ * Append `value` to the slice [*offset, *offset + length) of the buffer and return a
+ * reference to a buffer holding the longer slice. When the slice ends at the last written
+ * slot and there is room, the value is written in place and the buffer is shared;
+ * otherwise the slice is copied to a new buffer of twice the size and *offset is reset.
+ */
+int_buffer *int_buffer_append(int_buffer *buffer, size_t *offset, const size_t length, const int64_t value) {
+    const size_t end = *offset + length;
+    if (end == buffer->used && end < buffer->capacity) {
+        buffer->data[buffer->used++] = value;
+        return int_buffer_retain(buffer);
+    }
+    int_buffer *copy = int_buffer_create(length * 2);
+    memcpy(copy->data, buffer->data + *offset, length * sizeof(int64_t));
+    copy->data[length] = value;
+    copy->used         = length + 1;
+    *offset            = 0;
+    return copy;
+}
+
+int_buffer *int_buffer_retain(int_buffer *buffer) {
+    buffer->refcount++;
+    return buffer;
+}
+
+void int_buffer_free(int_buffer *buffer) {
+    if (buffer == NULL || --buffer->refcount > 0) {
+        return;
+    }
+    free(buffer);
+}
+
+/*********************************************************************************
+ ******************************  VECTOR KERNELS ***********************************
+ ********************************************************************************/
+
+/*
+ * Each kernel has an AVX2 version, picked once at startup when the CPU running the
+ * program has AVX2, so a default x86-64 build uses it too. Otherwise it falls back to
+ * SSE2, which every x86-64 CPU has, and to plain loops elsewhere. min and max need a
+ * 64-bit compare, which SSE2 lacks, so their fallback uses SSE4.2 when the CPU has it.
+ * Arithmetic wraps on overflow, the scalar tails go through uint64_t to match the
+ * vector lanes.
+ */
+
+static int64_t min_from(const int64_t *values, size_t i, const size_t count, int64_t result) {
+    for (; i < count; i++) {
+        result = values[i] < result ? values[i] : result;
+    }
+    return result;
+}
+
+static int64_t max_from(const int64_t *values, size_t i, const size_t count, int64_t result) {
+    for (; i < count; i++) {
+        result = values[i] > result ? values[i] : result;
+    }
+    return result;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define X86_KERNELS
+#define KERNEL_AVX2  __attribute__((target("avx2")))
+#define KERNEL_SSE42 __attribute__((target("sse4.2")))
+
+static bool has_avx2;
+static bool has_sse42;
+
+__attribute__((constructor)) static void select_kernels(void) {
+    __builtin_cpu_init();
+    has_avx2  = __builtin_cpu_supports("avx2");
+    has_sse42 = __builtin_cpu_supports("sse4.2");
+}
+
+KERNEL_AVX2 static int64_t sum_avx2(const int64_t *values, const size_t count) {
+    size_t  i   = 0;
+    __m256i acc = _mm256_setzero_si256();
+    for (; i + 4 <= count; i += 4) {
+        acc = _mm256_add_epi64(acc, _mm256_loadu_si256((const __m256i *) (values + i)));
+    }
+    int64_t lanes[4];
+    _mm256_storeu_si256((__m256i *) lanes, acc);
+    uint64_t sum = (uint64_t) lanes[0] + (uint64_t) lanes[1] + (uint64_t) lanes[2] + (uint64_t) lanes[3];
+    for (; i < count; i++) {
+        sum += (uint64_t) values[i];
+    }
+    return (int64_t) sum;
+}
+
+KERNEL_AVX2 static int64_t min_avx2(const int64_t *values, const size_t count) {
+    if (count < 4) {
+        return min_from(values, 1, count, values[0]);
+    }
+    __m256i acc = _mm256_loadu_si256((const __m256i *) values);
+    size_t  i   = 4;
+    for (; i + 4 <= count; i += 4) {
+        const __m256i v = _mm256_loadu_si256((const __m256i *) (values + i));
+        acc             = _mm256_blendv_epi8(acc, v, _mm256_cmpgt_epi64(acc, v));
+    }
+    int64_t lanes[4];
+    _mm256_storeu_si256((__m256i *) lanes, acc);
+    return min_from(values, i, count, min_from(lanes, 1, 4, lanes[0]));
+}
+
+KERNEL_AVX2 static int64_t max_avx2(const int64_t *values, const size_t count) {
+    if (count < 4) {
+        return max_from(values, 1, count, values[0]);
+    }
+    __m256i acc = _mm256_loadu_si256((const __m256i *) values);
+    size_t  i   = 4;
+    for (; i + 4 <= count; i += 4) {
+        const __m256i v = _mm256_loadu_si256((const __m256i *) (values + i));
+        acc             = _mm256_blendv_epi8(acc, v, _mm256_cmpgt_epi64(v, acc));
+    }
+    int64_t lanes[4];
+    _mm256_storeu_si256((__m256i *) lanes, acc);
+    return max_from(values, i, count, max_from(lanes, 1, 4, lanes[0]));
+}
+
+KERNEL_SSE42 static int64_t min_sse42(const int64_t *values, const size_t count) {
+    if (count < 2) {
+        return values[0];
+    }
+    __m128i acc = _mm_loadu_si128((const __m128i *) values);
+    size_t  i   = 2;
+    for (; i + 2 <= count; i += 2) {
+        const __m128i v = _mm_loadu_si128((const __m128i *) (values + i));
+        acc             = _mm_blendv_epi8(acc, v, _mm_cmpgt_epi64(acc, v));
+    }
+    int64_t lanes[2];
+    _mm_storeu_si128((__m128i *) lanes, acc);
+    return min_from(values, i, count, lanes[0] < lanes[1] ? lanes[0] : lanes[1]);
+}
+
+KERNEL_SSE42 static int64_t max_sse42(const int64_t *values, const size_t count) {
+    if (count < 2) {
+        return values[0];
+    }
+    __m128i acc = _mm_loadu_si128((const __m128i *) values);
+    size_t  i   = 2;
+    for (; i + 2 <= count; i += 2) {
+        const __m128i v = _mm_loadu_si128((const __m128i *) (values + i));
+        acc             = _mm_blendv_epi8(acc, v, _mm_cmpgt_epi64(v, acc));
+    }
+    int64_t lanes[2];
+    _mm_storeu_si128((__m128i *) lanes, acc);
+    return max_from(values, i, count, lanes[0] > lanes[1] ? lanes[0] : lanes[1]);
+}
+
+KERNEL_AVX2 static bool equals_avx2(const int64_t *a, const int64_t *b, const size_t count) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m256i eq = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i *) (a + i)),
+                                              _mm256_loadu_si256((const __m256i *) (b + i)));
+        if (_mm256_movemask_epi8(eq) != -1) {
+            return false;
+        }
+    }
+    for (; i < count; i++) {
+        if (a[i] != b[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+KERNEL_AVX2 static void add_avx2(int64_t *result, const int64_t *a, const int64_t *b, const size_t count) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        _mm256_storeu_si256((__m256i *) (result + i),
+                            _mm256_add_epi64(_mm256_loadu_si256((const __m256i *) (a + i)),
+                                             _mm256_loadu_si256((const __m256i *) (b + i))));
+    }
+    for (; i < count; i++) {
+        result[i] = (int64_t) ((uint64_t) a[i] + (uint64_t) b[i]);
+    }
+}
+
+KERNEL_AVX2 static void sub_avx2(int64_t *result, const int64_t *a, const int64_t *b, const size_t count) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        _mm256_storeu_si256((__m256i *) (result + i),
+                            _mm256_sub_epi64(_mm256_loadu_si256((const __m256i *) (a + i)),
+                                             _mm256_loadu_si256((const __m256i *) (b + i))));
+    }
+    for (; i < count; i++) {
+        result[i] = (int64_t) ((uint64_t) a[i] - (uint64_t) b[i]);
+    }
+}
+#endif
+
+int64_t int64_sum(const int64_t *values, const size_t count) {
+#ifdef X86_KERNELS
+    if (has_avx2) {
+        return sum_avx2(values, count);
+    }
+#endif
+    size_t   i   = 0;
+    uint64_t sum = 0;
+#if defined(__SSE2__)
+    __m128i acc = _mm_setzero_si128();
+    for (; i + 2 <= count; i += 2) {
+        acc = _mm_add_epi64(acc, _mm_loadu_si128((const __m128i *) (values + i)));
+    }
+    int64_t lanes[2];
+    _mm_storeu_si128((__m128i *) lanes, acc);
+    sum = (uint64_t) lanes[0] + (uint64_t) lanes[1];
+#endif
+    for (; i < count; i++) {
+        sum += (uint64_t) values[i];
+    }
+    return (int64_t) sum;
+}
+
+/**
+ * Smallest value of a non-empty range.
+ */
+int64_t int64_min(const int64_t *values, const size_t count) {
+#ifdef X86_KERNELS
+    if (has_avx2) {
+        return min_avx2(values, count);
+    }
+    if (has_sse42) {
+        return min_sse42(values, count);
+    }
+#endif
+    return min_from(values, 1, count, values[0]);
+}
+
+/**
+ * Largest value of a non-empty range.
+ */
+int64_t int64_max(const int64_t *values, const size_t count) {
+#ifdef X86_KERNELS
+    if (has_avx2) {
+        return max_avx2(values, count);
+    }
+    if (has_sse42) {
+        return max_sse42(values, count);
+    }
+#endif
+    return max_from(values, 1, count, values[0]);
+}
+
+bool int64_equals(const int64_t *a, const int64_t *b, const size_t count) {
+#ifdef X86_KERNELS
+    if (has_avx2) {
+        return equals_avx2(a, b, count);
+    }
+#endif
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 2 <= count; i += 2) {
+        const __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (a + i)),
+                                          _mm_loadu_si128((const __m128i *) (b + i)));
+        if (_mm_movemask_epi8(eq) != 0xFFFF) {
+            return false;
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        if (a[i] != b[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void int64_add(int64_t *result, const int64_t *a, const int64_t *b, const size_t count) {
+#ifdef X86_KERNELS
+    if (has_avx2) {
+        add_avx2(result, a, b, count);
+        return;
+    }
+#endif
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 2 <= count; i += 2) {
+        _mm_storeu_si128((__m128i *) (result + i),
+                         _mm_add_epi64(_mm_loadu_si128((const __m128i *) (a + i)),
+                                       _mm_loadu_si128((const __m128i *) (b + i))));
+    }
+#endif
+    for (; i < count; i++) {
+        result[i] = (int64_t) ((uint64_t) a[i] + (uint64_t) b[i]);
+    }
+}
+
+void int64_sub(int64_t *result, const int64_t *a, const int64_t *b, const size_t count) {
+#ifdef X86_KERNELS
+    if (has_avx2) {
+        sub_avx2(result, a, b, count);
+        return;
+    }
+#endif
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 2 <= count; i += 2) {
+        _mm_storeu_si128((__m128i *) (result + i),
+                         _mm_sub_epi64(_mm_loadu_si128((const __m128i *) (a + i)),
+                                       _mm_loadu_si128((const __m128i *) (b + i))));
+    }
+#endif
+    for (; i < count; i++) {
+        result[i] = (int64_t) ((uint64_t) a[i] - (uint64_t) b[i]);
+    }
+}
+
+/**
+ * Neither SSE2 nor AVX2 has a 64-bit multiply, so this is left to the compiler's
+ * auto-vectorizer.
+ */
+void int64_mul(int64_t *result, const int64_t *a, const int64_t *b, const size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        result[i] = (int64_t) ((uint64_t) a[i] * (uint64_t) b[i]);
+    }
+}
@@ -0,0 +1,53 @@
+//
+// Created by dgood on 1/18/25.
+//
+
+#ifndef INT_BUFFER_H
+#define INT_BUFFER_H
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define INT_BUFFER_INITIAL_CAPACITY 8
+
+/**
+ * Refcounted, growable buffer of unboxed 64-bit integers. Several arrays may share one
+ * buffer, each seeing its own prefix (or slice) of it. `used` is the number of slots
+ * written so far: an array that ends exactly at `used` may append in place, since no
+ * other array can see the slots past its end.
+ */
+typedef struct {
+    size_t  refcount;
+    size_t  used;
+    size_t  capacity;
+    int64_t data[];
+} int_buffer;
+
+int_buffer *int_buffer_create(size_t capacity);
+
+int_buffer *int_buffer_append(int_buffer *, size_t *, size_t, int64_t);
+
+int_buffer *int_buffer_retain(int_buffer *);
+
+void int_buffer_free(int_buffer *);
+
+/*** VECTOR KERNELS ***/
+
+int64_t int64_sum(const int64_t *, size_t);
+
+int64_t int64_min(const int64_t *, size_t);
+
+int64_t int64_max(const int64_t *, size_t);
+
+bool int64_equals(const int64_t *, const int64_t *, size_t);
+
+void int64_add(int64_t *, const int64_t *, const int64_t *, size_t);
+
+void int64_sub(int64_t *, const int64_t *, const int64_t *, size_t);
+
+void int64_mul(int64_t *, const int64_t *, const int64_t *, size_t);
+
+#endif //INT_BUFFER_H
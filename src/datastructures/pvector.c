@@ -0,0 +1,206 @@
+//
+// Created by dgood on 1/12/25.
+//
+
+#include "pvector.h"
+#include <err.h>
+#include <stdlib.h>
+#include <string.h>
+
+static pvector_node *node_create(void) {
+    pvector_node *node = calloc(1, sizeof(*node));
+    if (node == NULL) {
+        err(EXIT_FAILURE, "malloc failed");
+    }
+    node->refcount = 1;
+    return node;
+}
+
+/**
+ * Drop one reference to a node. `level` is the trie level of the node, 0 for leaves,
+ * which is needed to know whether the slots hold child nodes or items.
+ */
+static void node_release(pvector_node *node, const unsigned int level, void (*free_func)(void *)) {
+    if (node == NULL || --node->refcount > 0) {
+        return;
+    }
+    for (size_t i = 0; i < PVECTOR_WIDTH; i++) {
+        if (node->slots[i] == NULL) {
+            continue;
+        }
+        if (level > 0) {
+            node_release(node->slots[i], level - PVECTOR_BITS, free_func);
+        } else if (free_func != NULL) {
+            free_func(node->slots[i]);
+        }
+    }
+    free(node);
+}
+
+static pvector_node *node_clone(const pvector_node *node, const unsigned int level, void *(*copy_func)(void *)) {
+    pvector_node *clone = node_create();
+    for (size_t i = 0; i < PVECTOR_WIDTH; i++) {
+        if (node->slots[i] == NULL) {
+            continue;
+        }
+        if (level > 0) {
+            pvector_node *child = node->slots[i];
+            child->refcount++;
+            clone->slots[i] = child;
+        } else {
+            clone->slots[i] = copy_func != NULL ? copy_func(node->slots[i]) : node->slots[i];
+        }
+    }
+    return clone;
+}
+
+static size_t tail_offset(const pvector *vector) {
+    if (vector->count < PVECTOR_WIDTH) {
+        return 0;
+    }
+    return ((vector->count - 1) >> PVECTOR_BITS) << PVECTOR_BITS;
+}
+
+static pvector_node *new_path(const unsigned int level, pvector_node *node) {
+    if (level == 0) {
+        return node;
+    }
+    pvector_node *path = node_create();
+    path->slots[0]     = new_path(level - PVECTOR_BITS, node);
+    return path;
+}
+
+/**
+ * Copy the path from `parent` down to the slot where the full tail belongs, and hang the tail there.
+ * `count` is the item count of the vector the tail is pushed from.
+ */
+static pvector_node *push_tail(const pvector *vector, const unsigned int level, const pvector_node *parent,
+                               pvector_node *tail) {
+    const size_t  sub_index = ((vector->count - 1) >> level) & PVECTOR_MASK;
+    pvector_node *result    = node_clone(parent, level, vector->copy_func);
+    pvector_node *insert;
+    if (level == PVECTOR_BITS) {
+        insert = tail;
+    } else {
+        pvector_node *child = parent->slots[sub_index];
+        if (child != NULL) {
+            child->refcount--; // node_clone took a reference we are about to replace
+            insert = push_tail(vector, level - PVECTOR_BITS, child, tail);
+        } else {
+            insert = new_path(level - PVECTOR_BITS, tail);
+        }
+    }
+    result->slots[sub_index] = insert;
+    return result;
+}
+
+static pvector *vector_alloc(const pvector *source) {
+    pvector *vector = malloc(sizeof(*vector));
+    if (vector == NULL) {
+        err(EXIT_FAILURE, "malloc failed");
+    }
+    memcpy(vector, source, sizeof(*vector));
+    vector->refcount = 1;
+    return vector;
+}
+
+/**
+ * Create a new, empty persistent vector.
+ */
+pvector *pvector_create(void *(*copy_func)(void *), void (*free_func)(void *)) {
+    const pvector empty = {
+            .refcount = 1,
+            .count = 0,
+            .offset = 0,
+            .shift = PVECTOR_BITS,
+            .root = node_create(),
+            .tail = node_create(),
+            .copy_func = copy_func,
+            .free_func = free_func,
+    };
+    return vector_alloc(&empty);
+}
+
+/**
+ * Return a new vector with `item` appended. The new vector takes ownership of `item`,
+ * the source vector is left untouched.
+ */
+pvector *pvector_push(const pvector *vector, void *item) {
+    pvector *     result     = vector_alloc(vector);
+    const size_t  tail_count = vector->count - tail_offset(vector);
+    pvector_node *new_tail;
+
+    result->count = vector->count + 1;
+    if (tail_count < PVECTOR_WIDTH) {
+        // room in the tail: copy it and append
+        new_tail                    = node_clone(vector->tail, 0, vector->copy_func);
+        new_tail->slots[tail_count] = item;
+        result->tail                = new_tail;
+        vector->root->refcount++;
+        return result;
+    }
+
+    // the tail is full: move it into the trie and start a new one
+    vector->tail->refcount++;
+    if ((vector->count >> PVECTOR_BITS) > (1UL << vector->shift)) {
+        pvector_node *new_root = node_create();
+        vector->root->refcount++;
+        new_root->slots[0] = vector->root;
+        new_root->slots[1] = new_path(vector->shift, vector->tail);
+        result->root       = new_root;
+        result->shift      = vector->shift + PVECTOR_BITS;
+    } else {
+        result->root = push_tail(vector, vector->shift, vector->root, vector->tail);
+    }
+    new_tail           = node_create();
+    new_tail->slots[0] = item;
+    result->tail       = new_tail;
+    return result;
+}
+
+/**
+ * Return a new vector without the first item. The trie is shared as is, only the
+ * offset of the first visible item moves.
+ */
+pvector *pvector_rest(const pvector *vector) {
+    pvector *result = vector_alloc(vector);
+    if (pvector_size(vector) > 0) {
+        result->offset++;
+    }
+    vector->root->refcount++;
+    vector->tail->refcount++;
+    return result;
+}
+
+void *pvector_get(const pvector *vector, const size_t index) {
+    if (index >= pvector_size(vector)) {
+        return nullptr;
+    }
+    const size_t i = index + vector->offset;
+    if (i >= tail_offset(vector)) {
+        return vector->tail->slots[i & PVECTOR_MASK];
+    }
+    const pvector_node *node = vector->root;
+    for (unsigned int level = vector->shift; level > 0; level -= PVECTOR_BITS) {
+        node = node->slots[(i >> level) & PVECTOR_MASK];
+    }
+    return node->slots[i & PVECTOR_MASK];
+}
+
+size_t pvector_size(const pvector *vector) {
+    return vector->count - vector->offset;
+}
+
+pvector *pvector_retain(pvector *vector) {
+    vector->refcount++;
+    return vector;
+}
+
+void pvector_free(pvector *vector) {
+    if (vector == NULL || --vector->refcount > 0) {
+        return;
+    }
+    node_release(vector->root, vector->shift, vector->free_func);
+    node_release(vector->tail, 0, vector->free_func);
+    free(vector);
+}
@@ -0,0 +1,59 @@
+//
+// Created by dgood on 1/12/25.
+//
+
+#ifndef PVECTOR_H
+#define PVECTOR_H
+
+#pragma once
+
+#include <stddef.h>
+
+#define PVECTOR_BITS  5
+#define PVECTOR_WIDTH (1 << PVECTOR_BITS)
+#define PVECTOR_MASK  (PVECTOR_WIDTH - 1)
+
+/**
+ * A node of the vector trie. Internal nodes hold child nodes in their slots,
+ * leaf nodes hold the items themselves. Nodes are shared between versions
+ * of a vector and are released once their refcount drops to zero.
+ */
+typedef struct pvector_node {
+    size_t refcount;
+    void * slots[PVECTOR_WIDTH];
+} pvector_node;
+
+/**
+ * Persistent (immutable) vector: a 32-way trie plus a tail buffer. push and
+ * rest return a new vector that shares all untouched nodes with the old one,
+ * so both run in O(log32 n) and old versions stay valid.
+ *
+ * rest is implemented by bumping `offset`, the index of the first visible item.
+ */
+typedef struct {
+    size_t        refcount;
+    size_t        count;  // items stored in the trie and tail, including dropped ones
+    size_t        offset; // items dropped from the front by pvector_rest
+    unsigned int  shift;
+    pvector_node *root;
+    pvector_node *tail;
+
+    void *(*copy_func)(void *); // Function to copy an item when a leaf is path copied
+    void (*free_func)(void *);  // Function to free memory of items
+} pvector;
+
+pvector *pvector_create(void *(*copy_func)(void *), void (*free_func)(void *));
+
+pvector *pvector_push(const pvector *, void *);
+
+pvector *pvector_rest(const pvector *);
+
+void *pvector_get(const pvector *, size_t);
+
+size_t pvector_size(const pvector *);
+
+pvector *pvector_retain(pvector *);
+
+void pvector_free(pvector *);
+
+#endif //PVECTOR_H
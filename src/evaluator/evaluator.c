@@ -16,110 +16,84 @@ static bool is_error(object_object *obj) {
     return obj != NULL && obj->type == OBJECT_ERROR;
 }
 
-static object_object *eval_boolean_infix_expression(const char * operator,
-                                                    object_bool *left_value,
-                                                    object_bool *right_value) {
-    bool result;
-    if (strcmp(operator, "&&") == 0)
-        result = left_value->value && right_value->value;
-    else if (strcmp(operator, "||") == 0)
-        result = left_value->value || right_value->value;
-    else if (strcmp(operator, "==") == 0)
-        result = left_value->value == right_value->value;
-    else if (strcmp(operator, "!=") == 0)
-        result = left_value->value != right_value->value;
-    else
-        return (object_object *) object_create_error("unknown operator: %s %s %s",
-                                                     get_type_name(
-                                                             left_value->object.type),
-                                                     operator,
-                                                     get_type_name(
-                                                             right_value->object.
-                                                             type));
-    return (object_object *) object_create_bool(result);
-}
-
-static object_object *eval_integer_infix_expression(const char *operator,
-                                                    object_int *left_value,
-                                                    object_int *right_value) {
-    long result;
-    if (strcmp(operator, "+") == 0)
-        result = left_value->value + right_value->value;
-    else if (strcmp(operator, "-") == 0)
-        result = left_value->value - right_value->value;
-    else if (strcmp(operator, "*") == 0)
-        result = left_value->value * right_value->value;
-    else if (strcmp(operator, "/") == 0)
-        if (right_value->value != 0)
-            result = left_value->value / right_value->value;
-        else
-            return (object_object *)
-                    object_create_error("division by 0 not allowed");
-    else if (strcmp(operator, "<") == 0)
-        return (object_object *)
-                object_create_bool(left_value->value < right_value->value);
-    else if (strcmp(operator, ">") == 0)
-        return (object_object *)
-                object_create_bool(left_value->value > right_value->value);
-    else if (strcmp(operator, "==") == 0)
-        return (object_object *) object_create_bool(
-                left_value->value == right_value->value);
-    else if (strcmp(operator, "!=") == 0)
-        return (object_object *)
-                object_create_bool(left_value->value != right_value->value);
-    else if (strcmp(operator, "%") == 0)
-        if (right_value->value != 0)
-            result = left_value->value % right_value->value;
-        else
-            return (object_object *)
-                    object_create_error("division by 0 not allowed");
-    else
-        return (object_object *) object_create_error("unknown operator: %s %s %s",
-                                                     get_type_name(
-                                                             left_value->object.type),
-                                                     operator,
-                                                     get_type_name(
-                                                             right_value->object.
-                                                             type));
-    return (object_object *) object_create_int(result);
+static object_object *unknown_infix_operator(const ast_operator   operator,
+                                            const object_object *left_value,
+                                            const object_object *right_value) {
+    return (object_object *) object_create_error("unknown operator: %s %s %s",
+                                                 get_type_name(left_value->type),
+                                                 ast_get_operator_literal(operator),
+                                                 get_type_name(right_value->type));
 }
 
-static object_object *eval_string_infix_expression(const char *         operator,
-                                                   const object_string *left_value,
-                                                   const object_string *right_value) {
-    if (strcmp(operator, "+") == 0) {
-        const size_t new_len    = left_value->length + right_value->length;
-        char *       new_string = malloc(new_len + 1);
-        memcpy(new_string, left_value->value, left_value->length);
-        memcpy(new_string + left_value->length, right_value->value,
-               right_value->length);
-        new_string[new_len]           = 0;
-        object_string *new_string_obj = object_create_string(nullptr, 0);
-        new_string_obj->value         = new_string;
-        new_string_obj->length        = new_len;
-        return (object_object *) new_string_obj;
+static object_object *eval_boolean_infix_expression(const ast_operator operator,
+                                                    object_bool *      left_value,
+                                                    object_bool *      right_value) {
+    bool result;
+    switch (operator) {
+        case OPERATOR_AND:
+            result = left_value->value && right_value->value;
+            break;
+        case OPERATOR_OR:
+            result = left_value->value || right_value->value;
+            break;
+        case OPERATOR_EQ:
+            result = left_value->value == right_value->value;
+            break;
+        case OPERATOR_NOT_EQ:
+            result = left_value->value != right_value->value;
+            break;
+        default:
+            return unknown_infix_operator(operator, &left_value->object, &right_value->object);
     }
+    return (object_object *) object_create_bool(result);
+}
 
-    if (strcmp(operator, "==") == 0) {
-        if (strcmp(left_value->value, right_value->value) == 0)
-            return (object_object *) object_create_bool(true);
-        else
-            return (object_object *) object_create_bool(false);
+static object_object *eval_integer_infix_expression(const ast_operator operator,
+                                                    object_int *       left_value,
+                                                    object_int *       right_value) {
+    const long left  = left_value->value;
+    const long right = right_value->value;
+    switch (operator) {
+        case OPERATOR_PLUS:
+            return (object_object *) object_create_int(left + right);
+        case OPERATOR_MINUS:
+            return (object_object *) object_create_int(left - right);
+        case OPERATOR_ASTERISK:
+            return (object_object *) object_create_int(left * right);
+        case OPERATOR_SLASH:
+            if (right == 0)
+                return (object_object *) object_create_error("division by 0 not allowed");
+            return (object_object *) object_create_int(left / right);
+        case OPERATOR_PERCENT:
+            if (right == 0)
+                return (object_object *) object_create_error("division by 0 not allowed");
+            return (object_object *) object_create_int(left % right);
+        case OPERATOR_LT:
+            return (object_object *) object_create_bool(left < right);
+        case OPERATOR_GT:
+            return (object_object *) object_create_bool(left > right);
+        case OPERATOR_EQ:
+            return (object_object *) object_create_bool(left == right);
+        case OPERATOR_NOT_EQ:
+            return (object_object *) object_create_bool(left != right);
+        default:
+            return unknown_infix_operator(operator, &left_value->object, &right_value->object);
     }
+}
 
-    if (strcmp(operator, "!=") == 0) {
-        if (strcmp(left_value->value, right_value->value) == 0)
-            return (object_object *) object_create_bool(false);
-        else
-            return (object_object *) object_create_bool(true);
+static object_object *eval_string_infix_expression(const ast_operator operator,
+                                                   object_string *    left_value,
+                                                   object_string *    right_value) {
+    switch (operator) {
+        case OPERATOR_PLUS:
+            return (object_object *) object_string_concat(left_value, right_value);
+        case OPERATOR_EQ:
+            return (object_object *) object_create_bool(object_equals(left_value, right_value));
+        case OPERATOR_NOT_EQ:
+            return (object_object *) object_create_bool(!object_equals(left_value, right_value));
+        default:
+            return unknown_infix_operator(operator, &left_value->object, &right_value->object);
     }
-
-    return (object_object *) object_create_error("unknown operator: %s %s %s",
-                                                 get_type_name(
-                                                         left_value->object.type),
-                                                 operator,
-                                                 get_type_name(
-                                                         right_value->object.type));
 }
 
 static object_object *eval_minus_prefix_expression(object_object *right_value) {
@@ -145,21 +119,34 @@ static object_object *eval_bang_expression(object_object *right_value) {
     return (object_object *) object_create_bool(false);
 }
 
-static object_object *eval_prefix_epxression(const char *operator, object_object *right_value) {
-    if (strcmp(operator, "!") == 0) {
-        return eval_bang_expression(right_value);
-    } else if (strcmp(operator, "-") == 0) {
-        return eval_minus_prefix_expression(right_value);
+static object_object *eval_prefix_epxression(const ast_operator operator, object_object *right_value) {
+    switch (operator) {
+        case OPERATOR_BANG:
+            return eval_bang_expression(right_value);
+        case OPERATOR_MINUS:
+            return eval_minus_prefix_expression(right_value);
+        default:
+            return (object_object *) object_create_error("unknown operator: %s%s",
+                                                         ast_get_operator_literal(operator),
+                                                         get_type_name(
+                                                                 right_value->type));
+    }
+}
+
+static object_object *eval_array_infix_expression(const ast_operator  operator,
+                                                  const object_array *left_value,
+                                                  const object_array *right_value) {
+    object_array *result = object_array_arithmetic(left_value, right_value, ast_get_operator_literal(operator)[0]);
+    if (result == NULL) {
+        return (object_object *) object_create_error("operator %s requires integer arrays of equal length",
+                                                     ast_get_operator_literal(operator));
     }
-    return (object_object *) object_create_error("unknown operator: %s%s",
-                                                 operator,
-                                                 get_type_name(
-                                                         right_value->type));
+    return (object_object *) result;
 }
 
-static object_object *eval_infix_expression(const char *   operator,
-                                            object_object *left_value,
-                                            object_object *right_value) {
+static object_object *eval_infix_expression(const ast_operator operator,
+                                            object_object *    left_value,
+                                            object_object *    right_value) {
     if (left_value->type == OBJECT_INT && right_value->type == OBJECT_INT)
         return eval_integer_infix_expression(operator,
                                              (object_int *) left_value,
@@ -172,26 +159,25 @@ static object_object *eval_infix_expression(const char *   operator,
         return eval_boolean_infix_expression(operator,
                                              (object_bool *) left_value,
                                              (object_bool *) right_value);
-    if (strcmp(operator, "==") == 0)
+    if (left_value->type == OBJECT_ARRAY && right_value->type == OBJECT_ARRAY &&
+        (operator == OPERATOR_PLUS || operator == OPERATOR_MINUS || operator == OPERATOR_ASTERISK))
+        return eval_array_infix_expression(operator,
+                                           (object_array *) left_value,
+                                           (object_array *) right_value);
+    if (operator == OPERATOR_EQ)
         return (object_object *)
                 object_create_bool(left_value == right_value);
-    if (strcmp(operator, "!=") == 0)
+    if (operator == OPERATOR_NOT_EQ)
         return (object_object *)
                 object_create_bool(left_value != right_value);
     if (left_value->type != right_value->type)
         return (object_object *) object_create_error("type mismatch: %s %s %s",
                                                      get_type_name(
                                                              left_value->type),
-                                                     operator,
-                                                     get_type_name(
-                                                             right_value->type));
-    else
-        return (object_object *) object_create_error("unknown operator: %s %s %s",
-                                                     get_type_name(
-                                                             left_value->type),
-                                                     operator,
+                                                     ast_get_operator_literal(operator),
                                                      get_type_name(
                                                              right_value->type));
+    return unknown_infix_operator(operator, left_value, right_value);
 }
 
 static bool is_truthy(object_object *value) {
@@ -315,24 +301,22 @@ static object_object *eval_array_index_expression(object_object *left_value,
     const object_array *array_obj = (object_array *) left_value;
     const object_int *  index_obj = (object_int *) index_value;
 
-    if (index_obj->value < 0 || index_obj->value >= array_obj->elements->size) {
+    if (index_obj->value < 0 || (size_t) index_obj->value >= object_array_length(array_obj)) {
         return (object_object *) object_create_null();
     }
 
     // Return a reference instead of copying the object
-    object_object *result = array_obj->elements->body[index_obj->value];
-    result->refcount++; // Increment refcount for the reference
-    return result;
+    return object_array_get(array_obj, index_obj->value);
 }
 
 static object_object *eval_string_index_expression(object_object *left_value,
                                                    object_object *index_value) {
-    const object_string *string = (object_string *) left_value;
-    const object_int *   index  = (object_int *) index_value;
+    object_string *   string = (object_string *) left_value;
+    const object_int *index  = (object_int *) index_value;
     if (index->value < 0 || index->value > string->length - 1) {
         return (object_object *) object_create_null();
     }
-    return (object_object *) object_create_string(&string->value[index->value], 1);
+    return (object_object *) object_string_slice(string, index->value, 1);
 }
 
 static object_object *eval_hash_index_expression(object_object *left_value,
@@ -344,7 +328,7 @@ static object_object *eval_hash_index_expression(object_object *left_value,
                                                      get_type_name(
                                                              index_value->type));
     }
-    return object_copy_object(hashtable_get(hash_obj->pairs, index_value));
+    return object_copy_object(object_hash_get(hash_obj, index_value));
 }
 
 static object_object *eval_index_expression(object_object *left_value,
@@ -400,7 +384,7 @@ static object_object *eval_array_literal(const ast_array_literal *array_exp, env
         arraylist_add(elements, value);
     }
 
-    return (object_object *) object_create_array(elements);
+    return (object_object *) object_pack_array(elements);
 }
 
 static object_object *eval_hash_literal(const ast_hash_literal *hash_exp, environment *env) {
@@ -605,7 +589,7 @@ static object_object *eval_statement(ast_statement *statement, environment *env)
                 return evaluated;
             }
             object_return_value *ret_val = object_create_return_value(evaluated);
-            free(evaluated);
+            object_free(evaluated);
             return (object_object *) ret_val;
         case LET_STATEMENT:
             let_stmt = (ast_let_statement *) statement;
@@ -0,0 +1,401 @@
+//
+// Created by dgood on 1/23/25.
+//
+
+#include "ir.h"
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define UNVISITED SIZE_MAX
+
+static void *grow(void *array, size_t *capacity, const size_t size) {
+    *capacity = *capacity ? *capacity * 2 : 8;
+    array     = reallocarray(array, *capacity, size);
+    if (array == NULL) {
+        err(EXIT_FAILURE, "malloc failed");
+    }
+    return array;
+}
+
+ir_function *ir_function_init(const bool is_program) {
+    ir_function *fn = calloc(1, sizeof(*fn));
+    if (fn == NULL) {
+        err(EXIT_FAILURE, "malloc failed");
+    }
+    fn->is_program = is_program;
+    ir_add_block(fn);
+    return fn;
+}
+
+void ir_function_free(ir_function *fn) {
+    for (size_t i = 0; i < fn->value_count; i++) {
+        ir_instruction *in = &fn->values[i];
+        if (in->constant != NULL)
+            object_free(in->constant);
+        free(in->operands);
+        free(in->incoming);
+    }
+    for (size_t i = 0; i < fn->block_count; i++)
+        free(fn->blocks[i].instructions);
+    free(fn->values);
+    free(fn->blocks);
+    free(fn);
+}
+
+size_t ir_add_block(ir_function *fn) {
+    if (fn->block_count == fn->block_capacity)
+        fn->blocks = grow(fn->blocks, &fn->block_capacity, sizeof(*fn->blocks));
+    fn->blocks[fn->block_count] = (ir_block){.terminator = IR_END, .value = IR_NONE, .reachable = true};
+    return fn->block_count++;
+}
+
+/**
+ * Add an instruction at the end of `block`. The instructions may move, so pointers
+ * into them are only good until the next one is added.
+ */
+ir_value ir_append(ir_function *fn, const size_t block, const ir_op op) {
+    if (fn->value_count == fn->value_capacity)
+        fn->values = grow(fn->values, &fn->value_capacity, sizeof(*fn->values));
+    const ir_value v = fn->value_count++;
+    fn->values[v]    = (ir_instruction){.op = op, .block = block, .copy_of = IR_NONE};
+
+    ir_block *b = &fn->blocks[block];
+    if (b->count == b->capacity)
+        b->instructions = grow(b->instructions, &b->capacity, sizeof(*b->instructions));
+    fn->values[v].position      = b->count;
+    b->instructions[b->count++] = v;
+    return v;
+}
+
+void ir_add_operand(ir_function *fn, const ir_value v, const ir_value operand) {
+    ir_instruction *in = &fn->values[v];
+    if (in->operand_count == in->operand_capacity) {
+        in->operands = grow(in->operands, &in->operand_capacity, sizeof(*in->operands));
+        if (in->op == IR_PHI) {
+            in->incoming = reallocarray(in->incoming, in->operand_capacity, sizeof(*in->incoming));
+            if (in->incoming == NULL) {
+                err(EXIT_FAILURE, "malloc failed");
+            }
+        }
+    }
+    in->operands[in->operand_count++] = operand;
+}
+
+/** Add the value a phi takes when control comes from `block`. */
+void ir_add_incoming(ir_function *fn, const ir_value phi, const size_t block, const ir_value value) {
+    ir_add_operand(fn, phi, value);
+    fn->values[phi].incoming[fn->values[phi].operand_count - 1] = block;
+}
+
+/**
+ * Remove a value along with everything computed only for it. Each value has at most
+ * one use, so its operands go with it.
+ */
+void ir_remove_tree(ir_function *fn, const ir_value v) {
+    ir_instruction *in = &fn->values[v];
+    if (in->removed)
+        return;
+    in->removed = true;
+    for (size_t i = 0; i < in->operand_count; i++)
+        ir_remove_tree(fn, in->operands[i]);
+}
+
+static size_t successor_count(const ir_block *block) {
+    switch (block->terminator) {
+        case IR_JUMP:
+            return 1;
+        case IR_BRANCH:
+            return 2;
+        default:
+            return 0;
+    }
+}
+
+static bool is_successor(const ir_block *block, const size_t successor) {
+    for (size_t i = 0; i < successor_count(block); i++) {
+        if (block->successors[i] == successor)
+            return true;
+    }
+    return false;
+}
+
+/** The blocks reachable from the entry, in postorder. Returns how many there are. */
+static size_t postorder(const ir_function *fn, size_t *order) {
+    bool *  visited = calloc(fn->block_count, sizeof(*visited));
+    size_t *stack   = malloc(fn->block_count * sizeof(*stack));
+    size_t *next    = calloc(fn->block_count, sizeof(*next));
+    if (visited == NULL || stack == NULL || next == NULL) {
+        err(EXIT_FAILURE, "malloc failed");
+    }
+    size_t count = 0, depth = 0;
+    stack[depth++] = 0;
+    visited[0]     = true;
+    while (depth > 0) {
+        const size_t    b     = stack[depth - 1];
+        const ir_block *block = &fn->blocks[b];
+        if (next[b] < successor_count(block)) {
+            const size_t s = block->successors[next[b]++];
+            if (!visited[s]) {
+                visited[s]     = true;
+                stack[depth++] = s;
+            }
+            continue;
+        }
+        order[count++] = b;
+        depth--;
+    }
+    free(visited);
+    free(stack);
+    free(next);
+    return count;
+}
+
+static size_t intersect(const ir_function *fn, size_t a, size_t b) {
+    while (a != b) {
+        while (fn->blocks[a].order > fn->blocks[b].order)
+            a = fn->blocks[a].idom;
+        while (fn->blocks[b].order > fn->blocks[a].order)
+            b = fn->blocks[b].idom;
+    }
+    return a;
+}
+
+/**
+ * Work out which blocks are reachable, their reverse postorder and their immediate
+ * dominators, and where each instruction sits in its block. Dominators are found with
+ * the iterative algorithm of Cooper, Harvey and Kennedy.
+ */
+void ir_analyze(ir_function *fn) {
+    size_t *post = malloc(fn->block_count * sizeof(*post));
+    if (post == NULL) {
+        err(EXIT_FAILURE, "malloc failed");
+    }
+    const size_t count = postorder(fn, post);
+    for (size_t b = 0; b < fn->block_count; b++) {
+        fn->blocks[b].reachable = false;
+        fn->blocks[b].order     = UNVISITED;
+        fn->blocks[b].idom      = UNVISITED;
+        for (size_t i = 0; i < fn->blocks[b].count; i++)
+            fn->values[fn->blocks[b].instructions[i]].position = i;
+    }
+    for (size_t i = 0; i < count; i++) {
+        fn->blocks[post[i]].reachable = true;
+        fn->blocks[post[i]].order     = count - 1 - i;
+    }
+
+    // predecessors of each block, packed one block after another
+    size_t *first = calloc(fn->block_count + 1, sizeof(*first));
+    size_t *preds = malloc((2 * fn->block_count + 1) * sizeof(*preds));
+    if (first == NULL || preds == NULL) {
+        err(EXIT_FAILURE, "malloc failed");
+    }
+    for (size_t b = 0; b < fn->block_count; b++) {
+        for (size_t i = 0; fn->blocks[b].reachable && i < successor_count(&fn->blocks[b]); i++)
+            first[fn->blocks[b].successors[i] + 1]++;
+    }
+    for (size_t b = 0; b < fn->block_count; b++)
+        first[b + 1] += first[b];
+    size_t *filled = calloc(fn->block_count, sizeof(*filled));
+    if (filled == NULL) {
+        err(EXIT_FAILURE, "malloc failed");
+    }
+    for (size_t b = 0; b < fn->block_count; b++) {
+        for (size_t i = 0; fn->blocks[b].reachable && i < successor_count(&fn->blocks[b]); i++) {
+            const size_t s = fn->blocks[b].successors[i];
+            preds[first[s] + filled[s]++] = b;
+        }
+    }
+
+    fn->blocks[0].idom = 0;
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (size_t i = count - 1; i-- > 0;) {
+            const size_t b    = post[i];
+            size_t       idom = UNVISITED;
+            for (size_t j = first[b]; j < first[b + 1]; j++) {
+                if (fn->blocks[preds[j]].idom != UNVISITED)
+                    idom = idom == UNVISITED ? preds[j] : intersect(fn, preds[j], idom);
+            }
+            if (idom != fn->blocks[b].idom) {
+                fn->blocks[b].idom = idom;
+                changed            = true;
+            }
+        }
+    }
+    free(first);
+    free(preds);
+    free(filled);
+    free(post);
+}
+
+static bool block_dominates(const ir_function *fn, const size_t a, size_t b) {
+    if (!fn->blocks[a].reachable || !fn->blocks[b].reachable)
+        return false;
+    while (b != a) {
+        if (b == 0)
+            return false;
+        b = fn->blocks[b].idom;
+    }
+    return true;
+}
+
+/** Whether `a` runs before `b` on every path to `b`, as of the last ir_analyze. */
+bool ir_dominates(const ir_function *fn, const ir_value a, const ir_value b) {
+    const ir_instruction *first  = &fn->values[a];
+    const ir_instruction *second = &fn->values[b];
+    if (first->block == second->block)
+        return first->position < second->position;
+    return block_dominates(fn, first->block, second->block);
+}
+
+/** Whether every path through the function that leaves it goes through `block`, as of the last ir_analyze. */
+bool ir_always_runs(const ir_function *fn, const size_t block) {
+    for (size_t b = 0; b < fn->block_count; b++) {
+        const ir_terminator terminator = fn->blocks[b].terminator;
+        if (fn->blocks[b].reachable && terminator != IR_JUMP && terminator != IR_BRANCH &&
+            !block_dominates(fn, block, b))
+            return false;
+    }
+    return fn->blocks[block].reachable;
+}
+
+/** How many times each value is used, by instructions that are left and by terminators. */
+size_t *ir_count_uses(const ir_function *fn) {
+    size_t *uses = calloc(fn->value_count + 1, sizeof(*uses));
+    if (uses == NULL) {
+        err(EXIT_FAILURE, "malloc failed");
+    }
+    for (size_t v = 0; v < fn->value_count; v++) {
+        const ir_instruction *in = &fn->values[v];
+        if (in->removed)
+            continue;
+        for (size_t i = 0; i < in->operand_count; i++)
+            uses[in->operands[i]]++;
+    }
+    for (size_t b = 0; b < fn->block_count; b++) {
+        const ir_block *block = &fn->blocks[b];
+        if (block->reachable && (block->terminator == IR_BRANCH || block->terminator == IR_RETURN))
+            uses[block->value]++;
+    }
+    return uses;
+}
+
+/**
+ * Remove the blocks control can no longer reach, and the values phis would have taken
+ * from them. Leaves the function analyzed.
+ */
+bool ir_remove_unreachable(ir_function *fn) {
+    ir_analyze(fn);
+    bool changed = false;
+    for (size_t b = 0; b < fn->block_count; b++) {
+        ir_block *block = &fn->blocks[b];
+        if (block->reachable || (block->count == 0 && block->terminator == IR_END))
+            continue;
+        for (size_t i = 0; i < block->count; i++)
+            fn->values[block->instructions[i]].removed = true;
+        block->count      = 0;
+        block->terminator = IR_END;
+        block->value      = IR_NONE;
+        changed           = true;
+    }
+    for (size_t v = 0; v < fn->value_count; v++) {
+        ir_instruction *in = &fn->values[v];
+        if (in->removed || in->op != IR_PHI)
+            continue;
+        size_t kept = 0;
+        for (size_t i = 0; i < in->operand_count; i++) {
+            const ir_block *from = &fn->blocks[in->incoming[i]];
+            if (from->reachable && is_successor(from, in->block)) {
+                in->operands[kept]   = in->operands[i];
+                in->incoming[kept++] = in->incoming[i];
+            } else {
+                ir_remove_tree(fn, in->operands[i]);
+                changed = true;
+            }
+        }
+        in->operand_count = kept;
+    }
+    return changed;
+}
+
+static const char *op_names[] = {
+        "const", "load", "store", "binary", "unary", "array", "hash", "index", "call", "closure", "phi", "pop",
+};
+
+static void print_instruction(FILE *out, const ir_function *fn, const ir_value v) {
+    const ir_instruction *in = &fn->values[v];
+    if (in->op != IR_STORE && in->op != IR_POP)
+        fprintf(out, "  %%%u = %s", v, op_names[in->op]);
+    else
+        fprintf(out, "  %s", op_names[in->op]);
+    switch (in->op) {
+        case IR_CONST:
+            char *s = in->constant->inspect(in->constant);
+            fprintf(out, " %s", s);
+            free(s);
+            break;
+        case IR_LOAD:
+        case IR_STORE:
+            fprintf(out, " %s %zu", get_scope_name(in->scope), in->index);
+            break;
+        case IR_BINARY:
+        case IR_UNARY:
+            fprintf(out, " %s", opcode_definition_lookup(in->opcode)->name);
+            break;
+        case IR_CLOSURE:
+            fprintf(out, " %zu", in->index);
+            break;
+        default:
+            break;
+    }
+    for (size_t i = 0; i < in->operand_count; i++) {
+        if (in->op == IR_PHI)
+            fprintf(out, " [%%%u block %zu]", in->operands[i], in->incoming[i]);
+        else
+            fprintf(out, " %%%u", in->operands[i]);
+    }
+    fprintf(out, "\n");
+}
+
+/** The function's reachable blocks in a readable form, for tests and debugging. */
+char *ir_function_to_string(const ir_function *fn) {
+    char * string = nullptr;
+    size_t length = 0;
+    FILE * out    = open_memstream(&string, &length);
+    if (out == NULL) {
+        err(EXIT_FAILURE, "malloc failed");
+    }
+    for (size_t b = 0; b < fn->block_count; b++) {
+        const ir_block *block = &fn->blocks[b];
+        if (!block->reachable)
+            continue;
+        fprintf(out, "block %zu:\n", b);
+        for (size_t i = 0; i < block->count; i++) {
+            if (!fn->values[block->instructions[i]].removed)
+                print_instruction(out, fn, block->instructions[i]);
+        }
+        switch (block->terminator) {
+            case IR_END:
+                fprintf(out, "  end\n");
+                break;
+            case IR_JUMP:
+                fprintf(out, "  jump block %zu\n", block->successors[0]);
+                break;
+            case IR_BRANCH:
+                fprintf(out, "  branch %%%u block %zu block %zu\n", block->value, block->successors[0],
+                        block->successors[1]);
+                break;
+            case IR_RETURN:
+                fprintf(out, "  return %%%u\n", block->value);
+                break;
+            case IR_RETURN_NONE:
+                fprintf(out, "  return\n");
+                break;
+        }
+    }
+    fclose(out);
+    return string;
+}
@@ -0,0 +1,179 @@
+//
+// Created by dgood on 1/23/25.
+//
+
+#ifndef IR_H
+#define IR_H
+
+#include <stdint.h>
+#include "../compiler/compiler_core.h"
+
+/**
+ * A mid level representation of one function, between the AST and the bytecode: a
+ * control flow graph of basic blocks whose instructions are values in SSA form, each
+ * one defined exactly once and referred to by its index.
+ *
+ * Variables live in the same slots the bytecode uses and are read and written by
+ * IR_LOAD and IR_STORE. Every let gets a slot of its own, so a slot is only ever
+ * stored to once, and a load that the store dominates always sees the stored value.
+ *
+ * The builder emits each expression's operands right before the instruction using
+ * them, and every value is used at most once, in that order. The passes rewrite
+ * instructions in place and only ever remove uses, so lowering can keep each value on
+ * the VM's stack from where it is defined to where it is used.
+ */
+
+#define IR_NONE UINT32_MAX
+
+typedef uint32_t ir_value;
+
+typedef enum : uint8_t {
+    IR_CONST,   // `constant`
+    IR_LOAD,    // the variable in `scope` and `index`
+    IR_STORE,   // operand 0 into the variable in `scope` and `index`
+    IR_BINARY,  // `opcode` applied to operands 0 and 1
+    IR_UNARY,   // `opcode` applied to operand 0
+    IR_ARRAY,   // an array of the operands
+    IR_HASH,    // a hash of the operands, as key, value pairs
+    IR_INDEX,   // operand 0 indexed by operand 1
+    IR_CALL,    // operand 0 called with the rest as arguments
+    IR_CLOSURE, // a closure over the function in constant `index` capturing the operands
+    IR_PHI,     // operand i when control came from `incoming[i]`
+    IR_POP,     // operand 0 is thrown away
+} ir_op;
+
+/** What type inference found out about a value. IR_TYPE_ANY is anything at all. */
+typedef enum : uint8_t {
+    IR_TYPE_ANY,
+    IR_TYPE_INT,
+    IR_TYPE_BOOL,
+    IR_TYPE_STRING,
+    IR_TYPE_NULL,
+    IR_TYPE_ARRAY,
+    IR_TYPE_HASH,
+    IR_TYPE_FUNCTION,
+} ir_type;
+
+typedef struct {
+    ir_op          op;
+    Opcode         opcode;
+    ir_type        type;
+    bool           removed;
+    symbol_scope   scope;
+    size_t         index;
+    object_object *constant; // owned
+    size_t         block;
+    size_t         position; // within its block, as of the last ir_analyze
+    ir_value *     operands;
+    size_t *       incoming;
+    size_t         operand_count;
+    size_t         operand_capacity;
+    ir_value       copy_of; // the value a load was found to always see, or IR_NONE
+} ir_instruction;
+
+typedef enum : uint8_t {
+    IR_END,         // falls off the end of the program
+    IR_JUMP,        // to successors[0]
+    IR_BRANCH,      // to successors[0] if `value` is truthy, to successors[1] otherwise
+    IR_RETURN,      // `value` from the function
+    IR_RETURN_NONE, // null from the function
+} ir_terminator;
+
+typedef struct {
+    ir_value *    instructions;
+    size_t        count;
+    size_t        capacity;
+    ir_terminator terminator;
+    ir_value      value;
+    size_t        successors[2];
+    bool          reachable;
+    size_t        idom; // immediate dominator, the entry block dominates itself
+    size_t        order; // position in reverse postorder
+} ir_block;
+
+typedef struct {
+    ir_instruction *values;
+    size_t          value_count;
+    size_t          value_capacity;
+    ir_block *      blocks;
+    size_t          block_count;
+    size_t          block_capacity;
+    bool            is_program; // the top level, where popped values are seen by the caller
+} ir_function;
+
+ir_function *ir_function_init(bool);
+
+void ir_function_free(ir_function *);
+
+size_t ir_add_block(ir_function *);
+
+ir_value ir_append(ir_function *, size_t, ir_op);
+
+void ir_add_operand(ir_function *, ir_value, ir_value);
+
+void ir_add_incoming(ir_function *, ir_value, size_t, ir_value);
+
+void ir_remove_tree(ir_function *, ir_value);
+
+void ir_analyze(ir_function *);
+
+bool ir_dominates(const ir_function *, ir_value, ir_value);
+
+bool ir_always_runs(const ir_function *, size_t);
+
+size_t *ir_count_uses(const ir_function *);
+
+bool ir_remove_unreachable(ir_function *);
+
+char *ir_function_to_string(const ir_function *);
+
+/*** passes ***/
+
+typedef struct {
+    const char *name;
+    bool (*run)(ir_function *);
+} ir_pass;
+
+bool ir_copy_propagation(ir_function *);
+
+bool ir_type_inference(ir_function *);
+
+bool ir_constant_folding(ir_function *);
+
+bool ir_common_subexpressions(ir_function *);
+
+bool ir_dead_code(ir_function *);
+
+void ir_run_passes(ir_function *, const ir_pass *, size_t);
+
+void ir_optimize(ir_function *);
+
+/*** inlining ***/
+
+typedef struct ir_inline_function ir_inline_function;
+
+bool ir_can_inline(const symbol *, ir_function *, arraylist *);
+
+bool ir_remember_function(compiler *, const symbol *, ir_function *, size_t, size_t, arraylist *);
+
+void ir_forget_functions(const compiler *, const symbol_table *);
+
+const ir_inline_function *ir_find_inline(const compiler *, const symbol *, size_t);
+
+ir_value ir_inline(compiler *, ir_function *, size_t *, const ir_inline_function *, const ir_value *);
+
+/*** escape analysis ***/
+
+bool ir_is_called_only(const ast_block_statement *, const ast_let_statement *);
+
+void ir_pass_captured_as_arguments(ir_function *, size_t, size_t);
+
+/*** building and lowering ***/
+
+compiler_error ir_build_program(compiler *, ast_node *, ir_function **);
+
+bool ir_lower(compiler *, const ir_function *);
+
+compiler_error compile_optimized(compiler *, ast_node *);
+
+#endif //IR_H
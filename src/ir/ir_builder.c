@@ -0,0 +1,649 @@
+//
+// Created by dgood on 1/23/25.
+//
+
+#include "ir.h"
+
+#include <err.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../compiler/compiler_utils.h"
+#include "../compiler/constant_folding.h"
+#include "../compiler/instructions.h"
+#include "../compiler/node_compiler.h"
+#include "../compiler/scope.h"
+
+typedef struct {
+    compiler *                 compiler;
+    ir_function *              fn;
+    size_t                     block;     // where instructions are added
+    const ast_block_statement *body;      // of the function being built, NULL for the program
+    arraylist *                converted; // of converted_function
+    size_t                     branches;  // if branches the block is in, whose lets may not run
+} ir_builder;
+
+/**
+ * A function bound by a let in the function being built, which is only ever called and
+ * so takes the variables it would have captured as arguments after its own.
+ */
+typedef struct {
+    size_t         index;        // of the let's local
+    object_object *closure;      // capturing nothing
+    arraylist *    free_symbols; // what to pass
+} converted_function;
+
+static void converted_function_free(void *f) {
+    converted_function *function = f;
+    object_free(function->closure);
+    arraylist_destroy(function->free_symbols);
+    free(function);
+}
+
+static compiler_error build_statement(ir_builder *, ast_statement *);
+
+static compiler_error build_expression(ir_builder *, ast_expression *, ir_value *);
+
+/*** what the IR can represent ***/
+
+static bool supports_expression(ast_expression *);
+
+static bool supports_block(const ast_block_statement *block) {
+    for (size_t i = 0; i < block->statement_count; i++) {
+        ast_statement *statement = block->statements[i];
+        switch (statement->statement_type) {
+            case LET_STATEMENT:
+                if (!supports_expression(((ast_let_statement *) statement)->value))
+                    return false;
+                break;
+            case RETURN_STATEMENT:
+                if (!supports_expression(((ast_return_statement *) statement)->return_value))
+                    return false;
+                break;
+            case EXPRESSION_STATEMENT:
+                if (!supports_expression(((ast_expression_statement *) statement)->expression))
+                    return false;
+                break;
+            case BLOCK_STATEMENT:
+                if (!supports_block((ast_block_statement *) statement))
+                    return false;
+                break;
+        }
+    }
+    return true;
+}
+
+/**
+ * An if's branch leaves its value behind for the if when it ends in an expression, or
+ * leaves the function when it ends in a return. One that is empty or ends in a let gives
+ * null. A nested block at the end passes on the value of whatever it ends in, which is
+ * only matched by compiling the AST directly.
+ */
+static bool supports_branch(const ast_block_statement *block) {
+    if (block->statement_count == 0)
+        return true;
+    const ast_statement_type last = block->statements[block->statement_count - 1]->statement_type;
+    return last != BLOCK_STATEMENT && supports_block(block);
+}
+
+static bool supports_expression(ast_expression *expression) {
+    ast_if_expression *if_exp;
+    arraylist *        keys;
+    bool               supported = true;
+    switch (expression->expression_type) {
+        case IDENTIFIER_EXPRESSION:
+        case INTEGER_EXPRESSION:
+        case STRING_EXPRESSION:
+        case BOOLEAN_EXPRESSION:
+            return true;
+        case PREFIX_EXPRESSION:
+            return supports_expression(((ast_prefix_expression *) expression)->right);
+        case INFIX_EXPRESSION:
+            // && and || jump around their right operand, which is left to the AST compiler
+            return infix_opcodes[((ast_infix_expression *) expression)->operator].defined &&
+                   supports_expression(((ast_infix_expression *) expression)->left) &&
+                   supports_expression(((ast_infix_expression *) expression)->right);
+        case IF_EXPRESSION:
+            if_exp = (ast_if_expression *) expression;
+            return supports_expression(if_exp->condition) && supports_branch(if_exp->consequence) &&
+                   (if_exp->alternative == NULL || supports_branch(if_exp->alternative));
+        case FUNCTION_LITERAL:
+            return supports_block(((ast_function_literal *) expression)->body);
+        case CALL_EXPRESSION:
+            if (!supports_expression(((ast_call_expression *) expression)->function))
+                return false;
+            for (const list_node *arg = ((ast_call_expression *) expression)->arguments->head; arg != NULL;
+                 arg = arg->next) {
+                if (!supports_expression(arg->data))
+                    return false;
+            }
+            return true;
+        case ARRAY_LITERAL:
+            for (size_t i = 0; i < ((ast_array_literal *) expression)->elements->size; i++) {
+                if (!supports_expression(arraylist_get(((ast_array_literal *) expression)->elements, i)))
+                    return false;
+            }
+            return true;
+        case INDEX_EXPRESSION:
+            return supports_expression(((ast_index_expression *) expression)->left) &&
+                   supports_expression(((ast_index_expression *) expression)->index);
+        case HASH_LITERAL:
+            keys = hashtable_get_keys(((ast_hash_literal *) expression)->pairs);
+            for (size_t i = 0; keys != NULL && i < keys->size && supported; i++) {
+                ast_expression *key = arraylist_get(keys, i);
+                supported = supports_expression(key) &&
+                            supports_expression(hashtable_get(((ast_hash_literal *) expression)->pairs, key));
+            }
+            if (keys != NULL)
+                arraylist_destroy(keys);
+            return supported;
+        default:
+            return false;
+    }
+}
+
+static bool supports_node(ast_node *node) {
+    switch (node->type) {
+        case PROGRAM:
+            for (size_t i = 0; i < ((ast_program *) node)->statement_count; i++) {
+                if (!supports_node((ast_node *) ((ast_program *) node)->statements[i]))
+                    return false;
+            }
+            return true;
+        case STATEMENT:
+            return supports_block(&(ast_block_statement){.statements = (ast_statement *[]){(ast_statement *) node},
+                                                         .statement_count = 1});
+        default:
+            return false;
+    }
+}
+
+/*** building ***/
+
+static ir_value append(const ir_builder *b, const ir_op op) { return ir_append(b->fn, b->block, op); }
+
+static ir_value append_constant(const ir_builder *b, object_object *constant) {
+    const ir_value v          = append(b, IR_CONST);
+    b->fn->values[v].constant = constant;
+    return v;
+}
+
+static ir_value append_unary(const ir_builder *b, const ir_op op, const ir_value operand) {
+    const ir_value v = append(b, op);
+    ir_add_operand(b->fn, v, operand);
+    return v;
+}
+
+static ir_value append_load(const ir_builder *b, const symbol *sym) {
+    object_object *constant = fold_global_value(b->compiler, sym);
+    if (constant != NULL)
+        return append_constant(b, object_copy_object(constant));
+    const ir_value v       = append(b, IR_LOAD);
+    b->fn->values[v].scope = sym->scope;
+    b->fn->values[v].index = sym->index;
+    return v;
+}
+
+static void terminate(const ir_builder *b, const ir_terminator terminator, const ir_value value) {
+    b->fn->blocks[b->block].terminator = terminator;
+    b->fn->blocks[b->block].value      = value;
+}
+
+static compiler_error unknown_operator(const ast_operator operator) {
+    return (compiler_error){COMPILER_UNKNOWN_OPERATOR,
+                            get_err_msg("Unknown operator %s", ast_get_operator_literal(operator))};
+}
+
+/**
+ * Build the statements of one of an if's branches. The value of the expression it ends
+ * in is left in `value` instead of being popped, null if it is empty or ends in a let,
+ * or IR_NONE if it ends in a return.
+ */
+static compiler_error build_branch(ir_builder *b, const ast_block_statement *block, ir_value *value) {
+    compiler_error error = {COMPILER_ERROR_NONE, nullptr};
+    b->branches++;
+    for (size_t i = 0; i + 1 < block->statement_count && error.error_code == COMPILER_ERROR_NONE; i++)
+        error = build_statement(b, block->statements[i]);
+    ast_statement *last = block->statement_count > 0 ? block->statements[block->statement_count - 1] : nullptr;
+    *value              = IR_NONE;
+    if (error.error_code == COMPILER_ERROR_NONE && last != NULL && last->statement_type == EXPRESSION_STATEMENT)
+        error = build_expression(b, ((ast_expression_statement *) last)->expression, value);
+    else if (error.error_code == COMPILER_ERROR_NONE && last != NULL)
+        error = build_statement(b, last);
+    if (error.error_code == COMPILER_ERROR_NONE && (last == NULL || last->statement_type == LET_STATEMENT))
+        *value = append_constant(b, (object_object *) object_create_null());
+    b->branches--;
+    return error;
+}
+
+/**
+ * The branches of an if become blocks of their own, which jump to a block after them
+ * whose phi takes the if's value from whichever branch ran. A branch without an else
+ * gives null.
+ */
+static compiler_error build_if(ir_builder *b, const ast_if_expression *if_exp, ir_value *value) {
+    ir_value       condition;
+    compiler_error error = build_expression(b, if_exp->condition, &condition);
+    if (error.error_code != COMPILER_ERROR_NONE)
+        return error;
+    const size_t branch_block = b->block;
+
+    ir_value     consequence;
+    const size_t consequence_block = b->block = ir_add_block(b->fn);
+    error                                     = build_branch(b, if_exp->consequence, &consequence);
+    if (error.error_code != COMPILER_ERROR_NONE)
+        return error;
+    const size_t consequence_end = b->block;
+
+    ir_value     alternative;
+    const size_t alternative_block = b->block = ir_add_block(b->fn);
+    if (if_exp->alternative == NULL) {
+        alternative = append_constant(b, (object_object *) object_create_null());
+    } else {
+        error = build_branch(b, if_exp->alternative, &alternative);
+        if (error.error_code != COMPILER_ERROR_NONE)
+            return error;
+    }
+    const size_t alternative_end = b->block;
+
+    const size_t join = ir_add_block(b->fn);
+    ir_block *   from = &b->fn->blocks[branch_block];
+    from->terminator  = IR_BRANCH;
+    from->value       = condition;
+    from->successors[0] = consequence_block;
+    from->successors[1] = alternative_block;
+
+    b->block = join;
+    *value   = append(b, IR_PHI);
+    if (consequence != IR_NONE) {
+        b->fn->blocks[consequence_end].terminator    = IR_JUMP;
+        b->fn->blocks[consequence_end].successors[0] = join;
+        ir_add_incoming(b->fn, *value, consequence_end, consequence);
+    }
+    if (alternative != IR_NONE) {
+        b->fn->blocks[alternative_end].terminator    = IR_JUMP;
+        b->fn->blocks[alternative_end].successors[0] = join;
+        ir_add_incoming(b->fn, *value, alternative_end, alternative);
+    }
+    return error;
+}
+
+/**
+ * A function body is built, optimized and lowered in a scope of its own, the same one
+ * compile_expression_node would use, and becomes a closure over the outer variables it
+ * uses. If lowering fails the body is compiled from the AST instead. The optimized body
+ * of a function bound by a let is kept for inlining calls through `binding`.
+ *
+ * Inside a function, a closure that captures nothing is made once, as a constant. So is
+ * one that is `called_only`, which is converted to take what it captures as arguments
+ * instead, unless it is going to be inlined anyway.
+ */
+static compiler_error build_function(ir_builder *b, const ast_function_literal *func_exp, const symbol *binding,
+                                     const bool called_only, ir_value *value) {
+    compiler *compiler = b->compiler;
+    compiler_enter_scope(compiler);
+    if (func_exp->name != NULL)
+        symbol_define_function(compiler->symbol_table, func_exp->name);
+    for (const list_node *param = func_exp->parameters->head; param != NULL; param = param->next)
+        symbol_define(compiler->symbol_table, ((ast_identifier *) param->data)->value);
+
+    ir_builder     body  = {compiler, ir_function_init(false), 0, func_exp->body, nullptr, 0};
+    compiler_error error = build_statement(&body, (ast_statement *) func_exp->body);
+    if (body.converted != NULL)
+        arraylist_destroy(body.converted);
+    if (error.error_code != COMPILER_ERROR_NONE) {
+        ir_function_free(body.fn);
+        return error;
+    }
+    // like the bytecode, the value of a trailing expression is returned
+    ir_block *last = &body.fn->blocks[body.block];
+    if (last->count > 0 && body.fn->values[last->instructions[last->count - 1]].op == IR_POP) {
+        ir_instruction *pop = &body.fn->values[last->instructions[--last->count]];
+        pop->removed        = true;
+        terminate(&body, IR_RETURN, pop->operands[0]);
+    } else {
+        terminate(&body, IR_RETURN_NONE, IR_NONE);
+    }
+    ir_optimize(body.fn);
+
+    arraylist *  free_symbols    = arraylist_clone(compiler->symbol_table->free_symbols, _copy_symbol, symbol_free);
+    const size_t parameter_count = func_exp->parameters->size;
+    size_t       num_locals      = compiler->symbol_table->symbol_count;
+    size_t       free_count      = free_symbols->size;
+    // the captured variables become locals as well, which have to fit in a symbol's index
+    bool convert = called_only && free_count > 0 && num_locals + free_count <= UINT16_MAX &&
+                   parameter_count + free_count <= UINT16_MAX && !ir_can_inline(binding, body.fn, free_symbols);
+    if (convert)
+        ir_pass_captured_as_arguments(body.fn, parameter_count, free_count);
+    const bool lowered = ir_lower(compiler, body.fn);
+    if (!lowered) {
+        convert = false;
+        compilation_scope *scope    = get_top_scope(compiler);
+        scope->instructions->length = 0;
+        scope->last_instruction     = (emitted_instruction){};
+        scope->prev_instruction     = (emitted_instruction){};
+        error                       = compile(compiler, (ast_node *) func_exp->body);
+        if (error.error_code != COMPILER_ERROR_NONE) {
+            ir_function_free(body.fn);
+            arraylist_destroy(free_symbols, symbol_free);
+            return error;
+        }
+        if (last_instruction_is(compiler, OP_POP))
+            replace_last_pop_with_return(compiler);
+        if (!last_instruction_is(compiler, OP_RETURN_VALUE))
+            emit(compiler, OP_RETURN, nullptr);
+        // compiling the AST defines the variables again
+        arraylist_destroy(free_symbols, symbol_free);
+        free_symbols = arraylist_clone(compiler->symbol_table->free_symbols, _copy_symbol, symbol_free);
+        num_locals   = compiler->symbol_table->symbol_count;
+        free_count   = free_symbols->size;
+    }
+    if (!convert && free_count > MAX_FREE_VARIABLES) {
+        ir_function_free(body.fn);
+        arraylist_destroy(free_symbols, symbol_free);
+        return operand_too_large(OP_CLOSURE, free_count);
+    }
+
+    ir_forget_functions(compiler, compiler->symbol_table);
+    instructions *ins = compiler_leave_scope(compiler);
+    if (convert)
+        num_locals += free_count;
+    object_compiled_fn *compiled_fn =
+            object_create_compiled_fn(ins, num_locals, parameter_count + (convert ? free_count : 0));
+    instructions_free(ins);
+
+    if (convert || (free_count == 0 && !b->fn->is_program)) {
+        object_object *closure = (object_object *) object_create_closure(compiled_fn, nullptr);
+        object_free(compiled_fn);
+        *value = append_constant(b, closure);
+        if (convert) {
+            converted_function *function = malloc(sizeof(*function));
+            if (function == NULL) {
+                err(EXIT_FAILURE, "malloc failed");
+            }
+            *function = (converted_function){binding->index, object_copy_object(closure), free_symbols};
+            if (b->converted == NULL)
+                b->converted = arraylist_create(4, converted_function_free);
+            arraylist_add(b->converted, function);
+            ir_function_free(body.fn);
+            return error;
+        }
+    } else {
+        ir_value *captured = malloc((free_count + 1) * sizeof(*captured));
+        if (captured == NULL) {
+            err(EXIT_FAILURE, "malloc failed");
+        }
+        for (size_t i = 0; i < free_count; i++)
+            captured[i] = append_load(b, arraylist_get(free_symbols, i));
+        *value                      = append(b, IR_CLOSURE);
+        b->fn->values[*value].index = add_constant(compiler, (object_object *) compiled_fn);
+        for (size_t i = 0; i < free_count; i++)
+            ir_add_operand(b->fn, *value, captured[i]);
+        free(captured);
+    }
+    if (binding == NULL || !lowered ||
+        !ir_remember_function(compiler, binding, body.fn, parameter_count, num_locals, free_symbols)) {
+        ir_function_free(body.fn);
+        arraylist_destroy(free_symbols, symbol_free);
+    }
+    return error;
+}
+
+/** The converted function a call is made through, if it is one of those bound in the function being built. */
+static const converted_function *converted_callee(const ir_builder *b, const ast_call_expression *call_exp) {
+    if (b->converted == NULL || call_exp->function->expression_type != IDENTIFIER_EXPRESSION)
+        return nullptr;
+    const symbol *sym = symbol_resolve(b->compiler->symbol_table, ((ast_identifier *) call_exp->function)->value);
+    for (size_t i = 0; sym != NULL && sym->scope == LOCAL && i < b->converted->size; i++) {
+        const converted_function *function = arraylist_get(b->converted, i);
+        if (function->index == sym->index)
+            return function;
+    }
+    return nullptr;
+}
+
+/** The function a call can be inlined to, when it is made through a let binding of one. */
+static const ir_inline_function *inline_callee(const ir_builder *b, const ast_call_expression *call_exp) {
+    if (call_exp->function->expression_type != IDENTIFIER_EXPRESSION)
+        return nullptr;
+    const symbol *sym = symbol_resolve(b->compiler->symbol_table, ((ast_identifier *) call_exp->function)->value);
+    return sym != NULL ? ir_find_inline(b->compiler, sym, call_exp->arguments->size) : nullptr;
+}
+
+static compiler_error build_expression(ir_builder *b, ast_expression *expression, ir_value *value) {
+    compiler_error          error = {COMPILER_ERROR_NONE, nullptr};
+    ast_infix_expression *  infix_exp;
+    ast_prefix_expression * prefix_exp;
+    ast_index_expression *  index_exp;
+    ast_array_literal *     array_exp;
+    ast_hash_literal *      hash_exp;
+    ast_call_expression *   call_exp;
+    const operator_opcode * op;
+    ir_value                left, right;
+    ir_value *              operands;
+    size_t                  count;
+    switch (expression->expression_type) {
+        case INFIX_EXPRESSION:
+            infix_exp = (ast_infix_expression *) expression;
+            op        = &infix_opcodes[infix_exp->operator];
+            if (!op->defined)
+                return unknown_operator(infix_exp->operator);
+            error = build_expression(b, op->swap ? infix_exp->right : infix_exp->left, &left);
+            if (error.error_code != COMPILER_ERROR_NONE)
+                return error;
+            error = build_expression(b, op->swap ? infix_exp->left : infix_exp->right, &right);
+            if (error.error_code != COMPILER_ERROR_NONE)
+                return error;
+            *value                      = append(b, IR_BINARY);
+            b->fn->values[*value].opcode = op->opcode;
+            ir_add_operand(b->fn, *value, left);
+            ir_add_operand(b->fn, *value, right);
+            break;
+        case PREFIX_EXPRESSION:
+            prefix_exp = (ast_prefix_expression *) expression;
+            op         = &prefix_opcodes[prefix_exp->operator];
+            if (!op->defined)
+                return unknown_operator(prefix_exp->operator);
+            error = build_expression(b, prefix_exp->right, &right);
+            if (error.error_code != COMPILER_ERROR_NONE)
+                return error;
+            *value                       = append_unary(b, IR_UNARY, right);
+            b->fn->values[*value].opcode = op->opcode;
+            break;
+        case INTEGER_EXPRESSION:
+            *value = append_constant(b, (object_object *) object_create_int(((ast_integer *) expression)->value));
+            break;
+        case BOOLEAN_EXPRESSION:
+            *value = append_constant(
+                    b, (object_object *) object_create_bool(((ast_boolean_expression *) expression)->value));
+            break;
+        case STRING_EXPRESSION:
+            const char *s = ((ast_string *) expression)->value;
+            *value        = append_constant(b, (object_object *) object_create_string(s, strlen(s)));
+            break;
+        case IF_EXPRESSION:
+            return build_if(b, (ast_if_expression *) expression, value);
+        case IDENTIFIER_EXPRESSION:
+            const char *name = ((ast_identifier *) expression)->value;
+            symbol *    sym  = symbol_resolve(b->compiler->symbol_table, name);
+            if (sym == NULL)
+                return (compiler_error){COMPILER_UNDEFINED_VARIABLE, get_err_msg("undefined variable: %s\n", name)};
+            *value = append_load(b, sym);
+            break;
+        case ARRAY_LITERAL:
+            array_exp = (ast_array_literal *) expression;
+            count     = array_exp->elements->size;
+            operands  = malloc((count + 1) * sizeof(*operands));
+            if (operands == NULL) {
+                err(EXIT_FAILURE, "malloc failed");
+            }
+            for (size_t i = 0; i < count && error.error_code == COMPILER_ERROR_NONE; i++)
+                error = build_expression(b, arraylist_get(array_exp->elements, i), &operands[i]);
+            if (error.error_code == COMPILER_ERROR_NONE) {
+                *value = append(b, IR_ARRAY);
+                for (size_t i = 0; i < count; i++)
+                    ir_add_operand(b->fn, *value, operands[i]);
+            }
+            free(operands);
+            break;
+        case HASH_LITERAL:
+            hash_exp        = (ast_hash_literal *) expression;
+            arraylist *keys = hashtable_get_keys(hash_exp->pairs);
+            count           = keys != NULL ? keys->size : 0;
+            operands        = malloc((2 * count + 1) * sizeof(*operands));
+            if (operands == NULL) {
+                err(EXIT_FAILURE, "malloc failed");
+            }
+            if (keys != NULL)
+                arraylist_sort(keys, compare_object_hash_keys);
+            for (size_t i = 0; i < count && error.error_code == COMPILER_ERROR_NONE; i++) {
+                ast_expression *key = arraylist_get(keys, i);
+                error               = build_expression(b, key, &operands[2 * i]);
+                if (error.error_code == COMPILER_ERROR_NONE)
+                    error = build_expression(b, hashtable_get(hash_exp->pairs, key), &operands[2 * i + 1]);
+            }
+            if (error.error_code == COMPILER_ERROR_NONE) {
+                *value = append(b, IR_HASH);
+                for (size_t i = 0; i < 2 * count; i++)
+                    ir_add_operand(b->fn, *value, operands[i]);
+            }
+            if (keys != NULL)
+                arraylist_destroy(keys);
+            free(operands);
+            break;
+        case INDEX_EXPRESSION:
+            index_exp = (ast_index_expression *) expression;
+            error     = build_expression(b, index_exp->left, &left);
+            if (error.error_code != COMPILER_ERROR_NONE)
+                return error;
+            error = build_expression(b, index_exp->index, &right);
+            if (error.error_code != COMPILER_ERROR_NONE)
+                return error;
+            *value = append_unary(b, IR_INDEX, left);
+            ir_add_operand(b->fn, *value, right);
+            break;
+        case FUNCTION_LITERAL:
+            return build_function(b, (ast_function_literal *) expression, nullptr, false, value);
+        case CALL_EXPRESSION:
+            call_exp = (ast_call_expression *) expression;
+            const converted_function *converted = converted_callee(b, call_exp);
+            const ir_inline_function *callee    = converted == NULL ? inline_callee(b, call_exp) : nullptr;
+            // a converted function is passed what it would have captured after its arguments
+            const size_t argument_count = call_exp->arguments->size;
+            count    = argument_count + (converted != NULL ? converted->free_symbols->size : 0);
+            operands = malloc((count + 1) * sizeof(*operands));
+            if (operands == NULL) {
+                err(EXIT_FAILURE, "malloc failed");
+            }
+            if (converted != NULL)
+                operands[count] = append_constant(b, object_copy_object(converted->closure));
+            else if (callee == NULL)
+                error = build_expression(b, call_exp->function, &operands[count]);
+            for (size_t i = 0; i < argument_count && error.error_code == COMPILER_ERROR_NONE; i++)
+                error = build_expression(b, linked_list_get_at(call_exp->arguments, i)->data, &operands[i]);
+            for (size_t i = argument_count; i < count && error.error_code == COMPILER_ERROR_NONE; i++)
+                operands[i] = append_load(b, arraylist_get(converted->free_symbols, i - argument_count));
+            if (error.error_code == COMPILER_ERROR_NONE && callee == NULL &&
+                !opcode_operands_fit(OP_CALL, (size_t[]){count}, true))
+                error = operand_too_large(OP_CALL, count);
+            if (error.error_code == COMPILER_ERROR_NONE && callee != NULL) {
+                *value = ir_inline(b->compiler, b->fn, &b->block, callee, operands);
+            } else if (error.error_code == COMPILER_ERROR_NONE) {
+                *value = append_unary(b, IR_CALL, operands[count]);
+                for (size_t i = 0; i < count; i++)
+                    ir_add_operand(b->fn, *value, operands[i]);
+            }
+            free(operands);
+            break;
+        default:
+            break;
+    }
+    return error;
+}
+
+static compiler_error build_statement(ir_builder *b, ast_statement *statement) {
+    compiler_error       error = {COMPILER_ERROR_NONE, nullptr};
+    ast_let_statement *  let_stmt;
+    ast_block_statement *block_stmt;
+    symbol *             sym;
+    ir_value             value;
+    switch (statement->statement_type) {
+        case EXPRESSION_STATEMENT:
+            error = build_expression(b, ((ast_expression_statement *) statement)->expression, &value);
+            if (error.error_code == COMPILER_ERROR_NONE)
+                append_unary(b, IR_POP, value);
+            break;
+        case BLOCK_STATEMENT:
+            block_stmt = (ast_block_statement *) statement;
+            for (size_t i = 0; i < block_stmt->statement_count && error.error_code == COMPILER_ERROR_NONE; i++)
+                error = build_statement(b, block_stmt->statements[i]);
+            break;
+        case LET_STATEMENT:
+            let_stmt = (ast_let_statement *) statement;
+            sym      = symbol_define(b->compiler->symbol_table, let_stmt->name->value);
+            if (let_stmt->value->expression_type == FUNCTION_LITERAL)
+                error = build_function(b, (ast_function_literal *) let_stmt->value, sym,
+                                       b->body != NULL && ir_is_called_only(b->body, let_stmt), &value);
+            else
+                error = build_expression(b, let_stmt->value, &value);
+            if (error.error_code != COMPILER_ERROR_NONE)
+                return error;
+            if (b->branches == 0 && b->fn->values[value].op == IR_CONST)
+                fold_record_global_value(b->compiler, sym, b->fn->values[value].constant);
+            const ir_value store   = append_unary(b, IR_STORE, value);
+            b->fn->values[store].scope = sym->scope;
+            b->fn->values[store].index = sym->index;
+            break;
+        case RETURN_STATEMENT:
+            error = build_expression(b, ((ast_return_statement *) statement)->return_value, &value);
+            if (error.error_code != COMPILER_ERROR_NONE)
+                return error;
+            // whatever follows can't be reached, but still defines variables
+            terminate(b, IR_RETURN, value);
+            b->block = ir_add_block(b->fn);
+            break;
+    }
+    return error;
+}
+
+/** Build the IR for a program or a single top level statement. */
+compiler_error ir_build_program(compiler *compiler, ast_node *node, ir_function **fn) {
+    ir_builder     b     = {compiler, ir_function_init(true), 0, nullptr, nullptr, 0};
+    compiler_error error = {COMPILER_ERROR_NONE, nullptr};
+    *fn                  = b.fn;
+    if (node->type == PROGRAM) {
+        const ast_program *program = (ast_program *) node;
+        for (size_t i = 0; i < program->statement_count && error.error_code == COMPILER_ERROR_NONE; i++)
+            error = build_statement(&b, program->statements[i]);
+    } else {
+        error = build_statement(&b, (ast_statement *) node);
+    }
+    return error;
+}
+
+/**
+ * Compile a program or a top level statement at the compiler's optimization level.
+ * With optimize_ir set, it goes through the IR, is optimized there and lowered to
+ * bytecode; code the IR can't represent is compiled straight from the AST.
+ */
+compiler_error compile_optimized(compiler *compiler, ast_node *node) {
+    if (!compiler->optimize_ir || !supports_node(node))
+        return compile(compiler, node);
+
+    compilation_scope *       scope    = get_top_scope(compiler);
+    const size_t              position = scope->instructions->length;
+    const emitted_instruction last     = scope->last_instruction;
+    const emitted_instruction prev     = scope->prev_instruction;
+    ir_function *             fn;
+    compiler_error            error = ir_build_program(compiler, node, &fn);
+    if (error.error_code == COMPILER_ERROR_NONE) {
+        ir_optimize(fn);
+        if (!ir_lower(compiler, fn)) {
+            scope->instructions->length = position;
+            scope->last_instruction     = last;
+            scope->prev_instruction     = prev;
+            error                       = compile(compiler, node);
+        }
+    }
+    ir_function_free(fn);
+    return error;
+}
@@ -0,0 +1,141 @@
+//
+// Created by dgood on 1/23/25.
+//
+
+#include "ir.h"
+
+#include <string.h>
+
+/**
+ * What the escape analysis is looking for: a function bound to `name`, which is only
+ * allowed to appear as the callee of calls passing `argument_count` arguments.
+ */
+typedef struct {
+    const char *name;
+    size_t      argument_count;
+} escape_query;
+
+static bool escapes_block(const escape_query *, const ast_block_statement *, bool);
+
+static bool is_name(const ast_expression *expression, const char *name) {
+    return expression->expression_type == IDENTIFIER_EXPRESSION &&
+           strcmp(((ast_identifier *) expression)->value, name) == 0;
+}
+
+/**
+ * Whether the name is used as anything but the callee of a matching call. Within a
+ * nested function any use at all counts, because the function would be captured.
+ */
+static bool escapes(const escape_query *query, ast_expression *expression, const bool nested) {
+    ast_call_expression *call_exp;
+    ast_if_expression *  if_exp;
+    arraylist *          elements;
+    arraylist *          keys;
+    bool                 escaped = false;
+    switch (expression->expression_type) {
+        case IDENTIFIER_EXPRESSION:
+            return is_name(expression, query->name);
+        case PREFIX_EXPRESSION:
+            return escapes(query, ((ast_prefix_expression *) expression)->right, nested);
+        case INFIX_EXPRESSION:
+            return escapes(query, ((ast_infix_expression *) expression)->left, nested) ||
+                   escapes(query, ((ast_infix_expression *) expression)->right, nested);
+        case IF_EXPRESSION:
+            if_exp = (ast_if_expression *) expression;
+            return escapes(query, if_exp->condition, nested) || escapes_block(query, if_exp->consequence, nested) ||
+                   (if_exp->alternative != NULL && escapes_block(query, if_exp->alternative, nested));
+        case WHILE_EXPRESSION:
+            return escapes(query, ((ast_while_expression *) expression)->condition, nested) ||
+                   escapes_block(query, ((ast_while_expression *) expression)->body, nested);
+        case FUNCTION_LITERAL:
+            return escapes_block(query, ((ast_function_literal *) expression)->body, true);
+        case CALL_EXPRESSION:
+            call_exp = (ast_call_expression *) expression;
+            if (!is_name(call_exp->function, query->name) || nested ||
+                call_exp->arguments->size != query->argument_count)
+                escaped = escapes(query, call_exp->function, nested);
+            for (const list_node *arg = call_exp->arguments->head; arg != NULL && !escaped; arg = arg->next)
+                escaped = escapes(query, arg->data, nested);
+            return escaped;
+        case ARRAY_LITERAL:
+            elements = ((ast_array_literal *) expression)->elements;
+            for (size_t i = 0; i < elements->size && !escaped; i++)
+                escaped = escapes(query, arraylist_get(elements, i), nested);
+            return escaped;
+        case INDEX_EXPRESSION:
+            return escapes(query, ((ast_index_expression *) expression)->left, nested) ||
+                   escapes(query, ((ast_index_expression *) expression)->index, nested);
+        case HASH_LITERAL:
+            keys = hashtable_get_keys(((ast_hash_literal *) expression)->pairs);
+            for (size_t i = 0; keys != NULL && i < keys->size && !escaped; i++) {
+                ast_expression *key = arraylist_get(keys, i);
+                escaped             = escapes(query, key, nested) ||
+                          escapes(query, hashtable_get(((ast_hash_literal *) expression)->pairs, key), nested);
+            }
+            if (keys != NULL)
+                arraylist_destroy(keys);
+            return escaped;
+        default:
+            return false;
+    }
+}
+
+static bool escapes_statement(const escape_query *query, ast_statement *statement, const bool nested) {
+    switch (statement->statement_type) {
+        case LET_STATEMENT:
+            return escapes(query, ((ast_let_statement *) statement)->value, nested);
+        case RETURN_STATEMENT:
+            return escapes(query, ((ast_return_statement *) statement)->return_value, nested);
+        case EXPRESSION_STATEMENT:
+            return escapes(query, ((ast_expression_statement *) statement)->expression, nested);
+        case BLOCK_STATEMENT:
+            return escapes_block(query, (ast_block_statement *) statement, nested);
+    }
+    return true;
+}
+
+static bool escapes_block(const escape_query *query, const ast_block_statement *block, const bool nested) {
+    for (size_t i = 0; i < block->statement_count; i++) {
+        if (escapes_statement(query, block->statements[i], nested))
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Whether the function that `let_stmt`, one of the statements of a function's `body`,
+ * binds can't escape: the body only ever calls it directly, with the arguments it
+ * takes. Nothing else can then get hold of its closure, so the variables it captures
+ * can be passed to it on each call instead. A let nested in a block might not run, so
+ * it doesn't count.
+ */
+bool ir_is_called_only(const ast_block_statement *body, const ast_let_statement *let_stmt) {
+    if (let_stmt->value->expression_type != FUNCTION_LITERAL)
+        return false;
+    bool direct = false;
+    for (size_t i = 0; i < body->statement_count && !direct; i++)
+        direct = body->statements[i] == (ast_statement *) let_stmt;
+    const escape_query query = {let_stmt->name->value,
+                                ((ast_function_literal *) let_stmt->value)->parameters->size};
+    return direct && !escapes_block(&query, body, false);
+}
+
+/**
+ * Turn a function's free variables into arguments following its parameters, moving
+ * its other locals up to make room. Calls then pass what the closure would have
+ * captured, which is the same as long as the function can't escape: every variable
+ * is only set once, before any function that uses it is made.
+ */
+void ir_pass_captured_as_arguments(ir_function *fn, const size_t parameter_count, const size_t free_count) {
+    for (size_t i = 0; i < fn->value_count; i++) {
+        ir_instruction *in = &fn->values[i];
+        if (in->removed || (in->op != IR_LOAD && in->op != IR_STORE))
+            continue;
+        if (in->scope == LOCAL && in->index >= parameter_count) {
+            in->index += free_count;
+        } else if (in->scope == FREE) {
+            in->scope = LOCAL;
+            in->index += parameter_count;
+        }
+    }
+}
@@ -0,0 +1,239 @@
+//
+// Created by dgood on 1/23/25.
+//
+
+#include "ir.h"
+
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define INLINE_MAX_INSTRUCTIONS 16
+
+/**
+ * A small function bound by a let. The let's slot is only ever set once, so a call
+ * through it always runs this body, which can be copied into the caller instead.
+ */
+struct ir_inline_function {
+    const symbol_table *table; // where the function was bound
+    symbol_scope        scope;
+    size_t              index;
+    size_t              parameter_count;
+    size_t              local_count; // parameters included
+    ir_function *       body;        // optimized, and leaving through IR_RETURN or IR_RETURN_NONE
+    arraylist *         free_symbols; // what the body's free variables are in `table`
+};
+
+static void inline_function_free(void *f) {
+    ir_inline_function *function = f;
+    ir_function_free(function->body);
+    arraylist_destroy(function->free_symbols);
+    free(function);
+}
+
+static bool is_binding(const ir_inline_function *function, const symbol *sym) {
+    return sym->scope == function->scope && sym->index == function->index;
+}
+
+/** Whether the body is small, and doesn't call itself through its name or its binding. */
+static bool is_inlinable(const ir_inline_function *function) {
+    const ir_function *body  = function->body;
+    size_t             count = 0;
+    for (size_t i = 0; i < body->value_count; i++) {
+        const ir_instruction *in = &body->values[i];
+        if (in->removed || !body->blocks[in->block].reachable || in->op == IR_PHI)
+            continue;
+        if (++count > INLINE_MAX_INSTRUCTIONS)
+            return false;
+        if (in->op != IR_LOAD)
+            continue;
+        if (in->scope == FUNCTION_SCOPE)
+            return false;
+        if (in->scope == GLOBAL && is_binding(function, &(symbol){nullptr, GLOBAL, (uint16_t) in->index}))
+            return false;
+        if (in->scope == FREE && is_binding(function, arraylist_get(function->free_symbols, in->index)))
+            return false;
+    }
+    return true;
+}
+
+/** Whether ir_remember_function would keep a function for inlining. */
+bool ir_can_inline(const symbol *binding, ir_function *body, arraylist *free_symbols) {
+    const ir_inline_function function = {nullptr, binding->scope, binding->index, 0, 0, body, free_symbols};
+    return (binding->scope == GLOBAL || binding->scope == LOCAL) && is_inlinable(&function);
+}
+
+/**
+ * Keep the optimized body of a function bound by `binding` for inlining calls to it,
+ * taking over the body and its free symbols if it is small and not recursive.
+ */
+bool ir_remember_function(compiler *compiler, const symbol *binding, ir_function *body, const size_t parameter_count,
+                          const size_t local_count, arraylist *free_symbols) {
+    if (binding->scope != GLOBAL && binding->scope != LOCAL)
+        return false;
+    ir_inline_function *function = malloc(sizeof(*function));
+    if (function == NULL) {
+        err(EXIT_FAILURE, "malloc failed");
+    }
+    *function = (ir_inline_function){compiler->symbol_table, binding->scope, binding->index, parameter_count,
+                                     local_count, body, free_symbols};
+    if (!is_inlinable(function)) {
+        free(function);
+        return false;
+    }
+    if (compiler->inline_functions == NULL)
+        compiler->inline_functions = arraylist_create(16, inline_function_free);
+    arraylist_add(compiler->inline_functions, function);
+    return true;
+}
+
+/** Drop the functions bound in `table`, which is about to go away along with its scope. */
+void ir_forget_functions(const compiler *compiler, const symbol_table *table) {
+    if (compiler->inline_functions == NULL)
+        return;
+    for (size_t i = compiler->inline_functions->size; i > 0; i--) {
+        const ir_inline_function *function = arraylist_get(compiler->inline_functions, i - 1);
+        if (function->table == table)
+            arraylist_remove_and_free(compiler->inline_functions, i - 1);
+    }
+}
+
+/**
+ * The function a call through `callee` with `argument_count` arguments can be replaced
+ * with, if any. Locals are only found from the function they belong to, where the free
+ * variables of the body mean the same thing they did where it was bound.
+ */
+const ir_inline_function *ir_find_inline(const compiler *compiler, const symbol *callee, const size_t argument_count) {
+    if (compiler->inline_functions == NULL || (callee->scope != GLOBAL && callee->scope != LOCAL))
+        return nullptr;
+    const symbol_table *table = compiler->symbol_table;
+    for (size_t i = 0; i < compiler->inline_functions->size; i++) {
+        const ir_inline_function *function = arraylist_get(compiler->inline_functions, i);
+        if (!is_binding(function, callee) || (callee->scope == LOCAL && function->table != table))
+            continue;
+        // the variables of the body get slots of their own, which have to fit in a symbol's index
+        if (function->parameter_count != argument_count || table->symbol_count + function->local_count > UINT16_MAX)
+            return nullptr;
+        return function;
+    }
+    return nullptr;
+}
+
+/** A slot for one of the inlined body's variables, named so that no program can refer to it. */
+static symbol *define_hidden(symbol_table *table) {
+    char name[16];
+    snprintf(name, sizeof(name), "$%u", table->symbol_count);
+    return symbol_define(table, name);
+}
+
+static void copy_slot(ir_instruction *in, const ir_inline_function *function, symbol **locals) {
+    const symbol *sym;
+    switch (in->scope) {
+        case LOCAL:
+            sym = locals[in->index];
+            break;
+        case FREE:
+            sym = arraylist_get(function->free_symbols, in->index);
+            break;
+        default:
+            return;
+    }
+    in->scope = sym->scope;
+    in->index = sym->index;
+}
+
+/**
+ * Replace a call to `function` with a copy of its body, starting at the end of `*block`
+ * and leaving `*block` where the caller goes on from. The arguments, which must be on
+ * the stack in order, are stored into the slots that stand in for the parameters, and
+ * each return becomes a jump to the phi giving the call's value.
+ */
+ir_value ir_inline(compiler *compiler, ir_function *fn, size_t *block, const ir_inline_function *function,
+                   const ir_value *arguments) {
+    const ir_function *body   = function->body;
+    symbol **          locals = malloc((function->local_count + 1) * sizeof(*locals));
+    ir_value *         values = malloc((body->value_count + 1) * sizeof(*values));
+    size_t *           blocks = malloc(body->block_count * sizeof(*blocks));
+    if (locals == NULL || values == NULL || blocks == NULL) {
+        err(EXIT_FAILURE, "malloc failed");
+    }
+    for (size_t i = 0; i < function->local_count; i++)
+        locals[i] = define_hidden(compiler->symbol_table);
+    for (size_t i = function->parameter_count; i > 0; i--) {
+        const ir_value store      = ir_append(fn, *block, IR_STORE);
+        fn->values[store].scope   = locals[i - 1]->scope;
+        fn->values[store].index   = locals[i - 1]->index;
+        ir_add_operand(fn, store, arguments[i - 1]);
+    }
+
+    for (size_t b = 0; b < body->block_count; b++)
+        blocks[b] = b == 0 ? *block : body->blocks[b].reachable ? ir_add_block(fn) : SIZE_MAX;
+    const size_t   after  = ir_add_block(fn);
+    const ir_value result = ir_append(fn, after, IR_PHI);
+
+    for (size_t b = 0; b < body->block_count; b++) {
+        const ir_block *from = &body->blocks[b];
+        if (!from->reachable)
+            continue;
+        for (size_t i = 0; i < from->count; i++) {
+            const ir_instruction *in = &body->values[from->instructions[i]];
+            if (in->removed)
+                continue;
+            const ir_value v = values[from->instructions[i]] = ir_append(fn, blocks[b], in->op);
+            ir_instruction *copy = &fn->values[v];
+            copy->opcode         = in->opcode;
+            copy->type           = in->type;
+            copy->scope          = in->scope;
+            copy->index          = in->index;
+            copy->constant       = in->constant != NULL ? object_copy_object(in->constant) : nullptr;
+            if (in->op == IR_LOAD || in->op == IR_STORE)
+                copy_slot(copy, function, locals);
+        }
+    }
+    // operands can come from blocks copied later, so they are only filled in now
+    for (size_t i = 0; i < body->value_count; i++) {
+        const ir_instruction *in = &body->values[i];
+        if (in->removed || !body->blocks[in->block].reachable)
+            continue;
+        for (size_t j = 0; j < in->operand_count; j++) {
+            if (in->op == IR_PHI)
+                ir_add_incoming(fn, values[i], blocks[in->incoming[j]], values[in->operands[j]]);
+            else
+                ir_add_operand(fn, values[i], values[in->operands[j]]);
+        }
+    }
+
+    for (size_t b = 0; b < body->block_count; b++) {
+        const ir_block *from = &body->blocks[b];
+        if (!from->reachable)
+            continue;
+        ir_value returned;
+        switch (from->terminator) {
+            case IR_JUMP:
+            case IR_BRANCH:
+                fn->blocks[blocks[b]].terminator    = from->terminator;
+                fn->blocks[blocks[b]].value         = from->value != IR_NONE ? values[from->value] : IR_NONE;
+                fn->blocks[blocks[b]].successors[0] = blocks[from->successors[0]];
+                fn->blocks[blocks[b]].successors[1] =
+                        from->terminator == IR_BRANCH ? blocks[from->successors[1]] : 0;
+                continue;
+            case IR_RETURN:
+                returned = values[from->value];
+                break;
+            default:
+                returned                      = ir_append(fn, blocks[b], IR_CONST);
+                fn->values[returned].constant = (object_object *) object_create_null();
+                fn->values[returned].type     = IR_TYPE_NULL;
+                break;
+        }
+        fn->blocks[blocks[b]].terminator    = IR_JUMP;
+        fn->blocks[blocks[b]].successors[0] = after;
+        ir_add_incoming(fn, result, blocks[b], returned);
+    }
+    free(locals);
+    free(values);
+    free(blocks);
+    *block = after;
+    return result;
+}
@@ -0,0 +1,270 @@
+//
+// Created by dgood on 1/23/25.
+//
+
+#include "ir.h"
+
+#include <err.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../compiler/constant_folding.h"
+#include "../compiler/instructions.h"
+
+#define NO_BLOCK SIZE_MAX
+
+/** The values on the VM's stack at some point, the top one last. */
+typedef struct {
+    ir_value *values;
+    size_t    count;
+    size_t    capacity;
+    bool      known;
+} value_stack;
+
+typedef struct {
+    size_t position; // of the jump instruction
+    size_t block;    // it jumps to
+} pending_jump;
+
+typedef struct {
+    compiler *         compiler;
+    const ir_function *fn;
+    value_stack        stack;
+    value_stack *      entries; // what is on the stack when each block starts
+    size_t *           starts;  // where each block's bytecode starts
+    size_t *           next;    // the block laid out after each block
+    pending_jump *     jumps;
+    size_t             jump_count;
+} lowering;
+
+static void push(value_stack *stack, const ir_value v) {
+    if (stack->count == stack->capacity) {
+        stack->capacity = stack->capacity ? stack->capacity * 2 : 16;
+        stack->values   = reallocarray(stack->values, stack->capacity, sizeof(*stack->values));
+        if (stack->values == NULL) {
+            err(EXIT_FAILURE, "malloc failed");
+        }
+    }
+    stack->values[stack->count++] = v;
+}
+
+/** Take `count` values off the top of the stack, if they are `values` in that order. */
+static bool pop(value_stack *stack, const ir_value *values, const size_t count) {
+    if (count == 0)
+        return true;
+    if (stack->count < count || memcmp(stack->values + stack->count - count, values, count * sizeof(*values)) != 0)
+        return false;
+    stack->count -= count;
+    return true;
+}
+
+/** Record what is on the stack when `block` starts, which must agree with any earlier jump there. */
+static bool enter(const lowering *l, const size_t block, const value_stack *stack) {
+    value_stack *entry = &l->entries[block];
+    if (entry->known)
+        return entry->count == stack->count &&
+               memcmp(entry->values, stack->values, stack->count * sizeof(*stack->values)) == 0;
+    for (size_t i = 0; i < stack->count; i++)
+        push(entry, stack->values[i]);
+    entry->known = true;
+    return true;
+}
+
+static void jump(lowering *l, const Opcode op, const size_t block) {
+    const size_t position = emit_jump(l->compiler, op);
+    l->jumps              = reallocarray(l->jumps, l->jump_count + 1, sizeof(*l->jumps));
+    if (l->jumps == NULL) {
+        err(EXIT_FAILURE, "malloc failed");
+    }
+    l->jumps[l->jump_count++] = (pending_jump){position, block};
+}
+
+static void lower_constant(compiler *compiler, object_object *constant) {
+    switch (constant->type) {
+        case OBJECT_BOOL:
+            emit(compiler, ((object_bool *) constant)->value ? OP_TRUE : OP_FALSE, nullptr);
+            break;
+        case OBJECT_NULL:
+            emit(compiler, OP_NULL, nullptr);
+            break;
+        default:
+            emit(compiler, OP_CONSTANT, (size_t[]){add_constant(compiler, object_copy_object(constant))});
+            break;
+    }
+}
+
+static void lower_instruction(const lowering *l, const ir_instruction *in) {
+    compiler *   compiler = l->compiler;
+    const symbol sym      = {nullptr, in->scope, (uint16_t) in->index};
+    switch (in->op) {
+        case IR_CONST:
+            lower_constant(compiler, in->constant);
+            break;
+        case IR_LOAD:
+            load_symbol(compiler, &sym);
+            break;
+        case IR_STORE:
+            emit(compiler, in->scope == GLOBAL ? OP_SET_GLOBAL : OP_SET_LOCAL, (size_t[]){in->index});
+            if (l->fn->values[in->operands[0]].op == IR_CONST && ir_always_runs(l->fn, in->block))
+                fold_record_global_value(compiler, &sym, l->fn->values[in->operands[0]].constant);
+            break;
+        case IR_BINARY:
+        case IR_UNARY:
+            emit(compiler, in->opcode, nullptr);
+            break;
+        case IR_ARRAY:
+            emit(compiler, OP_ARRAY, (size_t[]){in->operand_count});
+            break;
+        case IR_HASH:
+            emit(compiler, OP_HASH, (size_t[]){in->operand_count});
+            break;
+        case IR_INDEX:
+            emit(compiler, OP_INDEX, nullptr);
+            break;
+        case IR_CALL:
+            emit(compiler, OP_CALL, (size_t[]){in->operand_count - 1});
+            break;
+        case IR_CLOSURE:
+            emit(compiler, OP_CLOSURE, (size_t[]){in->index, in->operand_count});
+            break;
+        case IR_POP:
+            emit(compiler, OP_POP, nullptr);
+            break;
+        case IR_PHI:
+            break;
+    }
+}
+
+/** The phi at the start of `block`, if it has one. */
+static const ir_instruction *block_phi(const ir_function *fn, const size_t block) {
+    const ir_block *b = &fn->blocks[block];
+    for (size_t i = 0; i < b->count; i++) {
+        const ir_instruction *in = &fn->values[b->instructions[i]];
+        if (!in->removed)
+            return in->op == IR_PHI ? in : nullptr;
+    }
+    return nullptr;
+}
+
+static bool lower_terminator(lowering *l, const size_t b) {
+    const ir_block *block = &l->fn->blocks[b];
+    value_stack *   stack = &l->stack;
+    switch (block->terminator) {
+        case IR_END:
+            return true;
+        case IR_RETURN:
+            if (!pop(stack, &block->value, 1))
+                return false;
+            emit(l->compiler, OP_RETURN_VALUE, nullptr);
+            return true;
+        case IR_RETURN_NONE:
+            emit(l->compiler, OP_RETURN, nullptr);
+            return true;
+        case IR_JUMP:
+            const size_t          target = block->successors[0];
+            const ir_instruction *phi    = block_phi(l->fn, target);
+            if (phi != NULL) {
+                // the phi's value for this edge is left on the stack to become the phi
+                size_t i = 0;
+                while (i < phi->operand_count && phi->incoming[i] != b)
+                    i++;
+                if (i == phi->operand_count || !pop(stack, &phi->operands[i], 1))
+                    return false;
+                push(stack, (ir_value) (phi - l->fn->values));
+            }
+            if (!enter(l, target, stack))
+                return false;
+            if (l->next[b] != target)
+                jump(l, OP_JUMP, target);
+            return true;
+        case IR_BRANCH:
+            if (!pop(stack, &block->value, 1) || !enter(l, block->successors[0], stack) ||
+                !enter(l, block->successors[1], stack))
+                return false;
+            if (l->next[b] == block->successors[1]) {
+                jump(l, OP_JUMP_TRUTHY, block->successors[0]);
+                return true;
+            }
+            jump(l, OP_JUMP_NOT_TRUTHY, block->successors[1]);
+            if (l->next[b] != block->successors[0])
+                jump(l, OP_JUMP, block->successors[0]);
+            return true;
+    }
+    return false;
+}
+
+static bool lower_block(lowering *l, const size_t b) {
+    const ir_block *block = &l->fn->blocks[b];
+    value_stack *   stack = &l->stack;
+    stack->count          = 0;
+    if (b != 0) {
+        const value_stack *entry = &l->entries[b];
+        if (!entry->known)
+            return false;
+        for (size_t i = 0; i < entry->count; i++)
+            push(stack, entry->values[i]);
+    }
+    l->starts[b] = get_current_instructions(l->compiler)->length;
+    for (size_t i = 0; i < block->count; i++) {
+        const ir_value        v  = block->instructions[i];
+        const ir_instruction *in = &l->fn->values[v];
+        if (in->removed)
+            continue;
+        if (in->op == IR_PHI) {
+            if (stack->count == 0 || stack->values[stack->count - 1] != v)
+                return false;
+            continue;
+        }
+        if (!pop(stack, in->operands, in->operand_count))
+            return false;
+        lower_instruction(l, in);
+        if (in->op != IR_STORE && in->op != IR_POP)
+            push(stack, v);
+    }
+    return lower_terminator(l, b);
+}
+
+/**
+ * Emit the bytecode for an optimized function into the compiler's current scope. Blocks
+ * are laid out in the order they were built, so that most jumps fall through. Each value
+ * is pushed where it is defined and must be on top of the stack, in order, where it is
+ * used; returns false, having emitted part of the function, if that doesn't hold.
+ */
+bool ir_lower(compiler *compiler, const ir_function *fn) {
+    lowering l = {.compiler   = compiler,
+                  .fn         = fn,
+                  .stack      = {.values = nullptr, .count = 0, .capacity = 0, .known = false},
+                  .entries    = calloc(fn->block_count, sizeof(*l.entries)),
+                  .starts     = calloc(fn->block_count, sizeof(*l.starts)),
+                  .next       = calloc(fn->block_count, sizeof(*l.next)),
+                  .jumps      = nullptr,
+                  .jump_count = 0};
+    if (l.entries == NULL || l.starts == NULL || l.next == NULL) {
+        err(EXIT_FAILURE, "malloc failed");
+    }
+    size_t previous = NO_BLOCK;
+    for (size_t b = 0; b < fn->block_count; b++) {
+        l.next[b] = NO_BLOCK;
+        if (!fn->blocks[b].reachable)
+            continue;
+        if (previous != NO_BLOCK)
+            l.next[previous] = b;
+        previous = b;
+    }
+
+    bool lowered = true;
+    for (size_t b = 0; b < fn->block_count && lowered; b++) {
+        if (fn->blocks[b].reachable)
+            lowered = lower_block(&l, b);
+    }
+    for (size_t i = 0; i < l.jump_count && lowered; i++)
+        lowered = change_operand(compiler, l.jumps[i].position, l.starts[l.jumps[i].block]);
+
+    for (size_t b = 0; b < fn->block_count; b++)
+        free(l.entries[b].values);
+    free(l.entries);
+    free(l.starts);
+    free(l.next);
+    free(l.jumps);
+    free(l.stack.values);
+    return lowered;
+}
@@ -0,0 +1,560 @@
+//
+// Created by dgood on 1/23/25.
+//
+
+#include "ir.h"
+
+#include <err.h>
+#include <limits.h>
+#include <stdlib.h>
+#include "../compiler/constant_folding.h"
+
+/** The passes are repeated until none of them changes anything, or this many times. */
+#define IR_MAX_ROUNDS 8
+
+static const ir_pass default_passes[] = {
+        {"copy propagation", ir_copy_propagation},
+        {"type inference", ir_type_inference},
+        {"constant folding", ir_constant_folding},
+        {"common subexpressions", ir_common_subexpressions},
+        {"dead code", ir_dead_code},
+};
+
+static bool is_live(const ir_function *fn, const ir_instruction *in) {
+    return !in->removed && fn->blocks[in->block].reachable;
+}
+
+static ir_type operand_type(const ir_function *fn, const ir_instruction *in, const size_t i) {
+    return fn->values[in->operands[i]].type;
+}
+
+static bool is_constant_int(const ir_function *fn, const ir_value v, const long value) {
+    const ir_instruction *in = &fn->values[v];
+    return in->op == IR_CONST && in->constant->type == OBJECT_INT && ((object_int *) in->constant)->value == value;
+}
+
+/**
+ * Whether throwing a value away is the same as never computing it: it has no side
+ * effects and, going by the types of its operands, can't fail at runtime.
+ */
+static bool is_removable(const ir_function *fn, const ir_instruction *in) {
+    switch (in->op) {
+        case IR_CONST:
+        case IR_LOAD:
+        case IR_ARRAY:
+        case IR_CLOSURE:
+            return true;
+        case IR_UNARY:
+            if (in->opcode == OP_MINUS)
+                return operand_type(fn, in, 0) == IR_TYPE_INT;
+            return operand_type(fn, in, 0) == IR_TYPE_BOOL || operand_type(fn, in, 0) == IR_TYPE_NULL;
+        case IR_BINARY:
+            const ir_type left = operand_type(fn, in, 0), right = operand_type(fn, in, 1);
+            if (left == IR_TYPE_STRING && right == IR_TYPE_STRING)
+                return in->opcode == OP_ADD;
+            if (left == IR_TYPE_BOOL && right == IR_TYPE_BOOL)
+                return in->opcode == OP_EQUAL || in->opcode == OP_NOT_EQUAL;
+            if (left != IR_TYPE_INT || right != IR_TYPE_INT)
+                return false;
+            if (in->opcode != OP_DIV && in->opcode != OP_MOD)
+                return true;
+            // a division can still divide by zero, or overflow
+            return fn->values[in->operands[1]].op == IR_CONST && !is_constant_int(fn, in->operands[1], 0) &&
+                   !is_constant_int(fn, in->operands[1], -1);
+        case IR_INDEX:
+            return (operand_type(fn, in, 0) == IR_TYPE_ARRAY || operand_type(fn, in, 0) == IR_TYPE_STRING) &&
+                   operand_type(fn, in, 1) == IR_TYPE_INT;
+        default:
+            return false;
+    }
+}
+
+static bool is_removable_tree(const ir_function *fn, const ir_value v) {
+    const ir_instruction *in = &fn->values[v];
+    if (!is_removable(fn, in))
+        return false;
+    for (size_t i = 0; i < in->operand_count; i++) {
+        if (!is_removable_tree(fn, in->operands[i]))
+            return false;
+    }
+    return true;
+}
+
+/*** copy propagation ***/
+
+typedef struct {
+    ir_value *globals;
+    size_t    global_count;
+    ir_value *locals;
+    size_t    local_count;
+} slot_map;
+
+static ir_value *slot_entry(slot_map *map, const symbol_scope scope, const size_t index) {
+    ir_value **slots = scope == GLOBAL ? &map->globals : &map->locals;
+    size_t *   count = scope == GLOBAL ? &map->global_count : &map->local_count;
+    if (index >= *count) {
+        const size_t grown = 2 * index + 16;
+        *slots             = reallocarray(*slots, grown, sizeof(**slots));
+        if (*slots == NULL) {
+            err(EXIT_FAILURE, "malloc failed");
+        }
+        for (size_t i = *count; i < grown; i++)
+            (*slots)[i] = IR_NONE;
+        *count = grown;
+    }
+    return &(*slots)[index];
+}
+
+static bool is_slot(const ir_instruction *in) { return in->scope == GLOBAL || in->scope == LOCAL; }
+
+/**
+ * Replace loads of a variable with what was stored in it, where the store runs before
+ * the load on every path. A stored constant or variable is loaded directly instead;
+ * anything else is remembered in `copy_of` for the passes that follow.
+ */
+bool ir_copy_propagation(ir_function *fn) {
+    ir_analyze(fn);
+    slot_map map = {};
+    for (size_t v = 0; v < fn->value_count; v++) {
+        const ir_instruction *in = &fn->values[v];
+        if (is_live(fn, in) && in->op == IR_STORE)
+            *slot_entry(&map, in->scope, in->index) = v;
+    }
+
+    bool changed = false;
+    for (size_t v = 0; v < fn->value_count; v++) {
+        ir_instruction *in = &fn->values[v];
+        if (!is_live(fn, in) || in->op != IR_LOAD || !is_slot(in))
+            continue;
+        const ir_value store = *slot_entry(&map, in->scope, in->index);
+        if (store == IR_NONE || !ir_dominates(fn, store, v))
+            continue;
+        const ir_value        stored = fn->values[store].operands[0];
+        const ir_instruction *value  = &fn->values[stored];
+        if (value->op == IR_CONST) {
+            in->op       = IR_CONST;
+            in->constant = object_copy_object(value->constant);
+            in->copy_of  = IR_NONE;
+        } else if (value->op == IR_LOAD) {
+            if (value->scope == in->scope && value->index == in->index && value->copy_of == in->copy_of)
+                continue;
+            in->scope   = value->scope;
+            in->index   = value->index;
+            in->copy_of = value->copy_of;
+        } else if (in->copy_of != stored) {
+            in->copy_of = stored;
+        } else {
+            continue;
+        }
+        changed = true;
+    }
+    free(map.globals);
+    free(map.locals);
+    return changed;
+}
+
+/*** type inference ***/
+
+static ir_type constant_type(const object_object *constant) {
+    switch (constant->type) {
+        case OBJECT_INT:
+            return IR_TYPE_INT;
+        case OBJECT_BOOL:
+            return IR_TYPE_BOOL;
+        case OBJECT_STRING:
+            return IR_TYPE_STRING;
+        case OBJECT_NULL:
+            return IR_TYPE_NULL;
+        case OBJECT_CLOSURE:
+            return IR_TYPE_FUNCTION;
+        default:
+            return IR_TYPE_ANY;
+    }
+}
+
+/** The type of an operator's result, given that it didn't fail. */
+static ir_type infer_type(const ir_function *fn, const ir_instruction *in) {
+    ir_type type;
+    switch (in->op) {
+        case IR_CONST:
+            return constant_type(in->constant);
+        case IR_LOAD:
+            return in->copy_of != IR_NONE ? fn->values[in->copy_of].type : IR_TYPE_ANY;
+        case IR_UNARY:
+            return in->opcode == OP_MINUS ? IR_TYPE_INT : IR_TYPE_BOOL;
+        case IR_BINARY:
+            if (in->opcode == OP_GREATER_THAN || in->opcode == OP_EQUAL || in->opcode == OP_NOT_EQUAL)
+                return IR_TYPE_BOOL;
+            if (in->opcode == OP_DIV || in->opcode == OP_MOD)
+                return IR_TYPE_INT;
+            // the others need both operands to be the same type, and give that type
+            type = operand_type(fn, in, 0);
+            if (type == IR_TYPE_ANY)
+                type = operand_type(fn, in, 1);
+            return type == IR_TYPE_INT || type == IR_TYPE_STRING || type == IR_TYPE_ARRAY ? type : IR_TYPE_ANY;
+        case IR_ARRAY:
+            return IR_TYPE_ARRAY;
+        case IR_HASH:
+            return IR_TYPE_HASH;
+        case IR_CLOSURE:
+            return IR_TYPE_FUNCTION;
+        case IR_PHI:
+            type = in->operand_count > 0 ? operand_type(fn, in, 0) : IR_TYPE_ANY;
+            for (size_t i = 1; i < in->operand_count; i++) {
+                if (operand_type(fn, in, i) != type)
+                    return IR_TYPE_ANY;
+            }
+            return type;
+        default:
+            return IR_TYPE_ANY;
+    }
+}
+
+/**
+ * Work out what type each value has whenever it is computed without an error. The
+ * other passes use it to tell which operators can't fail and which conditions always
+ * hold.
+ */
+bool ir_type_inference(ir_function *fn) {
+    ir_analyze(fn);
+    bool changed = false;
+    // values only refer to values before them, and phis to blocks before them
+    for (bool again = true; again;) {
+        again = false;
+        for (size_t v = 0; v < fn->value_count; v++) {
+            ir_instruction *in = &fn->values[v];
+            if (!is_live(fn, in))
+                continue;
+            const ir_type type = infer_type(fn, in);
+            if (type != in->type) {
+                in->type = type;
+                again    = true;
+                changed  = true;
+            }
+        }
+    }
+    return changed;
+}
+
+/*** constant folding ***/
+
+static void replace_with_constant(ir_function *fn, ir_instruction *in, object_object *constant) {
+    for (size_t i = 0; i < in->operand_count; i++)
+        ir_remove_tree(fn, in->operands[i]);
+    in->operand_count = 0;
+    in->op            = IR_CONST;
+    in->constant      = constant;
+    in->type          = constant_type(constant);
+}
+
+static bool is_always_truthy(const ir_type type) {
+    return type == IR_TYPE_INT || type == IR_TYPE_STRING || type == IR_TYPE_ARRAY || type == IR_TYPE_HASH ||
+           type == IR_TYPE_FUNCTION;
+}
+
+static void take_branch(ir_block *block, const size_t successor) {
+    block->terminator    = IR_JUMP;
+    block->successors[0] = block->successors[successor];
+    block->value         = IR_NONE;
+}
+
+/**
+ * Fold a branch on a condition that is known ahead of time into a jump, and a branch on
+ * the negation of a boolean into a branch on the boolean itself. Returns whether the
+ * branch changed.
+ */
+static bool fold_branch(ir_function *fn, const size_t b) {
+    ir_block *            block     = &fn->blocks[b];
+    const ir_value        condition = block->value;
+    const ir_instruction *in        = &fn->values[condition];
+    if (in->op == IR_CONST) {
+        const bool truthy = in->constant->type == OBJECT_BOOL ? ((object_bool *) in->constant)->value
+                                                              : in->constant->type != OBJECT_NULL;
+        ir_remove_tree(fn, condition);
+        take_branch(block, truthy ? 0 : 1);
+        return true;
+    }
+    if (in->op == IR_UNARY && in->opcode == OP_BANG &&
+        (operand_type(fn, in, 0) == IR_TYPE_BOOL || operand_type(fn, in, 0) == IR_TYPE_NULL)) {
+        fn->values[condition].removed = true;
+        block->value                  = in->operands[0];
+        const size_t consequence      = block->successors[0];
+        block->successors[0]          = block->successors[1];
+        block->successors[1]          = consequence;
+        return true;
+    }
+    if (is_always_truthy(in->type)) {
+        // the condition still has to be computed if that could have an effect
+        if (is_removable_tree(fn, condition)) {
+            ir_remove_tree(fn, condition);
+        } else {
+            const ir_value pop = ir_append(fn, b, IR_POP);
+            ir_add_operand(fn, pop, condition);
+        }
+        take_branch(&fn->blocks[b], 0);
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Evaluate operators on constants at compile time the way the VM would, and fold
+ * branches whose direction is known. Operations the VM would reject are left for it to
+ * report.
+ */
+bool ir_constant_folding(ir_function *fn) {
+    ir_analyze(fn);
+    bool changed = false;
+    for (size_t v = 0; v < fn->value_count; v++) {
+        ir_instruction *in = &fn->values[v];
+        if (!is_live(fn, in) || (in->op != IR_BINARY && in->op != IR_UNARY))
+            continue;
+        bool constant = true;
+        for (size_t i = 0; i < in->operand_count; i++)
+            constant &= fn->values[in->operands[i]].op == IR_CONST;
+        if (!constant)
+            continue;
+        object_object *result = fold_operator(in->opcode, fn->values[in->operands[0]].constant,
+                                              in->op == IR_BINARY ? fn->values[in->operands[1]].constant : nullptr);
+        if (result == NULL)
+            continue;
+        replace_with_constant(fn, in, result);
+        changed = true;
+    }
+    for (size_t b = 0; b < fn->block_count; b++) {
+        if (fn->blocks[b].reachable && fn->blocks[b].terminator == IR_BRANCH)
+            changed |= fold_branch(fn, b);
+    }
+    return changed;
+}
+
+/*** common subexpressions ***/
+
+typedef struct {
+    ir_op        op;
+    Opcode       opcode;
+    symbol_scope scope;
+    size_t       index;
+    ir_value     operands[2];
+} value_key;
+
+typedef struct {
+    value_key *keys;
+    ir_value * values; // the first value with each key, IR_NONE for an empty slot
+    size_t     capacity;
+} value_table;
+
+/**
+ * The key of a value that is computed the same way every time, or false for one that
+ * isn't. A variable's loads only share a key once its store has run, or when it isn't
+ * stored to in this function at all.
+ */
+static bool value_key_of(ir_function *fn, const ir_value *numbers, slot_map *stores, const ir_value v,
+                         value_key *key) {
+    const ir_instruction *in = &fn->values[v];
+    *key                     = (value_key){.op = in->op, .opcode = in->opcode, .operands = {IR_NONE, IR_NONE}};
+    switch (in->op) {
+        case IR_CONST:
+            if (in->constant->type == OBJECT_BOOL) {
+                key->opcode = ((object_bool *) in->constant)->value ? OP_TRUE : OP_FALSE;
+                return true;
+            }
+            key->opcode = OP_CONSTANT;
+            key->index  = in->constant->type == OBJECT_INT ? (size_t) ((object_int *) in->constant)->value : 0;
+            return in->constant->type == OBJECT_INT;
+        case IR_LOAD:
+            if (is_slot(in)) {
+                const ir_value store = *slot_entry(stores, in->scope, in->index);
+                if (store != IR_NONE && !ir_dominates(fn, store, v))
+                    return false;
+            }
+            key->scope = in->scope;
+            key->index = in->index;
+            return true;
+        case IR_BINARY:
+        case IR_UNARY:
+        case IR_INDEX:
+            for (size_t i = 0; i < in->operand_count; i++)
+                key->operands[i] = numbers[in->operands[i]];
+            return true;
+        default:
+            return false;
+    }
+}
+
+static size_t value_key_hash(const value_key *key) {
+    size_t hash = 14695981039346656037UL;
+    hash        = (hash ^ key->op) * 1099511628211UL;
+    hash        = (hash ^ key->opcode) * 1099511628211UL;
+    hash        = (hash ^ key->scope) * 1099511628211UL;
+    hash        = (hash ^ key->index) * 1099511628211UL;
+    hash        = (hash ^ key->operands[0]) * 1099511628211UL;
+    hash        = (hash ^ key->operands[1]) * 1099511628211UL;
+    return hash;
+}
+
+static bool value_key_equals(const value_key *a, const value_key *b) {
+    return a->op == b->op && a->opcode == b->opcode && a->scope == b->scope && a->index == b->index &&
+           a->operands[0] == b->operands[0] && a->operands[1] == b->operands[1];
+}
+
+/** The first value with `key`, or IR_NONE after making `v` that value. */
+static ir_value value_table_find_or_add(const value_table *table, const value_key *key, const ir_value v) {
+    size_t slot = value_key_hash(key) & (table->capacity - 1);
+    while (table->values[slot] != IR_NONE) {
+        if (value_key_equals(&table->keys[slot], key))
+            return table->values[slot];
+        slot = (slot + 1) & (table->capacity - 1);
+    }
+    table->keys[slot]   = *key;
+    table->values[slot] = v;
+    return IR_NONE;
+}
+
+/** The blocks that can be reached, in reverse postorder. Returns how many there are. */
+static size_t reverse_postorder(const ir_function *fn, size_t *order) {
+    size_t count = 0;
+    for (size_t b = 0; b < fn->block_count; b++) {
+        if (fn->blocks[b].reachable) {
+            order[fn->blocks[b].order] = b;
+            count++;
+        }
+    }
+    return count;
+}
+
+/**
+ * Give values that are always equal the same number, and replace a computation that
+ * was already done by a load of the variable the first result was stored in. Values are
+ * used only once, so the first result can only be reused through its variable.
+ */
+bool ir_common_subexpressions(ir_function *fn) {
+    ir_analyze(fn);
+    ir_value *numbers = malloc((fn->value_count + 1) * sizeof(*numbers));
+    ir_value *homes   = malloc((fn->value_count + 1) * sizeof(*homes));
+    size_t *  order   = malloc((fn->block_count + 1) * sizeof(*order));
+    if (numbers == NULL || homes == NULL || order == NULL) {
+        err(EXIT_FAILURE, "malloc failed");
+    }
+    value_table table = {nullptr, nullptr, 16};
+    while (table.capacity < 2 * fn->value_count)
+        table.capacity *= 2;
+    table.keys   = malloc(table.capacity * sizeof(*table.keys));
+    table.values = malloc(table.capacity * sizeof(*table.values));
+    if (table.keys == NULL || table.values == NULL) {
+        err(EXIT_FAILURE, "malloc failed");
+    }
+    for (size_t i = 0; i < table.capacity; i++)
+        table.values[i] = IR_NONE;
+    for (size_t v = 0; v < fn->value_count; v++) {
+        numbers[v] = v;
+        homes[v]   = IR_NONE;
+    }
+    slot_map stores = {};
+    for (size_t v = 0; v < fn->value_count; v++) {
+        const ir_instruction *in = &fn->values[v];
+        if (is_live(fn, in) && in->op == IR_STORE) {
+            homes[in->operands[0]]                     = v;
+            *slot_entry(&stores, in->scope, in->index) = v;
+        }
+    }
+
+    bool         changed = false;
+    const size_t count   = reverse_postorder(fn, order);
+    for (size_t i = 0; i < count; i++) {
+        const ir_block *block = &fn->blocks[order[i]];
+        for (size_t j = 0; j < block->count; j++) {
+            const ir_value  v  = block->instructions[j];
+            ir_instruction *in = &fn->values[v];
+            if (in->removed)
+                continue;
+            if (in->op == IR_LOAD && in->copy_of != IR_NONE) {
+                numbers[v] = numbers[in->copy_of];
+                continue;
+            }
+            value_key key;
+            if (!value_key_of(fn, numbers, &stores, v, &key))
+                continue;
+            const ir_value first = value_table_find_or_add(&table, &key, v);
+            if (first == IR_NONE)
+                continue;
+            numbers[v] = numbers[first];
+            if (in->op == IR_CONST || in->op == IR_LOAD)
+                continue;
+            const ir_value home = homes[first];
+            if (home == IR_NONE || !ir_dominates(fn, home, v))
+                continue;
+            for (size_t k = 0; k < in->operand_count; k++)
+                ir_remove_tree(fn, in->operands[k]);
+            in->operand_count = 0;
+            in->op            = IR_LOAD;
+            in->scope         = fn->values[home].scope;
+            in->index         = fn->values[home].index;
+            in->copy_of       = first;
+            changed           = true;
+        }
+    }
+    free(numbers);
+    free(homes);
+    free(order);
+    free(table.keys);
+    free(table.values);
+    free(stores.globals);
+    free(stores.locals);
+    return changed;
+}
+
+/*** dead code ***/
+
+/**
+ * Remove what can't be reached, stores to local variables that are never loaded, and
+ * values that are computed only to be thrown away and can't fail. At the top level a
+ * popped value is what the program leaves behind, so those pops stay.
+ */
+bool ir_dead_code(ir_function *fn) {
+    bool changed = ir_remove_unreachable(fn);
+    if (fn->is_program)
+        return changed;
+
+    slot_map loads = {};
+    for (size_t v = 0; v < fn->value_count; v++) {
+        const ir_instruction *in = &fn->values[v];
+        if (is_live(fn, in) && in->op == IR_LOAD && in->scope == LOCAL)
+            *slot_entry(&loads, LOCAL, in->index) = v;
+    }
+    for (size_t v = 0; v < fn->value_count; v++) {
+        ir_instruction *in = &fn->values[v];
+        if (!is_live(fn, in))
+            continue;
+        if (in->op == IR_STORE && in->scope == LOCAL && *slot_entry(&loads, LOCAL, in->index) == IR_NONE) {
+            // the value may still have to be computed for what it does
+            in->op  = IR_POP;
+            changed = true;
+        }
+        if (in->op == IR_POP && is_removable_tree(fn, in->operands[0])) {
+            ir_remove_tree(fn, v);
+            changed = true;
+        }
+    }
+    free(loads.locals);
+    return changed;
+}
+
+/*** pass manager ***/
+
+/**
+ * Run `passes` in order, over and over until none of them changes anything, and remove
+ * what can no longer be reached.
+ */
+void ir_run_passes(ir_function *fn, const ir_pass *passes, const size_t count) {
+    for (size_t round = 0; round < IR_MAX_ROUNDS; round++) {
+        bool changed = false;
+        for (size_t i = 0; i < count; i++)
+            changed |= passes[i].run(fn);
+        if (!changed)
+            break;
+    }
+    ir_remove_unreachable(fn);
+}
+
+void ir_optimize(ir_function *fn) { ir_run_passes(fn, default_passes, sizeof(default_passes) / sizeof(*default_passes)); }
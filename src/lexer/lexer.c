@@ -4,47 +4,236 @@
 
 #include "lexer.h"
 #include <ctype.h>
+#include <err.h>
+#include <errno.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <assert.h>
 
 #include "../token/token.h"
 
-lexer *lexer_init(const char *input) {
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/*********************************************************************************
+ ******************************  BLOCK SCANNING **********************************
+ ********************************************************************************/
+
+/*
+ * Whitespace runs, identifiers and string bodies are scanned a block at a time: each
+ * block of input is classified into a bitmask with one bit per byte, and the end of a
+ * run is the first zero bit. Blocks are 32 bytes with AVX2 and 16 with SSE2; other
+ * targets, and the last partial block of the input, fall back to the byte loops.
+ * Character classes are built from signed byte compares, so bytes >= 0x80 are never
+ * part of a class, which matches isalnum in the C locale.
+ */
+#if defined(__AVX2__)
+#define SCAN_WIDTH 32
+#define SCAN_FULL  0xFFFFFFFFU
+typedef __m256i scan_block;
+#define scan_load(p)    _mm256_loadu_si256((const __m256i *) (p))
+#define scan_eq(b, c)   _mm256_cmpeq_epi8(b, _mm256_set1_epi8(c))
+#define scan_gt(b, c)   _mm256_cmpgt_epi8(b, _mm256_set1_epi8(c))
+#define scan_lt(b, c)   _mm256_cmpgt_epi8(_mm256_set1_epi8(c), b)
+#define scan_or(a, b)   _mm256_or_si256(a, b)
+#define scan_and(a, b)  _mm256_and_si256(a, b)
+#define scan_lower(b)   _mm256_or_si256(b, _mm256_set1_epi8(0x20))
+#define scan_mask(b)    ((uint32_t) _mm256_movemask_epi8(b))
+#elif defined(__SSE2__)
+#define SCAN_WIDTH 16
+#define SCAN_FULL  0xFFFFU
+typedef __m128i scan_block;
+#define scan_load(p)    _mm_loadu_si128((const __m128i *) (p))
+#define scan_eq(b, c)   _mm_cmpeq_epi8(b, _mm_set1_epi8(c))
+#define scan_gt(b, c)   _mm_cmpgt_epi8(b, _mm_set1_epi8(c))
+#define scan_lt(b, c)   _mm_cmplt_epi8(b, _mm_set1_epi8(c))
+#define scan_or(a, b)   _mm_or_si128(a, b)
+#define scan_and(a, b)  _mm_and_si128(a, b)
+#define scan_lower(b)   _mm_or_si128(b, _mm_set1_epi8(0x20))
+#define scan_mask(b)    ((uint32_t) _mm_movemask_epi8(b))
+#endif
+
+#ifdef SCAN_WIDTH
+static uint32_t whitespace_mask(const scan_block b) {
+    return scan_mask(scan_or(scan_or(scan_eq(b, ' '), scan_eq(b, '\n')), scan_or(scan_eq(b, '\r'), scan_eq(b, '\t'))));
+}
+
+static uint32_t identifier_mask(const scan_block b) {
+    const scan_block lower = scan_lower(b);
+    const scan_block alpha = scan_and(scan_gt(lower, 'a' - 1), scan_lt(lower, 'z' + 1));
+    const scan_block digit = scan_and(scan_gt(b, '0' - 1), scan_lt(b, '9' + 1));
+    return scan_mask(scan_or(scan_or(alpha, digit), scan_eq(b, '_')));
+}
+#endif
+
+/**
+ * Return the offset of the first byte at or after `offset` that is not whitespace,
+ * adding the newlines skipped to `line`.
+ */
+static size_t scan_whitespace(const lexer *l, size_t offset, size_t *line) {
+#ifdef SCAN_WIDTH
+    while (offset + SCAN_WIDTH <= l->length) {
+        const scan_block b        = scan_load(l->input + offset);
+        const uint32_t   stop     = ~whitespace_mask(b) & SCAN_FULL;
+        uint32_t         newlines = scan_mask(scan_eq(b, '\n'));
+        if (stop != 0) {
+            const unsigned int end = __builtin_ctz(stop);
+            *line += __builtin_popcount(newlines & ((1U << end) - 1));
+            return offset + end;
+        }
+        *line += __builtin_popcount(newlines);
+        offset += SCAN_WIDTH;
+    }
+#endif
+    for (char c = l->input[offset]; c == ' ' || c == '\n' || c == '\r' || c == '\t'; c = l->input[++offset]) {
+        if (c == '\n')
+            (*line)++;
+    }
+    return offset;
+}
+
+#define is_character(c) (isalnum((unsigned char) (c)) || (c) == '_')
+
+/**
+ * Return the offset of the first byte at or after `offset` that can't be part of an
+ * identifier or number.
+ */
+static size_t scan_identifier(const lexer *l, size_t offset) {
+#ifdef SCAN_WIDTH
+    while (offset + SCAN_WIDTH <= l->length) {
+        const uint32_t stop = ~identifier_mask(scan_load(l->input + offset)) & SCAN_FULL;
+        if (stop != 0) {
+            return offset + __builtin_ctz(stop);
+        }
+        offset += SCAN_WIDTH;
+    }
+#endif
+    while (is_character(l->input[offset])) {
+        offset++;
+    }
+    return offset;
+}
+
+/**
+ * Return the offset of the closing quote of a string starting at `offset`, or of the
+ * end of the input when the string is not terminated, adding the newlines inside the
+ * string to `line`.
+ */
+static size_t scan_string(const lexer *l, size_t offset, size_t *line) {
+#ifdef SCAN_WIDTH
+    while (offset + SCAN_WIDTH <= l->length) {
+        const scan_block b        = scan_load(l->input + offset);
+        const uint32_t   stop     = scan_mask(scan_eq(b, '"'));
+        const uint32_t   newlines = scan_mask(scan_eq(b, '\n'));
+        if (stop != 0) {
+            const unsigned int end = __builtin_ctz(stop);
+            *line += __builtin_popcount(newlines & ((1U << end) - 1));
+            return offset + end;
+        }
+        *line += __builtin_popcount(newlines);
+        offset += SCAN_WIDTH;
+    }
+#endif
+    for (char c = l->input[offset]; c != '"' && c != 0; c = l->input[++offset]) {
+        if (c == '\n')
+            (*line)++;
+    }
+    return offset;
+}
+
+static void seek(lexer *l, const size_t offset) {
+    l->current_offset = offset;
+    l->read_offset    = offset + 1;
+    l->ch             = l->input[offset];
+}
+
+/**
+ * Create a lexer over `length` bytes of `input`, which must be followed by a nul byte.
+ */
+lexer *lexer_init_buffer(const char *input, const size_t length) {
     lexer *l = malloc(sizeof(*l));
     assert(l != NULL);
 
-    l->input = strdup(input);
-    assert(l->input != NULL);
-
+    l->input          = input;
+    l->length         = length;
     l->current_offset = 0;
     l->read_offset    = 1;
+    l->line           = 1;
     l->ch             = input[0];
+    l->fd             = -1;
+    l->buffer         = nullptr;
+    l->capacity       = 0;
+    l->base           = 0;
+    l->keep           = 0;
 
     return l;
 }
 
-#define is_character(c) isalnum(c) || c == '_'
-
-static char *read_identifier(lexer *l) {
-    const size_t position = l->current_offset;
+lexer *lexer_init(const char *input) {
+    return lexer_init_buffer(input, strlen(input));
+}
 
-    while (is_character(l->input[l->current_offset])) {
-        l->current_offset++;
+/**
+ * Drop the part of the window before the last token handed out and read more of the
+ * stream behind the rest, growing the window when nothing could be dropped. Returns
+ * how far the window moved; offsets into it have to be moved back by as much.
+ */
+static size_t refill(lexer *l) {
+    const size_t dropped = l->keep;
+    memmove(l->buffer, l->buffer + dropped, l->length - dropped);
+    l->length -= dropped;
+    l->base += dropped;
+    l->keep = 0;
+    if (l->length == l->capacity) {
+        l->capacity *= 2;
+        l->buffer = realloc(l->buffer, l->capacity + 1);
+        if (l->buffer == NULL) {
+            err(EXIT_FAILURE, "malloc failed");
+        }
     }
-    const size_t numCharacters = l->current_offset - position;
 
-    char *identifier = malloc(numCharacters + 1);
-    assert(identifier != NULL);
-
-    memcpy(identifier, l->input + position, numCharacters);
-    identifier[numCharacters] = '\0';
+    ssize_t n;
+    do {
+        n = read(l->fd, l->buffer + l->length, l->capacity - l->length);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        err(EXIT_FAILURE, "read failed");
+    }
+    if (n == 0) {
+        l->fd = -1;
+    }
+    l->length += (size_t) n;
+    l->buffer[l->length] = 0;
+    l->input             = l->buffer;
+    return dropped;
+}
 
-    l->read_offset = l->current_offset + 1;
-    l->ch          = l->input[l->current_offset];
+/**
+ * Create a lexer that reads its input from `fd` as it goes. The descriptor is not
+ * closed by the lexer.
+ */
+lexer *lexer_init_stream(const int fd) {
+    lexer *l = lexer_init("");
+    l->fd       = fd;
+    l->capacity = LEXER_STREAM_CHUNK;
+    l->buffer   = malloc(l->capacity + 1);
+    if (l->buffer == NULL) {
+        err(EXIT_FAILURE, "malloc failed");
+    }
+    l->buffer[0] = 0;
+    l->input     = l->buffer;
+    refill(l);
+    l->ch = l->input[0];
+    return l;
+}
 
-    return identifier;
+static void read_identifier(lexer *l, token_span *t) {
+    seek(l, scan_identifier(l, l->current_offset));
+    t->length = l->current_offset - t->offset;
 }
 
 static void read_char(lexer *l) {
@@ -56,183 +245,113 @@ static void read_char(lexer *l) {
 }
 
 static void skip_whitespace(lexer *l) {
-    while (l->ch && (l->ch == ' ' || l->ch == '\n' || l->ch == '\r' || l->ch == '\t'))
-        read_char(l);
+    if (l->ch == ' ' || l->ch == '\n' || l->ch == '\r' || l->ch == '\t')
+        seek(l, scan_whitespace(l, l->current_offset, &l->line));
 }
 
-static char *read_string(lexer *l) {
-    const size_t position = l->current_offset + 1;
-    l->current_offset++;
+static void read_string(lexer *l, token_span *t) {
+    t->offset        = l->current_offset + 1;
+    const size_t end = scan_string(l, t->offset, &l->line);
+    t->length        = end - t->offset;
+    seek(l, l->input[end] == '"' ? end + 1 : end);
+}
 
-    while (l->input[l->current_offset] != '"' && l->input[l->current_offset] != 0) {
-        l->current_offset++;
+/**
+ * Set the type of a one or two character token and move past it. `second` is the
+ * character that turns it into `long_type`, or 0 for single character tokens.
+ */
+static void read_operator(lexer *l, token_span *t, const token_type type, const char second,
+                          const token_type long_type) {
+    if (second && l->input[l->read_offset] == second) {
+        t->type   = long_type;
+        t->length = 2;
+        read_char(l);
+    } else {
+        t->type = type;
     }
-
-    const size_t length = l->current_offset - position;
-    char *       string = malloc(length + 1);
-    assert(string != NULL);
-
-    memcpy(string, l->input + position, length);
-    string[length] = '\0';
-
-    l->current_offset++;
-    l->read_offset = l->current_offset + 1;
-    l->ch          = l->input[l->current_offset];
-
-    return string;
+    read_char(l);
 }
 
-token *lexer_next_token(lexer *l) {
-    token *t = malloc(sizeof(token));
-    assert(t);
-
+static token_span next_token(lexer *l) {
     //skip_comment(l);
     skip_whitespace(l);
 
+    token_span t = {ILLEGAL, l->current_offset, 1, l->line};
+
     switch (l->ch) {
         case '=':
-            if (l->input[l->read_offset] == '=') {
-                t->literal = strdup("==");
-                t->type    = EQ;
-                read_char(l);
-                read_char(l);
-                break;
-            }
-            t->literal = strdup("=");
-            t->type    = ASSIGN;
-            read_char(l);
+            read_operator(l, &t, ASSIGN, '=', EQ);
             break;
         case '+':
-            t->literal = strdup("+");
-            t->type = PLUS;
-            read_char(l);
+            read_operator(l, &t, PLUS, 0, PLUS);
             break;
         case ',':
-            t->literal = strdup(",");
-            t->type = COMMA;
-            read_char(l);
+            read_operator(l, &t, COMMA, 0, COMMA);
             break;
         case ';':
-            t->literal = strdup(";");
-            t->type = SEMICOLON;
-            read_char(l);
+            read_operator(l, &t, SEMICOLON, 0, SEMICOLON);
             break;
         case '(':
-            t->literal = strdup("(");
-            t->type = LPAREN;
-            read_char(l);
+            read_operator(l, &t, LPAREN, 0, LPAREN);
             break;
         case ')':
-            t->literal = strdup(")");
-            t->type = RPAREN;
-            read_char(l);
+            read_operator(l, &t, RPAREN, 0, RPAREN);
             break;
         case '{':
-            t->literal = strdup("{");
-            t->type = LBRACE;
-            read_char(l);
+            read_operator(l, &t, LBRACE, 0, LBRACE);
             break;
         case '}':
-            t->literal = strdup("}");
-            t->type = RBRACE;
-            read_char(l);
+            read_operator(l, &t, RBRACE, 0, RBRACE);
             break;
         case '!':
-            if (l->input[l->read_offset] == '=') {
-                t->literal = strdup("!=");
-                t->type    = NOT_EQ;
-                read_char(l);
-                read_char(l);
-                break;
-            }
-            t->literal = strdup("!");
-            t->type    = BANG;
-            read_char(l);
+            read_operator(l, &t, BANG, '=', NOT_EQ);
             break;
         case '-':
-            t->literal = strdup("-");
-            t->type = MINUS;
-            read_char(l);
+            read_operator(l, &t, MINUS, 0, MINUS);
             break;
         case '/':
-            t->literal = strdup("/");
-            t->type = SLASH;
-            read_char(l);
+            read_operator(l, &t, SLASH, 0, SLASH);
             break;
         case '*':
-            t->literal = strdup("*");
-            t->type = ASTERISK;
-            read_char(l);
+            read_operator(l, &t, ASTERISK, 0, ASTERISK);
             break;
         case '<':
-            t->literal = strdup("<");
-            t->type = LT;
-            read_char(l);
+            read_operator(l, &t, LT, 0, LT);
             break;
         case '>':
-            t->literal = strdup(">");
-            t->type = GT;
-            read_char(l);
+            read_operator(l, &t, GT, 0, GT);
             break;
         case 0:
-            t->literal = "";
-            t->type = END_OF_FILE;
+            t.type   = END_OF_FILE;
+            t.length = 0;
             break;
         case '"':
-            t->literal = read_string(l);
-            t->type = STRING;
+            t.type = STRING;
+            read_string(l, &t);
             break;
         case '[':
-            t->literal = strdup("[");
-            t->type = LBRACKET;
-            read_char(l);
+            read_operator(l, &t, LBRACKET, 0, LBRACKET);
             break;
         case ']':
-            t->literal = strdup("]");
-            t->type = RBRACKET;
-            read_char(l);
+            read_operator(l, &t, RBRACKET, 0, RBRACKET);
             break;
         case ':':
-            t->literal = strdup(":");
-            t->type = COLON;
-            read_char(l);
+            read_operator(l, &t, COLON, 0, COLON);
             break;
         case '&':
-            if (l->input[l->read_offset] == '&') {
-                t->literal = strdup("&&");
-                t->type    = AND;
-                read_char(l);
-                read_char(l);
-            } else {
-                t->literal = nullptr;
-                t->type    = ILLEGAL;
-                read_char(l);
-            }
+            read_operator(l, &t, ILLEGAL, '&', AND);
             break;
         case '|':
-            if (l->input[l->read_offset] == '|') {
-                t->literal = strdup("||");
-                t->type    = OR;
-                read_char(l);
-                read_char(l);
-            } else {
-                t->literal = nullptr;
-                t->type    = ILLEGAL;
-                read_char(l);
-            }
+            read_operator(l, &t, ILLEGAL, '|', OR);
             break;
         case '%':
-            t->literal = strdup("%");
-            t->type = PERCENT;
-            read_char(l);
+            read_operator(l, &t, PERCENT, 0, PERCENT);
             break;
         default:
             if (is_character(l->ch)) {
-                t->literal = read_identifier(l);
-                t->type    = token_get_type(t->literal);
+                read_identifier(l, &t);
+                t.type = token_get_type(l->input + t.offset, t.length);
             } else {
-                t->literal = nullptr;
-                t->type    = ILLEGAL;
                 read_char(l);
             }
     }
@@ -240,7 +359,49 @@ token *lexer_next_token(lexer *l) {
     return t;
 }
 
+token_span lexer_next_token(lexer *l) {
+    for (;;) {
+        const size_t current_offset = l->current_offset;
+        const size_t line           = l->line;
+        token_span   t              = next_token(l);
+        // a token that runs into the end of the window may continue in the part of
+        // the stream that has not been read yet: read more and lex it again
+        if (l->fd < 0 || l->current_offset < l->length) {
+            l->keep = t.offset;
+            t.offset += l->base;
+            return t;
+        }
+        const size_t dropped = refill(l);
+        seek(l, current_offset - dropped);
+        l->line = line;
+    }
+}
+
+/**
+ * Return the first character of a token. Only valid until the next call to
+ * lexer_next_token for streaming lexers.
+ */
+const char *lexer_token_start(const lexer *l, const token_span t) {
+    return l->input + (t.offset - l->base);
+}
+
+/**
+ * Return a copy of the text of a token, for the few places that need it as a string.
+ */
+char *lexer_token_literal(const lexer *l, const token_span t) {
+    char *literal = strndup(lexer_token_start(l, t), t.length);
+    if (literal == NULL) {
+        err(EXIT_FAILURE, "malloc failed");
+    }
+    return literal;
+}
+
+token *lexer_token_copy(const lexer *l, token_span t) {
+    t.offset -= l->base;
+    return token_from_span(l->input, t);
+}
+
 void lexer_free(lexer *l) {
-    free(l->input);
+    free(l->buffer);
     free(l);
 }
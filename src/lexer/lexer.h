@@ -7,15 +7,40 @@
 #include <stdlib.h>
 #include "../token/token.h"
 
+#define LEXER_STREAM_CHUNK (64 * 1024)
+
+/**
+ * The lexer does not copy its input: tokens are spans of `input`, so the buffer must
+ * outlive the lexer and any token_span taken from it.
+ *
+ * A streaming lexer (lexer_init_stream) reads its input from a file descriptor into a
+ * window that slides forward as tokens are consumed. Only the last token handed out
+ * and the one being lexed are kept in the window, so token spans are offsets into the
+ * whole stream and must be turned into text with lexer_token_literal or
+ * lexer_token_copy before the next call to lexer_next_token.
+ */
 typedef struct {
-    char    *input;
+    const char *input;
+    size_t  length;
     size_t  current_offset;
     size_t  read_offset;
+    size_t  line;
     char    ch;
+
+    int     fd;       // stream being read, -1 for in-memory input or once the stream is drained
+    char    *buffer;  // window owned by a streaming lexer
+    size_t  capacity;
+    size_t  base;     // stream offset of input[0]
+    size_t  keep;     // window offset of the last token handed out
 } lexer;
 
-lexer*  lexer_init(const char *);
-token*  lexer_next_token(lexer *);
-void    lexer_free(lexer *);
+lexer*      lexer_init(const char *);
+lexer*      lexer_init_buffer(const char *, size_t);
+lexer*      lexer_init_stream(int);
+token_span  lexer_next_token(lexer *);
+char*       lexer_token_literal(const lexer *, token_span);
+token*      lexer_token_copy(const lexer *, token_span);
+const char* lexer_token_start(const lexer *, token_span);
+void        lexer_free(lexer *);
 
 #endif //LEXER_H
@@ -1,12 +1,58 @@
 #include <err.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "repl/repl.h"
 
+#ifdef TRACE
+#include "parser/parser_tracing.h"
+
+static FILE *trace_file = nullptr;
+
+static void stop_parser_trace(void) {
+    parser_trace_stop();
+    fclose(trace_file);
+}
+
+/**
+ * Trace the parser into the file named by PARSER_TRACE, as a Chrome trace when the
+ * name ends in .json and as indented text otherwise.
+ */
+static void start_parser_trace(void) {
+    const char *path = getenv("PARSER_TRACE");
+    if (path == NULL)
+        return;
+    trace_file = fopen(path, "w");
+    if (trace_file == NULL)
+        err(EXIT_FAILURE, "could not open %s", path);
+    const char *extension = strrchr(path, '.');
+    parser_trace_start(trace_file, extension != NULL && strcmp(extension, ".json") == 0
+                                           ? PARSER_TRACE_CHROME
+                                           : PARSER_TRACE_TEXT);
+    atexit(stop_parser_trace);
+}
+#endif
+
 int main(const int argc, char **argv) {
+#ifdef TRACE
+    start_parser_trace();
+#endif
     if (argc == 1)
         return repl();
-    if (argc == 2)
-        return execute_file(argv[1]);
-    err(EXIT_FAILURE, "Unsupported number of arguments %d", argc);
+
+    // compiler [--stats] [--parse-threads N] [-O0|-O1|-O2] [--aligned] file, where file may be - for stdin
+    execute_options options = {false, 0, 1, false};
+    for (int i = 1; i < argc - 1; i++) {
+        if (strcmp(argv[i], "--stats") == 0)
+            options.print_stats = true;
+        else if (strcmp(argv[i], "--parse-threads") == 0 && i + 2 < argc)
+            options.parse_threads = strtoul(argv[++i], nullptr, 10);
+        else if (strlen(argv[i]) == 3 && strncmp(argv[i], "-O", 2) == 0 && argv[i][2] >= '0' && argv[i][2] <= '2')
+            options.optimization_level = argv[i][2] - '0';
+        else if (strcmp(argv[i], "--aligned") == 0)
+            options.aligned = true;
+        else
+            errx(EXIT_FAILURE, "Unsupported argument %s", argv[i]);
+    }
+    return execute_file(argv[argc - 1], &options);
 }
@@ -9,6 +9,7 @@
 #include "../datastructures/hashmap.h"
 #include "../datastructures/linked_list.h"
 
+#include <err.h>
 #include <stdlib.h>
 
 const char *BUILTINS[MAX_BUILTINS] = {
@@ -19,6 +20,9 @@ const char *BUILTINS[MAX_BUILTINS] = {
         "rest",
         "push",
         "type",
+        "sum",
+        "min",
+        "max",
 };
 
 static object_object *len(linked_list *);
@@ -35,15 +39,24 @@ static object_object *_puts(linked_list *);
 
 static object_object *type(linked_list *);
 
+static object_object *sum(linked_list *);
+
+static object_object *min(linked_list *);
+
+static object_object *max(linked_list *);
+
 static char *builtin_inspect(object_object *);
 
-const object_builtin BUILTIN_LEN   = {{OBJECT_BUILTIN, builtin_inspect}, len};
-const object_builtin BUILTIN_FIRST = {{OBJECT_BUILTIN, builtin_inspect}, first};
-const object_builtin BUILTIN_LAST  = {{OBJECT_BUILTIN, builtin_inspect}, last};
-const object_builtin BUILTIN_REST  = {{OBJECT_BUILTIN, builtin_inspect}, rest};
-const object_builtin BUILTIN_PUSH  = {{OBJECT_BUILTIN, builtin_inspect}, push};
-const object_builtin BUILTIN_PUTS  = {{OBJECT_BUILTIN, builtin_inspect}, _puts};
-const object_builtin BUILTIN_TYPE  = {{OBJECT_BUILTIN, builtin_inspect}, type};
+const object_builtin BUILTIN_LEN   = {{OBJECT_BUILTIN, builtin_inspect}, len, true};
+const object_builtin BUILTIN_FIRST = {{OBJECT_BUILTIN, builtin_inspect}, first, true};
+const object_builtin BUILTIN_LAST  = {{OBJECT_BUILTIN, builtin_inspect}, last, true};
+const object_builtin BUILTIN_REST  = {{OBJECT_BUILTIN, builtin_inspect}, rest, true};
+const object_builtin BUILTIN_PUSH  = {{OBJECT_BUILTIN, builtin_inspect}, push, true};
+const object_builtin BUILTIN_PUTS  = {{OBJECT_BUILTIN, builtin_inspect}, _puts, false};
+const object_builtin BUILTIN_TYPE  = {{OBJECT_BUILTIN, builtin_inspect}, type, true};
+const object_builtin BUILTIN_SUM   = {{OBJECT_BUILTIN, builtin_inspect}, sum, true};
+const object_builtin BUILTIN_MIN   = {{OBJECT_BUILTIN, builtin_inspect}, min, true};
+const object_builtin BUILTIN_MAX   = {{OBJECT_BUILTIN, builtin_inspect}, max, true};
 
 static char *builtin_inspect(object_object *object) {
     return "builtin function";
@@ -89,10 +102,10 @@ static object_object *len(linked_list *arguments) {
             return (object_object *) object_create_int(str->length);
         case OBJECT_ARRAY:
             array = (object_array *) arg;
-            return (object_object *) object_create_int(array->elements->size);
+            return (object_object *) object_create_int(object_array_length(array));
         case OBJECT_HASH:
             hash_obj = (object_hash *) arg;
-            return (object_object *) object_create_int(hash_obj->pairs->table_size);
+            return (object_object *) object_create_int(object_hash_count(hash_obj));
         default:
             return (object_object *) object_create_error(
                     "argument to `len` not supported, got %s", get_type_name(arg->type));
@@ -112,8 +125,8 @@ static object_object *first(linked_list *arguments) {
                 "argument to `first` must be ARRAY, got %s", get_type_name(arg->type));
     }
     object_array *array = (object_array *) arg;
-    if (array->elements->size > 0)
-        return object_copy_object(array->elements->body[0]);
+    if (object_array_length(array) > 0)
+        return object_array_get(array, 0);
     else
         return (object_object *) object_create_null();
 }
@@ -134,9 +147,9 @@ last(linked_list *arguments) {
     }
 
     const object_array *array = (object_array *) arg;
-    if (array->elements->size > 0) {
-        return object_copy_object(
-                arraylist_get(array->elements, array->elements->size - 1));
+    const size_t length = object_array_length(array);
+    if (length > 0) {
+        return object_array_get(array, length - 1);
     }
     return (object_object *) object_create_null();
 
@@ -159,17 +172,11 @@ static object_object *rest(linked_list *arguments) {
 
     object_array *array = (object_array *) arg;
 
-    if (array->elements->size == 0) {
+    if (object_array_length(array) == 0) {
         return (object_object *) object_create_null();
     }
 
-    arraylist *rest_elements = arraylist_create(array->elements->size - 1, nullptr);
-    for (size_t i = 1; i < array->elements->size; i++) {
-        object_object *obj = object_copy_object(array->elements->body[i]);
-        arraylist_add(rest_elements, obj);
-    }
-    object_array *rest_array = object_create_array(rest_elements);
-    return (object_object *) rest_array;
+    return (object_object *) object_array_rest(array);
 }
 
 static object_object *push(linked_list *arguments) {
@@ -188,19 +195,82 @@ static object_object *push(linked_list *arguments) {
                                     get_type_name(arg->type));
     }
 
-    const object_array *array             = (object_array *) arg;
-    arraylist *         new_list_elements = arraylist_create(arguments->size + 1, nullptr);
-    for (size_t i = 0; i < array->elements->size; i++) {
-        obj = object_copy_object(array->elements->body[i]);
-        arraylist_add(new_list_elements, obj);
+    const object_array *array = (object_array *) arg;
+    obj                       = (object_object *) arguments->head->next->data;
+    if (array->ints != NULL && obj->type == OBJECT_INT) {
+        return (object_object *) object_array_push_int(array, ((object_int *) obj)->value);
     }
 
-    obj = (object_object *) arguments->head->next->data;
-    arraylist_add(new_list_elements, object_copy_object(obj));
-    object_array *new_array = object_create_array(new_list_elements);
+    // anything else than an integer turns the array into a boxed vector
+    pvector *     vector    = object_array_to_vector(array);
+    object_array *new_array = object_create_array_from_vector(pvector_push(vector, object_copy_object(obj)));
+    pvector_free(vector);
     return (object_object *) new_array;
 }
 
+typedef int64_t (*int64_reduce_fn)(const int64_t *, size_t);
+
+/**
+ * Shared implementation of sum, min and max. Packed arrays are reduced with the vector
+ * kernels directly; boxed arrays are unboxed into a scratch buffer first, and must hold
+ * integers only.
+ */
+static object_object *reduce_int_array(linked_list *arguments, const char *name, const int64_reduce_fn reduce,
+                                       const bool allow_empty) {
+    if (arguments->size != 1) {
+        return (object_object *)
+                object_create_error("wrong number of arguments. got=%zu, want=1",
+                                    arguments->size);
+    }
+
+    object_object *arg = arguments->head->data;
+    if (arg->type != OBJECT_ARRAY) {
+        return (object_object *) object_create_error(
+                "argument to `%s` must be ARRAY, got %s", name, get_type_name(arg->type));
+    }
+
+    const object_array *array  = (object_array *) arg;
+    const size_t        length = object_array_length(array);
+    if (length == 0) {
+        return allow_empty ? (object_object *) object_create_int(0) : (object_object *) object_create_null();
+    }
+    if (array->ints != NULL) {
+        return (object_object *) object_create_int(reduce(array->ints->data + array->offset, length));
+    }
+
+    int64_t *values = malloc(length * sizeof(int64_t));
+    if (values == NULL) {
+        err(EXIT_FAILURE, "malloc failed");
+    }
+    for (size_t i = 0; i < length; i++) {
+        object_object *elem = object_array_get(array, i);
+        if (elem->type != OBJECT_INT) {
+            object_error *error = object_create_error("`%s` expects an array of INTEGER, found %s", name,
+                                                      get_type_name(elem->type));
+            object_free(elem);
+            free(values);
+            return (object_object *) error;
+        }
+        values[i] = ((object_int *) elem)->value;
+        object_free(elem);
+    }
+    object_int *result = object_create_int(reduce(values, length));
+    free(values);
+    return (object_object *) result;
+}
+
+static object_object *sum(linked_list *arguments) {
+    return reduce_int_array(arguments, "sum", int64_sum, true);
+}
+
+static object_object *min(linked_list *arguments) {
+    return reduce_int_array(arguments, "min", int64_min, false);
+}
+
+static object_object *max(linked_list *arguments) {
+    return reduce_int_array(arguments, "max", int64_max, false);
+}
+
 object_builtin *get_builtins(const char *name) {
     if (strcmp(name, "len") == 0)
         return (object_builtin *) &BUILTIN_LEN;
@@ -216,6 +286,12 @@ object_builtin *get_builtins(const char *name) {
         return (object_builtin *) &BUILTIN_PUTS;
     if (strcmp(name, "type") == 0)
         return (object_builtin *) &BUILTIN_TYPE;
+    if (strcmp(name, "sum") == 0)
+        return (object_builtin *) &BUILTIN_SUM;
+    if (strcmp(name, "min") == 0)
+        return (object_builtin *) &BUILTIN_MIN;
+    if (strcmp(name, "max") == 0)
+        return (object_builtin *) &BUILTIN_MAX;
     return nullptr;
 }
 
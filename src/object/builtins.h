@@ -7,7 +7,7 @@
 #include "../datastructures/hashmap.h"
 #include "object.h"
 
-#define MAX_BUILTINS 7
+#define MAX_BUILTINS 10
 
 typedef hashtable *builtins_table;
 
@@ -21,6 +21,9 @@ extern const object_builtin BUILTIN_REST;
 extern const object_builtin BUILTIN_PUSH;
 extern const object_builtin BUILTIN_PUTS;
 extern const object_builtin BUILTIN_TYPE;
+extern const object_builtin BUILTIN_SUM;
+extern const object_builtin BUILTIN_MIN;
+extern const object_builtin BUILTIN_MAX;
 
 
 #define get_builtins_count() sizeof(BUILTINS)/sizeof(BUILTINS[0])
@@ -39,12 +39,20 @@ static char *function_inspect(object_object *obj) {
     return str;
 }
 
-static char *join_expressions_list(arraylist *list) {
+static object_array *create_packed_array(int_buffer *ints, const size_t offset, const size_t length) {
+    object_array *array = object_create_array(nullptr);
+    array->ints         = ints;
+    array->offset       = offset;
+    array->length       = length;
+    return array;
+}
+
+static char *join_expressions_list(const object_array *array) {
     char *string = nullptr;
     char *temp   = nullptr;
     int   ret;
-    for (size_t i = 0; i < list->size; i++) {
-        object_object *elem        = list->body[i];
+    for (size_t i = 0; i < object_array_length(array); i++) {
+        object_object *elem        = object_array_get(array, i);
         char *         elem_string = elem->inspect(elem);
         if (string == NULL) {
             ret = asprintf(&temp, "%s", elem_string);
@@ -53,6 +61,7 @@ static char *join_expressions_list(arraylist *list) {
             free(string);
         }
         free(elem_string);
+        object_free(elem);
         if (ret == -1) {
             err(EXIT_FAILURE, "malloc failed");
         }
@@ -62,37 +71,51 @@ static char *join_expressions_list(arraylist *list) {
     return string;
 }
 
-static char *join_expressions_table(hashtable *table) {
-    char *string = nullptr;
-    char *temp   = nullptr;
-    int   ret;
-    for (size_t i = 0; i < table->table_size; i++) {
+static char *join_expressions_pair(char *string, object_object *key_obj, object_object *value_obj) {
+    char *    temp         = nullptr;
+    char *    key_string   = key_obj->inspect(key_obj);
+    char *    value_string = value_obj->inspect(value_obj);
+    int       ret;
+    if (string == NULL) {
+        ret = asprintf(&temp, "%s: %s", key_string, value_string);
+    } else {
+        ret = asprintf(&temp, "%s, %s: %s", string, key_string, value_string);
+        free(string);
+    }
+    free(key_string);
+    free(value_string);
+    if (ret == -1) {
+        err(EXIT_FAILURE, "malloc failed");
+    }
+    return temp;
+}
+
+static char *join_expressions_table(const object_hash *hash) {
+    char *           string = nullptr;
+    char *           temp   = nullptr;
+    int              ret;
+    const hashtable *table = hash->pairs;
+    if (hash->trie != NULL) {
+        arraylist *keys = hamt_get_keys(hash->trie);
+        for (size_t i = 0; keys != NULL && i < keys->size; i++) {
+            object_object *key_obj = keys->body[i];
+            string                 = join_expressions_pair(string, key_obj, hamt_get(hash->trie, key_obj));
+        }
+        if (keys != NULL) {
+            arraylist_destroy(keys);
+        }
+    }
+    for (size_t i = 0; table != NULL && i < table->used_slots->size; i++) {
         size_t *     index      = table->used_slots->body[i];
         linked_list *entry_list = table->table[*index];
         list_node *  entry_node = entry_list->head;
         while (entry_node != NULL) {
-            hashtable_entry *entry      = entry_node->data;
-            entry_node                  = entry_node->next;
-            object_object *key_obj      = entry->key;
-            object_object *value_obj    = entry->value;
-            char *         key_string   = key_obj->inspect(key_obj);
-            char *         value_string = value_obj->inspect(value_obj);
-            if (string == NULL) {
-                ret = asprintf(&temp, "%s: %s", key_string, value_string);
-            } else {
-                ret = asprintf(&temp, "%s, %s: %s", string, key_string, value_string);
-                free(string);
-            }
-            free(key_string);
-            free(value_string);
-            if (ret == -1) {
-                err(EXIT_FAILURE, "malloc failed");
-            }
-            string = temp;
-            temp   = nullptr;
+            hashtable_entry *entry = entry_node->data;
+            entry_node             = entry_node->next;
+            string                 = join_expressions_pair(string, entry->key, entry->value);
         }
     }
-    ret = asprintf(&temp, "{%s}", string);
+    ret = asprintf(&temp, "{%s}", string ? string : "");
     free(string);
     if (ret == -1) {
         err(EXIT_FAILURE, "malloc failed");
@@ -131,13 +154,13 @@ char *inspect(object_object *obj) {
         case OBJECT_FUNCTION:
             return function_inspect(obj);
         case OBJECT_STRING:
-            return strdup(((object_string *) obj)->value);
+            return strndup(object_string_value((object_string *) obj), ((object_string *) obj)->length);
         case OBJECT_BUILTIN:
             return strdup("builtin function");
         case OBJECT_ARRAY:
             array = (object_array *) obj;
-            if (array->elements->size > 0) {
-                elements_string = join_expressions_list(array->elements);
+            if (object_array_length(array) > 0) {
+                elements_string = join_expressions_list(array);
             }
             ret = asprintf(&string, "[%s]", elements_string ? elements_string : "");
             if (elements_string != NULL) {
@@ -149,7 +172,7 @@ char *inspect(object_object *obj) {
             return string;
         case OBJECT_HASH:
             hash_obj = (object_hash *) obj;
-            return join_expressions_table(hash_obj->pairs);
+            return join_expressions_table(hash_obj);
         case OBJECT_COMPILED_FUNCTION:
             compiled_fn = (object_compiled_fn *) obj;
             ret = asprintf(&string, "compiled function %p", compiled_fn);
@@ -168,11 +191,19 @@ char *inspect(object_object *obj) {
 }
 
 static bool array_equals(object_array *arr1, object_array *arr2) {
-    if (arr1->elements->size != arr2->elements->size) {
+    if (object_array_length(arr1) != object_array_length(arr2)) {
         return false;
     }
-    for (size_t i = 0; i < arr1->elements->size; i++) {
-        if (!object_equals(arr1->elements->body[i], arr2->elements->body[i])) {
+    if (arr1->ints != NULL && arr2->ints != NULL) {
+        return int64_equals(arr1->ints->data + arr1->offset, arr2->ints->data + arr2->offset, arr1->length);
+    }
+    for (size_t i = 0; i < object_array_length(arr1); i++) {
+        object_object *elem1 = object_array_get(arr1, i);
+        object_object *elem2 = object_array_get(arr2, i);
+        const bool     equal = object_equals(elem1, elem2);
+        object_free(elem1);
+        object_free(elem2);
+        if (!equal) {
             return false;
         }
     }
@@ -180,9 +211,21 @@ static bool array_equals(object_array *arr1, object_array *arr2) {
 }
 
 static bool hash_equals(object_hash *hash1, object_hash *hash2) {
-    if (hash1->pairs->key_count != hash2->pairs->key_count) {
+    if (object_hash_count(hash1) != object_hash_count(hash2)) {
         return false;
     }
+    if (hash1->trie != NULL || hash2->trie != NULL) {
+        arraylist *keys  = object_hash_keys(hash1);
+        bool       equal = true;
+        for (size_t i = 0; keys != NULL && i < keys->size && equal; i++) {
+            object_object *value2 = object_hash_get(hash2, keys->body[i]);
+            equal                 = value2 != NULL && object_equals(object_hash_get(hash1, keys->body[i]), value2);
+        }
+        if (keys != NULL) {
+            arraylist_destroy(keys);
+        }
+        return equal;
+    }
     for (size_t i = 0; i < hash1->pairs->key_count; i++) {
         size_t *index1 = hash1->pairs->used_slots->body[i];
         size_t *index2 = hash2->pairs->used_slots->body[i];
@@ -198,7 +241,7 @@ static bool hash_equals(object_hash *hash1, object_hash *hash2) {
 }
 
 static bool instructions_equals(const instructions *ins1, const instructions *ins2) {
-    if (ins1->length != ins2->length) {
+    if (ins1->length != ins2->length || ins1->format != ins2->format) {
         return false;
     }
     for (size_t i = 0; i < ins1->length; i++) {
@@ -265,7 +308,10 @@ bool object_equals(void *o1, void *o2) {
         case OBJECT_STRING:
             str1 = (object_string *) obj1;
             str2 = (object_string *) obj2;
-            return strcmp(str1->value, str2->value) == 0;
+            if (str1->length != str2->length) {
+                return false;
+            }
+            return memcmp(object_string_value(str1), object_string_value(str2), str1->length) == 0;
         case OBJECT_RETURN_VALUE:
             ret1 = (object_return_value *) obj1;
             ret2 = (object_return_value *) obj2;
@@ -302,7 +348,7 @@ size_t object_get_hash(void *object) {
     switch (obj->type) {
         case OBJECT_STRING:
             str_obj = (object_string *) obj;
-            return string_hash_function(str_obj->value);
+            return string_n_hash_function(object_string_value(str_obj), str_obj->length);
         case OBJECT_INT:
             int_obj = (object_int *) obj;
             return int_hash_function(&int_obj->value);
@@ -352,18 +398,46 @@ static void free_error_object(object_error *err_obj) {
 
 static void free_return_object(object_return_value *ret_obj) {
     if (ret_obj->value) {
-        free(ret_obj->value);
+        object_free(ret_obj->value);
     }
     free(ret_obj);
     ret_obj = nullptr;
 }
 
+/**
+ * Ropes built in a loop are as deep as the number of concatenations, so children and
+ * view parents are released with an explicit stack instead of recursing through object_free.
+ */
 static void free_string_object(object_string *str_obj) {
-    if (str_obj->value) {
-        free(str_obj->value);
+    size_t          count    = 0;
+    size_t          capacity = 16;
+    object_string **pending  = malloc(sizeof(*pending) * capacity);
+    if (pending == NULL) {
+        err(EXIT_FAILURE, "malloc failed");
     }
-    free(str_obj);
-    str_obj = nullptr;
+    pending[count++] = str_obj;
+    while (count > 0) {
+        object_string *str         = pending[--count];
+        object_string *children[3] = {str->left, str->right, str->parent};
+        for (size_t i = 0; i < 3; i++) {
+            if (children[i] == NULL || --children[i]->object.refcount > 0) {
+                continue;
+            }
+            if (count == capacity) {
+                capacity *= 2;
+                pending = realloc(pending, sizeof(*pending) * capacity);
+                if (pending == NULL) {
+                    err(EXIT_FAILURE, "malloc failed");
+                }
+            }
+            pending[count++] = children[i];
+        }
+        if (str->value && str->parent == NULL) {
+            free(str->value);
+        }
+        free(str);
+    }
+    free(pending);
 }
 
 static void free_array_object(object_array *array_obj) {
@@ -379,12 +453,25 @@ static void free_array_object(object_array *array_obj) {
         arraylist_destroy(array_obj->elements);
         array_obj->elements = nullptr;
     }
+    if (array_obj->vector) {
+        pvector_free(array_obj->vector);
+        array_obj->vector = nullptr;
+    }
+    if (array_obj->ints) {
+        int_buffer_free(array_obj->ints);
+        array_obj->ints = nullptr;
+    }
     free(array_obj);
     array_obj = nullptr;
 }
 
 static void free_hash_object(object_hash *hash_obj) {
-    hashtable_destroy(hash_obj->pairs);
+    if (hash_obj->pairs != NULL) {
+        hashtable_destroy(hash_obj->pairs);
+    }
+    if (hash_obj->trie != NULL) {
+        hamt_free(hash_obj->trie);
+    }
     free(hash_obj);
 }
 
@@ -474,18 +561,33 @@ object_object *object_copy_object(object_object *object) {
             object_int *int_obj = (object_int *) object;
             return (object_object *) object_create_int(int_obj->value);
         }
-        case OBJECT_STRING: {
-            object_string *str_obj = (object_string *) object;
-            return (object_object *) object_create_string(str_obj->value, str_obj->length);
-        }
+        case OBJECT_STRING:
+            // strings are immutable, so copies share the object
+            object->refcount++;
+            return object;
         case OBJECT_ARRAY: {
             object_array *array_obj = (object_array *) object;
-            arraylist *   elements  = arraylist_clone(array_obj->elements, _object_copy_object, object_free);
+            if (array_obj->vector != NULL) {
+                // persistent vectors are immutable, share the structure instead of copying it
+                return (object_object *) object_create_array_from_vector(pvector_retain(array_obj->vector));
+            }
+            if (array_obj->ints != NULL) {
+                // so are int buffers, a copy only adds another view of the same slice
+                return (object_object *) create_packed_array(int_buffer_retain(array_obj->ints), array_obj->offset,
+                                                             array_obj->length);
+            }
+            arraylist *elements = arraylist_clone(array_obj->elements, _object_copy_object, object_free);
             return (object_object *) object_create_array(elements);
         }
         case OBJECT_HASH: {
-            object_hash *hash  = (object_hash *) object;
-            hashtable *  pairs = hashtable_clone(hash->pairs, _object_copy_object, _object_copy_object);
+            object_hash *hash = (object_hash *) object;
+            if (hash->trie != NULL) {
+                // tries are immutable, share the structure instead of copying it
+                object_hash *copy = object_create_hash(nullptr);
+                copy->trie        = hamt_retain(hash->trie);
+                return (object_object *) copy;
+            }
+            hashtable *pairs = hashtable_clone(hash->pairs, _object_copy_object, _object_copy_object);
             return (object_object *) object_create_hash(pairs);
         }
 
@@ -518,6 +620,9 @@ object_string *object_create_string(const char *value, const size_t length) {
         string_obj->value  = nullptr;
         string_obj->length = 0;
     }
+    string_obj->left            = nullptr;
+    string_obj->right           = nullptr;
+    string_obj->parent          = nullptr;
     string_obj->object.type     = OBJECT_STRING;
     string_obj->object.hash     = object_get_hash;
     string_obj->object.inspect  = inspect;
@@ -526,6 +631,101 @@ object_string *object_create_string(const char *value, const size_t length) {
     return string_obj;
 }
 
+/**
+ * Concatenate two strings. Short results are copied into a new flat string, longer ones
+ * become a rope node that references both halves, which keeps `s = s + x` loops linear.
+ */
+object_string *object_string_concat(object_string *left, object_string *right) {
+    const size_t length = left->length + right->length;
+    if (length < STRING_ROPE_THRESHOLD) {
+        char *value = malloc(length + 1);
+        if (value == NULL) {
+            err(EXIT_FAILURE, "malloc failed");
+        }
+        memcpy(value, object_string_value(left), left->length);
+        memcpy(value + left->length, object_string_value(right), right->length);
+        value[length]         = 0;
+        object_string *result = object_create_string(nullptr, 0);
+        result->value         = value;
+        result->length        = length;
+        return result;
+    }
+    object_string *rope = object_create_string(nullptr, 0);
+    left->object.refcount++;
+    right->object.refcount++;
+    rope->left   = left;
+    rope->right  = right;
+    rope->length = length;
+    return rope;
+}
+
+/**
+ * Copy the leaves of a rope into one buffer and drop the children, so later reads of
+ * the same node are O(1).
+ */
+static void string_flatten(object_string *rope) {
+    size_t          count    = 0;
+    size_t          capacity = 16;
+    size_t          offset   = 0;
+    object_string **pending  = malloc(sizeof(*pending) * capacity);
+    char *          value    = malloc(rope->length + 1);
+    if (pending == NULL || value == NULL) {
+        err(EXIT_FAILURE, "malloc failed");
+    }
+    pending[count++] = rope;
+    while (count > 0) {
+        object_string *str = pending[--count];
+        if (str->left == NULL) {
+            memcpy(value + offset, object_string_value(str), str->length);
+            offset += str->length;
+            continue;
+        }
+        if (count + 2 > capacity) {
+            capacity *= 2;
+            pending = realloc(pending, sizeof(*pending) * capacity);
+            if (pending == NULL) {
+                err(EXIT_FAILURE, "malloc failed");
+            }
+        }
+        // the right half goes first so the left half is copied first
+        pending[count++] = str->right;
+        pending[count++] = str->left;
+    }
+    free(pending);
+    value[rope->length] = 0;
+    rope->value         = value;
+    object_free(rope->left);
+    object_free(rope->right);
+    rope->left  = nullptr;
+    rope->right = nullptr;
+}
+
+/**
+ * Return a view of `length` characters of `str` starting at `offset`. The view shares the
+ * buffer of the string it was taken from instead of copying it.
+ */
+object_string *object_string_slice(object_string *str, const size_t offset, const size_t length) {
+    object_string *parent = str->parent != NULL ? str->parent : str;
+    const char *   value  = object_string_value(str);
+    object_string *view   = object_create_string(nullptr, 0);
+    parent->object.refcount++;
+    view->parent = parent;
+    view->value  = (char *) value + offset;
+    view->length = length;
+    return view;
+}
+
+/**
+ * Return the characters of the string, flattening it first if it is a rope. The result
+ * is only NUL terminated for strings that are not views.
+ */
+const char *object_string_value(object_string *str) {
+    if (str->value == NULL && str->left != NULL) {
+        string_flatten(str);
+    }
+    return str->value;
+}
+
 object_builtin *object_create_builtin(builtin_fn function) {
     object_builtin *builtin = malloc(sizeof(*builtin));
     if (builtin == NULL) {
@@ -535,6 +735,7 @@ object_builtin *object_create_builtin(builtin_fn function) {
     builtin->object.inspect  = inspect;
     builtin->object.hash     = nullptr;
     builtin->function        = function;
+    builtin->pure            = false;
     builtin->object.refcount = 1;
     return builtin;
 }
@@ -548,12 +749,183 @@ object_array *object_create_array(arraylist *elements) {
     array->object.inspect  = inspect;
     array->object.hash     = nullptr;
     array->elements        = elements;
+    array->vector          = nullptr;
+    array->ints            = nullptr;
+    array->offset          = 0;
+    array->length          = 0;
     array->object.equals   = object_equals;
     array->object.refcount = 1;
 
     return array;
 }
 
+object_array *object_create_array_from_vector(pvector *vector) {
+    object_array *array = object_create_array(nullptr);
+    array->vector       = vector;
+    return array;
+}
+
+/**
+ * Take another reference to an element stored in a persistent vector. Objects are never
+ * mutated once they are part of an array, so versions of a vector can share them.
+ */
+static void *object_retain(void *v) {
+    object_object *object = v;
+    if (object->type != OBJECT_BUILTIN && object->type != OBJECT_BOOL && object->type != OBJECT_NULL) {
+        object->refcount++;
+    }
+    return object;
+}
+
+/**
+ * Return a persistent vector holding the elements of the array, the caller owns the returned
+ * reference. Vector backed arrays hand out their own vector, literal arrays are converted once.
+ */
+pvector *object_array_to_vector(const object_array *array) {
+    if (array->vector != NULL) {
+        return pvector_retain(array->vector);
+    }
+    pvector *vector = pvector_create(object_retain, object_free);
+    if (array->ints != NULL) {
+        for (size_t i = 0; i < array->length; i++) {
+            pvector *next = pvector_push(vector, object_create_int(array->ints->data[array->offset + i]));
+            pvector_free(vector);
+            vector = next;
+        }
+        return vector;
+    }
+    for (size_t i = 0; i < array->elements->size; i++) {
+        pvector *next = pvector_push(vector, object_retain(array->elements->body[i]));
+        pvector_free(vector);
+        vector = next;
+    }
+    return vector;
+}
+
+size_t object_array_length(const object_array *array) {
+    if (array->vector != NULL) {
+        return pvector_size(array->vector);
+    }
+    if (array->ints != NULL) {
+        return array->length;
+    }
+    return array->elements->size;
+}
+
+/**
+ * Return a new reference to the element at `index`, or nullptr when out of bounds.
+ * Elements of packed arrays are boxed on the way out.
+ */
+object_object *object_array_get(const object_array *array, const size_t index) {
+    if (index >= object_array_length(array)) {
+        return nullptr;
+    }
+    if (array->ints != NULL) {
+        return (object_object *) object_create_int(array->ints->data[array->offset + index]);
+    }
+    if (array->vector != NULL) {
+        return object_retain(pvector_get(array->vector, index));
+    }
+    return object_retain(array->elements->body[index]);
+}
+
+/**
+ * Create an array from a list of evaluated elements, taking ownership of the list. When
+ * every element is an integer the values are moved into an int_buffer and the list is
+ * destroyed, otherwise the list backs the array as is.
+ */
+object_array *object_pack_array(arraylist *elements) {
+    for (size_t i = 0; i < elements->size; i++) {
+        const object_object *elem = elements->body[i];
+        if (elem->type != OBJECT_INT) {
+            return object_create_array(elements);
+        }
+    }
+    int_buffer *ints = int_buffer_create(elements->size);
+    for (size_t i = 0; i < elements->size; i++) {
+        object_int *elem = elements->body[i];
+        ints->data[i]    = elem->value;
+        if (!elements->free_func) {
+            object_free(elem);
+        }
+    }
+    ints->used = elements->size;
+    arraylist_destroy(elements);
+    return create_packed_array(ints, 0, ints->used);
+}
+
+/**
+ * Return a new packed array with `value` appended. The buffer is shared with the source
+ * array whenever it can be appended to in place.
+ */
+object_array *object_array_push_int(const object_array *array, const int64_t value) {
+    size_t      offset = array->offset;
+    int_buffer *ints   = int_buffer_append(array->ints, &offset, array->length, value);
+    return create_packed_array(ints, offset, array->length + 1);
+}
+
+/**
+ * Return a new array without the first element. Both the persistent vector and int
+ * buffers are shared with the source array.
+ */
+object_array *object_array_rest(const object_array *array) {
+    if (array->ints != NULL) {
+        return create_packed_array(int_buffer_retain(array->ints), array->offset + 1, array->length - 1);
+    }
+    pvector *     vector = object_array_to_vector(array);
+    object_array *rest   = object_create_array_from_vector(pvector_rest(vector));
+    pvector_free(vector);
+    return rest;
+}
+
+/**
+ * Element-wise `+`, `-` or `*` of two packed arrays of the same length. Returns nullptr
+ * when the operands can't be combined, leaving the error message to the caller.
+ */
+object_array *object_array_arithmetic(const object_array *left, const object_array *right, const char op) {
+    if (left->ints == NULL || right->ints == NULL || left->length != right->length) {
+        return nullptr;
+    }
+    const int64_t *a    = left->ints->data + left->offset;
+    const int64_t *b    = right->ints->data + right->offset;
+    int_buffer *   ints = int_buffer_create(left->length);
+    switch (op) {
+        case '+':
+            int64_add(ints->data, a, b, left->length);
+            break;
+        case '-':
+            int64_sub(ints->data, a, b, left->length);
+            break;
+        case '*':
+            int64_mul(ints->data, a, b, left->length);
+            break;
+        default:
+            int_buffer_free(ints);
+            return nullptr;
+    }
+    ints->used = left->length;
+    return create_packed_array(ints, 0, ints->used);
+}
+
+/**
+ * Move the pairs of a large hashtable into a persistent trie. The trie takes its own
+ * references, so the table can be destroyed afterwards.
+ */
+static hamt *hash_pairs_to_trie(const hashtable *pairs) {
+    hamt *     trie = hamt_create(object_get_hash, object_equals, object_retain, object_retain, object_free, object_free);
+    arraylist *keys = hashtable_get_keys(pairs);
+    for (size_t i = 0; keys != NULL && i < keys->size; i++) {
+        object_object *key  = keys->body[i];
+        hamt *         next = hamt_set(trie, object_retain(key), object_retain(hashtable_get(pairs, key)));
+        hamt_free(trie);
+        trie = next;
+    }
+    if (keys != NULL) {
+        arraylist_destroy(keys);
+    }
+    return trie;
+}
+
 object_hash *object_create_hash(hashtable *pairs) {
     object_hash *hash_obj = malloc(sizeof(*hash_obj));
     if (hash_obj == NULL) {
@@ -564,11 +936,45 @@ object_hash *object_create_hash(hashtable *pairs) {
     hash_obj->object.hash     = nullptr;
     hash_obj->object.equals   = object_equals;
     hash_obj->pairs           = pairs;
+    hash_obj->trie            = nullptr;
     hash_obj->object.refcount = 1;
 
+    if (pairs != NULL && pairs->key_count > HASH_TRIE_THRESHOLD) {
+        hash_obj->trie  = hash_pairs_to_trie(pairs);
+        hash_obj->pairs = nullptr;
+        hashtable_destroy(pairs);
+    }
     return hash_obj;
 }
 
+size_t object_hash_count(const object_hash *hash) {
+    if (hash->trie != NULL) {
+        return hamt_count(hash->trie);
+    }
+    return hash->pairs->key_count;
+}
+
+/**
+ * Return the value stored for `key` without taking a reference, or NULL if not found.
+ */
+object_object *object_hash_get(const object_hash *hash, object_object *key) {
+    if (hash->trie != NULL) {
+        return hamt_get(hash->trie, key);
+    }
+    return hashtable_get(hash->pairs, key);
+}
+
+/**
+ * Return a list of the keys of the hash, or NULL if the hash is empty.
+ * The list does not own the keys; destroy it with arraylist_destroy.
+ */
+arraylist *object_hash_keys(const object_hash *hash) {
+    if (hash->trie != NULL) {
+        return hamt_get_keys(hash->trie);
+    }
+    return hashtable_get_keys(hash->pairs);
+}
+
 object_int *object_create_int(const long value) {
     object_int *int_obj = malloc(sizeof(object_int));
     if (int_obj == NULL) {
@@ -645,6 +1051,7 @@ object_compiled_fn *object_create_compiled_fn(instructions *ins, const size_t nu
     // Copy metadata
     compiled_fn->instructions->length   = ins->length;
     compiled_fn->instructions->capacity = ins->capacity;
+    compiled_fn->instructions->format   = ins->format;
 
     // Allocate and copy the bytes
     compiled_fn->instructions->bytes = malloc(ins->length);
@@ -7,6 +7,9 @@
 
 #include "../ast/ast.h"
 #include "../datastructures/arraylist.h"
+#include "../datastructures/hamt.h"
+#include "../datastructures/int_buffer.h"
+#include "../datastructures/pvector.h"
 #include "environment.h"
 #include "../opcode/opcode.h"
 #include <stddef.h>
@@ -43,6 +46,8 @@ static const char *type_names[] = {
 };
 
 #define MAX_FREE_VARIABLES 256
+#define HASH_TRIE_THRESHOLD 64
+#define STRING_ROPE_THRESHOLD 256
 #define get_type_name(type) type_names[type]
 
 typedef struct object_object {
@@ -88,10 +93,21 @@ typedef struct {
     environment *        env;
 } object_function;
 
-typedef struct {
-    object_object object;
-    char *        value;
-    size_t        length;
+/**
+ * Strings are immutable. A concatenation whose result is at least STRING_ROPE_THRESHOLD
+ * bytes long is stored as a rope node: `value` stays NULL and `left`/`right` hold the
+ * two halves until object_string_value flattens the node on demand.
+ *
+ * A slice is a view: `value` points into the buffer of `parent`, which the view keeps
+ * alive, and is not NUL terminated. Always pair `value` with `length`.
+ */
+typedef struct object_string {
+    object_object         object;
+    char *                value;
+    size_t                length;
+    struct object_string *left;
+    struct object_string *right;
+    struct object_string *parent;
 } object_string;
 
 typedef struct {
@@ -106,16 +122,36 @@ typedef object_object *(*builtin_fn)(linked_list *);
 typedef struct {
     object_object object;
     builtin_fn    function;
+    bool          pure; // no side effects, so calling it only produces its result
 } object_builtin;
 
+/**
+ * Arrays built from literals are backed by `elements`. Arrays produced by push and rest
+ * are backed by the persistent `vector` instead, which shares structure with the array
+ * they were derived from. Arrays holding only integers are stored unboxed in the
+ * [offset, offset + length) slice of `ints`, which push and rest share the same way.
+ * Exactly one of the three is set; use object_array_length and object_array_get to read
+ * any of them.
+ */
 typedef struct {
     object_object object;
     arraylist *   elements;
+    pvector *     vector;
+    int_buffer *  ints;
+    size_t        offset;
+    size_t        length;
 } object_array;
 
+/**
+ * Hashes with up to HASH_TRIE_THRESHOLD pairs are backed by the `pairs` hashtable.
+ * Larger hashes are moved into the persistent `trie`, which keeps lookups O(log32 n)
+ * and lets copies share the whole structure. Exactly one of the two is set; use the
+ * object_hash_* functions to read either.
+ */
 typedef struct {
     object_object object;
     hashtable *   pairs;
+    hamt *        trie;
 } object_hash;
 
 typedef struct {
@@ -135,7 +171,7 @@ extern const object_bool TRUE_OBJ;
 extern const object_bool FALSE_OBJ;
 extern const object_null NULL_OBJ;
 
-#define object_create_bool(val) ((val == true) ? ((object_bool *) &TRUE_OBJ) : ((object_bool *) &FALSE_OBJ))
+#define object_create_bool(val) (((val) == true) ? ((object_bool *) &TRUE_OBJ) : ((object_bool *) &FALSE_OBJ))
 #define object_create_null() (&NULL_OBJ)
 
 
@@ -148,12 +184,40 @@ object_function *object_create_function(linked_list *, ast_block_statement *,
 
 object_string *object_create_string(const char *, size_t);
 
+object_string *object_string_concat(object_string *, object_string *);
+
+object_string *object_string_slice(object_string *, size_t, size_t);
+
+const char *object_string_value(object_string *);
+
 object_builtin *object_create_builtin(builtin_fn);
 
 object_array *object_create_array(arraylist *);
 
+object_array *object_create_array_from_vector(pvector *);
+
+pvector *object_array_to_vector(const object_array *);
+
+size_t object_array_length(const object_array *);
+
+object_object *object_array_get(const object_array *, size_t);
+
+object_array *object_pack_array(arraylist *);
+
+object_array *object_array_push_int(const object_array *, int64_t);
+
+object_array *object_array_rest(const object_array *);
+
+object_array *object_array_arithmetic(const object_array *, const object_array *, char);
+
 object_hash *object_create_hash(hashtable *);
 
+size_t object_hash_count(const object_hash *);
+
+object_object *object_hash_get(const object_hash *, object_object *);
+
+arraylist *object_hash_keys(const object_hash *);
+
 object_return_value *object_create_return_value(object_object *);
 
 object_compiled_fn *object_create_compiled_fn(instructions *, size_t, size_t);
@@ -15,19 +15,58 @@ OpcodeDefinition *opcode_definition_lookup(const Opcode op) {
     return &opcode_definitions[op - 1];
 }
 
-// Function to create instruction
-instructions *opcode_make_instruction(Opcode op, size_t *operands) {
+/**
+ * OP_WIDE in front of an instruction doubles the width of each of its operands, so
+ * that one byte operands take two and two byte operands take four. Instructions are
+ * only made wide when their operands don't fit otherwise.
+ */
+static size_t operand_width(const OpcodeDefinition *def, const size_t i, const bool wide) {
+    return wide ? 2 * def->operand_widths[i] : def->operand_widths[i];
+}
+
+/** Whether the operands can be encoded in the compact form, or the wide one. */
+bool opcode_operands_fit(const Opcode op, const size_t *operands, const bool wide) {
+    const OpcodeDefinition *def = opcode_definition_lookup(op);
+    if (!def) {
+        return false;
+    }
+    for (int i = 0; i < def->operand_count; i++) {
+        const size_t bits = 8 * operand_width(def, i, wide);
+        if (bits < 8 * sizeof(size_t) && operands[i] >> bits != 0)
+            return false;
+    }
+    return true;
+}
+
+/** The number of bytes an instruction takes, OP_WIDE included. */
+size_t opcode_instruction_width(const Opcode op, const bool wide) {
+    const OpcodeDefinition *def   = opcode_definition_lookup(op);
+    size_t                  width = wide && def->operand_count > 0 ? 2 : 1;
+    for (int i = 0; i < def->operand_count; i++)
+        width += operand_width(def, i, wide && def->operand_count > 0);
+    return width;
+}
+
+/** The number of bytes the instruction starting at `bytes` takes. */
+size_t opcode_instruction_length(const uint8_t *bytes) {
+    return bytes[0] == OP_WIDE ? opcode_instruction_width(bytes[1], true) : opcode_instruction_width(bytes[0], false);
+}
+
+/** Whether the instruction's operand is the position it jumps to. */
+bool opcode_is_jump(const Opcode op) {
+    return op == OP_JUMP || op == OP_JUMP_NOT_TRUTHY || op == OP_JUMP_TRUTHY || op == OP_LOOP;
+}
+
+static instructions *make_instruction(const Opcode op, size_t *operands, bool wide) {
     OpcodeDefinition *def = opcode_definition_lookup(op);
 
     if (!def) {
         return nullptr;
     }
+    wide = wide && def->operand_count > 0;
 
     // Calculate instruction length
-    char instruction_len = 1; // Opcode itself
-    for (char i = 0; i < def->operand_count; i++) {
-        instruction_len += def->operand_widths[i];
-    }
+    const size_t instruction_len = opcode_instruction_width(op, wide);
 
     // Allocate memory for the instruction
     instructions *instruction = malloc(sizeof(instructions));
@@ -41,26 +80,40 @@ instructions *opcode_make_instruction(Opcode op, size_t *operands) {
     }
 
     // Set the Opcode
-    instruction->bytes[0] = op;
+    size_t offset = 0;
+    if (wide)
+        instruction->bytes[offset++] = OP_WIDE;
+    instruction->bytes[offset++] = op;
 
     // TODO: Check if operands array matches required operand_count
-    // Set the operands
-    int offset = 1;
+    // Set the operands, big endian
     for (int i = 0; i < def->operand_count; i++) {
-        int width = def->operand_widths[i];
-        if (width == 2) {
-            put_uint16_big_endian(&instruction->bytes[offset], 2, (uint16_t) operands[i]);
-        } else if (width == 1) {
-            instruction->bytes[offset] = (uint8_t) operands[i];
-        }
+        const size_t width = operand_width(def, i, wide);
+        for (size_t j = 0; j < width; j++)
+            instruction->bytes[offset + j] = (uint8_t) (operands[i] >> 8 * (width - 1 - j));
         offset += width;
     }
 
-    instruction->length = instruction->capacity = (unsigned char) instruction_len;
+    instruction->length = instruction->capacity = instruction_len;
+    instruction->format                         = INSTRUCTIONS_BYTES;
 
     return instruction;
 }
 
+// Function to create instruction, in the compact form unless its operands need the wide one
+instructions *opcode_make_instruction(Opcode op, size_t *operands) {
+    if (opcode_operands_fit(op, operands, false))
+        return make_instruction(op, operands, false);
+    if (opcode_operands_fit(op, operands, true))
+        return make_instruction(op, operands, true);
+    return nullptr;
+}
+
+// Function to create instruction with OP_WIDE in front, whatever its operands are
+instructions *opcode_make_wide_instruction(Opcode op, size_t *operands) {
+    return opcode_operands_fit(op, operands, true) ? make_instruction(op, operands, true) : nullptr;
+}
+
 // Read operands from instruction
 void read_operands(const OpcodeDefinition *def, const uint8_t *ins, size_t *operands, size_t *bytes_read) {
     *bytes_read = 0;
@@ -134,19 +187,69 @@ instructions *opcode_flatten_instructions(size_t n, instructions *ins_array[n])
     flat_ins->bytes    = bytes;
     flat_ins->length   = bytes_len;
     flat_ins->capacity = bytes_len;
+    flat_ins->format   = n > 0 ? ins_array[0]->format : INSTRUCTIONS_BYTES;
     return flat_ins;
 }
 
+/** Add an instruction to the listing, with `prefix` in front of its name. */
+static char *append_instruction(char *string, const size_t position, const char *prefix,
+                                const OpcodeDefinition *def, const size_t *operands) {
+    char *line;
+    if (asprintf(&line, "%s%04zu %s%s", string == NULL ? "" : "\n", position, prefix, def->name) == -1)
+        err(EXIT_FAILURE, "malloc failed");
+    for (int i = 0; i < def->operand_count; i++) {
+        char *temp = nullptr;
+        if (asprintf(&temp, "%s %zu", line, operands[i]) == -1)
+            err(EXIT_FAILURE, "malloc failed");
+        free(line);
+        line = temp;
+    }
+    char *temp = nullptr;
+    if (asprintf(&temp, "%s%s", string == NULL ? "" : string, line) == -1)
+        err(EXIT_FAILURE, "malloc failed");
+    free(line);
+    free(string);
+    return temp;
+}
+
+/** Add a wide instruction to the listing, with OP_WIDE in front of its name. */
+static char *append_wide_instruction(char *string, const size_t position, const uint8_t *bytes) {
+    size_t       operands[MAX_OPERANDS];
+    const Opcode op = vm_instruction_decode(bytes, operands);
+    return append_instruction(string, position, "OP_WIDE ", opcode_definition_lookup(op), operands);
+}
+
+/** The listing of aligned instructions, which are numbered by word rather than byte. */
+static char *aligned_to_string(const instructions *ins) {
+    const uint32_t *words = (const uint32_t *) ins->bytes;
+    const size_t    count = ins->length / sizeof(*words);
+    char *          string = nullptr;
+    size_t          operands[MAX_OPERANDS];
+    size_t          width;
+    for (size_t i = 0; i < count; i += width) {
+        const Opcode op = opcode_decode_aligned(words + i, operands, &width);
+        if (op == OP_INVALID)
+            break;
+        string = append_instruction(string, i, width == 2 ? "OP_WIDE " : "", opcode_definition_lookup(op), operands);
+    }
+    return string;
+}
+
 char *instructions_to_string(instructions *instructions) {
+    if (instructions->format == INSTRUCTIONS_ALIGNED)
+        return aligned_to_string(instructions);
     char *string = nullptr;
     for (size_t i = 0; i < instructions->length; i++) {
         Opcode            op = instructions->bytes[i];
         size_t            operand;
+        size_t            operands[MAX_OPERANDS];
         OpcodeDefinition *op_def = opcode_definition_lookup(op);
         switch (op) {
             case OP_CONSTANT:
             case OP_JUMP_NOT_TRUTHY:
+            case OP_JUMP_TRUTHY:
             case OP_JUMP:
+            case OP_LOOP:
             case OP_SET_GLOBAL:
             case OP_GET_GLOBAL:
             case OP_ARRAY:
@@ -220,6 +323,7 @@ char *instructions_to_string(instructions *instructions) {
             case OP_SUB:
             case OP_MUL:
             case OP_DIV:
+            case OP_MOD:
             case OP_TRUE:
             case OP_FALSE:
             case OP_GREATER_THAN:
@@ -232,6 +336,7 @@ char *instructions_to_string(instructions *instructions) {
             case OP_RETURN:
             case OP_RETURN_VALUE:
             case OP_CURRENT_CLOSURE:
+            case OP_DUP:
                 if (string == NULL) {
                     int retval = asprintf(&string, "%04zu %s", i, op_def->name);
                     if (retval == -1)
@@ -245,6 +350,18 @@ char *instructions_to_string(instructions *instructions) {
                     string = temp;
                 }
                 break;
+            case OP_INCREMENT_GLOBAL:
+            case OP_INCREMENT_LOCAL:
+            case OP_LESS_THAN_GLOBAL:
+            case OP_LESS_THAN_LOCAL:
+                vm_instruction_decode(instructions->bytes + i, operands);
+                string = append_instruction(string, i, "", op_def, operands);
+                i += opcode_instruction_length(instructions->bytes + i) - 1;
+                break;
+            case OP_WIDE:
+                string = append_wide_instruction(string, i, instructions->bytes + i);
+                i += opcode_instruction_length(instructions->bytes + i) - 1;
+                break;
             case OP_POP:
                 if (string == NULL) {
                     int retval = asprintf(&string, "%04zu %s", i, "OPPOP");
@@ -308,6 +425,7 @@ instructions *opcode_copy_instructions(instructions *ins) {
     // Copy the length and capacity
     ret->length   = ins->length;
     ret->capacity = ins->capacity;
+    ret->format   = ins->format;
 
     return ret;
 }
@@ -318,17 +436,18 @@ Opcode vm_instruction_decode(const uint8_t *bytes, size_t *operands) {
         return OP_INVALID; // Return an invalid opcode if input is NULL
     }
 
-    Opcode            op  = bytes[0];
-    OpcodeDefinition *def = opcode_definition_lookup(op);
+    const bool        wide = bytes[0] == OP_WIDE;
+    Opcode            op   = bytes[wide];
+    OpcodeDefinition *def  = opcode_definition_lookup(op);
 
     if (!def) {
         return OP_INVALID; // Return invalid opcode if not found
     }
 
-    size_t offset = 1;
+    size_t offset = wide ? 2 : 1;
     for (size_t i = 0; i < def->operand_count; i++) {
         operands[i] = 0;
-        for (size_t j = 0; j < def->operand_widths[i]; j++) {
+        for (size_t j = 0; j < operand_width(def, i, wide); j++) {
             operands[i] <<= 8;
             operands[i] |= bytes[offset++];
         }
@@ -336,3 +455,120 @@ Opcode vm_instruction_decode(const uint8_t *bytes, size_t *operands) {
 
     return op;
 }
+
+/**
+ * Pack operands `from` up to `to` into the high 24 bits of an aligned word. A lone
+ * operand gets all of them, several get the widths of their compact form. Returns
+ * false if they don't fit, which those widths adding up to more than 24 bits never do.
+ */
+static bool pack_operands(const OpcodeDefinition *def, const size_t *operands, const int from, const int to,
+                          uint32_t *word) {
+    size_t shift = 8;
+    for (int i = from; i < to; i++) {
+        const size_t bits = to - from == 1 ? ALIGNED_OPERAND_BITS : 8 * def->operand_widths[i];
+        if (shift + bits > 32 || operands[i] >> bits != 0)
+            return false;
+        *word |= (uint32_t) operands[i] << shift;
+        shift += bits;
+    }
+    return true;
+}
+
+static void unpack_operands(const OpcodeDefinition *def, const uint32_t word, const int from, const int to,
+                            size_t *operands) {
+    size_t shift = 8;
+    for (int i = from; i < to; i++) {
+        const size_t bits = to - from == 1 ? ALIGNED_OPERAND_BITS : 8 * def->operand_widths[i];
+        operands[i]       = word >> shift & ((UINT32_C(1) << bits) - 1);
+        shift += bits;
+    }
+}
+
+/**
+ * Write the aligned form of an instruction into `words` and return how many it takes:
+ * one, or two when its operands don't fit in one together, the first then going in an
+ * OP_WIDE word in front and the rest in the instruction's own. Returns 0 if they don't
+ * fit either way.
+ */
+static size_t align_instruction(const Opcode op, const size_t *operands, uint32_t words[2]) {
+    const OpcodeDefinition *def = opcode_definition_lookup(op);
+    words[0]                    = (uint8_t) op;
+    if (pack_operands(def, operands, 0, def->operand_count, &words[0]))
+        return 1;
+    words[0] = OP_WIDE;
+    words[1] = (uint8_t) op;
+    if (def->operand_count > 1 && pack_operands(def, operands, 0, 1, &words[0]) &&
+        pack_operands(def, operands, 1, def->operand_count, &words[1]))
+        return 2;
+    return 0;
+}
+
+/**
+ * The instructions in the aligned format, where each is a native endian 32 bit word with
+ * the opcode in its low byte and the operands in the rest, so that decoding one takes a
+ * single load and a mask. Jumps go to the index of a word rather than of a byte. Returns
+ * nullptr if an operand doesn't fit in the 24 bits.
+ */
+instructions *opcode_align_instructions(const instructions *ins) {
+    size_t   operands[MAX_OPERANDS];
+    uint32_t scratch[2];
+    // the word each instruction starts at, by the byte it started at, for the jumps
+    size_t *starts = malloc((ins->length + 1) * sizeof(*starts));
+    if (starts == NULL) {
+        err(EXIT_FAILURE, "malloc failed");
+    }
+    size_t count = 0;
+    for (size_t i = 0; i < ins->length; i += opcode_instruction_length(ins->bytes + i)) {
+        const Opcode op = vm_instruction_decode(ins->bytes + i, operands);
+        starts[i]       = count;
+        count += opcode_is_jump(op) ? 1 : align_instruction(op, operands, scratch);
+    }
+    starts[ins->length] = count;
+
+    uint32_t *words = malloc((count + 1) * sizeof(*words));
+    if (words == NULL) {
+        err(EXIT_FAILURE, "malloc failed");
+    }
+    size_t length = 0;
+    for (size_t i = 0; i < ins->length; i += opcode_instruction_length(ins->bytes + i)) {
+        const Opcode op = vm_instruction_decode(ins->bytes + i, operands);
+        if (opcode_is_jump(op))
+            operands[0] = starts[operands[0]];
+        const size_t width = align_instruction(op, operands, scratch);
+        if (width == 0) {
+            free(starts);
+            free(words);
+            return nullptr;
+        }
+        memcpy(words + length, scratch, width * sizeof(*words));
+        length += width;
+    }
+    free(starts);
+
+    instructions *aligned = malloc(sizeof(*aligned));
+    if (aligned == NULL) {
+        err(EXIT_FAILURE, "malloc failed");
+    }
+    aligned->bytes    = (uint8_t *) words;
+    aligned->length   = aligned->capacity = length * sizeof(*words);
+    aligned->format   = INSTRUCTIONS_ALIGNED;
+    return aligned;
+}
+
+/** Decode the aligned instruction starting at `words`, and how many words it takes. */
+Opcode opcode_decode_aligned(const uint32_t *words, size_t *operands, size_t *word_count) {
+    const bool   wide = aligned_opcode(words[0]) == OP_WIDE;
+    const Opcode op   = aligned_opcode(words[wide]);
+    if (op < OP_CONSTANT || op >= OP_WIDE) {
+        return OP_INVALID;
+    }
+    const OpcodeDefinition *def = opcode_definition_lookup(op);
+    if (wide) {
+        unpack_operands(def, words[0], 0, 1, operands);
+        unpack_operands(def, words[1], 1, def->operand_count, operands);
+    } else {
+        unpack_operands(def, words[0], 0, def->operand_count, operands);
+    }
+    *word_count = wide ? 2 : 1;
+    return op;
+}
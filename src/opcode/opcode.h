@@ -5,13 +5,26 @@
 #include <stdint.h>
 
 #define MAX_OPERANDS 16
+#define ALIGNED_OPERAND_BITS 24
+
+/** How instructions are laid out in their bytes. */
+typedef enum : uint8_t {
+    INSTRUCTIONS_BYTES,  // an opcode byte followed by big endian operands, as compact as they fit
+    INSTRUCTIONS_ALIGNED // a native endian 32 bit word each, see opcode_align_instructions
+} instruction_format;
 
 typedef struct {
-    uint8_t *bytes;    // Pointer to the instruction byte array
-    size_t   capacity; // Current size of the byte array
-    size_t   length;   // Number of bytes currently used
+    uint8_t *          bytes;    // Pointer to the instruction byte array
+    size_t             capacity; // Current size of the byte array
+    size_t             length;   // Number of bytes currently used
+    instruction_format format;
 } instructions;
 
+/** The opcode of an aligned instruction word, in its low byte. */
+#define aligned_opcode(word) ((Opcode) ((word) & 0xFF))
+/** The operand of an aligned instruction word, or its operands packed together, in the high 24 bits. */
+#define aligned_operand(word) ((size_t) ((word) >> 8))
+
 // Opcode enumeration, 1 byte
 typedef enum : char {
     OP_CONSTANT = 1,
@@ -44,6 +57,15 @@ typedef enum : char {
     OP_CLOSURE,
     OP_GET_FREE,
     OP_CURRENT_CLOSURE,
+    OP_JUMP_TRUTHY,
+    OP_DUP,
+    OP_MOD,
+    OP_LOOP,
+    OP_INCREMENT_GLOBAL,
+    OP_INCREMENT_LOCAL,
+    OP_LESS_THAN_GLOBAL,
+    OP_LESS_THAN_LOCAL,
+    OP_WIDE,
     OP_INVALID
 } Opcode;
 
@@ -86,6 +108,15 @@ static OpcodeDefinition opcode_definitions[] = {
     {"OP_CLOSURE", "closure", {2, 1}, 2},
     {"OP_GET_FREE", "get_free", {1}, 1},
     {"OP_CURRENT_CLOSURE", "current_closure", {0}, 0},
+    {"OP_JUMP_TRUTHY", "jump_if_true", {2}, 1},
+    {"OP_DUP", "dup", {0}, 0},
+    {"OP_MOD", "%", {0}, 0},
+    {"OP_LOOP", "loop", {2}, 1},
+    {"OP_INCREMENT_GLOBAL", "increment_global", {2, 2}, 2},
+    {"OP_INCREMENT_LOCAL", "increment_local", {1, 2}, 2},
+    {"OP_LESS_THAN_GLOBAL", "less_than_global", {2, 2}, 2},
+    {"OP_LESS_THAN_LOCAL", "less_than_local", {1, 1}, 2},
+    {"OP_WIDE", "wide", {0}, 0},
     {"OP_INVALID", "invalid", {0}, 0}
 };
 
@@ -93,6 +124,20 @@ static OpcodeDefinition opcode_definitions[] = {
 //instructions *instruction_init(Opcode, size_t *operands, size_t operand_count);
 instructions *opcode_make_instruction(Opcode op, size_t *operands);
 
+instructions *opcode_make_wide_instruction(Opcode op, size_t *operands);
+
+bool opcode_operands_fit(Opcode op, const size_t *operands, bool wide);
+
+size_t opcode_instruction_width(Opcode op, bool wide);
+
+size_t opcode_instruction_length(const uint8_t *bytes);
+
+bool opcode_is_jump(Opcode op);
+
+instructions *opcode_align_instructions(const instructions *ins);
+
+Opcode opcode_decode_aligned(const uint32_t *words, size_t *operands, size_t *word_count);
+
 void read_operands(const OpcodeDefinition *def, const uint8_t *ins, size_t *operands, size_t *bytes_read);
 
 void concat_instructions(instructions *, instructions *);
@@ -0,0 +1,237 @@
+//
+// Created by dgood on 1/22/25.
+//
+
+#include "parallel_parser.h"
+#include <ctype.h>
+#include <err.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include "parser_tracing.h"
+
+typedef struct {
+    size_t          start; // offset of the chunk in the input
+    size_t          end;   // offset just past the chunk
+    ast_statement **statements;
+    size_t          statement_count;
+    size_t          statement_capacity;
+    linked_list *   errors;
+} parse_chunk;
+
+typedef struct {
+    const char *  input;
+    parse_chunk * chunks;
+    size_t        chunk_count;
+    atomic_size_t next; // next chunk to be picked up by a thread
+} parse_job;
+
+static void add_chunk(parse_chunk **chunks, size_t *count, size_t *capacity, const size_t start, const size_t end) {
+    if (*count == *capacity) {
+        *capacity *= 2;
+        *chunks = reallocarray(*chunks, *capacity, sizeof(**chunks));
+        if (*chunks == NULL) {
+            err(EXIT_FAILURE, "malloc failed");
+        }
+    }
+    (*chunks)[(*count)++] = (parse_chunk){start, end, nullptr, 0, 0, nullptr};
+}
+
+#define is_word_character(c) (isalnum((unsigned char) (c)) || (c) == '_')
+#define is_whitespace(c) ((c) == ' ' || (c) == '\n' || (c) == '\r' || (c) == '\t')
+
+static bool is_statement_keyword(const char *word, const size_t length) {
+    return (length == 3 && memcmp(word, "let", 3) == 0) || (length == 6 && memcmp(word, "return", 6) == 0);
+}
+
+/**
+ * Split the input into chunks of at least `target` bytes that only break between top
+ * level statements: before the token after a semicolon, or before a let or return,
+ * outside of any brackets. The parser ends a statement at each of those, so the chunks
+ * parse to the same statements the whole input does.
+ *
+ * This runs on one thread ahead of the others, so instead of lexing it only looks at
+ * what it needs: brackets, semicolons, strings and whole words.
+ */
+static parse_chunk *split_chunks(const char *input, const size_t length, const size_t target, size_t *count) {
+    size_t       capacity = 16;
+    parse_chunk *chunks   = malloc(capacity * sizeof(*chunks));
+    if (chunks == NULL) {
+        err(EXIT_FAILURE, "malloc failed");
+    }
+    *count = 0;
+
+    long   depth = 0;
+    size_t start = 0;
+    size_t i     = 0;
+    while (i < length) {
+        const char c = input[i];
+        if (c == '"') {
+            const char *end = memchr(input + i + 1, '"', length - i - 1);
+            i               = end != NULL ? (size_t) (end - input) + 1 : length;
+            continue;
+        }
+        if (is_word_character(c)) {
+            const size_t word = i;
+            while (i < length && is_word_character(input[i]))
+                i++;
+            if (depth == 0 && word - start >= target && is_statement_keyword(input + word, i - word)) {
+                add_chunk(&chunks, count, &capacity, start, word);
+                start = word;
+            }
+            continue;
+        }
+        i++;
+        switch (c) {
+            case '(':
+            case '{':
+            case '[':
+                depth++;
+                break;
+            case ')':
+            case '}':
+            case ']':
+                depth--;
+                break;
+            case ';':
+                if (depth == 0 && i - start >= target) {
+                    while (i < length && is_whitespace(input[i]))
+                        i++;
+                    if (i < length) {
+                        add_chunk(&chunks, count, &capacity, start, i);
+                        start = i;
+                    }
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    add_chunk(&chunks, count, &capacity, start, length);
+    return chunks;
+}
+
+/**
+ * Parse one chunk. The lexer needs its input nul terminated, so the chunk is copied
+ * into the thread's scratch buffer first; the AST keeps copies of the token text, so
+ * the buffer can be reused for the next chunk.
+ */
+static void parse_chunk_statements(const char *input, parse_chunk *chunk, char **scratch, size_t *scratch_capacity) {
+    const size_t length = chunk->end - chunk->start;
+    if (length + 1 > *scratch_capacity) {
+        *scratch_capacity = length + 1;
+        *scratch          = realloc(*scratch, *scratch_capacity);
+        if (*scratch == NULL) {
+            err(EXIT_FAILURE, "malloc failed");
+        }
+    }
+    memcpy(*scratch, input + chunk->start, length);
+    (*scratch)[length] = 0;
+
+    parser *       parser = parser_init(lexer_init_buffer(*scratch, length));
+    ast_statement *stmt;
+    while ((stmt = parser_next_statement(parser)) != NULL) {
+        if (chunk->statement_count == chunk->statement_capacity) {
+            chunk->statement_capacity = chunk->statement_capacity ? chunk->statement_capacity * 2 : 64;
+            chunk->statements =
+                    reallocarray(chunk->statements, chunk->statement_capacity, sizeof(*chunk->statements));
+            if (chunk->statements == NULL) {
+                err(EXIT_FAILURE, "malloc failed");
+            }
+        }
+        chunk->statements[chunk->statement_count++] = stmt;
+    }
+    chunk->errors  = parser->errors;
+    parser->errors = nullptr;
+    parser_free(parser);
+}
+
+static void *parse_worker(void *arg) {
+    parse_job *job              = arg;
+    char *     scratch          = nullptr;
+    size_t     scratch_capacity = 0;
+    size_t     i;
+    while ((i = atomic_fetch_add(&job->next, 1)) < job->chunk_count) {
+        parse_chunk_statements(job->input, &job->chunks[i], &scratch, &scratch_capacity);
+    }
+    free(scratch);
+    return nullptr;
+}
+
+/**
+ * Parse the parser's input on up to `threads` threads, with the same result as
+ * parse_program. The input is split between top level statements, the chunks are
+ * parsed independently and their statements and errors are joined back in source
+ * order, so the result does not depend on how the threads were scheduled.
+ *
+ * Streamed input, input too small to be worth splitting and traced parses are parsed
+ * serially. The parser must not have been used yet.
+ */
+ast_program *parse_program_parallel(parser *parser, const size_t threads) {
+    const lexer *l = parser->lexer;
+    if (threads < 2 || l->fd >= 0 || l->base > 0 || l->length < 2 * PARALLEL_PARSE_MIN_CHUNK ||
+        parser_trace_enabled) {
+        return parse_program(parser);
+    }
+
+    const size_t target = l->length / (threads * 4) > PARALLEL_PARSE_MIN_CHUNK
+                                  ? l->length / (threads * 4)
+                                  : PARALLEL_PARSE_MIN_CHUNK;
+    size_t       chunk_count;
+    parse_chunk *chunks = split_chunks(l->input, l->length, target, &chunk_count);
+    parse_job    job    = {l->input, chunks, chunk_count, 0};
+
+    // the calling thread parses chunks as well
+    const size_t worker_count = (threads < chunk_count ? threads : chunk_count) - 1;
+    pthread_t *  workers      = malloc((worker_count + 1) * sizeof(*workers));
+    if (workers == NULL) {
+        err(EXIT_FAILURE, "malloc failed");
+    }
+    for (size_t i = 0; i < worker_count; i++) {
+        if (pthread_create(&workers[i], nullptr, parse_worker, &job) != 0) {
+            err(EXIT_FAILURE, "could not start parser thread");
+        }
+    }
+    parse_worker(&job);
+    for (size_t i = 0; i < worker_count; i++) {
+        pthread_join(workers[i], nullptr);
+    }
+    free(workers);
+
+    ast_program *program = program_init();
+    if (program == NULL) {
+        err(EXIT_FAILURE, "malloc failed");
+    }
+    size_t total = 0;
+    for (size_t i = 0; i < chunk_count; i++) {
+        total += job.chunks[i].statement_count;
+    }
+    if (total > program->array_size) {
+        program->statements = reallocarray(program->statements, total, sizeof(*program->statements));
+        if (program->statements == NULL) {
+            err(EXIT_FAILURE, "malloc failed");
+        }
+        program->array_size = total;
+    }
+    for (size_t i = 0; i < chunk_count; i++) {
+        parse_chunk *chunk = &job.chunks[i];
+        for (size_t j = 0; j < chunk->statement_count; j++) {
+            program->statements[program->statement_count++] = chunk->statements[j];
+        }
+        free(chunk->statements);
+        if (chunk->errors == NULL) {
+            continue;
+        }
+        if (parser->errors == NULL) {
+            parser->errors = chunk->errors;
+            continue;
+        }
+        for (const list_node *node = chunk->errors->head; node != NULL; node = node->next) {
+            linked_list_addNode(parser->errors, node->data);
+        }
+        linked_list_free(chunk->errors, nullptr);
+    }
+    free(job.chunks);
+    return program;
+}
@@ -0,0 +1,15 @@
+//
+// Created by dgood on 1/22/25.
+//
+
+#ifndef PARALLEL_PARSER_H
+#define PARALLEL_PARSER_H
+
+#include "parser.h"
+
+/** Smallest piece of input handed to a parsing thread, smaller inputs are parsed serially. */
+#define PARALLEL_PARSE_MIN_CHUNK (16 * 1024)
+
+ast_program *parse_program_parallel(parser *, size_t);
+
+#endif //PARALLEL_PARSER_H
@@ -2,9 +2,8 @@
 // Created by dgood on 12/5/24.
 //
 
-// #define TRACE
-
 #include "parser.h"
+#include "parser_tracing.h"
 
 #include <err.h>
 #include <errno.h>
@@ -44,10 +43,19 @@ static ast_expression *parse_call_expression(parser *, ast_expression *);
 
 static ast_expression *parse_index_expression(parser *, ast_expression *);
 
+#define OPERATOR_FROM_TOKEN(name, literal, tok) [tok] = name,
+
+/**
+ * Operator of each operator token, for the prefix and infix parse functions.
+ */
+static const ast_operator token_operators[TOKEN_TYPE_COUNT] = {
+        OPERATOR_LIST(OPERATOR_FROM_TOKEN)
+};
+
 /**
  *
  */
-static prefix_parse_fn prefix_fns[] = {
+static prefix_parse_fn prefix_fns[TOKEN_TYPE_COUNT] = {
         nullptr,                     // ILLEGAL
         nullptr,                     // END OF FILE
         parse_identifier_expression, // IDENT
@@ -85,7 +93,7 @@ static prefix_parse_fn prefix_fns[] = {
         parse_while_expression       // WHILE
 };
 
-static infix_parse_fn infix_fns[] = {
+static infix_parse_fn infix_fns[TOKEN_TYPE_COUNT] = {
         nullptr,                // ILLEGAL
         nullptr,                // END OF FILE
         nullptr,                // IDENT
@@ -155,10 +163,6 @@ static void free_prefix_expression(ast_prefix_expression *prefix_exp) {
         token_free(prefix_exp->token);
         prefix_exp->token = nullptr;
     }
-    if (prefix_exp->operator) {
-        free(prefix_exp->operator);
-        prefix_exp->operator = nullptr;
-    }
     if (prefix_exp->right) {
         free_expression(prefix_exp->right);
         prefix_exp->right = nullptr;
@@ -167,10 +171,6 @@ static void free_prefix_expression(ast_prefix_expression *prefix_exp) {
 }
 
 static void free_infix_expression(ast_infix_expression *infix_exp) {
-    if (infix_exp->operator) {
-        free(infix_exp->operator);
-        infix_exp->operator = nullptr;
-    }
     if (infix_exp->token) {
         token_free(infix_exp->token);
         infix_exp->token = nullptr;
@@ -412,12 +412,6 @@ void parser_free(parser *parser) {
     if (parser == NULL)
         return;
 
-    if (parser->cur_tok) {
-        token_free(parser->cur_tok);
-    }
-    if (parser->peek_tok) {
-        token_free(parser->peek_tok);
-    }
     if (parser->lexer) {
         lexer_free(parser->lexer);
     }
@@ -455,12 +449,21 @@ static void add_parse_error(parser *parser, char *errmsg) {
 
 static void handle_no_prefix_fn(parser *parser) {
     char *msg = nullptr;
-    asprintf(&msg, "no prefix parse function for the token \"%s\"", parser->cur_tok->literal);
+    asprintf(&msg, "no prefix parse function for the token \"%.*s\"", (int) parser->cur_tok.length,
+             lexer_token_start(parser->lexer, parser->cur_tok));
     if (msg == NULL)
         err(EXIT_FAILURE, "malloc failed");
     add_parse_error(parser, msg);
 }
 
+/**
+ * AST nodes keep their own copy of the token they were parsed from, the lexer only hands
+ * out spans of the source.
+ */
+static token *materialize_token(const parser *parser, const token_span span) {
+    return lexer_token_copy(parser->lexer, span);
+}
+
 static operator_precedence precedence(token_type tok_type) {
     switch (tok_type) {
         case EQ:
@@ -488,9 +491,9 @@ static operator_precedence precedence(token_type tok_type) {
     }
 }
 
-static operator_precedence peek_precedence(const parser *parser) { return precedence(parser->peek_tok->type); }
+static operator_precedence peek_precedence(const parser *parser) { return precedence(parser->peek_tok.type); }
 
-static operator_precedence cur_precedence(const parser *parser) { return precedence(parser->cur_tok->type); }
+static operator_precedence cur_precedence(const parser *parser) { return precedence(parser->cur_tok.type); }
 
 static char *program_token_literal(void *prog_obj) {
     ast_program *program = prog_obj;
@@ -582,7 +585,8 @@ static char *return_statement_string(void *stmt) {
     char *                ret_stmt_string = nullptr;
     char *                value_string    =
             ret_stmt->return_value ? ret_stmt->return_value->node.string(ret_stmt->return_value) : strdup("");
-    asprintf(&ret_stmt_string, "%s %s;", ret_stmt->statement.node.string(ret_stmt), value_string);
+    asprintf(&ret_stmt_string, "%s %s;", ret_stmt->token->literal, value_string);
+    free(value_string);
     if (ret_stmt_string == NULL)
         err(EXIT_FAILURE, "malloc failed");
     return ret_stmt_string;
@@ -606,7 +610,7 @@ static char *prefix_expression_string(void *node) {
     ast_prefix_expression *prefix_exp     = node;
     char *                 str            = nullptr;
     char *                 operand_string = prefix_exp->right->node.string(prefix_exp->right);
-    asprintf(&str, "(%s%s)", prefix_exp->operator, operand_string);
+    asprintf(&str, "(%s%s)", ast_get_operator_literal(prefix_exp->operator), operand_string);
     free(operand_string);
     if (str == NULL) {
         err(EXIT_FAILURE, "malloc failed");
@@ -619,7 +623,7 @@ static char *infix_expression_string(void *node) {
     char *                str          = nullptr;
     char *                left_string  = infix_exp->left->node.string(infix_exp->left);
     char *                right_string = infix_exp->right->node.string(infix_exp->right);
-    asprintf(&str, "(%s %s %s)", left_string, infix_exp->operator, right_string);
+    asprintf(&str, "(%s %s %s)", left_string, ast_get_operator_literal(infix_exp->operator), right_string);
     free(left_string);
     free(right_string);
     if (str == NULL) {
@@ -669,20 +673,31 @@ static char *boolean_expression_string(void *exp) {
     return strdup("false");
 }
 
+static int compare_key_strings(const void *a, const void *b) {
+    const ast_expression *left         = *(ast_expression *const *) a;
+    const ast_expression *right        = *(ast_expression *const *) b;
+    char *                left_string  = left->node.string((void *) left);
+    char *                right_string = right->node.string((void *) right);
+    const int             result       = strcmp(left_string, right_string);
+    free(left_string);
+    free(right_string);
+    return result;
+}
+
 static char *hash_literal_string(void *exp) {
     ast_hash_literal *hash_exp = exp;
     char *            string   = nullptr;
     char *            temp     = nullptr;
     int               ret;
-    for (size_t i = 0; i < hash_exp->pairs->table_size; i++) {
-        void *obj = hash_exp->pairs->table[i];
-        if (obj == NULL)
-            continue;
-        hashtable_entry *entry       = obj;
-        ast_expression * keyexp      = entry->key;
-        ast_expression * valuexp     = entry->value;
-        char *           keystring   = keyexp->node.string(keyexp);
-        char *           valuestring = valuexp->node.string(valuexp);
+    // the pairs are keyed by node address, sort them so the string doesn't depend on it
+    arraylist *keys = hashtable_get_keys(hash_exp->pairs);
+    if (keys != NULL)
+        arraylist_sort(keys, compare_key_strings);
+    for (size_t i = 0; keys != NULL && i < keys->size; i++) {
+        ast_expression *keyexp      = arraylist_get(keys, i);
+        ast_expression *valuexp     = hashtable_get(hash_exp->pairs, keyexp);
+        char *          keystring   = keyexp->node.string(keyexp);
+        char *          valuestring = valuexp->node.string(valuexp);
         if (string == NULL) {
             ret = asprintf(&temp, "%s:%s", keystring, valuestring);
         } else {
@@ -696,7 +711,9 @@ static char *hash_literal_string(void *exp) {
         string = temp;
         temp   = nullptr;
     }
-    ret = asprintf(&temp, "{%s}", string);
+    if (keys != NULL)
+        arraylist_destroy(keys);
+    ret = asprintf(&temp, "{%s}", string ? string : "");
     free(string);
     if (ret == -1)
         err(EXIT_FAILURE, "malloc failed");
@@ -898,7 +915,7 @@ static ast_let_statement *create_let_statement(parser *parser) {
     if (let_stmt == NULL) {
         err(EXIT_FAILURE, "malloc failed");
     }
-    let_stmt->token = token_copy(parser->cur_tok);
+    let_stmt->token = materialize_token(parser, parser->cur_tok);
     if (let_stmt->token == NULL) {
         free(let_stmt);
         err(EXIT_FAILURE, "malloc failed");
@@ -917,7 +934,7 @@ static ast_return_statement *create_return_statement(parser *parser) {
     if (ret_stmt == NULL) {
         err(EXIT_FAILURE, "malloc failed");
     }
-    ret_stmt->token = token_copy(parser->cur_tok);
+    ret_stmt->token = materialize_token(parser, parser->cur_tok);
     if (ret_stmt->token == NULL) {
         free(ret_stmt);
         err(EXIT_FAILURE, "malloc failed");
@@ -935,7 +952,7 @@ static ast_expression_statement *create_expression_statement(parser *parser) {
     if (exp_stmt == NULL) {
         err(EXIT_FAILURE, "malloc failed");
     }
-    exp_stmt->token = token_copy(parser->cur_tok);
+    exp_stmt->token = materialize_token(parser, parser->cur_tok);
     if (exp_stmt->token == NULL) {
         free(exp_stmt);
         err(EXIT_FAILURE, "malloc failed");
@@ -964,7 +981,7 @@ static ast_block_statement *create_block_statement(parser *parser) {
         err(EXIT_FAILURE, "malloc failed");
     }
     block_stmt->statement_count = 0;
-    block_stmt->token           = token_copy(parser->cur_tok);
+    block_stmt->token           = materialize_token(parser, parser->cur_tok);
     return block_stmt;
 }
 
@@ -978,7 +995,7 @@ static ast_function_literal *create_function_literal(parser *parser) {
     func->expression.node.type          = EXPRESSION;
     func->expression.expression_type    = FUNCTION_LITERAL;
     func->parameters                    = linked_list_create(nullptr);
-    func->token                         = token_copy(parser->cur_tok);
+    func->token                         = materialize_token(parser, parser->cur_tok);
     func->body                          = nullptr;
     func->name                          = nullptr;
     return func;
@@ -998,7 +1015,7 @@ static ast_call_expression *create_call_expression(parser *parser) {
     if (call_exp->arguments == NULL) {
         err(EXIT_FAILURE, "malloc failed");
     }
-    call_exp->token = token_copy(parser->peek_tok);
+    call_exp->token = materialize_token(parser, parser->peek_tok);
     if (call_exp->token == NULL) {
         err(EXIT_FAILURE, "malloc failed");
     }
@@ -1029,8 +1046,6 @@ parser *parser_init(lexer *l) {
         return nullptr;
     }
     parser->lexer    = l;
-    parser->cur_tok  = nullptr;
-    parser->peek_tok = nullptr;
     parser->errors   = nullptr;
     parser_next_token(parser);
     parser_next_token(parser);
@@ -1038,9 +1053,6 @@ parser *parser_init(lexer *l) {
 }
 
 void parser_next_token(parser *parser) {
-    if (parser->cur_tok) {
-        token_free(parser->cur_tok);
-    }
     parser->cur_tok  = parser->peek_tok;
     parser->peek_tok = lexer_next_token(parser->lexer);
 }
@@ -1074,14 +1086,14 @@ static int add_statement_to_block(ast_block_statement *block_stmt, ast_statement
 static void peek_error(parser *parser, token_type tok_type) {
     char *msg = nullptr;
     asprintf(&msg, "expected next token to be %s, got %s instead", token_get_name_from_type(tok_type),
-             token_get_name_from_type(parser->peek_tok->type));
+             token_get_name_from_type(parser->peek_tok.type));
     if (msg == NULL)
         err(EXIT_FAILURE, "malloc failed");
     add_parse_error(parser, msg);
 }
 
 static int expect_peek(parser *parser, token_type tok_type) {
-    if (parser->peek_tok->type == tok_type) {
+    if (parser->peek_tok.type == tok_type) {
         parser_next_token(parser);
         return 1;
     }
@@ -1099,7 +1111,7 @@ static ast_identifier *create_identifier(parser *parser) {
     if (ident == NULL) {
         err(EXIT_FAILURE, "malloc failed");
     }
-    ident->token = token_copy(parser->cur_tok);
+    ident->token = materialize_token(parser, parser->cur_tok);
     if (ident->token == NULL) {
         free(ident);
         err(EXIT_FAILURE, "malloc failed");
@@ -1108,7 +1120,7 @@ static ast_identifier *create_identifier(parser *parser) {
     ident->expression.expression_type    = IDENTIFIER_EXPRESSION;
     ident->expression.node.string        = identifier_string;
     ident->expression.node.type          = EXPRESSION;
-    ident->value                         = strdup(parser->cur_tok->literal);
+    ident->value                         = lexer_token_literal(parser->lexer, parser->cur_tok);
     if (ident->value == NULL) {
         token_free(ident->token);
         free(ident);
@@ -1124,23 +1136,23 @@ static ast_expression *parse_identifier_expression(parser *parser) {
 }
 
 static ast_expression *parse_expression(parser *parser, operator_precedence precedence) {
-#ifdef TRACE
-    trace("parse_expression");
-#endif
-    prefix_parse_fn prefix_fn = prefix_fns[parser->cur_tok->type];
+    TRACE_BEGIN("parse_expression");
+    prefix_parse_fn prefix_fn = prefix_fns[parser->cur_tok.type];
     if (prefix_fn == NULL) {
         handle_no_prefix_fn(parser);
+        TRACE_END("parse_expression");
         return nullptr;
     }
     ast_expression *left_exp = prefix_fn(parser);
 
-    while (parser->peek_tok->type != SEMICOLON) {
+    while (parser->peek_tok.type != SEMICOLON) {
         if (precedence >= peek_precedence(parser)) {
             break;
         }
 
-        infix_parse_fn infix_fn = infix_fns[parser->peek_tok->type];
+        infix_parse_fn infix_fn = infix_fns[parser->peek_tok.type];
         if (infix_fn == NULL) {
+            TRACE_END("parse_expression");
             return left_exp;
         }
 
@@ -1149,9 +1161,7 @@ static ast_expression *parse_expression(parser *parser, operator_precedence prec
         left_exp              = right;
     }
 
-#ifdef TRACE
-    untrace("parse_expression");
-#endif
+    TRACE_END("parse_expression");
     return left_exp;
 }
 
@@ -1171,6 +1181,10 @@ static ast_let_statement *parse_let_statement(parser *parser) {
     }
     parser_next_token(parser);
     let_stmt->value = parse_expression(parser, LOWEST);
+    if (let_stmt->value == NULL) {
+        free_statement((ast_statement *) let_stmt);
+        return nullptr;
+    }
     if (let_stmt->value->expression_type == FUNCTION_LITERAL) {
         ast_function_literal *fn_literal = (ast_function_literal *) let_stmt->value;
         fn_literal->name                 = let_stmt->name->value;
@@ -1178,7 +1192,7 @@ static ast_let_statement *parse_let_statement(parser *parser) {
             err(EXIT_FAILURE, "malloc failed");
         }
     }
-    if (parser->peek_tok->type == SEMICOLON) {
+    if (parser->peek_tok.type == SEMICOLON) {
         parser_next_token(parser);
     }
 
@@ -1189,7 +1203,7 @@ static ast_return_statement *parse_return_statement(parser *parser) {
     ast_return_statement *ret_stmt = create_statement(parser, RETURN_STATEMENT);
     parser_next_token(parser);
     ret_stmt->return_value = parse_expression(parser, LOWEST);
-    if (parser->peek_tok->type == SEMICOLON) {
+    if (parser->peek_tok.type == SEMICOLON) {
         parser_next_token(parser);
     }
     return ret_stmt;
@@ -1212,41 +1226,50 @@ ast_program *program_init(void) {
     return program;
 }
 
+/**
+ * Parse and return the next top level statement, or NULL at the end of the input.
+ * Statements that fail to parse are skipped, their errors are left in parser->errors.
+ * The caller owns the statement and frees it with free_statement once done with it,
+ * so a whole program never has to be held in memory at once.
+ */
+ast_statement *parser_next_statement(parser *parser) {
+    while (parser->cur_tok.type != END_OF_FILE) {
+        ast_statement *stmt = parser_parse_statement(parser);
+        parser_next_token(parser);
+        if (stmt != NULL)
+            return stmt;
+    }
+    return nullptr;
+}
+
 ast_program *parse_program(parser *parser) {
     ast_program *program = program_init();
     if (program == NULL)
         err(EXIT_FAILURE, "malloc failed");
-    while (parser->cur_tok->type != END_OF_FILE) {
-        ast_statement *stmt = parser_parse_statement(parser);
-        if (stmt != NULL) {
-            int status = add_statement_to_program(program, stmt);
-            if (status != 0) {
-                program_free(program);
-                return nullptr;
-            }
+    ast_statement *stmt;
+    while ((stmt = parser_next_statement(parser)) != NULL) {
+        int status = add_statement_to_program(program, stmt);
+        if (status != 0) {
+            program_free(program);
+            return nullptr;
         }
-        parser_next_token(parser);
     }
     return program;
 }
 
 static ast_expression_statement *parse_expression_statement(parser *parser) {
-#ifdef TRACE
-    trace("parse_expression_statement");
-#endif
+    TRACE_BEGIN("parse_expression_statement");
     ast_expression_statement *exp_stmt = create_expression_statement(parser);
     exp_stmt->expression               = parse_expression(parser, LOWEST);
-    if (parser->peek_tok->type == SEMICOLON)
+    if (parser->peek_tok.type == SEMICOLON)
         parser_next_token(parser);
-#ifdef TRACE
-    untrace("parse_expression_statement");
-#endif
+    TRACE_END("parse_expression_statement");
     return exp_stmt;
 }
 
 
 ast_statement *parser_parse_statement(parser *parser) {
-    switch (parser->cur_tok->type) {
+    switch (parser->cur_tok.type) {
         case LET:
             return (ast_statement *) parse_let_statement(parser);
         case RETURN:
@@ -1267,9 +1290,7 @@ static char *index_exp_token_literal(void *exp) {
 }
 
 ast_expression *parse_integer_expression(parser *parser) {
-#ifdef TRACE
-    trace("parse_integer_expression");
-#endif
+    TRACE_BEGIN("parse_integer_expression");
     ast_integer *int_exp = malloc(sizeof(ast_integer));
     if (int_exp == NULL)
         err(EXIT_FAILURE, "malloc failed");
@@ -1277,29 +1298,25 @@ ast_expression *parse_integer_expression(parser *parser) {
     int_exp->expression.node.string        = integer_string;
     int_exp->expression.node.type          = EXPRESSION;
     int_exp->expression.expression_type    = INTEGER_EXPRESSION;
-    int_exp->token                         = token_copy(parser->cur_tok);
+    int_exp->token                         = materialize_token(parser, parser->cur_tok);
     errno                                  = 0;
     char *ep;
-    int_exp->value = strtol(parser->cur_tok->literal, &ep, 10);
-    if (ep == parser->cur_tok->literal || *ep != 0 || errno != 0) {
+    int_exp->value = strtol(int_exp->token->literal, &ep, 10);
+    if (ep == int_exp->token->literal || *ep != 0 || errno != 0) {
         char *errmsg = nullptr;
-        asprintf(&errmsg, "could not parse %s as integer", parser->cur_tok->literal);
+        asprintf(&errmsg, "could not parse %s as integer", int_exp->token->literal);
         if (errmsg == NULL)
             err(EXIT_FAILURE, "malloc failed");
         add_parse_error(parser, errmsg);
     }
 
-#ifdef TRACE
-    untrace("parse_integer_expression");
-#endif
+    TRACE_END("parse_integer_expression");
 
     return (ast_expression *) int_exp;
 }
 
 ast_expression *parse_string_expression(parser *parser) {
-#ifdef TRACE
-    trace("parse_string_expression");
-#endif
+    TRACE_BEGIN("parse_string_expression");
     ast_string *string = malloc(sizeof(*string));
     if (string == NULL)
         err(EXIT_FAILURE, "malloc failed");
@@ -1307,21 +1324,17 @@ ast_expression *parse_string_expression(parser *parser) {
     string->expression.node.token_literal = string_token_literal;
     string->expression.node.type          = EXPRESSION;
     string->expression.expression_type    = STRING_EXPRESSION;
-    string->token                         = token_copy(parser->cur_tok);
-    string->value                         = strdup(parser->cur_tok->literal);
-    string->length                        = strlen(parser->cur_tok->literal);
+    string->token                         = materialize_token(parser, parser->cur_tok);
+    string->value                         = lexer_token_literal(parser->lexer, parser->cur_tok);
+    string->length                        = parser->cur_tok.length;
     if (string->value == NULL)
         err(EXIT_FAILURE, "malloc failed");
-#ifdef TRACE
-    untrace("parse_string_expression");
-#endif
+    TRACE_END("parse_string_expression");
     return (ast_expression *) string;
 }
 
 ast_expression *parse_prefix_expression(parser *parser) {
-#ifdef TRACE
-    trace("parse_prefix_expression");
-#endif
+    TRACE_BEGIN("parse_prefix_expression");
     ast_prefix_expression *prefix_exp = malloc(sizeof(*prefix_exp));
     if (prefix_exp == NULL)
         err(EXIT_FAILURE, "malloc failed");
@@ -1329,26 +1342,22 @@ ast_expression *parse_prefix_expression(parser *parser) {
     prefix_exp->expression.node.string        = prefix_expression_string;
     prefix_exp->expression.node.token_literal = prefix_expression_token_literal;
     prefix_exp->expression.node.type          = EXPRESSION;
-    prefix_exp->token                         = token_copy(parser->cur_tok);
-    prefix_exp->operator                      = strdup(parser->cur_tok->literal);
-    if (prefix_exp->operator == NULL)
-        err(EXIT_FAILURE, "malloc failed");
+    prefix_exp->token                         = materialize_token(parser, parser->cur_tok);
+    prefix_exp->operator                      = token_operators[parser->cur_tok.type];
     parser_next_token(parser);
     prefix_exp->right = parse_expression(parser, PREFIX);
 
-#ifdef TRACE
-    untrace("parse_prefix_expression");
-#endif
+    TRACE_END("parse_prefix_expression");
     return (ast_expression *) prefix_exp;
 }
 
 
-static ast_hash_literal *create_hash_literal(token *cur_tok) {
+static ast_hash_literal *create_hash_literal(token *tok) {
     ast_hash_literal *hash_exp = malloc(sizeof(*hash_exp));
     if (hash_exp == NULL) {
         err(EXIT_FAILURE, "malloc failed");
     }
-    hash_exp->token = token_copy(cur_tok);
+    hash_exp->token = tok;
     hash_exp->expression.node.string = hash_literal_string;
     hash_exp->expression.node.token_literal = hash_literal_token_literal;
     hash_exp->expression.node.type = EXPRESSION;
@@ -1358,8 +1367,8 @@ static ast_hash_literal *create_hash_literal(token *cur_tok) {
 }
 
 static ast_expression *parse_hash_literal(parser *parser) {
-    ast_hash_literal *hash_exp = create_hash_literal(parser->cur_tok);
-    while (parser->peek_tok->type != RBRACE) {
+    ast_hash_literal *hash_exp = create_hash_literal(materialize_token(parser, parser->cur_tok));
+    while (parser->peek_tok.type != RBRACE) {
         parser_next_token(parser);
         ast_expression *key = parse_expression(parser, LOWEST);
         if (!expect_peek(parser, COLON)) {
@@ -1372,7 +1381,7 @@ static ast_expression *parse_hash_literal(parser *parser) {
         parser_next_token(parser);
         ast_expression *value = parse_expression(parser, LOWEST);
         hashtable_set(hash_exp->pairs, key, value);
-        if (parser->peek_tok->type != RBRACE && !expect_peek(parser, COMMA)) {
+        if (parser->peek_tok.type != RBRACE && !expect_peek(parser, COMMA)) {
             hashtable_destroy(hash_exp->pairs);
             token_free(hash_exp->token);
             free(hash_exp);
@@ -1388,31 +1397,27 @@ static ast_expression *parse_hash_literal(parser *parser) {
 }
 
 static ast_expression *parse_boolean_expression(parser *parser) {
-#ifdef TRACE
-    trace("parse_boolean_expression");
-#endif
+    TRACE_BEGIN("parse_boolean_expression");
     ast_boolean_expression *bool_exp = malloc(sizeof(*bool_exp));
     if (bool_exp == NULL)
         err(EXIT_FAILURE, "malloc failed");
-    bool_exp->token                         = token_copy(parser->cur_tok);
+    bool_exp->token                         = materialize_token(parser, parser->cur_tok);
     bool_exp->expression.expression_type    = BOOLEAN_EXPRESSION;
     bool_exp->expression.node.token_literal = boolean_expression_token_literal;
     bool_exp->expression.node.string        = boolean_expression_string;
     bool_exp->expression.node.type          = EXPRESSION;
-    if (parser->cur_tok->type == TRUE)
+    if (parser->cur_tok.type == TRUE)
         bool_exp->value = true;
     else
         bool_exp->value = false;
 
-#ifdef TRACE
-    untrace("parse_boolean_expression");
-#endif
+    TRACE_END("parse_boolean_expression");
     return (ast_expression *) bool_exp;
 }
 
 static arraylist *parse_expression_list(parser *parser, token_type stop_token_type) {
     arraylist *expression_list = arraylist_create(4, free_expression);
-    if (parser->peek_tok->type == stop_token_type) {
+    if (parser->peek_tok.type == stop_token_type) {
         parser_next_token(parser);
         return expression_list;
     }
@@ -1420,7 +1425,7 @@ static arraylist *parse_expression_list(parser *parser, token_type stop_token_ty
     parser_next_token(parser);
     ast_expression *exp = parse_expression(parser, LOWEST);
     arraylist_add(expression_list, exp);
-    while (parser->peek_tok->type == COMMA) {
+    while (parser->peek_tok.type == COMMA) {
         parser_next_token(parser);
         parser_next_token(parser);
         exp = parse_expression(parser, LOWEST);
@@ -1435,9 +1440,7 @@ static arraylist *parse_expression_list(parser *parser, token_type stop_token_ty
 }
 
 static ast_expression *parse_grouped_expression(parser *parser) {
-#ifdef TRACE
-    trace("parse_grouped_expression");
-#endif
+    TRACE_BEGIN("parse_grouped_expression");
     parser_next_token(parser);
     ast_expression *exp = parse_expression(parser, LOWEST);
     if (!expect_peek(parser, RPAREN)) {
@@ -1445,35 +1448,27 @@ static ast_expression *parse_grouped_expression(parser *parser) {
         exp = nullptr;
     }
 
-#ifdef TRACE
-    untrace("parse_grouped_expression");
-#endif
+    TRACE_END("parse_grouped_expression");
     return exp;
 }
 
 static ast_expression *parse_array_literal(parser *parser) {
-#ifdef TRACE
-    trace("parse_array_literal");
-#endif
+    TRACE_BEGIN("parse_array_literal");
     ast_array_literal *array = malloc(sizeof(*array));
     if (array == NULL)
         err(EXIT_FAILURE, "malloc failed");
     array->elements                      = parse_expression_list(parser, RBRACKET);
-    array->token                         = token_copy(parser->cur_tok);
+    array->token                         = materialize_token(parser, parser->cur_tok);
     array->expression.node.string        = array_literal_string;
     array->expression.node.token_literal = array_literal_token_literal;
     array->expression.node.type          = EXPRESSION;
     array->expression.expression_type    = ARRAY_LITERAL;
-#ifdef TRACE
-    untrace("parse_array_literal");
-#endif
+    TRACE_END("parse_array_literal");
     return (ast_expression *) array;
 }
 
 static ast_expression *parse_index_expression(parser *parser, ast_expression *left) {
-#ifdef TRACE
-    trace("parse_index_expression");
-#endif
+    TRACE_BEGIN("parse_index_expression");
     ast_index_expression *index_exp = malloc(sizeof(*index_exp));
     if (index_exp == NULL)
         err(EXIT_FAILURE, "malloc failed");
@@ -1483,41 +1478,33 @@ static ast_expression *parse_index_expression(parser *parser, ast_expression *le
     index_exp->expression.expression_type    = INDEX_EXPRESSION;
     index_exp->left                          = left;
     index_exp->index                         = nullptr;
-    index_exp->token                         = token_copy(parser->cur_tok);
+    index_exp->token                         = materialize_token(parser, parser->cur_tok);
     parser_next_token(parser);
     index_exp->index = parse_expression(parser, LOWEST);
     if (!expect_peek(parser, RBRACKET)) {
         free_index_expression(index_exp);
         index_exp = nullptr;
     }
-#ifdef TRACE
-    untrace("parse_index_expression");
-#endif
+    TRACE_END("parse_index_expression");
     return (ast_expression *) index_exp;
 }
 
 static ast_block_statement *parse_block_statement(parser *parser) {
-#ifdef TRACE
-    trace("parse_block_statement");
-#endif
+    TRACE_BEGIN("parse_block_statement");
     ast_block_statement *block_stmt = create_block_statement(parser);
     parser_next_token(parser);
-    while (parser->cur_tok->type != RBRACE && parser->cur_tok->type != END_OF_FILE) {
+    while (parser->cur_tok.type != RBRACE && parser->cur_tok.type != END_OF_FILE) {
         ast_statement *stmt = parser_parse_statement(parser);
         if (stmt != NULL)
             add_statement_to_block(block_stmt, stmt);
         parser_next_token(parser);
     }
-#ifdef TRACE
-    untrace("parse_block_statement");
-#endif
+    TRACE_END("parse_block_statement");
     return block_stmt;
 }
 
 static ast_expression *parse_while_expression(parser *parser) {
-#ifdef TRACE
-    trace("parse_while_expression");
-#endif
+    TRACE_BEGIN("parse_while_expression");
     ast_while_expression *while_exp = malloc(sizeof(*while_exp));
     if (while_exp == NULL) {
         err(EXIT_FAILURE, "malloc failed");
@@ -1526,7 +1513,7 @@ static ast_expression *parse_while_expression(parser *parser) {
     while_exp->expression.node.token_literal = while_expression_token_literal;
     while_exp->expression.node.type          = EXPRESSION;
     while_exp->expression.expression_type    = WHILE_EXPRESSION;
-    while_exp->token                         = token_copy(parser->cur_tok);
+    while_exp->token                         = materialize_token(parser, parser->cur_tok);
     while_exp->condition                     = nullptr;
     while_exp->body                          = nullptr;
 
@@ -1549,14 +1536,13 @@ static ast_expression *parse_while_expression(parser *parser) {
         free_while_expression(while_exp);
         return NULL;
     }
+    TRACE_END("parse_while_expression");
     return (ast_expression *) while_exp;
 }
 
 
 static ast_expression *parse_if_expression(parser *parser) {
-#ifdef TRACE
-    trace("parse_if_expression");
-#endif
+    TRACE_BEGIN("parse_if_expression");
     ast_if_expression *if_exp;
     if_exp = malloc(sizeof(*if_exp));
     if (if_exp == NULL)
@@ -1566,7 +1552,7 @@ static ast_expression *parse_if_expression(parser *parser) {
     if_exp->expression.node.token_literal = if_expression_token_literal;
     if_exp->expression.node.type          = EXPRESSION;
     if_exp->expression.expression_type    = IF_EXPRESSION;
-    if_exp->token                         = token_copy(parser->cur_tok);
+    if_exp->token                         = materialize_token(parser, parser->cur_tok);
     if_exp->condition                     = nullptr;
     if_exp->alternative                   = nullptr;
     if_exp->consequence                   = nullptr;
@@ -1591,7 +1577,7 @@ static ast_expression *parse_if_expression(parser *parser) {
 
     if_exp->consequence = parse_block_statement(parser);
 
-    if (parser->peek_tok->type == ELSE) {
+    if (parser->peek_tok.type == ELSE) {
         parser_next_token(parser);
         if (!expect_peek(parser, LBRACE)) {
             free_if_expression(if_exp);
@@ -1599,14 +1585,12 @@ static ast_expression *parse_if_expression(parser *parser) {
         }
         if_exp->alternative = parse_block_statement(parser);
     }
-#ifdef TRACE
-    untrace("parse_if_expression");
-#endif
+    TRACE_END("parse_if_expression");
     return (ast_expression *) if_exp;
 }
 
 static void parse_function_parameters(parser *parser, ast_function_literal *function) {
-    if (parser->peek_tok->type == RPAREN) {
+    if (parser->peek_tok.type == RPAREN) {
         parser_next_token(parser);
         return;
     }
@@ -1614,7 +1598,7 @@ static void parse_function_parameters(parser *parser, ast_function_literal *func
     parser_next_token(parser);
     ast_identifier *identifier = create_identifier(parser);
     linked_list_addNode(function->parameters, identifier);
-    while (parser->peek_tok->type == COMMA) {
+    while (parser->peek_tok.type == COMMA) {
         parser_next_token(parser);
         parser_next_token(parser);
         identifier = create_identifier(parser);
@@ -1652,7 +1636,7 @@ static ast_expression *parse_function_literal(parser *parser) {
 
 
 static void parse_call_arguments(parser *parser, ast_call_expression *call_exp) {
-    if (parser->peek_tok->type == RPAREN) {
+    if (parser->peek_tok.type == RPAREN) {
         parser_next_token(parser);
         return;
     }
@@ -1660,7 +1644,7 @@ static void parse_call_arguments(parser *parser, ast_call_expression *call_exp)
     parser_next_token(parser);
     ast_expression *arg = parse_expression(parser, LOWEST);
     linked_list_addNode(call_exp->arguments, arg);
-    while (parser->peek_tok->type == COMMA) {
+    while (parser->peek_tok.type == COMMA) {
         parser_next_token(parser);
         parser_next_token(parser);
         arg = parse_expression(parser, LOWEST);
@@ -1687,15 +1671,10 @@ static ast_expression *parse_infix_expression(parser *parser, ast_expression *le
     infix_exp->expression.node.type          = EXPRESSION;
     infix_exp->left                          = left;
     infix_exp->right                         = nullptr;
-    infix_exp->operator                      = strdup(parser->cur_tok->literal);
-    if (infix_exp->operator == NULL) {
-        free(infix_exp);
-        err(EXIT_FAILURE, "malloc failed");
-    }
+    infix_exp->operator                      = token_operators[parser->cur_tok.type];
 
-    infix_exp->token = token_copy(parser->cur_tok);
+    infix_exp->token = materialize_token(parser, parser->cur_tok);
     if (infix_exp->token == NULL) {
-        free(infix_exp->operator);
         free(infix_exp);
         err(EXIT_FAILURE, "malloc failed");
     }
@@ -1706,7 +1685,6 @@ static ast_expression *parse_infix_expression(parser *parser, ast_expression *le
     infix_exp->right = parse_expression(parser, precedence);
     if (infix_exp->right == NULL) {
         // Cleanup on failure
-        free(infix_exp->operator);
         token_free(infix_exp->token);
         free(infix_exp);
         return nullptr;
@@ -1773,9 +1751,7 @@ static ast_expression *copy_prefix_expression(ast_expression *exp) {
     copy->expression.node.type          = EXPRESSION;
     copy->expression.expression_type    = PREFIX_EXPRESSION;
     copy->token                         = token_copy(prefix_exp->token);
-    copy->operator                      = strdup(prefix_exp->operator);
-    if (copy->operator == NULL)
-        err(EXIT_FAILURE, "malloc failed");
+    copy->operator                      = prefix_exp->operator;
     copy->right = copy_expression(prefix_exp->right);
     return (ast_expression *) copy;
 }
@@ -1790,10 +1766,7 @@ static ast_expression *copy_infix_expression(ast_expression *exp) {
     copy->expression.node.type          = EXPRESSION;
     copy->expression.expression_type    = INFIX_EXPRESSION;
     copy->token                         = token_copy(infix_exp->token);
-    copy->operator                      = strdup(infix_exp->operator);
-    if (copy->operator == NULL) {
-        err(EXIT_FAILURE, "malloc failed");
-    }
+    copy->operator                      = infix_exp->operator;
     copy->left  = copy_expression(infix_exp->left);
     copy->right = copy_expression(infix_exp->right);
     return (ast_expression *) copy;
@@ -1894,7 +1867,7 @@ static ast_expression *copy_string_expression(ast_expression *exp) {
 
 static ast_expression *copy_hash_literal(ast_expression *exp) {
     ast_hash_literal *hash_exp = (ast_hash_literal *) exp;
-    ast_hash_literal *copy     = create_hash_literal(hash_exp->token);
+    ast_hash_literal *copy     = create_hash_literal(token_copy(hash_exp->token));
     for (size_t i = 0; i < hash_exp->pairs->key_count; i++) {
         hashtable_entry *entry     = (hashtable_entry *) hash_exp->pairs->table[i];
         ast_expression * key_exp   = entry->key;
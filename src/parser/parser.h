@@ -10,8 +10,8 @@
 
 typedef struct parser_t {
     lexer *      lexer;
-    token *      cur_tok;
-    token *      peek_tok;
+    token_span   cur_tok;
+    token_span   peek_tok;
     linked_list *errors;
 } parser;
 
@@ -39,6 +39,8 @@ ast_program *parse_program(parser *);
 
 ast_statement *parser_parse_statement(parser *);
 
+ast_statement *parser_next_statement(parser *);
+
 ast_program *program_init(void);
 
 void program_free(ast_program *);
@@ -4,63 +4,117 @@
 
 #include "parser_tracing.h"
 
+#include <err.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <string.h>
+#include <time.h>
 
+#define TRACE_BUFFER_EVENTS 4096
 
-static size_t         trace_level              = 0;
-static char trace_indent_placeholder = '\t';
+/**
+ * A begin or end event. Names are the string literals passed by the parse functions,
+ * so events can be recorded without copying or formatting anything.
+ */
+typedef struct {
+    const char *name;
+    long long   timestamp_ns;
+    bool        begin;
+} trace_event;
 
-static char *indent_level(void) {
-  if (trace_level == 0)
-    return strdup("");
-  char *str = malloc(trace_level);
-  if (str == NULL)
-    return NULL;
-  for (size_t i = 0; i < trace_level; i++) {
-    str[i] = trace_indent_placeholder;
-  }
-  str[trace_level - 1] = 0;
-  return str;
+bool parser_trace_enabled = false;
+
+static trace_event *       events       = nullptr;
+static size_t              event_count  = 0;
+static size_t              trace_level  = 0;
+static bool                first_event  = true;
+static long long           start_ns     = 0;
+static FILE *              trace_sink   = nullptr;
+static parser_trace_format trace_format = PARSER_TRACE_TEXT;
+
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void write_text_event(const trace_event *event) {
+    if (!event->begin && trace_level > 0)
+        trace_level--;
+    for (size_t i = 0; i < trace_level; i++)
+        fputc('\t', trace_sink);
+    fprintf(trace_sink, "%s %s\n", event->begin ? "BEGIN" : "END", event->name);
+    if (event->begin)
+        trace_level++;
+}
+
+static void write_chrome_event(const trace_event *event) {
+    fprintf(trace_sink, "%s{\"name\":\"%s\",\"cat\":\"parser\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":1}",
+            first_event ? "" : ",\n", event->name, event->begin ? 'B' : 'E',
+            (double) (event->timestamp_ns - start_ns) / 1000.0);
+    first_event = false;
+}
+
+/**
+ * Write out the buffered events. The sink is a stdio stream, so this is itself buffered.
+ */
+static void flush_events(void) {
+    for (size_t i = 0; i < event_count; i++) {
+        if (trace_format == PARSER_TRACE_CHROME)
+            write_chrome_event(&events[i]);
+        else
+            write_text_event(&events[i]);
+    }
+    event_count = 0;
 }
 
-static void trace_print(char *string) {
-  char *indent = indent_level();
-  if (indent == NULL)
-    return;
-  printf("%s%s\n", indent, string);
-  free(indent);
+static void record_event(const char *name, const bool begin) {
+    if (event_count == TRACE_BUFFER_EVENTS)
+        flush_events();
+    events[event_count++] = (trace_event){name, now_ns(), begin};
 }
 
-static void inc_indent(void) {
-  trace_level++;
+/**
+ * Start recording parse function entries and exits to `sink`, which stays owned by the
+ * caller. Has no effect unless the parser was compiled with TRACE.
+ */
+void parser_trace_start(FILE *sink, const parser_trace_format format) {
+    if (parser_trace_enabled)
+        parser_trace_stop();
+    events = malloc(TRACE_BUFFER_EVENTS * sizeof(*events));
+    if (events == NULL)
+        err(EXIT_FAILURE, "malloc failed");
+    event_count          = 0;
+    trace_level          = 0;
+    first_event          = true;
+    start_ns             = now_ns();
+    trace_sink           = sink;
+    trace_format         = format;
+    parser_trace_enabled = true;
+    if (format == PARSER_TRACE_CHROME)
+        fputs("[\n", trace_sink);
 }
 
-static void dec_indent(void) {
-  trace_level--;
+/**
+ * Flush the remaining events and stop recording.
+ */
+void parser_trace_stop(void) {
+    if (!parser_trace_enabled)
+        return;
+    flush_events();
+    if (trace_format == PARSER_TRACE_CHROME)
+        fputs("\n]\n", trace_sink);
+    fflush(trace_sink);
+    free(events);
+    events               = nullptr;
+    trace_sink           = nullptr;
+    parser_trace_enabled = false;
 }
 
-const char *trace(const char *msg) {
-  inc_indent();
-  char *trace_msg = NULL;
-  asprintf(&trace_msg, "BEGIN %s", msg);
-  if (trace_msg == NULL)
-    return NULL;
-  trace_print(trace_msg);
-  free(trace_msg);
-  return msg;
+void parser_trace_begin(const char *name) {
+    record_event(name, true);
 }
 
-void untrace(const char *msg) {
-  char *untrace_msg = NULL;
-  asprintf(&untrace_msg, "END %s", msg);
-  if (untrace_msg == NULL) {
-    dec_indent();
-    return;
-  }
-  trace_print(untrace_msg);
-  free(untrace_msg);
-  dec_indent();
+void parser_trace_end(const char *name) {
+    record_event(name, false);
 }
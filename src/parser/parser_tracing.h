@@ -4,6 +4,43 @@
 
 #ifndef PARSER_TRACING_H
 #define PARSER_TRACING_H
-const char *trace(const char *);
-void untrace(const char *);
+#include <stdbool.h>
+#include <stdio.h>
+
+/*
+ * Parser tracing is gated twice: it is only compiled in when TRACE is defined (see the
+ * PARSER_TRACE build option), and even then only records anything between
+ * parser_trace_start and parser_trace_stop. Without TRACE the macros expand to nothing.
+ */
+typedef enum {
+    PARSER_TRACE_TEXT,   // indented BEGIN/END lines
+    PARSER_TRACE_CHROME, // Chrome trace event JSON, for chrome://tracing or Perfetto
+} parser_trace_format;
+
+extern bool parser_trace_enabled;
+
+void parser_trace_start(FILE *, parser_trace_format);
+
+void parser_trace_stop(void);
+
+void parser_trace_begin(const char *);
+
+void parser_trace_end(const char *);
+
+#ifdef TRACE
+#define TRACE_BEGIN(name)                   \
+    do {                                    \
+        if (parser_trace_enabled)           \
+            parser_trace_begin(name);       \
+    } while (0)
+#define TRACE_END(name)                     \
+    do {                                    \
+        if (parser_trace_enabled)           \
+            parser_trace_end(name);         \
+    } while (0)
+#else
+#define TRACE_BEGIN(name) ((void) 0)
+#define TRACE_END(name)   ((void) 0)
+#endif
+
 #endif //PARSER_TRACING_H
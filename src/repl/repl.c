@@ -5,6 +5,7 @@
 #include "repl.h"
 #include <err.h>
 #include <errno.h>
+#include <signal.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -12,12 +13,16 @@
 #include <unistd.h>
 #include "../ast/ast.h"
 #include "../compiler/compiler_core.h"
-#include "../evaluator/evaluator.h"
+#include "../compiler/instructions.h"
+#include "../compiler/peephole.h"
+#include "../compiler/scope.h"
+#include "../ir/ir.h"
 #include "../lexer/lexer.h"
 #include "../object/builtins.h"
-#include "../object/environment.h"
 #include "../object/object.h"
+#include "../parser/parallel_parser.h"
 #include "../parser/parser.h"
+#include "../source/source.h"
 #include "../vm/virtual_machine.h"
 
 static const char *PROMPT      = ">> ";
@@ -47,7 +52,9 @@ static void dump_bytecode(bytecode *bytecode) {
         printf("CONSTANT %zu %p %s:\n", i, constant, get_type_name(constant->type));
         switch (constant->type) {
             case OBJECT_COMPILED_FUNCTION:
-                fn = (object_compiled_fn *) constant;
+            case OBJECT_CLOSURE:
+                fn = constant->type == OBJECT_CLOSURE ? ((object_closure *) constant)->fn
+                                                      : (object_compiled_fn *) constant;
                 char *ins = instructions_to_string(fn->instructions);
                 printf(" Instructions:\n%s", ins);
                 free(ins);
@@ -82,10 +89,19 @@ static void free_lines(arraylist *lines) {
     lines->capacity = 0;
 }
 
-int execute_file(const char *filename) {
+/**
+ * Print how long the input took to open and to produce its first token.
+ */
+static void print_source_stats(const source *src) {
+    fprintf(stderr, "source: %zu bytes (%s), opened in %.3f ms, first token after %.3f ms\n", src->stats.bytes,
+            src->data != NULL ? "mapped" : "streamed", (double) src->stats.open_ns / 1e6,
+            (double) src->stats.first_token_ns / 1e6);
+}
+
+int execute_file(const char *filename, const execute_options *options) {
 
-    FILE *file = fopen(filename, "r");
-    if (file == NULL) {
+    source *src = source_open(filename);
+    if (src == NULL) {
         switch (errno) {
             case EINVAL:
             case ENOMEM:
@@ -103,46 +119,50 @@ int execute_file(const char *filename) {
                 err(EXIT_FAILURE, "Failed to open file %s", filename);
         }
     }
-    size_t       line_size      = 0;
-    char *       line           = nullptr;
-    char *       program_string = nullptr;
-    environment *env            = environment_create();
-    fseek(file, 0L, SEEK_END);
-    const long file_size = ftell(file);
-    rewind(file);
-    program_string = malloc(file_size);
-
-    if (program_string == NULL) {
-        err(EXIT_FAILURE, "malloc failed");
-    }
 
-    while (getline(&line, &line_size, file) != -1) {
-        strcat(program_string, line);
-        line      = nullptr;
-        line_size = 0;
+    lexer * lexer  = source_lexer(src);
+    parser *parser = parser_init(lexer);
+    source_first_token(src);
+    compiler *compiler = compiler_init();
+    compiler_set_optimization_level(compiler, options->optimization_level);
+    compiler_set_instruction_format(compiler, options->aligned ? INSTRUCTIONS_ALIGNED : INSTRUCTIONS_BYTES);
+    if (options->parse_threads > 1) {
+        // the whole program is parsed up front, split between the threads
+        ast_program *program = parse_program_parallel(parser, options->parse_threads);
+        if (!parser->errors && compile_optimized(compiler, (ast_node *) program).error_code != COMPILER_ERROR_NONE) {
+            err(EXIT_FAILURE, "Failed to compile program");
+        }
+        program_free(program);
+    } else {
+        // statements are parsed, compiled and freed one at a time, the compiler keeps the
+        // globals and constants, so only one statement's AST is ever held in memory
+        ast_statement *statement;
+        while ((statement = parser_next_statement(parser)) != NULL) {
+            if (parser->errors) {
+                free_statement(statement);
+                continue;
+            }
+            compiler_error error = compile_optimized(compiler, (ast_node *) statement);
+            free_statement(statement);
+            if (error.error_code != COMPILER_ERROR_NONE) {
+                err(EXIT_FAILURE, "Failed to compile program");
+            }
+        }
+    }
+    source_finish(src, lexer);
+    if (options->print_stats) {
+        print_source_stats(src);
     }
-
-    fclose(file);
-
-    lexer *      lexer    = lexer_init(program_string);
-    parser *     parser   = parser_init(lexer);
-    ast_program *program  = parse_program(parser);
-    compiler *   compiler = compiler_init();
-
-    printf("Executing file %s\n", program_string);
-
-    free(program_string);
 
     if (parser->errors) {
         print_parse_errors(parser);
         goto EXIT;
     }
 
-    compiler_error error = compile(compiler, (ast_node *) program);
-    if (error.error_code != COMPILER_ERROR_NONE) {
-        err(EXIT_FAILURE, "Failed to compile program");
-    }
     bytecode *bytecode = get_bytecode(compiler);
+    if (bytecode == NULL) {
+        errx(EXIT_FAILURE, "Program is too large for aligned instructions");
+    }
 
     dump_bytecode(bytecode);
 
@@ -155,32 +175,83 @@ int execute_file(const char *filename) {
     object_object *object = vm_last_popped_stack_elem(machine);
     printf("Result: %s\n", object->inspect(object));
 
-    //object_object *evaluated = evaluator_eval((ast_node *) program, env);
-    environment_free(env);
-    // if (evaluated != NULL) {
-    //     if (evaluated->type != OBJECT_NULL) {
-    //         char *s = evaluated->inspect(evaluated);
-    //         printf("%s\n", s);
-    //         free(s);
-    //     }
-    //     object_free(evaluated);
-    // }
+EXIT:
+    parser_free(parser);
+    source_close(src);
+    return 0;
+}
+
+static virtual_machine *running_machine;
+
+/** Ctrl-C stops the input that is running, at its next loop iteration, not the session. */
+static void interrupt_running_machine(int) {
+    if (running_machine != NULL)
+        vm_interrupt(running_machine);
+}
+
+/**
+ * Compile and run one complete input against the session's compiler and VM, printing
+ * the value of a trailing expression.
+ */
+static void run_input(compiler *compiler, virtual_machine **machine, const char *input) {
+    lexer *      l       = lexer_init(input);
+    parser *     parser  = parser_init(l);
+    ast_program *program = parse_program(parser);
+
+    if (parser->errors) {
+        print_parse_errors(parser);
+        goto EXIT;
+    }
+
+    const compiler_error error = compile_optimized(compiler, (ast_node *) program);
+    if (error.error_code != COMPILER_ERROR_NONE) {
+        printf("Woops! Compilation failed:\n %s\n", error.msg);
+        free(error.msg);
+        goto EXIT;
+    }
+
+    // the constants are borrowed, the VM only copies the ones it hasn't seen yet
+    const bool     prints   = last_instruction_is(compiler, OP_POP);
+    const bytecode bytecode = {get_top_scope(compiler)->instructions, compiler->constants_pool};
+    if (compiler->peephole)
+        peephole_optimize(bytecode.instructions);
+    if (bytecode.instructions->length == 0)
+        goto EXIT;
+    if (*machine == NULL)
+        *machine = vm_init(&bytecode);
+    else
+        vm_load(*machine, &bytecode);
+    running_machine             = *machine;
+    void (*previous)(int)       = signal(SIGINT, interrupt_running_machine);
+    const vm_error vm_error     = vm_run(*machine);
+    signal(SIGINT, previous);
+    running_machine = nullptr;
+    if (vm_error.code != VM_ERROR_NONE) {
+        printf("Woops! Executing bytecode failed:\n %s\n", vm_error.msg);
+        free(vm_error.msg);
+    } else if (prints) {
+        const object_object *object = vm_last_popped_stack_elem(*machine);
+        char *               s      = object->inspect((object_object *) object);
+        printf("%s\n", s);
+        free(s);
+    }
 
 EXIT:
+    compiler_reset(compiler);
     program_free(program);
     parser_free(parser);
-    if (line)
-        free(line);
-    return 0;
 }
 
 int repl(void) {
-    ssize_t      bytes_read;
-    size_t       line_size = 0;
-    char *       line      = nullptr;
-    parser *     parser    = nullptr;
-    ast_program *program   = nullptr;
-    environment *env       = environment_create();
+    ssize_t bytes_read;
+    size_t  line_size = 0;
+    char *  line      = nullptr;
+
+    // each input is compiled and run on its own, the symbol table, constants and
+    // globals carry the session's state from one input to the next
+    compiler *       compiler = compiler_init();
+    virtual_machine *machine  = nullptr;
+    compiler_set_optimization_level(compiler, 1);
 
     printf("%s\n", MONKEY_FACE);
     printf("Welcome to the monkey programming language\n");
@@ -192,7 +263,7 @@ int repl(void) {
         if (strcmp(line, "quit\n") == 0)
             break;
 
-        if (line[bytes_read - 2] == '\\') {
+        if (bytes_read >= 2 && line[bytes_read - 2] == '\\') {
             line[bytes_read - 2] = 0;
             arraylist_add(lines, line);
             line      = nullptr;
@@ -205,66 +276,20 @@ int repl(void) {
         line      = nullptr;
         line_size = 0;
 
-        char *program_string = arraylist_zip(lines, "\n");
-
-        lexer *l = lexer_init(program_string);
-        parser   = parser_init(l);
-        program  = parse_program(parser);
-
-        if (parser->errors) {
-            print_parse_errors(parser);
-            goto CONTINUE;
-        }
-
-        object_object *evaluated = evaluator_eval((ast_node *) program, env);
-        if (evaluated != NULL) {
-            char *s = evaluated->inspect(evaluated);
-            printf("%s\n", s);
-            free(s);
-            object_free(evaluated);
-        }
-
-    CONTINUE:
-        program_free(program);
-        parser_free(parser);
-        //free_lines(lines);
-        free(program_string);
-        line    = nullptr;
-        program = nullptr;
-        parser  = nullptr;
+        char *input = arraylist_zip(lines, "\n");
+        arraylist_clear(lines);
+        run_input(compiler, &machine, input);
+        free(input);
         printf("%s", PROMPT);
     }
 
-    if (program) {
-        program_free(program);
-    }
-    if (parser) {
-        parser_free(parser);
-    }
     if (line) {
         free(line);
     }
     arraylist_destroy(lines);
-    environment_free(env);
+    if (machine) {
+        vm_free(machine);
+    }
+    compiler_free(compiler);
     return 0;
 }
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
@@ -7,9 +7,16 @@
 
 #include "../parser/parser.h"
 
+typedef struct {
+    bool   print_stats;        // report how the source was loaded on stderr
+    size_t parse_threads;      // parse the whole file on this many threads, instead of a statement at a time
+    int    optimization_level; // see compiler_set_optimization_level
+    bool   aligned;            // run the program as aligned instructions, see compiler_set_instruction_format
+} execute_options;
+
 int repl(void);
 
-int execute_file(const char *);
+int execute_file(const char *, const execute_options *);
 
 static void print_parse_errors(const parser *parser);
 #endif //REPL_H
@@ -0,0 +1,130 @@
+//
+// Created by dgood on 1/21/25.
+//
+
+#include "source.h"
+#include <err.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * Map `size` bytes of a regular file followed by at least one zero byte. The lexer
+ * relies on the terminator, and a file whose size is a multiple of the page size has
+ * no slack in its last page to provide one, so the file is mapped over a zeroed
+ * anonymous reservation that is one byte longer.
+ */
+static bool map_file(source *src, const size_t size) {
+    const size_t page   = (size_t) sysconf(_SC_PAGESIZE);
+    const size_t length = (size + 1 + page - 1) & ~(page - 1);
+    void *       base   = mmap(nullptr, length, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        return false;
+    }
+    if (mmap(base, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, src->fd, 0) == MAP_FAILED) {
+        munmap(base, length);
+        return false;
+    }
+    madvise(base, length, MADV_SEQUENTIAL);
+    src->data       = base;
+    src->length     = size;
+    src->map_length = length;
+    return true;
+}
+
+/**
+ * Open the input at `fd`, mapping it when it is a regular file. The source does not
+ * close `fd`.
+ */
+source *source_from_fd(const int fd) {
+    source *src = calloc(1, sizeof(*src));
+    if (src == NULL) {
+        err(EXIT_FAILURE, "malloc failed");
+    }
+    src->start_ns = now_ns();
+    src->fd       = fd;
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        if (st.st_size == 0) {
+            src->data = "";
+        } else if (!map_file(src, (size_t) st.st_size)) {
+            src->data = nullptr; // fall back to reading it
+        }
+        if (src->data != NULL) {
+            src->stats.bytes = src->length;
+        }
+    }
+    src->stats.open_ns = now_ns() - src->start_ns;
+    return src;
+}
+
+/**
+ * Open the file at `path`, or standard input for "-". Returns NULL with errno set
+ * when the file can't be opened.
+ */
+source *source_open(const char *path) {
+    if (strcmp(path, "-") == 0) {
+        return source_from_fd(STDIN_FILENO);
+    }
+    const long long start = now_ns();
+    const int       fd    = open(path, O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+    source *src        = source_from_fd(fd);
+    src->owns_fd       = true;
+    src->start_ns      = start;
+    src->stats.open_ns = now_ns() - start;
+    return src;
+}
+
+/**
+ * Return a lexer over the source: in place over the mapping, or streaming from the
+ * file descriptor.
+ */
+lexer *source_lexer(const source *src) {
+    if (src->data != NULL) {
+        return lexer_init_buffer(src->data, src->length);
+    }
+    return lexer_init_stream(src->fd);
+}
+
+/**
+ * Record that the first token has been lexed.
+ */
+void source_first_token(source *src) {
+    src->stats.first_token_ns = now_ns() - src->start_ns;
+}
+
+/**
+ * Record what is only known once the whole input has been lexed.
+ */
+void source_finish(source *src, const lexer *l) {
+    if (src->data == NULL) {
+        src->stats.bytes = l->base + l->length;
+    }
+}
+
+void source_close(source *src) {
+    if (src == NULL) {
+        return;
+    }
+    if (src->map_length > 0) {
+        munmap((void *) src->data, src->map_length);
+    }
+    if (src->owns_fd) {
+        close(src->fd);
+    }
+    free(src);
+}
@@ -0,0 +1,45 @@
+//
+// Created by dgood on 1/21/25.
+//
+
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "../lexer/lexer.h"
+
+typedef struct {
+    size_t    bytes;          // size of the input, known up front for mapped files and once lexed otherwise
+    long long open_ns;        // time taken to open and map the input
+    long long first_token_ns; // time from opening the input to its first token
+} source_stats;
+
+/**
+ * Program text to be lexed. Regular files are mapped read only and lexed in place;
+ * pipes, terminals and anything else that can't be mapped are streamed through a
+ * read() based lexer instead, so the input is never copied into one big buffer.
+ */
+typedef struct {
+    const char * data;       // mapped text followed by a nul byte, or NULL when streamed
+    size_t       length;
+    size_t       map_length; // bytes mapped at data, including the terminator page
+    int          fd;
+    bool         owns_fd;
+    long long    start_ns;
+    source_stats stats;
+} source;
+
+source *source_open(const char *);
+
+source *source_from_fd(int);
+
+lexer *source_lexer(const source *);
+
+void source_first_token(source *);
+
+void source_finish(source *, const lexer *);
+
+void source_close(source *);
+
+#endif //SOURCE_H
@@ -5,6 +5,8 @@
 #include "token.h"
 
 #include <ctype.h>
+#include <err.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -13,59 +15,56 @@ void token_free(token *tok) {
     if (!tok) {
         return;
     }
-    if (tok->type != END_OF_FILE) {
-        if (tok->literal) {
-            free(tok->literal);
-        }
-    }
+    free(tok->literal);
     free(tok);
 }
 
-static int is_number(const char *literal) {
-    while (*literal) {
-        char c = *literal;
-        if (!c) {
-            break;
-        }
-
-        if (!isdigit(c))
+static bool is_number(const char *literal, const size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        if (!isdigit((unsigned char) literal[i]))
             return false;
-        literal++;
     }
     return true;
 }
 
-token_type token_get_type(const char *literal) {
-    if (strcmp(literal, "let") == 0)
-        return LET;
-
-    if (strcmp(literal, "fn") == 0)
-        return FUNCTION;
-
-    if (strcmp(literal, "if") == 0)
-        return IF;
-
-    if (strcmp(literal, "else") == 0)
-        return ELSE;
-
-    if (strcmp(literal, "return") == 0)
-        return RETURN;
-
-    if (strcmp(literal, "true") == 0)
-        return TRUE;
-
-    if (strcmp(literal, "false") == 0)
-        return FALSE;
-
-    if (strcmp(literal, "while") == 0)
-        return WHILE;
-
-    if (is_number(literal))
-        return INT;
+/*
+ * Keyword recognizer, expanded from the KEYWORD entries of TOKEN_LIST. Each entry costs
+ * a compare of the length and of the first character against constants, so most
+ * identifiers are rejected without touching memcmp.
+ */
+#define KEYWORD_MATCH(type, keyword)                                                                       \
+    if (length == sizeof(keyword) - 1 && literal[0] == (keyword)[0] && memcmp(literal, keyword, length) == 0) \
+        return type;
+#define TOKEN_SKIP(type)
+
+/**
+ * Classify an identifier-like span of `length` bytes, which need not be NUL terminated.
+ */
+token_type token_get_type(const char *literal, const size_t length) {
+    if (isdigit((unsigned char) literal[0]))
+        return is_number(literal, length) ? INT : IDENT;
+
+    TOKEN_LIST(TOKEN_SKIP, KEYWORD_MATCH)
 
     return IDENT;
 }
 
+/**
+ * Materialize a lexer token: copy the text of `span` out of the source buffer it points into.
+ */
+token *token_from_span(const char *input, const token_span span) {
+    token *tok = malloc(sizeof(*tok));
+    if (tok == NULL) {
+        err(EXIT_FAILURE, "malloc failed");
+    }
+    tok->type    = span.type;
+    tok->literal = strndup(input + span.offset, span.length);
+    if (tok->literal == NULL) {
+        err(EXIT_FAILURE, "malloc failed");
+    }
+    return tok;
+}
+
 token *token_copy(token *source) {
     token *destination = malloc(sizeof(*destination));
     if (destination == NULL) {
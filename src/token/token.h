@@ -4,105 +4,92 @@
 
 #ifndef TOKEN_H
 #define TOKEN_H
+#include <stddef.h>
 /*
- * If you want to add more token types then add it to the
- * token_type enum as well as the tokens array.
+ * Every token type is listed once here: TOKEN(type) for plain tokens and
+ * KEYWORD(type, literal) for keywords. The token_type enum, the tokens[] names and the
+ * keyword recognizer in token.c are all expanded from this list, so adding a keyword
+ * only takes a KEYWORD line (and parse functions for it in parser.c, if any).
  */
-typedef enum {
-    ILLEGAL,
-    END_OF_FILE,
-
-    // identifiers, literals
-    IDENT,
-    INT,
-    STRING,
+#define TOKEN_LIST(TOKEN, KEYWORD)  \
+    TOKEN(ILLEGAL)                  \
+    TOKEN(END_OF_FILE)              \
+                                    \
+    /* identifiers, literals */     \
+    TOKEN(IDENT)                    \
+    TOKEN(INT)                      \
+    TOKEN(STRING)                   \
+                                    \
+    /* operators */                 \
+    TOKEN(ASSIGN)                   \
+    TOKEN(PLUS)                     \
+    TOKEN(MINUS)                    \
+    TOKEN(BANG)                     \
+    TOKEN(SLASH)                    \
+    TOKEN(ASTERISK)                 \
+    TOKEN(PERCENT)                  \
+    TOKEN(LT)                       \
+    TOKEN(GT)                       \
+    TOKEN(EQ)                       \
+    TOKEN(NOT_EQ)                   \
+    TOKEN(AND)                      \
+    TOKEN(OR)                       \
+                                    \
+    /* delimiters */                \
+    TOKEN(COMMA)                    \
+    TOKEN(SEMICOLON)                \
+    TOKEN(LPAREN)                   \
+    TOKEN(RPAREN)                   \
+    TOKEN(LBRACE)                   \
+    TOKEN(RBRACE)                   \
+    TOKEN(LBRACKET)                 \
+    TOKEN(RBRACKET)                 \
+    TOKEN(COLON)                    \
+                                    \
+    /* keywords */                  \
+    KEYWORD(FUNCTION, "fn")         \
+    KEYWORD(LET, "let")             \
+    KEYWORD(IF, "if")               \
+    KEYWORD(ELSE, "else")           \
+    KEYWORD(RETURN, "return")       \
+    KEYWORD(TRUE, "true")           \
+    KEYWORD(FALSE, "false")         \
+    KEYWORD(WHILE, "while")
 
-    //operators
-    ASSIGN,
-    PLUS,
-    MINUS,
-    BANG,
-    SLASH,
-    ASTERISK,
-    PERCENT,
-    LT,
-    GT,
-    EQ,
-    NOT_EQ,
-    AND,
-    OR,
+#define TOKEN_ENUM(type) type,
+#define KEYWORD_ENUM(type, literal) type,
 
-    //delimiters
-    COMMA,
-    SEMICOLON,
-    LPAREN,
-    RPAREN,
-    LBRACE,
-    RBRACE,
-    LBRACKET,
-    RBRACKET,
-    COLON,
-
-    //keywords
-    FUNCTION,
-    LET,
-    IF,
-    ELSE,
-    RETURN,
-    TRUE,
-    FALSE,
-    WHILE
+typedef enum {
+    TOKEN_LIST(TOKEN_ENUM, KEYWORD_ENUM)
 } token_type;
 
-static const char *tokens[] = {
-    "ILLEGAL",
-    "END_OF_FILE",
-
-    // identifiers, literals
-    "IDENT",
-    "INT",
-    "STRING",
-
-    //operators
-    "ASSIGN",
-    "PLUS",
-    "MINUS",
-    "BANG",
-    "SLASH",
-    "ASTERISK",
-    "PERCENT",
-    "LT",
-    "GT",
-    "EQ",
-    "NOT_EQ",
-    "AND",
-    "OR",
-
-    //delimiters
-    "COMMA",
-    "SEMICOLON",
-    "LPAREN",
-    "RPAREN",
-    "LBRACE",
-    "RBRACE",
-    "LBRACKET",
-    "RBRACKET",
-    "COLON",
+#define TOKEN_NAME(type) #type,
+#define KEYWORD_NAME(type, literal) #type,
 
-    //keywords
-    "FUNCTION",
-    "LET",
-    "IF",
-    "ELSE",
-    "RETURN",
-    "TRUE",
-    "FALSE",
-    "WHILE"
+static const char *tokens[] = {
+    TOKEN_LIST(TOKEN_NAME, KEYWORD_NAME)
 };
 
+#define TOKEN_TYPE_COUNT (sizeof(tokens) / sizeof(tokens[0]))
+
 #define token_get_type_from_name(tok) tokens[tok->type]
 #define token_get_name_from_type(tok_type) tokens[tok_type]
 
+/**
+ * A token as produced by the lexer: a span of the source buffer instead of a copy of
+ * its text, so lexing does not allocate. For strings the span covers the characters
+ * between the quotes. `line` starts at 1.
+ */
+typedef struct {
+    token_type  type;
+    size_t      offset;
+    size_t      length;
+    size_t      line;
+} token_span;
+
+/**
+ * A token with its own copy of the literal, as kept by the AST nodes.
+ */
 typedef struct {
     token_type  type;
     char        *literal;
@@ -110,6 +97,7 @@ typedef struct {
 
 void        token_free(token *);
 token       *token_copy(token *);
-token_type  token_get_type(const char *);
+token       *token_from_span(const char *, token_span);
+token_type  token_get_type(const char *, size_t);
 
 #endif //TOKEN_H
@@ -70,7 +70,9 @@ static frame *pop_frame(virtual_machine *vm) {
     vm->frame_index--;
     frame *f = vm->frames[vm->frame_index];
     for (size_t i = 0; i < f->cl->fn->num_locals; i++) {
-        object_free(vm->stack[f->bp + i]);
+        // a local the function never got to set is still empty
+        if (vm->stack[f->bp + i] != nullptr)
+            object_free(vm->stack[f->bp + i]);
         vm->stack[f->bp + i] = nullptr; // ensure the VM doesn't try to clean these up
     }
 
@@ -97,6 +99,8 @@ virtual_machine *vm_init(const bytecode *bytecode) {
     }
     vm->sp          = 0;
     vm->stack_count = 0;
+    vm->loop_count  = 0;
+    vm->interrupted = 0;
 
     // Initialize globals
     for (size_t i = 0; i < GLOBALS_SIZE; i++) {
@@ -140,10 +144,45 @@ virtual_machine *vm_init_with_state(bytecode *bytecode, object_object *globals[G
     return vm;
 }
 
+/**
+ * Point a VM at new top level bytecode, keeping its globals so code compiled against
+ * the same compiler can pick up where the last run stopped. Only the constants added
+ * since the last load are copied in.
+ */
+void vm_load(virtual_machine *vm, const bytecode *bytecode) {
+    for (size_t i = 0; i < vm->stack_count && i < STACKSIZE; i++) {
+        if (vm->stack[i] != NULL) {
+            object_free(vm->stack[i]);
+            vm->stack[i] = nullptr;
+        }
+    }
+    vm->sp          = 0;
+    vm->stack_count = 0;
+
+    for (size_t i = 0; i < vm->frame_index; i++) {
+        frame_free(vm->frames[i]);
+        vm->frames[i] = nullptr;
+    }
+    vm->frame_index = 0;
+
+    if (bytecode->constants_pool) {
+        if (vm->constants == NULL)
+            vm->constants = arraylist_create(bytecode->constants_pool->size, object_free);
+        for (size_t i = vm->constants->size; i < bytecode->constants_pool->size; i++)
+            arraylist_add(vm->constants, object_copy_object(arraylist_get(bytecode->constants_pool, i)));
+    }
+
+    object_compiled_fn *main_fn      = object_create_compiled_fn(bytecode->instructions, 0, 0);
+    object_closure *    main_closure = object_create_closure(main_fn, nullptr);
+    vm->frames[vm->frame_index++]    = frame_init(main_closure, 0);
+    object_free(main_closure);
+    object_free(main_fn);
+}
+
 void vm_free(virtual_machine *vm) {
 
     // Free stack objects
-    for (size_t i = 0; i < vm->stack_count; i++) {
+    for (size_t i = 0; i < vm->stack_count && i < STACKSIZE; i++) {
         if (vm->stack[i] != NULL) {
             object_free(vm->stack[i]);
             vm->stack[i] = nullptr; // Avoid dangling pointers
@@ -228,7 +267,16 @@ static vm_error execute_binary_int_op(virtual_machine *vm, Opcode op, long leftv
             result = leftval * rightval;
             break;
         case OP_DIV:
-            result = leftval / rightval;
+        case OP_MOD:
+            if (rightval == 0) {
+                error.code = VM_DIVISION_BY_ZERO;
+                error.msg  = get_err_msg("division by 0 not allowed");
+                return error;
+            }
+            if (op == OP_DIV)
+                result = leftval / rightval;
+            else
+                result = rightval == -1 ? 0 : leftval % rightval; // LONG_MIN % -1 would trap
             break;
         default:
             op_def = opcode_definition_lookup(op);
@@ -243,22 +291,48 @@ static vm_error execute_binary_int_op(virtual_machine *vm, Opcode op, long leftv
 
 static vm_error execute_binary_string_op(virtual_machine *vm, Opcode op, object_string *leftval,
                                          object_string *  rightval) {
-    char *   result = nullptr;
-    vm_error error  = {VM_ERROR_NONE, nullptr};
+    vm_error error = {VM_ERROR_NONE, nullptr};
     if (op != OP_ADD) {
         OpcodeDefinition *op_def = opcode_definition_lookup(op);
         error.code               = VM_UNSUPPORTED_OPERATOR;
         error.msg                = get_err_msg("opcode %s not support for string operands", op_def->name);
         return error;
     }
-    if ((asprintf(&result, "%s%s", leftval->value, rightval->value)) == -1)
-        err(EXIT_FAILURE, "malloc failed");
-    object_object *result_obj = (object_object *) object_create_string(result, leftval->length + rightval->length);
-    free(result);
+    object_object *result_obj = (object_object *) object_string_concat(leftval, rightval);
     vm_push(vm, result_obj);
     return error;
 }
 
+static vm_error execute_binary_array_op(virtual_machine *vm, Opcode op, const object_array *leftval,
+                                        const object_array *rightval) {
+    vm_error          error  = {VM_ERROR_NONE, nullptr};
+    OpcodeDefinition *op_def = opcode_definition_lookup(op);
+    char              arith_op;
+    switch (op) {
+        case OP_ADD:
+            arith_op = '+';
+            break;
+        case OP_SUB:
+            arith_op = '-';
+            break;
+        case OP_MUL:
+            arith_op = '*';
+            break;
+        default:
+            error.code = VM_UNSUPPORTED_OPERATOR;
+            error.msg  = get_err_msg("opcode %s not support for array operands", op_def->name);
+            return error;
+    }
+    object_array *result = object_array_arithmetic(leftval, rightval, arith_op);
+    if (result == NULL) {
+        error.code = VM_UNSUPPORTED_OPERAND;
+        error.msg  = get_err_msg("'%s' operation requires integer arrays of equal length", op_def->name);
+        return error;
+    }
+    vm_push(vm, (object_object *) result);
+    return error;
+}
+
 static vm_error execute_binary_op(virtual_machine *vm, Opcode op) {
     object_object *right = vm_pop(vm);
     object_object *left  = vm_pop(vm);
@@ -271,6 +345,8 @@ static vm_error execute_binary_op(virtual_machine *vm, Opcode op) {
         vm_err        = execute_binary_int_op(vm, op, leftval, rightval);
     } else if (left->type == OBJECT_STRING && right->type == OBJECT_STRING) {
         vm_err = execute_binary_string_op(vm, op, (object_string *) left, (object_string *) right);
+    } else if (left->type == OBJECT_ARRAY && right->type == OBJECT_ARRAY) {
+        vm_err = execute_binary_array_op(vm, op, (object_array *) left, (object_array *) right);
     } else {
         vm_err.code              = VM_UNSUPPORTED_OPERAND;
         OpcodeDefinition *op_def = opcode_definition_lookup(op);
@@ -346,17 +422,17 @@ static vm_error execute_minus_operator(virtual_machine *vm) {
 
 static vm_error execute_array_index_expression(virtual_machine *vm, object_array *left, object_int *index) {
     vm_error vm_err = {VM_ERROR_NONE, nullptr};
-    if (index->value < 0 || index->value >= left->elements->size) {
+    if (index->value < 0 || (size_t) index->value >= object_array_length(left)) {
         vm_push(vm, (object_object *) object_create_null());
         return vm_err;
     }
-    vm_replace_top(vm, object_copy_object(arraylist_get(left->elements, index->value)));
+    vm_replace_top(vm, object_array_get(left, index->value));
     return vm_err;
 }
 
 static vm_error execute_hash_index_expression(virtual_machine *vm, object_hash *left, object_object *index) {
     const vm_error vm_err = {VM_ERROR_NONE, nullptr};
-    object_object *value  = hashtable_get(left->pairs, index);
+    object_object *value  = object_hash_get(left, index);
     if (value == NULL)
         vm_push(vm, (object_object *) object_create_null());
     else
@@ -364,6 +440,16 @@ static vm_error execute_hash_index_expression(virtual_machine *vm, object_hash *
     return vm_err;
 }
 
+static vm_error execute_string_index_expression(virtual_machine *vm, object_string *left, object_int *index) {
+    vm_error vm_err = {VM_ERROR_NONE, nullptr};
+    if (index->value < 0 || (size_t) index->value >= left->length) {
+        vm_push(vm, (object_object *) object_create_null());
+        return vm_err;
+    }
+    vm_replace_top(vm, (object_object *) object_string_slice(left, index->value, 1));
+    return vm_err;
+}
+
 static vm_error execute_index_expression(virtual_machine *vm, object_object *left, object_object *index) {
     vm_error vm_err;
     if (left->type == OBJECT_ARRAY) {
@@ -376,6 +462,8 @@ static vm_error execute_index_expression(virtual_machine *vm, object_object *lef
         return execute_array_index_expression(vm, (object_array *) left, (object_int *) index);
     } else if (left->type == OBJECT_HASH)
         return execute_hash_index_expression(vm, (object_hash *) left, index);
+    else if (left->type == OBJECT_STRING && index->type == OBJECT_INT)
+        return execute_string_index_expression(vm, (object_string *) left, (object_int *) index);
     vm_err.code = VM_UNSUPPORTED_OPERATOR;
     vm_err.msg  = get_err_msg("index operator not supported for %s", get_type_name(left->type));
     return vm_err;
@@ -420,6 +508,51 @@ RETURN:
     return error;
 }
 
+/** The slot an OP_INCREMENT or OP_LESS_THAN instruction names, a global or a local of `current_frame`. */
+static object_object **variable_slot(virtual_machine *vm, const frame *current_frame, const Opcode op,
+                                     const size_t index) {
+    if (op == OP_INCREMENT_GLOBAL || op == OP_LESS_THAN_GLOBAL)
+        return &vm->globals[index];
+    return &vm->stack[current_frame->bp + index];
+}
+
+/**
+ * Add the constant `step` to the variable in `slot`, as loading both, OP_ADD and setting
+ * the variable again would. An integer in a slot is never shared, everything that reads
+ * it gets a copy, so it is changed where it is.
+ */
+static vm_error increment_variable(virtual_machine *vm, object_object **slot, object_object *step) {
+    vm_error error = {VM_ERROR_NONE, nullptr};
+    if (*slot != NULL && (*slot)->type == OBJECT_INT && step->type == OBJECT_INT) {
+        ((object_int *) *slot)->value += ((object_int *) step)->value;
+        return error;
+    }
+    vm_push_copy(vm, *slot);
+    vm_push_copy(vm, step);
+    error = execute_binary_op(vm, OP_ADD);
+    if (error.code != VM_ERROR_NONE)
+        return error;
+    if (*slot != NULL)
+        object_free(*slot);
+    *slot = vm_pop(vm);
+    vm->stack[vm->sp] = nullptr;
+    return error;
+}
+
+/**
+ * Push whether the variable in `left` is less than the one in `right`, as loading them
+ * the way a < b compiles and OP_GREATER_THAN would, without copying integers to do it.
+ */
+static vm_error compare_variables(virtual_machine *vm, object_object *left, object_object *right) {
+    if (left != NULL && right != NULL && left->type == OBJECT_INT && right->type == OBJECT_INT) {
+        vm_push(vm, (object_object *) object_create_bool(((object_int *) left)->value < ((object_int *) right)->value));
+        return (vm_error){VM_ERROR_NONE, nullptr};
+    }
+    vm_push_copy(vm, right);
+    vm_push_copy(vm, left);
+    return execute_comparison_op(vm, OP_GREATER_THAN);
+}
+
 static bool is_truthy(object_object *condition) {
     switch (condition->type) {
         case OBJECT_BOOL:
@@ -474,6 +607,8 @@ static vm_error call_builtin(virtual_machine *vm, object_builtin *callee, size_t
     }
     object_object *result = callee->function(args);
     linked_list_free(args, nullptr);
+    // the result takes the place of the callee, the arguments are freed when their slots are reused
+    vm->sp = vm->sp - num_args - 1;
     vm_push(vm, result);
     vm_err.code = VM_ERROR_NONE;
     vm_err.msg  = nullptr;
@@ -518,8 +653,270 @@ uint16_t read_uint16(const uint8_t *bytes) {
     return (uint16_t) (bytes[0] << 8) | bytes[1];
 }
 
+static uint32_t read_uint32(const uint8_t *bytes) {
+    return (uint32_t) read_uint16(bytes) << 16 | read_uint16(bytes + 2);
+}
+
+/**
+ * Read the next operand of the instruction at the frame's ip, `width` bytes or twice
+ * that after OP_WIDE, and move the ip onto its last byte.
+ */
+static inline size_t read_operand(frame *current_frame, const instructions *ins, const size_t width,
+                                  const bool wide) {
+    const uint8_t *bytes   = &ins->bytes[current_frame->ip + 1];
+    const size_t   operand = wide ? (width == 2 ? read_uint32(bytes) : read_uint16(bytes))
+                                  : (width == 2 ? read_uint16(bytes) : bytes[0]);
+    current_frame->ip += wide ? 2 * width : width;
+    return operand;
+}
+
+/**
+ * Ask a running VM to stop, from a signal handler or another thread. It stops at the
+ * next backward branch, so a loop can't keep it from noticing.
+ */
+void vm_interrupt(virtual_machine *vm) {
+    vm->interrupted = 1;
+}
+
+/** Stop at a safepoint because of vm_interrupt, leaving the VM ready to run again. */
+static vm_error interrupt(virtual_machine *vm) {
+    vm->interrupted = 0;
+    return (vm_error){VM_INTERRUPTED, get_err_msg("interrupted")};
+}
+
+/**
+ * vm_run for aligned instructions. Each is one word, so its opcode and operand come from
+ * a single load, and the ip counts words rather than bytes. Only an instruction whose operands
+ * didn't fit in one word together takes two, the first an OP_WIDE word with its first operand.
+ */
+static vm_error run_aligned(virtual_machine *vm) {
+    vm_error        vm_err;
+    object_object * top = nullptr;
+    arraylist *     array_list;
+    hashtable *     table;
+    object_array *  array_obj;
+    object_hash *   hash_obj;
+    object_object * index;
+    object_object * left;
+    object_object * return_value;
+    frame *         popped_frame = nullptr;
+    object_closure *current_closure;
+    Opcode          wide_op;
+    size_t          operands[MAX_OPERANDS];
+    size_t          width;
+    frame *         current_frame = get_current_frame(vm);
+    const uint32_t *code          = (const uint32_t *) get_frame_instructions(current_frame)->bytes;
+    size_t          count         = get_frame_instructions(current_frame)->length / sizeof(*code);
+    while (current_frame->ip < count) {
+        const uint32_t word    = code[current_frame->ip];
+        const Opcode   op      = aligned_opcode(word);
+        const size_t   operand = aligned_operand(word);
+        if (top != NULL) {
+            object_free(top);
+            vm->stack[vm->sp] = nullptr;
+            top               = nullptr;
+        }
+        switch (op) {
+            case OP_CONSTANT:
+                vm_push_copy(vm, get_constant(vm, operand));
+                break;
+            case OP_ADD:
+            case OP_SUB:
+            case OP_MUL:
+            case OP_DIV:
+            case OP_MOD:
+                vm_err = execute_binary_op(vm, op);
+                if (vm_err.code != VM_ERROR_NONE)
+                    return vm_err;
+                break;
+            case OP_POP:
+                top = vm_pop(vm);
+                break;
+            case OP_TRUE:
+                vm_push(vm, (object_object *) object_create_bool(true));
+                break;
+            case OP_FALSE:
+                vm_push(vm, (object_object *) object_create_bool(false));
+                break;
+            case OP_NULL:
+                vm_push(vm, (object_object *) object_create_null());
+                break;
+            case OP_GREATER_THAN:
+            case OP_EQUAL:
+            case OP_NOT_EQUAL:
+                vm_err = execute_comparison_op(vm, op);
+                if (vm_err.code != VM_ERROR_NONE)
+                    return vm_err;
+                break;
+            case OP_MINUS:
+                vm_err = execute_minus_operator(vm);
+                if (vm_err.code != VM_ERROR_NONE)
+                    return vm_err;
+                break;
+            case OP_BANG:
+                vm_err = execute_bang_operator(vm);
+                if (vm_err.code != VM_ERROR_NONE)
+                    return vm_err;
+                break;
+            case OP_JUMP:
+                current_frame->ip = operand - 1;
+                break;
+            case OP_LOOP:
+                current_frame->ip = operand - 1;
+                vm->loop_count++;
+                if (vm->interrupted)
+                    return interrupt(vm);
+                break;
+            case OP_JUMP_NOT_TRUTHY:
+                top = vm_pop(vm);
+                if (!is_truthy(top))
+                    current_frame->ip = operand - 1;
+                break;
+            case OP_JUMP_TRUTHY:
+                top = vm_pop(vm);
+                if (is_truthy(top))
+                    current_frame->ip = operand - 1;
+                break;
+            case OP_DUP:
+                vm_push_copy(vm, vm->stack[vm->sp - 1]);
+                break;
+            case OP_SET_GLOBAL:
+                top = vm_pop(vm);
+                if (vm->globals[operand] != nullptr) {
+                    object_free(vm->globals[operand]);
+                }
+                vm->globals[operand] = object_copy_object(top);
+                break;
+            case OP_SET_LOCAL:
+                top = vm_pop(vm);
+                if (vm->stack[current_frame->bp + operand] != nullptr) {
+                    object_free(vm->stack[current_frame->bp + operand]);
+                }
+                vm->stack[current_frame->bp + operand] = object_copy_object(top);
+                break;
+            case OP_GET_GLOBAL:
+                vm_push_copy(vm, vm->globals[operand]);
+                break;
+            case OP_GET_LOCAL:
+                vm_push_copy(vm, vm->stack[current_frame->bp + operand]);
+                break;
+            case OP_GET_FREE:
+                current_closure = current_frame->cl;
+                vm_push_copy(vm, current_closure->free_variables[operand]);
+                break;
+            case OP_ARRAY:
+                array_list = build_array(vm, operand);
+                array_obj  = object_pack_array(array_list);
+                if (object_array_length(array_obj) == 0) {
+                    vm_push(vm, (object_object *) array_obj);
+                } else {
+                    vm_replace_top(vm, (object_object *) array_obj);
+                }
+                break;
+            case OP_HASH:
+                table    = build_hash(vm, operand);
+                hash_obj = object_create_hash(table);
+                vm->sp -= operand;
+                if (object_hash_count(hash_obj) == 0) {
+                    vm_push(vm, (object_object *) hash_obj);
+                } else {
+                    vm_replace_top(vm, (object_object *) hash_obj);
+                }
+                break;
+            case OP_INDEX:
+                index  = vm_pop(vm);
+                left   = vm_pop(vm);
+                vm_err = execute_index_expression(vm, left, index);
+                if (vm_err.code != VM_ERROR_NONE) {
+                    return vm_err;
+                }
+                break;
+            case OP_CALL:
+                vm_err = execute_call(vm, operand);
+                if (vm_err.code != VM_ERROR_NONE) {
+                    return vm_err;
+                }
+                break;
+            case OP_RETURN_VALUE:
+                return_value = vm_pop(vm);
+                popped_frame = pop_frame(vm);
+                vm->sp       = popped_frame->bp - 1;
+                vm_replace_top(vm, object_copy_object(return_value));
+                break;
+            case OP_RETURN:
+                popped_frame = pop_frame(vm);
+                vm->sp       = popped_frame->bp - 1;
+                vm_push(vm, (object_object *) object_create_null());
+                break;
+            case OP_GET_BUILTIN:
+                vm_push(vm, (object_object *) get_builtins(get_builtins_name(operand)));
+                break;
+            case OP_CLOSURE:
+                // the constant in the low 16 bits of the operand, the free variable count in the high 8
+                vm_push_closure(vm, operand & 0xFFFF, operand >> 16);
+                break;
+            case OP_CURRENT_CLOSURE:
+                current_closure = current_frame->cl;
+                vm_push_copy(vm, (object_object *) current_closure);
+                break;
+            case OP_INCREMENT_LOCAL:
+                vm_err = increment_variable(vm, variable_slot(vm, current_frame, op, operand & 0xFF),
+                                            get_constant(vm, operand >> 8));
+                if (vm_err.code != VM_ERROR_NONE)
+                    return vm_err;
+                break;
+            case OP_LESS_THAN_LOCAL:
+                vm_err = compare_variables(vm, *variable_slot(vm, current_frame, op, operand & 0xFF),
+                                           *variable_slot(vm, current_frame, op, operand >> 8));
+                if (vm_err.code != VM_ERROR_NONE)
+                    return vm_err;
+                break;
+            case OP_WIDE:
+                // the instruction in the word that follows has the rest of the operands
+                wide_op = opcode_decode_aligned(code + current_frame->ip++, operands, &width);
+                switch (wide_op) {
+                    case OP_CLOSURE:
+                        vm_push_closure(vm, operands[0], operands[1]);
+                        break;
+                    case OP_INCREMENT_GLOBAL:
+                    case OP_INCREMENT_LOCAL:
+                        vm_err = increment_variable(vm, variable_slot(vm, current_frame, wide_op, operands[0]),
+                                                    get_constant(vm, operands[1]));
+                        if (vm_err.code != VM_ERROR_NONE)
+                            return vm_err;
+                        break;
+                    default:
+                        vm_err = compare_variables(vm, *variable_slot(vm, current_frame, wide_op, operands[0]),
+                                                   *variable_slot(vm, current_frame, wide_op, operands[1]));
+                        if (vm_err.code != VM_ERROR_NONE)
+                            return vm_err;
+                        break;
+                }
+                break;
+            default:
+                OpcodeDefinition *op_def = opcode_definition_lookup(op);
+                vm_err.code              = VM_UNSUPPORTED_OPERATOR;
+                vm_err.msg               = get_err_msg("Unsupported opcode %s", op_def->name);
+                return vm_err;
+        }
+        if (popped_frame == current_frame) {
+            frame_free(popped_frame);
+            popped_frame = nullptr;
+        } else
+            current_frame->ip++;
+        if (current_frame != get_current_frame(vm)) {
+            current_frame = get_current_frame(vm);
+            code          = (const uint32_t *) get_frame_instructions(current_frame)->bytes;
+            count         = get_frame_instructions(current_frame)->length / sizeof(*code);
+        }
+    }
+    vm_err.code = VM_ERROR_NONE;
+    vm_err.msg  = nullptr;
+    return vm_err;
+}
+
 vm_error vm_run(virtual_machine *vm) {
-    size_t          const_index, jmp_pos, symbol_index, array_size, num_elements;
+    size_t          const_index, jmp_pos, symbol_index, limit_index, slot_width, array_size, num_elements;
     vm_error        vm_err;
     object_object * top = nullptr;
     arraylist *     array_list;
@@ -538,6 +935,9 @@ vm_error vm_run(virtual_machine *vm) {
     size_t          ip                         = 0;
     instructions *  current_frame_instructions = nullptr;
     Opcode          op                         = OP_INVALID;
+    bool            wide                       = false;
+    if (get_frame_instructions(current_frame)->format == INSTRUCTIONS_ALIGNED)
+        return run_aligned(vm);
     while (current_frame->ip < get_frame_instructions(current_frame)->length) {
         ip                         = current_frame->ip;
         current_frame_instructions = get_frame_instructions(current_frame);
@@ -549,14 +949,14 @@ vm_error vm_run(virtual_machine *vm) {
         }
         switch (op) {
             case OP_CONSTANT:
-                const_index = read_uint16(&current_frame_instructions->bytes[ip + 1]);
-                current_frame->ip += 2;
+                const_index = read_operand(current_frame, current_frame_instructions, 2, wide);
                 vm_push_copy(vm, get_constant(vm, const_index));
                 break;
             case OP_ADD:
             case OP_SUB:
             case OP_MUL:
             case OP_DIV:
+            case OP_MOD:
                 vm_err = execute_binary_op(vm, op);
                 if (vm_err.code != VM_ERROR_NONE)
                     return vm_err;
@@ -591,25 +991,41 @@ vm_error vm_run(virtual_machine *vm) {
                     return vm_err;
                 break;
             case OP_JUMP:
-                jmp_pos = read_uint16(&current_frame_instructions->bytes[ip + 1]);
+                jmp_pos           = read_operand(current_frame, current_frame_instructions, 2, wide);
+                current_frame->ip = jmp_pos - 1;
+                break;
+            case OP_LOOP:
+                jmp_pos           = read_operand(current_frame, current_frame_instructions, 2, wide);
                 current_frame->ip = jmp_pos - 1;
+                vm->loop_count++;
+                if (vm->interrupted)
+                    return interrupt(vm);
                 break;
             case OP_JUMP_NOT_TRUTHY:
-                jmp_pos = read_uint16(&current_frame_instructions->bytes[ip + 1]);
-                current_frame->ip += 2;
+                jmp_pos = read_operand(current_frame, current_frame_instructions, 2, wide);
                 top = vm_pop(vm);
                 if (!is_truthy(top))
                     current_frame->ip = jmp_pos - 1;
                 break;
+            case OP_JUMP_TRUTHY:
+                jmp_pos = read_operand(current_frame, current_frame_instructions, 2, wide);
+                top = vm_pop(vm);
+                if (is_truthy(top))
+                    current_frame->ip = jmp_pos - 1;
+                break;
+            case OP_DUP:
+                vm_push_copy(vm, vm->stack[vm->sp - 1]);
+                break;
             case OP_SET_GLOBAL:
-                symbol_index = read_uint16(&current_frame_instructions->bytes[ip + 1]);
-                current_frame->ip += 2;
-                top                       = vm_pop(vm);
+                symbol_index = read_operand(current_frame, current_frame_instructions, 2, wide);
+                top = vm_pop(vm);
+                if (vm->globals[symbol_index] != nullptr) {
+                    object_free(vm->globals[symbol_index]);
+                }
                 vm->globals[symbol_index] = object_copy_object(top);
                 break;
             case OP_SET_LOCAL:
-                symbol_index = current_frame_instructions->bytes[ip + 1];
-                current_frame->ip++;
+                symbol_index = read_operand(current_frame, current_frame_instructions, 1, wide);
                 top = vm_pop(vm);
                 if (vm->stack[current_frame->bp + symbol_index] != nullptr) {
                     object_free(vm->stack[current_frame->bp + symbol_index]);
@@ -617,39 +1033,34 @@ vm_error vm_run(virtual_machine *vm) {
                 vm->stack[current_frame->bp + symbol_index] = object_copy_object(top);
                 break;
             case OP_GET_GLOBAL:
-                symbol_index = read_uint16(&current_frame_instructions->bytes[ip + 1]);
-                current_frame->ip += 2;
+                symbol_index = read_operand(current_frame, current_frame_instructions, 2, wide);
                 vm_push_copy(vm, vm->globals[symbol_index]);
                 break;
             case OP_GET_LOCAL:
-                symbol_index = current_frame_instructions->bytes[ip + 1];
-                current_frame->ip++;
+                symbol_index = read_operand(current_frame, current_frame_instructions, 1, wide);
                 vm_push_copy(vm, vm->stack[current_frame->bp + symbol_index]);
                 break;
             case OP_GET_FREE:
-                symbol_index = current_frame_instructions->bytes[ip + 1];
-                current_frame->ip++;
+                symbol_index = read_operand(current_frame, current_frame_instructions, 1, wide);
                 current_closure = get_current_frame(vm)->cl;
                 vm_push_copy(vm, current_closure->free_variables[symbol_index]);
                 break;
             case OP_ARRAY:
-                array_size = read_uint16(&current_frame_instructions->bytes[ip + 1]);
-                current_frame->ip += 2;
+                array_size = read_operand(current_frame, current_frame_instructions, 2, wide);
                 array_list = build_array(vm, array_size);
-                array_obj  = object_create_array(array_list);
-                if (array_obj->elements->size == 0) {
+                array_obj  = object_pack_array(array_list);
+                if (object_array_length(array_obj) == 0) {
                     vm_push(vm, (object_object *) array_obj);
                 } else {
                     vm_replace_top(vm, (object_object *) array_obj);
                 }
                 break;
             case OP_HASH:
-                num_elements = read_uint16(&current_frame_instructions->bytes[ip + 1]);
-                current_frame->ip += 2;
+                num_elements = read_operand(current_frame, current_frame_instructions, 2, wide);
                 table    = build_hash(vm, num_elements);
                 hash_obj = object_create_hash(table);
                 vm->sp -= num_elements;
-                if (hash_obj->pairs->key_count == 0) {
+                if (object_hash_count(hash_obj) == 0) {
                     vm_push(vm, (object_object *) hash_obj);
                 } else {
                     vm_replace_top(vm, (object_object *) hash_obj);
@@ -664,8 +1075,7 @@ vm_error vm_run(virtual_machine *vm) {
                 }
                 break;
             case OP_CALL:
-                num_args = current_frame_instructions->bytes[ip + 1];
-                current_frame->ip++;
+                num_args = read_operand(current_frame, current_frame_instructions, 1, wide);
                 vm_err = execute_call(vm, num_args);
                 if (vm_err.code != VM_ERROR_NONE) {
                     return vm_err;
@@ -683,29 +1093,52 @@ vm_error vm_run(virtual_machine *vm) {
                 vm_push(vm, (object_object *) object_create_null());
                 break;
             case OP_GET_BUILTIN:
-                //builtin_idx = read_uint16(&current_frame_instructions->bytes[ip + 1]);
-                builtin_idx = current_frame_instructions->bytes[ip + 1];
-                current_frame->ip++;
+                builtin_idx = read_operand(current_frame, current_frame_instructions, 1, wide);
                 const char *    builtin_name = get_builtins_name(builtin_idx);
                 object_builtin *builtin      = get_builtins(builtin_name);
                 vm_push(vm, (object_object *) builtin);
                 break;
             case OP_CLOSURE:
-                const_index = read_uint16(&current_frame_instructions->bytes[ip + 1]);
-                num_free_vars = current_frame_instructions->bytes[ip + 3];
-                current_frame->ip += 3;
+                const_index   = read_operand(current_frame, current_frame_instructions, 2, wide);
+                num_free_vars = read_operand(current_frame, current_frame_instructions, 1, wide);
                 vm_push_closure(vm, const_index, num_free_vars);
                 break;
             case OP_CURRENT_CLOSURE:
                 current_closure = current_frame->cl;
                 vm_push_copy(vm, (object_object *) current_closure);
                 break;
+            case OP_INCREMENT_GLOBAL:
+            case OP_INCREMENT_LOCAL:
+                slot_width   = op == OP_INCREMENT_GLOBAL ? 2 : 1;
+                symbol_index = read_operand(current_frame, current_frame_instructions, slot_width, wide);
+                const_index  = read_operand(current_frame, current_frame_instructions, 2, wide);
+                vm_err       = increment_variable(vm, variable_slot(vm, current_frame, op, symbol_index),
+                                                 get_constant(vm, const_index));
+                if (vm_err.code != VM_ERROR_NONE)
+                    return vm_err;
+                break;
+            case OP_LESS_THAN_GLOBAL:
+            case OP_LESS_THAN_LOCAL:
+                slot_width   = op == OP_LESS_THAN_GLOBAL ? 2 : 1;
+                symbol_index = read_operand(current_frame, current_frame_instructions, slot_width, wide);
+                limit_index  = read_operand(current_frame, current_frame_instructions, slot_width, wide);
+                vm_err       = compare_variables(vm, *variable_slot(vm, current_frame, op, symbol_index),
+                                                 *variable_slot(vm, current_frame, op, limit_index));
+                if (vm_err.code != VM_ERROR_NONE)
+                    return vm_err;
+                break;
+            case OP_WIDE:
+                // the instruction that follows reads its operands twice as wide
+                wide = true;
+                current_frame->ip++;
+                continue;
             default:
                 OpcodeDefinition *op_def = opcode_definition_lookup(op);
                 vm_err.code = VM_UNSUPPORTED_OPERATOR;
                 vm_err.msg  = get_err_msg("Unsupported opcode %s", op_def->name);
                 return vm_err;
         }
+        wide = false;
         if (popped_frame == current_frame) {
             frame_free(popped_frame);
             popped_frame = nullptr;
@@ -5,6 +5,7 @@
 #ifndef VM_H
 #define VM_H
 
+#include <signal.h>
 #include <stdlib.h>
 #include "../compiler/compiler_core.h"
 #include "../datastructures/arraylist.h"
@@ -22,7 +23,9 @@ typedef enum vm_error_code {
     VM_UNSUPPORTED_OPERAND,
     VM_UNSUPPORTED_OPERATOR,
     VM_NON_FUNCTION,
-    VM_WRONG_NUMBER_ARGUMENTS
+    VM_WRONG_NUMBER_ARGUMENTS,
+    VM_DIVISION_BY_ZERO,
+    VM_INTERRUPTED
 } vm_error_code;
 
 static const char *VM_ERROR_DESC[] = {
@@ -31,7 +34,9 @@ static const char *VM_ERROR_DESC[] = {
     "UNSUPPORTED_OPERAND",
     "UNSUPPORTED_OPERATOR",
     "VM_NON_FUNCTION",
-    "VM_WRONG_NUMBER_OF_ARGUMENTS"
+    "VM_WRONG_NUMBER_OF_ARGUMENTS",
+    "DIVISION_BY_ZERO",
+    "INTERRUPTED"
 };
 
 typedef struct vm_error {
@@ -49,16 +54,22 @@ typedef struct virtual_machine {
     object_object *globals[GLOBALS_SIZE];
     size_t         sp;
     size_t         stack_count;
+    size_t         loop_count; // backward branches taken, how hot the program's loops run
+    volatile sig_atomic_t interrupted; // set by vm_interrupt, seen at the next OP_LOOP
 } virtual_machine;
 
 virtual_machine *vm_init(const bytecode *);
 
 virtual_machine *vm_init_with_state(bytecode *, object_object *[GLOBALS_SIZE]);
 
+void vm_load(virtual_machine *, const bytecode *);
+
 void vm_free(virtual_machine *);
 
 object_object *vm_last_popped_stack_elem(virtual_machine *);
 
 vm_error vm_run(virtual_machine *);
 
+void vm_interrupt(virtual_machine *);
+
 #endif //VM_H
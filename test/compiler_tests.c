@@ -11,6 +11,7 @@
 #include "../src/compiler/instructions.h"
 #include "../src/compiler/scope.h"
 #include "../src/datastructures/arraylist.h"
+#include "../src/ir/ir.h"
 #include "../src/object/object.h"
 #include "../src/opcode/opcode.h"
 #include "../src/parser/parser.h"
@@ -56,6 +57,12 @@ static instructions *opcode_make_instruction_and_track(const Opcode op, size_t *
 
 static void run_compiler_tests(compiler_test *);
 
+static void run_folded_compiler_tests(compiler_test *);
+
+static void run_peephole_compiler_tests(compiler_test *);
+
+static void run_optimized_compiler_tests(compiler_test *);
+
 static arraylist *create_constant_pool(const size_t count, ...) {
     va_list ap;
     va_start(ap, count);
@@ -266,6 +273,66 @@ static void test_if_true_else_block(void) {
 }
 
 
+static void test_while_loop(void) {
+    compiler_test test = {
+            "let i = 0; while (i < 2) { let i = i + 1; }",
+            17,
+            {opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){0}),
+             opcode_make_instruction_and_track(OP_SET_GLOBAL, (size_t[]){0}),
+             opcode_make_instruction_and_track(OP_GET_GLOBAL, (size_t[]){0}),
+             opcode_make_instruction_and_track(OP_SET_GLOBAL, (size_t[]){1}),
+             opcode_make_instruction_and_track(OP_NULL, nullptr),
+             opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){1}),
+             opcode_make_instruction_and_track(OP_GET_GLOBAL, (size_t[]){1}),
+             opcode_make_instruction_and_track(OP_GREATER_THAN, nullptr),
+             opcode_make_instruction_and_track(OP_JUMP_NOT_TRUTHY, (size_t[]){38}),
+             opcode_make_instruction_and_track(OP_POP, nullptr),
+             opcode_make_instruction_and_track(OP_GET_GLOBAL, (size_t[]){1}),
+             opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){2}),
+             opcode_make_instruction_and_track(OP_ADD, nullptr),
+             opcode_make_instruction_and_track(OP_SET_GLOBAL, (size_t[]){1}),
+             opcode_make_instruction_and_track(OP_NULL, nullptr),
+             opcode_make_instruction_and_track(OP_LOOP, (size_t[]){13}),
+             opcode_make_instruction_and_track(OP_POP, nullptr)},
+            create_constant_pool(3,
+                                 (object_object *) object_create_int(0),
+                                 (object_object *) object_create_int(2),
+                                 (object_object *) object_create_int(1))
+    };
+
+    printf("Testing while loop: let i = 0; while (i < 2) { let i = i + 1; }\n");
+    run_compiler_tests(&test);
+}
+
+static void test_logical_operators(void) {
+    compiler_test test = {
+            "true && false; true || false; 5 % 2",
+            16,
+            {opcode_make_instruction_and_track(OP_TRUE, nullptr),
+             opcode_make_instruction_and_track(OP_JUMP_NOT_TRUTHY, (size_t[]){8}),
+             opcode_make_instruction_and_track(OP_FALSE, nullptr),
+             opcode_make_instruction_and_track(OP_JUMP, (size_t[]){9}),
+             opcode_make_instruction_and_track(OP_FALSE, nullptr),
+             opcode_make_instruction_and_track(OP_POP, nullptr),
+             opcode_make_instruction_and_track(OP_TRUE, nullptr),
+             opcode_make_instruction_and_track(OP_JUMP_TRUTHY, (size_t[]){18}),
+             opcode_make_instruction_and_track(OP_FALSE, nullptr),
+             opcode_make_instruction_and_track(OP_JUMP, (size_t[]){19}),
+             opcode_make_instruction_and_track(OP_TRUE, nullptr),
+             opcode_make_instruction_and_track(OP_POP, nullptr),
+             opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){0}),
+             opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){1}),
+             opcode_make_instruction_and_track(OP_MOD, nullptr),
+             opcode_make_instruction_and_track(OP_POP, nullptr)},
+            create_constant_pool(2,
+                                 (object_object *) object_create_int(5),
+                                 (object_object *) object_create_int(2))
+    };
+
+    printf("Testing logical operators: true && false; true || false; 5 %% 2\n");
+    run_compiler_tests(&test);
+}
+
 /***************************************************************
 ************************** BOOLEANS ****************************
  ***************************************************************/
@@ -601,14 +668,13 @@ static void test_array_index_expression(void) {
              opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){1}),
              opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){2}),
              opcode_make_instruction_and_track(OP_ARRAY, (size_t[]){3}),
-             opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){3}),
-             opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){4}),
+             opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){0}),
+             opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){1}),
              opcode_make_instruction_and_track(OP_ADD, nullptr),
              opcode_make_instruction_and_track(OP_INDEX, nullptr),
              opcode_make_instruction_and_track(OP_POP, nullptr)},
-            create_constant_pool(5, (object_object *) object_create_int(1), (object_object *) object_create_int(2),
-                                 (object_object *) object_create_int(3), (object_object *) object_create_int(1),
-                                 (object_object *) object_create_int(2))
+            create_constant_pool(3, (object_object *) object_create_int(1), (object_object *) object_create_int(2),
+                                 (object_object *) object_create_int(3))
     };
 
     printf("Testing array index expression: [1, 2, 3][1 + 2]\n");
@@ -622,13 +688,12 @@ static void test_hash_index_expression(void) {
             {opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){0}),
              opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){1}),
              opcode_make_instruction_and_track(OP_HASH, (size_t[]){2}),
-             opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){2}),
-             opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){3}),
+             opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){1}),
+             opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){0}),
              opcode_make_instruction_and_track(OP_SUB, nullptr),
              opcode_make_instruction_and_track(OP_INDEX, nullptr),
              opcode_make_instruction_and_track(OP_POP, nullptr)},
-            create_constant_pool(4, (object_object *) object_create_int(1), (object_object *) object_create_int(2),
-                                 (object_object *) object_create_int(2), (object_object *) object_create_int(1))
+            create_constant_pool(2, (object_object *) object_create_int(1), (object_object *) object_create_int(2))
     };
 
     printf("Testing hash index expression: {1: 2}[2 - 1]\n");
@@ -672,14 +737,13 @@ static void test_simple_recursive_function(void) {
     test.expected_instructions[0] = opcode_make_instruction_and_track(OP_CLOSURE, (size_t[]){1, 0});
     test.expected_instructions[1] = opcode_make_instruction_and_track(OP_SET_GLOBAL, (size_t[]){0});
     test.expected_instructions[2] = opcode_make_instruction_and_track(OP_GET_GLOBAL, (size_t[]){0});
-    test.expected_instructions[3] = opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){2});
+    test.expected_instructions[3] = opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){0});
     test.expected_instructions[4] = opcode_make_instruction_and_track(OP_CALL, (size_t[]){1});
     test.expected_instructions[5] = opcode_make_instruction_and_track(OP_POP, (size_t[]){0});
     test.expected_constants       = create_constant_pool(
-            3,
+            2,
             object_create_int(1),
-            (object_object *) object_create_compiled_fn(ins, 0, 1),
-            object_create_int(1));
+            (object_object *) object_create_compiled_fn(ins, 0, 1));
 
     instructions_free(ins);
     printf("Testing simple recursive function\n");
@@ -700,7 +764,7 @@ static void test_nested_recursive_function_wrapper(void) {
             opcode_make_instruction(OP_CLOSURE, (size_t[]){1, 0}),
             opcode_make_instruction(OP_SET_LOCAL, (size_t[]){0}),
             opcode_make_instruction(OP_GET_LOCAL, (size_t[]){0}),
-            opcode_make_instruction(OP_CONSTANT, (size_t[]){2}),
+            opcode_make_instruction(OP_CONSTANT, (size_t[]){0}),
             opcode_make_instruction(OP_CALL, (size_t[]){1}),
             opcode_make_instruction(OP_RETURN_VALUE, nullptr));
     compiler_test test = {
@@ -712,16 +776,15 @@ static void test_nested_recursive_function_wrapper(void) {
             "   }\n"
             "wrapper();",
             5,
-            {opcode_make_instruction_and_track(OP_CLOSURE, (size_t[]){3, 0}),
+            {opcode_make_instruction_and_track(OP_CLOSURE, (size_t[]){2, 0}),
              opcode_make_instruction_and_track(OP_SET_GLOBAL, (size_t[]){0}),
              opcode_make_instruction_and_track(OP_GET_GLOBAL, (size_t[]){0}),
              opcode_make_instruction_and_track(OP_CALL, (size_t[]){0}),
              opcode_make_instruction_and_track(OP_POP, nullptr)},
             create_constant_pool(
-                    4,
+                    3,
                     object_create_int(1),
                     (object_object *) object_create_compiled_fn(ins, 0, 1),
-                    object_create_int(1),
                     (object_object *) object_create_compiled_fn(ins2, 1, 0))
     };
     instructions_free(ins);
@@ -1213,7 +1276,494 @@ static void test_builtin_function_in_closure(void) {
     run_compiler_tests(&test);
 }
 
-static void run_compiler_tests(compiler_test *test) {
+/***************************************************************
+********************** CONSTANT SHARING ************************
+ ***************************************************************/
+static void test_shared_constants(void) {
+    instructions *ins = create_compiled_fn_instructions(
+            2,
+            opcode_make_instruction(OP_CONSTANT, (size_t[]){0}),
+            opcode_make_instruction(OP_RETURN_VALUE, nullptr));
+    instructions *ins2 = create_compiled_fn_instructions(
+            2,
+            opcode_make_instruction(OP_CONSTANT, (size_t[]){0}),
+            opcode_make_instruction(OP_RETURN_VALUE, nullptr));
+    compiler_test test = {
+            "1; \"a\"; 1; \"a\"; fn() { 1 }; fn() { 1 }; fn(x) { 1 }",
+            14,
+            {opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){0}),
+             opcode_make_instruction_and_track(OP_POP, nullptr),
+             opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){1}),
+             opcode_make_instruction_and_track(OP_POP, nullptr),
+             opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){0}),
+             opcode_make_instruction_and_track(OP_POP, nullptr),
+             opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){1}),
+             opcode_make_instruction_and_track(OP_POP, nullptr),
+             opcode_make_instruction_and_track(OP_CLOSURE, (size_t[]){2, 0}),
+             opcode_make_instruction_and_track(OP_POP, nullptr),
+             opcode_make_instruction_and_track(OP_CLOSURE, (size_t[]){2, 0}),
+             opcode_make_instruction_and_track(OP_POP, nullptr),
+             opcode_make_instruction_and_track(OP_CLOSURE, (size_t[]){3, 0}),
+             opcode_make_instruction_and_track(OP_POP, nullptr)},
+            create_constant_pool(
+                    4,
+                    (object_object *) object_create_int(1),
+                    (object_object *) object_create_string("a", 1),
+                    (object_object *) object_create_compiled_fn(ins, 0, 0),
+                    (object_object *) object_create_compiled_fn(ins2, 1, 1))
+    };
+    instructions_free(ins);
+    instructions_free(ins2);
+
+    printf("Testing shared constants\n");
+    run_compiler_tests(&test);
+}
+
+/***************************************************************
+********************** CONSTANT FOLDING ************************
+ ***************************************************************/
+static void test_folded_arithmetic(void) {
+    compiler_test test = {
+            "1 + (50 / 2) - (8 * 3); -(2 * 3)",
+            4,
+            {opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){0}),
+             opcode_make_instruction_and_track(OP_POP, nullptr),
+             opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){1}),
+             opcode_make_instruction_and_track(OP_POP, nullptr)},
+            create_constant_pool(2, object_create_int(2), object_create_int(-6))
+    };
+
+    printf("Testing folded arithmetic\n");
+    run_folded_compiler_tests(&test);
+}
+
+static void test_folded_comparisons(void) {
+    compiler_test test = {
+            "!(1 < 2) == false; 3 != 3; \"mon\" + \"key\"",
+            6,
+            {opcode_make_instruction_and_track(OP_TRUE, nullptr),
+             opcode_make_instruction_and_track(OP_POP, nullptr),
+             opcode_make_instruction_and_track(OP_FALSE, nullptr),
+             opcode_make_instruction_and_track(OP_POP, nullptr),
+             opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){0}),
+             opcode_make_instruction_and_track(OP_POP, nullptr)},
+            create_constant_pool(1, object_create_string("monkey", 6))
+    };
+
+    printf("Testing folded comparisons\n");
+    run_folded_compiler_tests(&test);
+}
+
+static void test_folding_leaves_runtime_errors(void) {
+    compiler_test test = {
+            "(2 * 5) / 0; -true",
+            7,
+            {opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){0}),
+             opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){1}),
+             opcode_make_instruction_and_track(OP_DIV, nullptr),
+             opcode_make_instruction_and_track(OP_POP, nullptr),
+             opcode_make_instruction_and_track(OP_TRUE, nullptr),
+             opcode_make_instruction_and_track(OP_MINUS, nullptr),
+             opcode_make_instruction_and_track(OP_POP, nullptr)},
+            create_constant_pool(2, object_create_int(10), object_create_int(0))
+    };
+
+    printf("Testing folding leaves runtime errors\n");
+    run_folded_compiler_tests(&test);
+}
+
+static void test_propagated_globals(void) {
+    instructions *ins = create_compiled_fn_instructions(
+            6,
+            opcode_make_instruction(OP_CONSTANT, (size_t[]){2}),
+            opcode_make_instruction(OP_SET_LOCAL, (size_t[]){0}),
+            opcode_make_instruction(OP_GET_LOCAL, (size_t[]){0}),
+            opcode_make_instruction(OP_CONSTANT, (size_t[]){1}),
+            opcode_make_instruction(OP_ADD, nullptr),
+            opcode_make_instruction(OP_RETURN_VALUE, nullptr));
+    compiler_test test = {
+            "let a = 2 * 3; let b = a + 1; fn() { let a = 1; a + b }",
+            6,
+            {opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){0}),
+             opcode_make_instruction_and_track(OP_SET_GLOBAL, (size_t[]){0}),
+             opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){1}),
+             opcode_make_instruction_and_track(OP_SET_GLOBAL, (size_t[]){1}),
+             opcode_make_instruction_and_track(OP_CLOSURE, (size_t[]){3, 0}),
+             opcode_make_instruction_and_track(OP_POP, nullptr)},
+            create_constant_pool(
+                    4,
+                    (object_object *) object_create_int(6),
+                    (object_object *) object_create_int(7),
+                    (object_object *) object_create_int(1),
+                    (object_object *) object_create_compiled_fn(ins, 1, 0))
+    };
+    instructions_free(ins);
+
+    // the if's let defines a global of its own, which its branch never sets
+    compiler_test conditional = {
+            "let x = 1; if (false) { let x = 2; }; x",
+            12,
+            {opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){0}),
+             opcode_make_instruction_and_track(OP_SET_GLOBAL, (size_t[]){0}),
+             opcode_make_instruction_and_track(OP_FALSE, nullptr),
+             opcode_make_instruction_and_track(OP_JUMP_NOT_TRUTHY, (size_t[]){20}),
+             opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){1}),
+             opcode_make_instruction_and_track(OP_SET_GLOBAL, (size_t[]){1}),
+             opcode_make_instruction_and_track(OP_NULL, nullptr),
+             opcode_make_instruction_and_track(OP_JUMP, (size_t[]){21}),
+             opcode_make_instruction_and_track(OP_NULL, nullptr),
+             opcode_make_instruction_and_track(OP_POP, nullptr),
+             opcode_make_instruction_and_track(OP_GET_GLOBAL, (size_t[]){1}),
+             opcode_make_instruction_and_track(OP_POP, nullptr)},
+            create_constant_pool(2, object_create_int(1), object_create_int(2))
+    };
+
+    printf("Testing propagated globals\n");
+    run_folded_compiler_tests(&test);
+    run_folded_compiler_tests(&conditional);
+}
+
+static void test_shared_folded_constants(void) {
+    compiler_test test = {
+            "1 + 2; 3; 2 + 1",
+            6,
+            {opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){0}),
+             opcode_make_instruction_and_track(OP_POP, nullptr),
+             opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){0}),
+             opcode_make_instruction_and_track(OP_POP, nullptr),
+             opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){0}),
+             opcode_make_instruction_and_track(OP_POP, nullptr)},
+            create_constant_pool(1, object_create_int(3))
+    };
+
+    printf("Testing shared folded constants\n");
+    run_folded_compiler_tests(&test);
+}
+
+/***************************************************************
+************************** PEEPHOLE ****************************
+ ***************************************************************/
+static void test_peephole_constant_condition(void) {
+    compiler_test test = {
+            "if (true) {10}; 3333;",
+            4,
+            {opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){0}),
+             opcode_make_instruction_and_track(OP_POP, nullptr),
+             opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){1}),
+             opcode_make_instruction_and_track(OP_POP, nullptr)},
+            create_constant_pool(2, object_create_int(10), object_create_int(3333))
+    };
+
+    printf("Testing peephole: if (true) {10}; 3333;\n");
+    run_peephole_compiler_tests(&test);
+}
+
+static void test_peephole_inverted_condition(void) {
+    compiler_test test = {
+            "let x = 1; if (!(x == 3)) { 1 } else { 2 }",
+            10,
+            {opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){0}),
+             opcode_make_instruction_and_track(OP_DUP, nullptr),
+             opcode_make_instruction_and_track(OP_SET_GLOBAL, (size_t[]){0}),
+             opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){1}),
+             opcode_make_instruction_and_track(OP_EQUAL, nullptr),
+             opcode_make_instruction_and_track(OP_JUMP_TRUTHY, (size_t[]){20}),
+             opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){0}),
+             opcode_make_instruction_and_track(OP_JUMP, (size_t[]){23}),
+             opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){2}),
+             opcode_make_instruction_and_track(OP_POP, nullptr)},
+            create_constant_pool(3, object_create_int(1), object_create_int(3), object_create_int(2))
+    };
+
+    // '!' fails on an int, which a jump on the int's truthiness wouldn't
+    compiler_test integer = {
+            "let x = 5; if (!x) { 1 } else { 2 }",
+            9,
+            {opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){0}),
+             opcode_make_instruction_and_track(OP_DUP, nullptr),
+             opcode_make_instruction_and_track(OP_SET_GLOBAL, (size_t[]){0}),
+             opcode_make_instruction_and_track(OP_BANG, nullptr),
+             opcode_make_instruction_and_track(OP_JUMP_NOT_TRUTHY, (size_t[]){17}),
+             opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){1}),
+             opcode_make_instruction_and_track(OP_JUMP, (size_t[]){20}),
+             opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){2}),
+             opcode_make_instruction_and_track(OP_POP, nullptr)},
+            create_constant_pool(3, object_create_int(5), object_create_int(1), object_create_int(2))
+    };
+
+    printf("Testing peephole: inverted conditions\n");
+    run_peephole_compiler_tests(&test);
+    run_peephole_compiler_tests(&integer);
+}
+
+static void test_peephole_threaded_jumps(void) {
+    compiler_test test = {
+            "let x = 1; if (x) { if (x) { 1 } else { 2 } } else { 3 }",
+            12,
+            {opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){0}),
+             opcode_make_instruction_and_track(OP_DUP, nullptr),
+             opcode_make_instruction_and_track(OP_SET_GLOBAL, (size_t[]){0}),
+             opcode_make_instruction_and_track(OP_JUMP_NOT_TRUTHY, (size_t[]){28}),
+             opcode_make_instruction_and_track(OP_GET_GLOBAL, (size_t[]){0}),
+             opcode_make_instruction_and_track(OP_JUMP_NOT_TRUTHY, (size_t[]){22}),
+             opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){0}),
+             opcode_make_instruction_and_track(OP_JUMP, (size_t[]){31}),
+             opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){1}),
+             opcode_make_instruction_and_track(OP_JUMP, (size_t[]){31}),
+             opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){2}),
+             opcode_make_instruction_and_track(OP_POP, nullptr)},
+            create_constant_pool(3, object_create_int(1), object_create_int(2), object_create_int(3))
+    };
+
+    printf("Testing peephole: threaded jumps\n");
+    run_peephole_compiler_tests(&test);
+}
+
+static void test_peephole_unreachable_code(void) {
+    instructions *ins = create_compiled_fn_instructions(
+            4,
+            opcode_make_instruction(OP_GET_LOCAL, (size_t[]){0}),
+            opcode_make_instruction(OP_DUP, nullptr),
+            opcode_make_instruction(OP_SET_LOCAL, (size_t[]){1}),
+            opcode_make_instruction(OP_RETURN_VALUE, nullptr));
+    compiler_test test = {
+            "fn(a) { let b = a; return b; a + b; }",
+            2,
+            {opcode_make_instruction_and_track(OP_CLOSURE, (size_t[]){0, 0}),
+             opcode_make_instruction_and_track(OP_POP, nullptr)},
+            create_constant_pool(1, (object_object *) object_create_compiled_fn(ins, 2, 1))
+    };
+    instructions_free(ins);
+
+    printf("Testing peephole: unreachable code\n");
+    run_peephole_compiler_tests(&test);
+}
+
+/***************************************************************
+************************** IR PASSES ***************************
+ ***************************************************************/
+static void test_optimized_dead_locals(void) {
+    instructions *ins = create_compiled_fn_instructions(
+            2,
+            opcode_make_instruction(OP_CONSTANT, (size_t[]){0}),
+            opcode_make_instruction(OP_RETURN_VALUE, nullptr));
+    compiler_test test = {
+            "fn() { let a = 2; let b = a * 3; b + 1 }",
+            2,
+            {opcode_make_instruction_and_track(OP_CLOSURE, (size_t[]){1, 0}),
+             opcode_make_instruction_and_track(OP_POP, nullptr)},
+            create_constant_pool(2, object_create_int(7), (object_object *) object_create_compiled_fn(ins, 2, 0))
+    };
+    instructions_free(ins);
+
+    printf("Testing optimized: dead locals\n");
+    run_optimized_compiler_tests(&test);
+}
+
+static void test_optimized_common_subexpressions(void) {
+    instructions *ins = create_compiled_fn_instructions(
+            8,
+            opcode_make_instruction(OP_GET_LOCAL, (size_t[]){0}),
+            opcode_make_instruction(OP_GET_LOCAL, (size_t[]){0}),
+            opcode_make_instruction(OP_MUL, nullptr),
+            opcode_make_instruction(OP_DUP, nullptr),
+            opcode_make_instruction(OP_DUP, nullptr),
+            opcode_make_instruction(OP_SET_LOCAL, (size_t[]){1}),
+            opcode_make_instruction(OP_ADD, nullptr),
+            opcode_make_instruction(OP_RETURN_VALUE, nullptr));
+    compiler_test test = {
+            "fn(x) { let y = x * x; x * x + y }",
+            2,
+            {opcode_make_instruction_and_track(OP_CLOSURE, (size_t[]){0, 0}),
+             opcode_make_instruction_and_track(OP_POP, nullptr)},
+            create_constant_pool(1, (object_object *) object_create_compiled_fn(ins, 2, 1))
+    };
+    instructions_free(ins);
+
+    printf("Testing optimized: common subexpressions\n");
+    run_optimized_compiler_tests(&test);
+}
+
+static void test_optimized_typed_conditions(void) {
+    instructions *ins = create_compiled_fn_instructions(
+            2,
+            opcode_make_instruction(OP_CONSTANT, (size_t[]){0}),
+            opcode_make_instruction(OP_RETURN_VALUE, nullptr));
+    compiler_test test = {
+            "fn(a) { if ([a]) { 1 } else { 2 } }",
+            2,
+            {opcode_make_instruction_and_track(OP_CLOSURE, (size_t[]){1, 0}),
+             opcode_make_instruction_and_track(OP_POP, nullptr)},
+            create_constant_pool(2, object_create_int(1), (object_object *) object_create_compiled_fn(ins, 1, 1))
+    };
+    instructions_free(ins);
+
+    printf("Testing optimized: typed conditions\n");
+    run_optimized_compiler_tests(&test);
+}
+
+static void test_optimized_inverted_condition(void) {
+    instructions *ins = create_compiled_fn_instructions(
+            8,
+            opcode_make_instruction(OP_GET_LOCAL, (size_t[]){0}),
+            opcode_make_instruction(OP_CONSTANT, (size_t[]){0}),
+            opcode_make_instruction(OP_EQUAL, nullptr),
+            opcode_make_instruction(OP_JUMP_TRUTHY, (size_t[]){15}),
+            opcode_make_instruction(OP_CONSTANT, (size_t[]){0}),
+            opcode_make_instruction(OP_JUMP, (size_t[]){18}),
+            opcode_make_instruction(OP_CONSTANT, (size_t[]){1}),
+            opcode_make_instruction(OP_RETURN_VALUE, nullptr));
+    compiler_test test = {
+            "fn(a) { if (!(a == 1)) { 1 } else { 2 } }",
+            2,
+            {opcode_make_instruction_and_track(OP_CLOSURE, (size_t[]){2, 0}),
+             opcode_make_instruction_and_track(OP_POP, nullptr)},
+            create_constant_pool(3, object_create_int(1), object_create_int(2),
+                                 (object_object *) object_create_compiled_fn(ins, 1, 1))
+    };
+    instructions_free(ins);
+
+    printf("Testing optimized: inverted condition\n");
+    run_optimized_compiler_tests(&test);
+}
+
+static void test_optimized_counted_loop(void) {
+    compiler_test test = {
+            "let a = [1, 2]; let i = 0; while (i < len(a)) { let i = i + 1; }",
+            20,
+            {opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){0}),
+             opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){1}),
+             opcode_make_instruction_and_track(OP_ARRAY, (size_t[]){2}),
+             opcode_make_instruction_and_track(OP_SET_GLOBAL, (size_t[]){0}),
+             opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){2}),
+             opcode_make_instruction_and_track(OP_SET_GLOBAL, (size_t[]){1}),
+             opcode_make_instruction_and_track(OP_CONSTANT, (size_t[]){2}),
+             opcode_make_instruction_and_track(OP_SET_GLOBAL, (size_t[]){2}),
+             opcode_make_instruction_and_track(OP_NULL, nullptr),
+             opcode_make_instruction_and_track(OP_GET_BUILTIN, (size_t[]){0}),
+             opcode_make_instruction_and_track(OP_GET_GLOBAL, (size_t[]){0}),
+             opcode_make_instruction_and_track(OP_CALL, (size_t[]){1}),
+             opcode_make_instruction_and_track(OP_SET_GLOBAL, (size_t[]){3}),
+             opcode_make_instruction_and_track(OP_LESS_THAN_GLOBAL, (size_t[]){2, 3}),
+             opcode_make_instruction_and_track(OP_JUMP_NOT_TRUTHY, (size_t[]){53}),
+             opcode_make_instruction_and_track(OP_POP, nullptr),
+             opcode_make_instruction_and_track(OP_INCREMENT_GLOBAL, (size_t[]){2, 0}),
+             opcode_make_instruction_and_track(OP_NULL, nullptr),
+             opcode_make_instruction_and_track(OP_LOOP, (size_t[]){35}),
+             opcode_make_instruction_and_track(OP_POP, nullptr)},
+            create_constant_pool(3,
+                                 (object_object *) object_create_int(1),
+                                 (object_object *) object_create_int(2),
+                                 (object_object *) object_create_int(0))
+    };
+
+    printf("Testing optimized: counted loop\n");
+    run_optimized_compiler_tests(&test);
+}
+
+static void test_optimized_inlined_call(void) {
+    instructions *add = create_compiled_fn_instructions(
+            4,
+            opcode_make_instruction(OP_GET_LOCAL, (size_t[]){0}),
+            opcode_make_instruction(OP_GET_LOCAL, (size_t[]){1}),
+            opcode_make_instruction(OP_ADD, nullptr),
+            opcode_make_instruction(OP_RETURN_VALUE, nullptr));
+    instructions *ins = create_compiled_fn_instructions(
+            4,
+            opcode_make_instruction(OP_GET_LOCAL, (size_t[]){0}),
+            opcode_make_instruction(OP_CONSTANT, (size_t[]){1}),
+            opcode_make_instruction(OP_ADD, nullptr),
+            opcode_make_instruction(OP_RETURN_VALUE, nullptr));
+    compiler_test test = {
+            "let add = fn(a, b) { a + b }; fn(x) { add(x, 1) }",
+            4,
+            {opcode_make_instruction_and_track(OP_CLOSURE, (size_t[]){0, 0}),
+             opcode_make_instruction_and_track(OP_SET_GLOBAL, (size_t[]){0}),
+             opcode_make_instruction_and_track(OP_CLOSURE, (size_t[]){2, 0}),
+             opcode_make_instruction_and_track(OP_POP, nullptr)},
+            create_constant_pool(3, (object_object *) object_create_compiled_fn(add, 2, 2), object_create_int(1),
+                                 (object_object *) object_create_compiled_fn(ins, 3, 1))
+    };
+    instructions_free(add);
+    instructions_free(ins);
+
+    printf("Testing optimized: inlined call\n");
+    run_optimized_compiler_tests(&test);
+}
+
+static void test_optimized_closed_function(void) {
+    instructions *identity = create_compiled_fn_instructions(
+            2,
+            opcode_make_instruction(OP_GET_LOCAL, (size_t[]){0}),
+            opcode_make_instruction(OP_RETURN_VALUE, nullptr));
+    instructions *ins = create_compiled_fn_instructions(
+            2,
+            opcode_make_instruction(OP_CONSTANT, (size_t[]){0}),
+            opcode_make_instruction(OP_RETURN_VALUE, nullptr));
+    object_compiled_fn *identity_fn = object_create_compiled_fn(identity, 1, 1);
+    compiler_test       test        = {
+            "fn() { fn(x) { x } }",
+            2,
+            {opcode_make_instruction_and_track(OP_CLOSURE, (size_t[]){1, 0}),
+             opcode_make_instruction_and_track(OP_POP, nullptr)},
+            create_constant_pool(2, (object_object *) object_create_closure(identity_fn, nullptr),
+                                 (object_object *) object_create_compiled_fn(ins, 0, 0))
+    };
+    object_free(identity_fn);
+    instructions_free(identity);
+    instructions_free(ins);
+
+    printf("Testing optimized: closed function\n");
+    run_optimized_compiler_tests(&test);
+}
+
+static void test_optimized_converted_closure(void) {
+    instructions *power = create_compiled_fn_instructions(
+            18,
+            opcode_make_instruction(OP_GET_LOCAL, (size_t[]){0}),
+            opcode_make_instruction(OP_GET_LOCAL, (size_t[]){1}),
+            opcode_make_instruction(OP_MUL, nullptr),
+            opcode_make_instruction(OP_GET_LOCAL, (size_t[]){1}),
+            opcode_make_instruction(OP_MUL, nullptr),
+            opcode_make_instruction(OP_GET_LOCAL, (size_t[]){1}),
+            opcode_make_instruction(OP_MUL, nullptr),
+            opcode_make_instruction(OP_GET_LOCAL, (size_t[]){1}),
+            opcode_make_instruction(OP_MUL, nullptr),
+            opcode_make_instruction(OP_GET_LOCAL, (size_t[]){1}),
+            opcode_make_instruction(OP_MUL, nullptr),
+            opcode_make_instruction(OP_GET_LOCAL, (size_t[]){1}),
+            opcode_make_instruction(OP_MUL, nullptr),
+            opcode_make_instruction(OP_GET_LOCAL, (size_t[]){1}),
+            opcode_make_instruction(OP_MUL, nullptr),
+            opcode_make_instruction(OP_GET_LOCAL, (size_t[]){1}),
+            opcode_make_instruction(OP_MUL, nullptr),
+            opcode_make_instruction(OP_RETURN_VALUE, nullptr));
+    instructions *ins = create_compiled_fn_instructions(
+            5,
+            opcode_make_instruction(OP_CONSTANT, (size_t[]){0}),
+            opcode_make_instruction(OP_CONSTANT, (size_t[]){1}),
+            opcode_make_instruction(OP_GET_LOCAL, (size_t[]){0}),
+            opcode_make_instruction(OP_CALL, (size_t[]){2}),
+            opcode_make_instruction(OP_RETURN_VALUE, nullptr));
+    object_compiled_fn *power_fn = object_create_compiled_fn(power, 2, 2);
+    compiler_test       test     = {
+            "fn(a) { let f = fn(x) { x * a * a * a * a * a * a * a * a }; f(2) }",
+            2,
+            {opcode_make_instruction_and_track(OP_CLOSURE, (size_t[]){2, 0}),
+             opcode_make_instruction_and_track(OP_POP, nullptr)},
+            create_constant_pool(3, (object_object *) object_create_closure(power_fn, nullptr), object_create_int(2),
+                                 (object_object *) object_create_compiled_fn(ins, 2, 1))
+    };
+    object_free(power_fn);
+    instructions_free(power);
+    instructions_free(ins);
+
+    printf("Testing optimized: converted closure\n");
+    run_optimized_compiler_tests(&test);
+}
+
+static void run_compiler_test(compiler_test *test, const bool fold_constants, const bool peephole,
+                              const bool optimize_ir) {
     print_test_separator_line();
 
     printf("** Testing compilation for %s\n", test->input);
@@ -1221,7 +1771,11 @@ static void run_compiler_tests(compiler_test *test) {
     parser *             parser   = parser_init(lexer);
     ast_program *        program  = parse_program(parser);
     compiler *           compiler = compiler_init();
-    const compiler_error e        = compile(compiler, (ast_node *) program);
+    compiler->fold_constants      = fold_constants;
+    compiler->peephole            = peephole;
+    compiler->optimize_ir         = optimize_ir;
+    compiler->optimize_loops      = optimize_ir;
+    const compiler_error e        = compile_optimized(compiler, (ast_node *) program);
 
 #ifdef DEBUG
     ast_debug_print(program);
@@ -1254,6 +1808,22 @@ static void run_compiler_tests(compiler_test *test) {
     instructions_free(flattened_instructions);
 }
 
+static void run_compiler_tests(compiler_test *test) {
+    run_compiler_test(test, false, false, false);
+}
+
+static void run_folded_compiler_tests(compiler_test *test) {
+    run_compiler_test(test, true, false, false);
+}
+
+static void run_peephole_compiler_tests(compiler_test *test) {
+    run_compiler_test(test, false, true, false);
+}
+
+static void run_optimized_compiler_tests(compiler_test *test) {
+    run_compiler_test(test, true, true, true);
+}
+
 static void run_specific_test(const char *test_name) {
     if (strcmp(test_name, "test_addition") == 0) {
         RUN_TEST(test_addition);
@@ -1289,6 +1859,10 @@ static void run_specific_test(const char *test_name) {
         RUN_TEST(test_if_true_then_block);
     } else if (strcmp(test_name, "test_if_true_else_block") == 0) {
         RUN_TEST(test_if_true_else_block);
+    } else if (strcmp(test_name, "test_while_loop") == 0) {
+        RUN_TEST(test_while_loop);
+    } else if (strcmp(test_name, "test_logical_operators") == 0) {
+        RUN_TEST(test_logical_operators);
     } else if (strcmp(test_name, "test_multiple_global_let_statements") == 0) {
         RUN_TEST(test_multiple_global_let_statements);
     } else if (strcmp(test_name, "test_global_let_and_usage") == 0) {
@@ -1385,6 +1959,8 @@ int main(int argc, char **argv) {
         RUN_TEST(test_bang_operator);
         RUN_TEST(test_if_true_then_block);
         RUN_TEST(test_if_true_else_block);
+        RUN_TEST(test_while_loop);
+        RUN_TEST(test_logical_operators);
         RUN_TEST(test_multiple_global_let_statements);
         RUN_TEST(test_global_let_and_usage);
         RUN_TEST(test_single_string_expression);
@@ -1417,6 +1993,24 @@ int main(int argc, char **argv) {
         RUN_TEST(test_multiple_local_let_statements);
         RUN_TEST(test_builtin_function_calls);
         RUN_TEST(test_builtin_function_in_closure);
+        RUN_TEST(test_shared_constants);
+        RUN_TEST(test_folded_arithmetic);
+        RUN_TEST(test_folded_comparisons);
+        RUN_TEST(test_folding_leaves_runtime_errors);
+        RUN_TEST(test_propagated_globals);
+        RUN_TEST(test_shared_folded_constants);
+        RUN_TEST(test_peephole_constant_condition);
+        RUN_TEST(test_peephole_inverted_condition);
+        RUN_TEST(test_peephole_threaded_jumps);
+        RUN_TEST(test_peephole_unreachable_code);
+        RUN_TEST(test_optimized_dead_locals);
+        RUN_TEST(test_optimized_common_subexpressions);
+        RUN_TEST(test_optimized_typed_conditions);
+        RUN_TEST(test_optimized_inverted_condition);
+        RUN_TEST(test_optimized_inlined_call);
+        RUN_TEST(test_optimized_closed_function);
+        RUN_TEST(test_optimized_converted_closure);
+        RUN_TEST(test_optimized_counted_loop);
     }
 
     return UNITY_END();
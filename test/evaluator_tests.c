@@ -618,7 +618,7 @@ static void test_string_literal(void) {
     printf("Testing string literal evaluation\n");
     TEST_ASSERT_EQUAL_INT(evaluated->type, OBJECT_STRING);
     object_string *str = (object_string *) evaluated;
-    TEST_ASSERT_EQUAL_STRING(str->value, "Hello, world!");
+    TEST_ASSERT_EQUAL_STRING(object_string_value(str), "Hello, world!");
     object_free(str);
     environment_free(env);
 }
@@ -631,19 +631,35 @@ static void test_string_concatenation(void) {
     printf("Testing string concatenation evaluation\n");
     TEST_ASSERT_EQUAL_INT(evaluated->type, OBJECT_STRING);
     object_string *str = (object_string *) evaluated;
-    TEST_ASSERT_EQUAL_STRING(str->value, "Hello, world!");
+    TEST_ASSERT_EQUAL_STRING(object_string_value(str), "Hello, world!");
     object_free(str);
     environment_free(env);
 }
 
+static void test_string_concatenation_in_loop(void) {
+    const char *input = "let s = \"\"; let i = 0;"
+                        "while (i < 2000) { let s = s + \"ab\"; let i = i + 1; };"
+                        "let t = s + s; if (len(t) == 8000) { s[3999] + t[4000] } else { \"\" }";
+    environment *  env       = environment_create();
+    object_object *evaluated = test_eval(input, env);
+    print_test_separator_line();
+    printf("Testing string concatenation in a loop\n");
+    TEST_ASSERT_EQUAL_INT(evaluated->type, OBJECT_STRING);
+    test_string_object(evaluated, "ba", 2);
+    object_free(evaluated);
+    environment_free(env);
+}
+
 static void test_int_array(object_array *actual, object_array *expected) {
-    TEST_ASSERT_EQUAL_UINT(expected->elements->size, actual->elements->size);
-    for (size_t i = 0; i < expected->elements->size; i++) {
-        object_object *obj = (object_object *) expected->elements->body[i];
+    TEST_ASSERT_EQUAL_UINT(object_array_length(expected), object_array_length(actual));
+    for (size_t i = 0; i < object_array_length(expected); i++) {
+        object_object *obj = object_array_get(actual, i);
         TEST_ASSERT_EQUAL_INT(obj->type, OBJECT_INT);
         object_int *act_int = (object_int *) obj;
-        object_int *exp_int = (object_int *) expected->elements->body[i];
+        object_int *exp_int = (object_int *) object_array_get(expected, i);
         TEST_ASSERT_EQUAL_INT(act_int->value, exp_int->value);
+        object_free(obj);
+        object_free(exp_int);
     }
 }
 
@@ -655,6 +671,40 @@ static object_array *create_int_array(int *int_arr, size_t length) {
     return object_create_array(array_list);
 }
 
+static void test_array_arithmetic(void) {
+    typedef struct {
+        const char *  input;
+        object_array *expected;
+    } test_input;
+
+    test_input tests[] = {
+            {"[1, 2, 3] + [4, 5, 6]", create_int_array((int[]){5, 7, 9}, 3)},
+            {"[10, 20] - [1, 2]", create_int_array((int[]){9, 18}, 2)},
+            {"[1, 2, 3, 4, 5] * [5, 4, 3, 2, 1]", create_int_array((int[]){5, 8, 9, 8, 5}, 5)},
+            {"let a = push([1, 2], 3); a + rest([0, 1, 2, 3])", create_int_array((int[]){2, 4, 6}, 3)},
+    };
+
+    print_test_separator_line();
+    for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        printf("Testing array arithmetic %s\n", tests[i].input);
+        environment *  env       = environment_create();
+        object_object *evaluated = test_eval(tests[i].input, env);
+        TEST_ASSERT_EQUAL_INT(OBJECT_ARRAY, evaluated->type);
+        test_int_array((object_array *) evaluated, tests[i].expected);
+        object_free(tests[i].expected);
+        object_free(evaluated);
+        environment_free(env);
+    }
+
+    environment *  env       = environment_create();
+    object_object *evaluated = test_eval("[1, 2] + [1, 2, 3]", env);
+    TEST_ASSERT_EQUAL_INT(OBJECT_ERROR, evaluated->type);
+    TEST_ASSERT_EQUAL_STRING("operator + requires integer arrays of equal length",
+                             ((object_error *) evaluated)->message);
+    object_free(evaluated);
+    environment_free(env);
+}
+
 static void test_builtins(void) {
     typedef struct {
         const char *   input;
@@ -679,9 +729,21 @@ static void test_builtins(void) {
             {"rest([1, 2, 3])", (object_object *) create_int_array((int[]){2, 3}, 2)},
             {"rest([])", (object_object *) object_create_null()},
             {"push([], 1)", (object_object *) create_int_array((int[]){1}, 1)},
+            {"push(push([1], 2), 3)", (object_object *) create_int_array((int[]){1, 2, 3}, 3)},
+            {"rest(rest(push([1, 2], 3)))", (object_object *) create_int_array((int[]){3}, 1)},
             {"push(1, 1)", (object_object *) object_create_error("argument to `push` must be ARRAY, got INTEGER")},
             {"type(10)", (object_object *) object_create_string("INTEGER", 7)},
-            {"type(10, 1)", (object_object *) object_create_error("wrong number of arguments. got=2, want=1")}
+            {"type(10, 1)", (object_object *) object_create_error("wrong number of arguments. got=2, want=1")},
+            {"sum([1, 2, 3, 4, 5])", (object_object *) object_create_int(15)},
+            {"sum([])", (object_object *) object_create_int(0)},
+            {"sum(rest(push([1, 2], 3)))", (object_object *) object_create_int(5)},
+            {"min([3, -1, 7, 2, 9, 0])", (object_object *) object_create_int(-1)},
+            {"max([3, -1, 7, 2, 9, 0])", (object_object *) object_create_int(9)},
+            {"min([])", (object_object *) object_create_null()},
+            {"sum(1)", (object_object *) object_create_error("argument to `sum` must be ARRAY, got INTEGER")},
+            {"max([1, \"a\"])", (object_object *) object_create_error("`max` expects an array of INTEGER, found STRING")},
+            {"sum(rest(push([1, 2], \"a\")))", (object_object *) object_create_error(
+                     "`sum` expects an array of INTEGER, found STRING")},
     };
 
     size_t ntests = sizeof(tests) / sizeof(tests[0]);
@@ -701,7 +763,7 @@ static void test_builtins(void) {
         object_object *evaluated = test_eval(test.input, env);
         switch (test.expected->type) {
             case OBJECT_INT:
-                actual_int = (object_int *) evaluated;
+                actual_int = (object_int *) test.expected;
                 test_integer_object(evaluated, actual_int->value);
                 object_free(test.expected);
                 object_free(evaluated);
@@ -748,10 +810,13 @@ static void test_array_literals(void) {
     object_object *evaluated = test_eval(input, env);
     TEST_ASSERT_EQUAL_INT(evaluated->type, OBJECT_ARRAY);
     object_array *array = (object_array *) evaluated;
-    TEST_ASSERT_EQUAL_INT(array->elements->size, 3);
-    test_integer_object(array->elements->body[0], 1);
-    test_integer_object(array->elements->body[1], 4);
-    test_integer_object(array->elements->body[2], 6);
+    TEST_ASSERT_EQUAL_INT(object_array_length(array), 3);
+    const long expected[] = {1, 4, 6};
+    for (size_t i = 0; i < 3; i++) {
+        object_object *elem = object_array_get(array, i);
+        test_integer_object(elem, expected[i]);
+        object_free(elem);
+    }
     object_free(evaluated);
     environment_free(env);
 }
@@ -895,9 +960,8 @@ static void test_string_index_expression(void) {
     environment *  env       = environment_create();
     object_object *evaluated = test_eval(input, env);
     TEST_ASSERT_EQUAL_INT(evaluated->type, OBJECT_STRING);
-    object_string *actual_string   = (object_string *) evaluated;
     object_string *expected_string = (object_string *) expected;
-    TEST_ASSERT_EQUAL_STRING(expected_string->value, actual_string->value);
+    test_string_object(evaluated, expected_string->value, expected_string->length);
     object_free(expected);
     object_free(evaluated);
     environment_free(env);
@@ -911,14 +975,36 @@ static void test_string_index_expression_second_character(void) {
     environment *  env       = environment_create();
     object_object *evaluated = test_eval(input, env);
     TEST_ASSERT_EQUAL_INT(evaluated->type, OBJECT_STRING);
-    object_string *actual_string   = (object_string *) evaluated;
     object_string *expected_string = (object_string *) expected;
-    TEST_ASSERT_EQUAL_STRING(expected_string->value, actual_string->value);
+    test_string_object(evaluated, expected_string->value, expected_string->length);
     object_free(expected);
     object_free(evaluated);
     environment_free(env);
 }
 
+static void test_string_index_expression_as_string(void) {
+    typedef struct {
+        const char *   input;
+        object_object *expected;
+    } test_input;
+
+    test_input tests[] = {
+            {"let s = \"hello\"; let h = {\"e\": 1}; h[s[1]]", (object_object *) object_create_int(1)},
+            {"let s = \"hello\"; s[1] + s[4] == \"eo\"", (object_object *) object_create_bool(true)},
+            {"let s = \"hello\"; s[2] == s[3]", (object_object *) object_create_bool(true)},
+            {"let s = \"hello\"; len(s[0] + s[1])", (object_object *) object_create_int(2)},
+    };
+    print_test_separator_line();
+    for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        printf("Testing string index as string for %s\n", tests[i].input);
+        environment *  env       = environment_create();
+        object_object *evaluated = test_eval(tests[i].input, env);
+        test_object_object(evaluated, tests[i].expected);
+        object_free(tests[i].expected);
+        object_free(evaluated);
+        environment_free(env);
+    }
+}
 
 static void test_enclosing_env(void) {
     const char *input = "let first = 10;\n"\
@@ -986,13 +1072,13 @@ static void test_hash_literals(void) {
     TEST_ASSERT_EQUAL_INT(evaluated->type, OBJECT_HASH);
     object_hash *hash_obj            = (object_hash *) evaluated;
     size_t       expected_objs_count = sizeof(expected) / sizeof(expected[0]);
-    TEST_ASSERT_EQUAL_INT(hash_obj->pairs->key_count, expected_objs_count);
+    TEST_ASSERT_EQUAL_INT(object_hash_count(hash_obj), expected_objs_count);
 
     for (size_t i = 0; i < expected_objs_count; i++) {
         object_object *key            = expected[i].key;
         char *         key_string     = key->inspect(key);
         object_object *expected_value = expected[i].value;
-        object_object *actual_value   = (object_object *) hashtable_get(hash_obj->pairs, key);
+        object_object *actual_value   = object_hash_get(hash_obj, key);
         TEST_ASSERT_NOT_NULL(actual_value);
         test_object_object(actual_value, expected_value);
         free(key_string);
@@ -1153,6 +1239,7 @@ int main() {
     RUN_TEST(test_function_object);
     RUN_TEST(test_string_literal);       //pass
     RUN_TEST(test_string_concatenation); //pass
+    RUN_TEST(test_string_concatenation_in_loop);
     RUN_TEST(test_array_literals);
     RUN_TEST(test_while_expressions);
     RUN_TEST(test_hash_index_expression_boolean_key_true);
@@ -1174,6 +1261,7 @@ int main() {
     RUN_TEST(test_array_index_expression_negative_index);
     RUN_TEST(test_string_index_expression);
     RUN_TEST(test_string_index_expression_second_character);
+    RUN_TEST(test_string_index_expression_as_string);
     RUN_TEST(test_function_application_identity_function);
     RUN_TEST(test_function_application_identity_function_with_return);
     RUN_TEST(test_function_application_double_function);
@@ -1184,5 +1272,6 @@ int main() {
     RUN_TEST(test_hash_literals);
     RUN_TEST(test_string_comparison_equal_strings);
     RUN_TEST(test_string_comparison_different_strings);
+    RUN_TEST(test_array_arithmetic);
     return UNITY_END();
 }
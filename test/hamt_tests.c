@@ -0,0 +1,125 @@
+//
+// Created by dgood on 1/14/25.
+//
+#include <stdlib.h>
+#include "../Unity/src/unity.h"
+#include "../src/datastructures/hamt.h"
+
+void setUp(void) {
+    // Optional setup before each test
+}
+
+void tearDown(void) {
+    // Optional cleanup after each test
+}
+
+static size_t hash_long(void *data) {
+    return (size_t) *(long *) data * 2654435761UL;
+}
+
+// every key lands in one of four buckets, forcing collision nodes
+static size_t hash_colliding(void *data) {
+    return (size_t) *(long *) data % 4;
+}
+
+static bool long_equals(void *a, void *b) {
+    return *(long *) a == *(long *) b;
+}
+
+static void *copy_long(void *data) {
+    long *copy = malloc(sizeof(long));
+    *copy      = *(long *) data;
+    return copy;
+}
+
+static long *make_long(const long value) {
+    long *v = malloc(sizeof(long));
+    *v      = value;
+    return v;
+}
+
+static hamt *set_range(hamt *trie, const long start, const long end, const long scale) {
+    for (long i = start; i < end; i++) {
+        hamt *next = hamt_set(trie, make_long(i), make_long(i * scale));
+        hamt_free(trie);
+        trie = next;
+    }
+    return trie;
+}
+
+static hamt *create_trie(size_t (*hash_func)(void *)) {
+    return hamt_create(hash_func, long_equals, copy_long, copy_long, free, free);
+}
+
+void test_hamt_create(void) {
+    hamt *trie = create_trie(hash_long);
+    long  key  = 1;
+    TEST_ASSERT_NOT_NULL(trie);
+    TEST_ASSERT_EQUAL_size_t(0, hamt_count(trie));
+    TEST_ASSERT_NULL(hamt_get(trie, &key));
+    TEST_ASSERT_NULL(hamt_get_keys(trie));
+    hamt_free(trie);
+}
+
+void test_hamt_set_get(void) {
+    hamt *trie = set_range(create_trie(hash_long), 0, 5000, 3);
+    TEST_ASSERT_EQUAL_size_t(5000, hamt_count(trie));
+    for (long i = 0; i < 5000; i++) {
+        long *value = hamt_get(trie, &i);
+        TEST_ASSERT_NOT_NULL(value);
+        TEST_ASSERT_EQUAL_INT64(i * 3, *value);
+    }
+    long missing = 5000;
+    TEST_ASSERT_NULL(hamt_get(trie, &missing));
+
+    arraylist *keys = hamt_get_keys(trie);
+    TEST_ASSERT_EQUAL_UINT(5000, keys->size);
+    arraylist_destroy(keys);
+    hamt_free(trie);
+}
+
+void test_hamt_replace(void) {
+    hamt *trie     = set_range(create_trie(hash_long), 0, 100, 1);
+    hamt *replaced = set_range(hamt_retain(trie), 50, 60, -1);
+    long  key      = 55;
+    TEST_ASSERT_EQUAL_size_t(100, hamt_count(replaced));
+    TEST_ASSERT_EQUAL_INT64(-55, *(long *) hamt_get(replaced, &key));
+    TEST_ASSERT_EQUAL_INT64(55, *(long *) hamt_get(trie, &key));
+    hamt_free(trie);
+    hamt_free(replaced);
+}
+
+void test_hamt_set_is_persistent(void) {
+    hamt *base  = set_range(create_trie(hash_long), 0, 200, 1);
+    hamt *extra = set_range(hamt_retain(base), 200, 400, 1);
+    long  key   = 300;
+    TEST_ASSERT_EQUAL_size_t(200, hamt_count(base));
+    TEST_ASSERT_EQUAL_size_t(400, hamt_count(extra));
+    TEST_ASSERT_NULL(hamt_get(base, &key));
+    TEST_ASSERT_EQUAL_INT64(300, *(long *) hamt_get(extra, &key));
+    hamt_free(base);
+    for (long i = 0; i < 400; i++) {
+        TEST_ASSERT_EQUAL_INT64(i, *(long *) hamt_get(extra, &i));
+    }
+    hamt_free(extra);
+}
+
+void test_hamt_collisions(void) {
+    hamt *trie = set_range(create_trie(hash_colliding), 0, 64, 2);
+    trie       = set_range(trie, 0, 8, 5);
+    TEST_ASSERT_EQUAL_size_t(64, hamt_count(trie));
+    for (long i = 0; i < 64; i++) {
+        TEST_ASSERT_EQUAL_INT64(i < 8 ? i * 5 : i * 2, *(long *) hamt_get(trie, &i));
+    }
+    hamt_free(trie);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_hamt_create);
+    RUN_TEST(test_hamt_set_get);
+    RUN_TEST(test_hamt_replace);
+    RUN_TEST(test_hamt_set_is_persistent);
+    RUN_TEST(test_hamt_collisions);
+    return UNITY_END();
+}
@@ -0,0 +1,125 @@
+//
+// Created by dgood on 1/18/25.
+//
+#include <stdint.h>
+#include <stdio.h>
+#include "../Unity/src/unity.h"
+#include "../src/datastructures/int_buffer.h"
+
+void setUp(void) {
+    // Set up code if needed
+}
+
+void tearDown(void) {
+    // Tear down code if needed
+}
+
+void test_int_buffer_append_in_place(void) {
+    int_buffer *buffer = int_buffer_create(0);
+    size_t      offset = 0;
+    int_buffer *first  = int_buffer_append(buffer, &offset, 0, 1);
+    TEST_ASSERT_EQUAL_PTR(buffer, first);
+    TEST_ASSERT_EQUAL_size_t(0, offset);
+    TEST_ASSERT_EQUAL_size_t(1, buffer->used);
+    TEST_ASSERT_EQUAL_size_t(2, buffer->refcount);
+    int_buffer_free(first);
+    int_buffer_free(buffer);
+}
+
+void test_int_buffer_append_copies_shared_slot(void) {
+    int_buffer *buffer = int_buffer_create(0);
+    size_t      offset = 0;
+    int_buffer *a      = int_buffer_append(buffer, &offset, 0, 1);
+    int_buffer *b      = int_buffer_append(a, &offset, 1, 2);
+    // appending to the one element slice again must not clobber b's second element
+    offset             = 0;
+    int_buffer *c      = int_buffer_append(a, &offset, 1, 3);
+    TEST_ASSERT_NOT_EQUAL(a, c);
+    TEST_ASSERT_EQUAL_INT64(2, b->data[1]);
+    TEST_ASSERT_EQUAL_INT64(1, c->data[0]);
+    TEST_ASSERT_EQUAL_INT64(3, c->data[1]);
+    int_buffer_free(c);
+    int_buffer_free(b);
+    int_buffer_free(a);
+    int_buffer_free(buffer);
+}
+
+void test_int_buffer_append_grows(void) {
+    int_buffer *buffer = int_buffer_create(0);
+    size_t      offset = 0;
+    for (int64_t i = 0; i < 100; i++) {
+        int_buffer *next = int_buffer_append(buffer, &offset, (size_t) i, i);
+        int_buffer_free(buffer);
+        buffer = next;
+    }
+    TEST_ASSERT_EQUAL_size_t(100, buffer->used);
+    TEST_ASSERT_TRUE(buffer->capacity >= 100);
+    for (int64_t i = 0; i < 100; i++) {
+        TEST_ASSERT_EQUAL_INT64(i, buffer->data[i]);
+    }
+    int_buffer_free(buffer);
+}
+
+void test_int64_kernels(void) {
+    // odd lengths exercise both the vector loops and the scalar tails
+    int64_t a[]      = {5, -3, 12, 7, 0, 99, -42, 8, 1, 2, 3};
+    int64_t b[]      = {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1};
+    int64_t result[11];
+    TEST_ASSERT_EQUAL_INT64(92, int64_sum(a, 11));
+    TEST_ASSERT_EQUAL_INT64(-42, int64_min(a, 11));
+    TEST_ASSERT_EQUAL_INT64(99, int64_max(a, 11));
+    TEST_ASSERT_EQUAL_INT64(-3, int64_min(a, 3));
+    TEST_ASSERT_EQUAL_INT64(12, int64_max(a, 3));
+    TEST_ASSERT_TRUE(int64_equals(a, a, 11));
+    TEST_ASSERT_FALSE(int64_equals(a, b, 11));
+    int64_add(result, a, b, 11);
+    TEST_ASSERT_EQUAL_INT64(4, result[10]);
+    int64_sub(result, a, b, 11);
+    TEST_ASSERT_EQUAL_INT64(-43, result[6]);
+    int64_mul(result, a, a, 11);
+    TEST_ASSERT_EQUAL_INT64(9801, result[5]);
+}
+
+void test_int64_kernels_scalar_tails(void) {
+    // every length up to a few vectors, with the extremes and the mismatch in the last
+    // slot, which for lengths that aren't a multiple of the vector width is in the tail
+    int64_t a[13];
+    int64_t b[13];
+    int64_t result[13];
+    for (size_t count = 1; count <= 13; count++) {
+        int64_t sum = 0;
+        for (size_t i = 0; i < count; i++) {
+            a[i] = b[i] = (int64_t) i - 6;
+            sum += a[i];
+        }
+        TEST_ASSERT_EQUAL_INT64(sum, int64_sum(a, count));
+        TEST_ASSERT_TRUE(int64_equals(a, b, count));
+        a[count - 1] = -100;
+        TEST_ASSERT_EQUAL_INT64(-100, int64_min(a, count));
+        TEST_ASSERT_FALSE(int64_equals(a, b, count));
+        a[count - 1] = 100;
+        TEST_ASSERT_EQUAL_INT64(100, int64_max(a, count));
+        int64_add(result, a, b, count);
+        TEST_ASSERT_EQUAL_INT64(100 + b[count - 1], result[count - 1]);
+        int64_sub(result, a, b, count);
+        TEST_ASSERT_EQUAL_INT64(100 - b[count - 1], result[count - 1]);
+    }
+}
+
+void test_int64_equals_tail_mismatch(void) {
+    int64_t a[] = {1, 2, 3, 4, 5, 6, 7, 8, 9};
+    int64_t b[] = {1, 2, 3, 4, 5, 6, 7, 8, 10};
+    TEST_ASSERT_FALSE(int64_equals(a, b, 9));
+    TEST_ASSERT_TRUE(int64_equals(a, b, 8));
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_int_buffer_append_in_place);
+    RUN_TEST(test_int_buffer_append_copies_shared_slot);
+    RUN_TEST(test_int_buffer_append_grows);
+    RUN_TEST(test_int64_kernels);
+    RUN_TEST(test_int64_kernels_scalar_tails);
+    RUN_TEST(test_int64_equals_tail_mismatch);
+    return UNITY_END();
+}
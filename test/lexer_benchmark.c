@@ -0,0 +1,106 @@
+//
+// Created by dgood on 1/20/25.
+//
+// Lexer throughput benchmark: lexes a generated script of the given size (in MB,
+// default 8) a number of times (default 5) and reports the best MB/s, then times
+// token_get_type on a mix of keywords and identifiers.
+//
+//   lexer_benchmark [size_mb] [iterations]
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../src/lexer/lexer.h"
+#include "../src/token/token.h"
+
+static const char *SNIPPET =
+        "let fibonacci = fn(x) {\n"
+        "    if (x < 2) { return x; }\n"
+        "    fibonacci(x - 1) + fibonacci(x - 2);\n"
+        "};\n"
+        "let greeting = \"hello, world, this is a longer string literal\";\n"
+        "let numbers = [1, 22, 333, 4444, 55555, 666666];\n"
+        "let person = {\"name\": \"Monkey\", \"age\": 1234567890};\n"
+        "while (counter != 100000) { let counter = counter + 1; }\n"
+        "        \t\t    \n";
+
+static char *generate_script(const size_t size) {
+    const size_t snippet_length = strlen(SNIPPET);
+    char *       script         = malloc(size + snippet_length + 1);
+    if (script == NULL) {
+        return nullptr;
+    }
+    size_t used = 0;
+    while (used < size) {
+        memcpy(script + used, SNIPPET, snippet_length);
+        used += snippet_length;
+    }
+    script[used] = '\0';
+    return script;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+static const char *WORDS[] = {
+        "let", "fn", "if", "else", "return", "true", "false", "while",
+        "x", "fibonacci", "counter", "len", "lettuce", "iffy", "elsewhere", "returned", "person", "value",
+        "_tmp", "1234567",
+};
+
+static void benchmark_keywords(const size_t rounds) {
+    const size_t nwords  = sizeof(WORDS) / sizeof(WORDS[0]);
+    size_t       lengths[sizeof(WORDS) / sizeof(WORDS[0])];
+    size_t       checksum = 0;
+    for (size_t i = 0; i < nwords; i++) {
+        lengths[i] = strlen(WORDS[i]);
+    }
+    const double start = now();
+    for (size_t r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < nwords; i++) {
+            checksum += token_get_type(WORDS[i], lengths[i]);
+        }
+    }
+    const double elapsed = now() - start;
+    printf("token_get_type: %zu lookups in %.3f s: %.2f ns/lookup (checksum %zu)\n", rounds * nwords, elapsed,
+           elapsed * 1e9 / (double) (rounds * nwords), checksum);
+}
+
+int main(const int argc, char **argv) {
+    const size_t size_mb    = argc > 1 ? strtoul(argv[1], nullptr, 10) : 8;
+    const int    iterations = argc > 2 ? atoi(argv[2]) : 5;
+    char *       script     = generate_script(size_mb * 1024 * 1024);
+    if (script == NULL) {
+        fprintf(stderr, "could not allocate a %zu MB script\n", size_mb);
+        return EXIT_FAILURE;
+    }
+
+    const size_t length = strlen(script);
+    double       best   = 0;
+    size_t       tokens = 0;
+    for (int i = 0; i < iterations; i++) {
+        lexer *      l     = lexer_init(script);
+        const double start = now();
+        tokens             = 0;
+        while (lexer_next_token(l).type != END_OF_FILE) {
+            tokens++;
+        }
+        const double elapsed = now() - start;
+        lexer_free(l);
+        if (best == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+
+    printf("lexed %.1f MB, %zu tokens in %.3f s: %.1f MB/s, %.1f Mtokens/s\n",
+           (double) length / (1024 * 1024), tokens, best, (double) length / (1024 * 1024) / best,
+           (double) tokens / 1e6 / best);
+    free(script);
+
+    benchmark_keywords(5000000);
+    return EXIT_SUCCESS;
+}
@@ -2,6 +2,9 @@
 // Created by dgood on 12/15/24.
 //
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "../../Unity/src/unity.h"
 #include "../src/lexer/lexer.h"
 #include "../src/token/token.h"
@@ -183,20 +186,158 @@ void test_next_token(void) {
 
 	lexer *l = lexer_init(input);
 	int i = 0;
-	token *t;
+	token_span t;
 	for (i = 0; i < sizeof(tests)/sizeof(tests[0]); i++) {
 		t = lexer_next_token(l);
 		printf("Testing lexing for input %s\n", tests[i].literal);
-		TEST_ASSERT_EQUAL_STRING(&t->type, &tests[i].type);
-		TEST_ASSERT_EQUAL_STRING(t->literal, tests[i].literal);
-		token_free(t);
+		TEST_ASSERT_EQUAL_INT(tests[i].type, t.type);
+		char *literal = lexer_token_literal(l, t);
+		TEST_ASSERT_EQUAL_STRING(tests[i].literal, literal);
+		free(literal);
 	}
 	lexer_free(l);
 }
 
+void test_token_spans(void) {
+	const char *input = "let s = \"a\nb\";\nx";
+	lexer *l = lexer_init(input);
+	token_span t = lexer_next_token(l);
+	TEST_ASSERT_EQUAL_INT(LET, t.type);
+	TEST_ASSERT_EQUAL_size_t(0, t.offset);
+	TEST_ASSERT_EQUAL_size_t(3, t.length);
+	TEST_ASSERT_EQUAL_size_t(1, t.line);
+	lexer_next_token(l);
+	lexer_next_token(l);
+	t = lexer_next_token(l);
+	TEST_ASSERT_EQUAL_INT(STRING, t.type);
+	TEST_ASSERT_EQUAL_size_t(9, t.offset);
+	TEST_ASSERT_EQUAL_size_t(3, t.length);
+	TEST_ASSERT_EQUAL_PTR(input + 9, l->input + t.offset);
+	t = lexer_next_token(l);
+	TEST_ASSERT_EQUAL_INT(SEMICOLON, t.type);
+	TEST_ASSERT_EQUAL_size_t(2, t.line);
+	t = lexer_next_token(l);
+	TEST_ASSERT_EQUAL_INT(IDENT, t.type);
+	TEST_ASSERT_EQUAL_size_t(3, t.line);
+	t = lexer_next_token(l);
+	TEST_ASSERT_EQUAL_INT(END_OF_FILE, t.type);
+	TEST_ASSERT_EQUAL_size_t(0, t.length);
+	lexer_free(l);
+}
+
+void test_long_tokens(void) {
+	// runs longer than a scan block, ending at every position within one
+	char input[1024];
+	for (size_t n = 1; n < 70; n++) {
+		size_t used = 0;
+		for (size_t i = 0; i < n; i++)
+			input[used++] = i % 7 == 0 ? '\n' : ' ';
+		for (size_t i = 0; i < n; i++)
+			input[used++] = (char) ('a' + i % 26);
+		input[used++] = '"';
+		for (size_t i = 0; i < n; i++)
+			input[used++] = i % 5 == 0 ? '\n' : 'x';
+		input[used++] = '"';
+		input[used++] = ';';
+		input[used]   = '\0';
+
+		const size_t newlines = (n + 6) / 7;
+		lexer *l = lexer_init(input);
+		token_span t = lexer_next_token(l);
+		TEST_ASSERT_EQUAL_INT(IDENT, t.type);
+		TEST_ASSERT_EQUAL_size_t(n, t.offset);
+		TEST_ASSERT_EQUAL_size_t(n, t.length);
+		TEST_ASSERT_EQUAL_size_t(1 + newlines, t.line);
+		t = lexer_next_token(l);
+		TEST_ASSERT_EQUAL_INT(STRING, t.type);
+		TEST_ASSERT_EQUAL_size_t(2 * n + 1, t.offset);
+		TEST_ASSERT_EQUAL_size_t(n, t.length);
+		t = lexer_next_token(l);
+		TEST_ASSERT_EQUAL_INT(SEMICOLON, t.type);
+		TEST_ASSERT_EQUAL_size_t(1 + newlines + (n + 4) / 5, t.line);
+		TEST_ASSERT_EQUAL_INT(END_OF_FILE, lexer_next_token(l).type);
+		lexer_free(l);
+	}
+}
+
+void test_stream(void) {
+	// several windows worth of input, with tokens straddling every window boundary and
+	// an identifier and a string longer than a whole window
+	const char *statement = "let value_%zu = fn(a, b) { if (a <= b) { \"str\n%zu\" } else { a != b } };\n";
+	const size_t long_length = LEXER_STREAM_CHUNK + 100;
+	const size_t size = 4 * LEXER_STREAM_CHUNK + 2 * long_length + 64;
+	char *input = malloc(size);
+	size_t used = 0;
+	for (size_t i = 0; used < LEXER_STREAM_CHUNK * 2; i++)
+		used += sprintf(input + used, statement, i, i);
+	memset(input + used, 'x', long_length);
+	used += long_length;
+	input[used++] = ' ';
+	input[used++] = '"';
+	memset(input + used, 'y', long_length);
+	used += long_length;
+	input[used++] = '"';
+	for (size_t i = 0; used < size - 128; i++)
+		used += sprintf(input + used, statement, i, i);
+	input[used] = '\0';
+
+	FILE *file = tmpfile();
+	TEST_ASSERT_NOT_NULL(file);
+	TEST_ASSERT_EQUAL_size_t(used, fwrite(input, 1, used, file));
+	fflush(file);
+	rewind(file);
+
+	lexer *expected = lexer_init(input);
+	lexer *actual = lexer_init_stream(fileno(file));
+	size_t count = 0;
+	token_span e, a;
+	do {
+		e = lexer_next_token(expected);
+		a = lexer_next_token(actual);
+		TEST_ASSERT_EQUAL_INT(e.type, a.type);
+		TEST_ASSERT_EQUAL_size_t(e.offset, a.offset);
+		TEST_ASSERT_EQUAL_size_t(e.length, a.length);
+		TEST_ASSERT_EQUAL_size_t(e.line, a.line);
+		if (e.length > 0)
+			TEST_ASSERT_EQUAL_MEMORY(lexer_token_start(expected, e), lexer_token_start(actual, a), e.length);
+		count++;
+	} while (e.type != END_OF_FILE);
+	TEST_ASSERT_TRUE(count > 1000);
+	// the window only grows to fit the longest token
+	TEST_ASSERT_TRUE(actual->capacity <= 4 * LEXER_STREAM_CHUNK);
+
+	lexer_free(expected);
+	lexer_free(actual);
+	fclose(file);
+	free(input);
+}
+
+void test_token_get_type(void) {
+	const struct {
+		const char *literal;
+		token_type type;
+	} tests[] = {
+		{"fn", FUNCTION}, {"let", LET}, {"if", IF}, {"else", ELSE}, {"return", RETURN},
+		{"true", TRUE}, {"false", FALSE}, {"while", WHILE},
+		{"f", IDENT}, {"lettuce", IDENT}, {"iffy", IDENT}, {"returns", IDENT}, {"While", IDENT},
+		{"_", IDENT}, {"123", INT}, {"12ab", IDENT},
+	};
+	for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+		TEST_ASSERT_EQUAL_INT(tests[i].type, token_get_type(tests[i].literal, strlen(tests[i].literal)));
+	}
+	// spans are not NUL terminated
+	TEST_ASSERT_EQUAL_INT(LET, token_get_type("letter", 3));
+	TEST_ASSERT_EQUAL_STRING("WHILE", token_get_name_from_type(WHILE));
+	TEST_ASSERT_EQUAL_STRING("COLON", token_get_name_from_type(COLON));
+}
+
 // not needed when using generate_test_runner.rb
 int main() {
     UNITY_BEGIN();
     RUN_TEST(test_next_token);
+    RUN_TEST(test_token_spans);
+    RUN_TEST(test_long_tokens);
+    RUN_TEST(test_token_get_type);
+    RUN_TEST(test_stream);
     return UNITY_END();
 }
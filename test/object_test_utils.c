@@ -32,7 +32,7 @@ void test_string_object(object_object *obj, char *expected_value, size_t expecte
     log_debug("Testing Integer Object: %s\n", expected_value);
     object_string *str_obj = (object_string *) obj;
     TEST_ASSERT_EQUAL_INT(str_obj->length, expected_length);
-    TEST_ASSERT_EQUAL_STRING_LEN(str_obj->value, expected_value, expected_length);
+    TEST_ASSERT_EQUAL_STRING_LEN(object_string_value(str_obj), expected_value, expected_length);
 }
 
 void test_compiled_function_object(object_object *obj, object_object *expected) {
@@ -56,7 +56,7 @@ void test_object_object(object_object *obj, object_object *expected) {
         log_error("Error: NULL expected passed to test_object_object\n");
         abort();
     }
-    if (expected->type < OBJECT_INT || expected->type > OBJECT_COMPILED_FUNCTION) {
+    if (expected->type < OBJECT_INT || expected->type > OBJECT_CLOSURE) {
         log_error("Error: Invalid expected->type: %d\n", expected->type);
         abort();
     }
@@ -88,6 +88,9 @@ void test_object_object(object_object *obj, object_object *expected) {
         TEST_ASSERT_EQUAL_STRING(actual_err->message, expected_err->message);
     } else if (expected->type == OBJECT_COMPILED_FUNCTION) {
         test_compiled_function_object(obj, expected);
+    } else if (expected->type == OBJECT_CLOSURE) {
+        test_compiled_function_object((object_object *) ((object_closure *) obj)->fn,
+                                      (object_object *) ((object_closure *) expected)->fn);
     }
 }
 
@@ -95,27 +98,29 @@ void test_object_object(object_object *obj, object_object *expected) {
 void test_array_object(object_object *actual, object_object *expected) {
     object_array *actual_arr   = (object_array *) actual;
     object_array *expected_arr = (object_array *) expected;
-    TEST_ASSERT_EQUAL_UINT(actual_arr->elements->size, expected_arr->elements->size);
-    for (size_t i = 0; i < actual_arr->elements->size; i++) {
-        object_object *actual_obj   = arraylist_get(actual_arr->elements, i);
-        object_object *expected_obj = arraylist_get(expected_arr->elements, i);
+    TEST_ASSERT_EQUAL_UINT(object_array_length(actual_arr), object_array_length(expected_arr));
+    for (size_t i = 0; i < object_array_length(actual_arr); i++) {
+        object_object *actual_obj   = object_array_get(actual_arr, i);
+        object_object *expected_obj = object_array_get(expected_arr, i);
         test_object_object(actual_obj, expected_obj);
+        object_free(actual_obj);
+        object_free(expected_obj);
     }
 }
 
 void test_hash_object(object_object *actual, object_object *expected) {
     object_hash *actual_hash   = (object_hash *) actual;
     object_hash *expected_hash = (object_hash *) expected;
-    TEST_ASSERT_EQUAL_size_t(actual_hash->pairs->key_count, expected_hash->pairs->key_count);
-    arraylist *expected_keys = hashtable_get_keys(expected_hash->pairs);
-    arraylist *actual_keys   = hashtable_get_keys(actual_hash->pairs);
+    TEST_ASSERT_EQUAL_size_t(object_hash_count(actual_hash), object_hash_count(expected_hash));
+    arraylist *expected_keys = object_hash_keys(expected_hash);
+    arraylist *actual_keys   = object_hash_keys(actual_hash);
     if (expected_keys == NULL) {
         TEST_ASSERT_NULL(actual_keys);
     } else {
         for (size_t i = 0; i < expected_keys->size; i++) {
             object_object *key            = arraylist_get(expected_keys, i);
-            object_object *expected_value = hashtable_get(expected_hash->pairs, key);
-            object_object *actual_value   = hashtable_get(actual_hash->pairs, key);
+            object_object *expected_value = object_hash_get(expected_hash, key);
+            object_object *actual_value   = object_hash_get(actual_hash, key);
             char *         key_string     = key->inspect(key);
             TEST_ASSERT_NOT_NULL(actual_value);
             test_object_object(actual_value, expected_value);
@@ -10,6 +10,7 @@ void test_object_object(object_object *, object_object *);
 void test_null_object(object_object *);
 void test_integer_object(object_object *, long);
 void test_boolean_object(object_object *, bool);
+void test_string_object(object_object *, char *, size_t);
 void test_array_object(object_object *, object_object *);
 void test_hash_object(object_object *, object_object *);
 
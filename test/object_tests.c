@@ -244,6 +244,73 @@ void test_inspect_returns_correct_string_representation(void) {
     object_free(int_obj);
 }
 
+// Test for object_string_concat building and flattening a rope
+void test_string_concat_builds_rope(void) {
+    const size_t   pieces   = 100000;
+    object_string *piece    = object_create_string("ab", 2);
+    object_string *expected = object_create_string(nullptr, 0);
+    expected->value         = malloc(pieces * 2 + 1);
+    object_string *rope     = object_create_string("", 0);
+    for (size_t i = 0; i < pieces; i++) {
+        object_string *next = object_string_concat(rope, piece);
+        object_free(rope);
+        rope = next;
+        memcpy(expected->value + i * 2, "ab", 2);
+    }
+    expected->value[pieces * 2] = 0;
+    expected->length            = pieces * 2;
+
+    TEST_ASSERT_EQUAL(pieces * 2, rope->length);
+    TEST_ASSERT_NULL(rope->value);
+    TEST_ASSERT_EQUAL_size_t(expected->object.hash(expected), rope->object.hash(rope));
+    TEST_ASSERT_TRUE(object_equals(rope, expected));
+    TEST_ASSERT_EQUAL_STRING(expected->value, object_string_value(rope));
+    TEST_ASSERT_NULL(rope->left);
+
+    object_free(rope);
+    object_free(piece);
+    object_free(expected);
+}
+
+// Test for object_string_slice sharing the parent buffer
+void test_string_slice_shares_parent(void) {
+    object_string *parent = object_create_string("hello world", 11);
+    object_string *world  = object_string_slice(parent, 6, 5);
+    object_string *flat   = object_create_string("world", 5);
+    object_string *orld   = object_string_slice(world, 1, 4);
+
+    TEST_ASSERT_EQUAL_PTR(parent->value + 6, world->value);
+    TEST_ASSERT_EQUAL_PTR(parent, orld->parent);
+    TEST_ASSERT_EQUAL(5, world->length);
+    TEST_ASSERT_TRUE(object_equals(world, flat));
+    TEST_ASSERT_EQUAL_size_t(flat->object.hash(flat), world->object.hash(world));
+    char *inspected = world->object.inspect((object_object *) world);
+    TEST_ASSERT_EQUAL_STRING("world", inspected);
+    free(inspected);
+    TEST_ASSERT_EQUAL_STRING_LEN("orld", object_string_value(orld), 4);
+
+    object_free(parent);
+    TEST_ASSERT_EQUAL_STRING_LEN("world", object_string_value(world), 5);
+    object_free(world);
+    object_free(orld);
+    object_free(flat);
+}
+
+// Test that dropping an unflattened rope releases every node
+void test_string_concat_free_deep_rope(void) {
+    object_string *piece = object_create_string("xyz", 3);
+    object_string *rope  = object_create_string("", 0);
+    for (size_t i = 0; i < 200000; i++) {
+        object_string *next = object_string_concat(rope, piece);
+        object_free(rope);
+        rope = next;
+    }
+    TEST_ASSERT_EQUAL(600000, rope->length);
+    TEST_ASSERT_TRUE(piece->object.refcount > 1);
+    object_free(rope);
+    TEST_ASSERT_EQUAL(1, piece->object.refcount);
+    object_free(piece);
+}
 
 int main(int argc, char **argv) {
     UNITY_BEGIN();
@@ -252,6 +319,9 @@ int main(int argc, char **argv) {
     RUN_TEST(test_object_create_bool_returns_correct_boolean_objects);
     RUN_TEST(test_object_create_null_returns_null_object);
     RUN_TEST(test_object_create_string_creates_string_object);
+    RUN_TEST(test_string_concat_builds_rope);
+    RUN_TEST(test_string_concat_free_deep_rope);
+    RUN_TEST(test_string_slice_shares_parent);
     RUN_TEST(test_object_create_array_creates_array_object);
     RUN_TEST(test_object_create_hash_creates_hash_object);
     RUN_TEST(test_object_create_error_creates_error_object);
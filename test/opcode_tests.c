@@ -124,6 +124,24 @@ void test_instruction_init(void) {
             OP_CLOSURE, {(size_t) 65534, (size_t) 255},
             4,
             create_uint8_array(4, OP_CLOSURE, 255, 254, 255)
+        },
+        {
+            "Testing OP_CONSTANT 65536",
+            OP_CONSTANT, {(size_t) 65536},
+            6,
+            create_uint8_array(6, OP_WIDE, OP_CONSTANT, 0, 1, 0, 0)
+        },
+        {
+            "Test OP_SET_LOCAL 256",
+            OP_SET_LOCAL, {(size_t) 256},
+            4,
+            create_uint8_array(4, OP_WIDE, OP_SET_LOCAL, 1, 0)
+        },
+        {
+            "Test OP_CLOSURE 65536 1",
+            OP_CLOSURE, {(size_t) 65536, (size_t) 1},
+            8,
+            create_uint8_array(8, OP_WIDE, OP_CLOSURE, 0, 1, 0, 0, 0, 1)
         }
     };
     print_test_separator_line();
@@ -176,6 +194,144 @@ void test_instructions_string(void) {
     instructions_free(ins_array[4]);
 }
 
+void test_wide_instructions(void) {
+    instructions *ins_array[4] = {
+        opcode_make_instruction(OP_GET_LOCAL, (size_t[]){300}),
+        opcode_make_wide_instruction(OP_JUMP, (size_t[]){4}),
+        opcode_make_instruction(OP_CLOSURE, (size_t[]){70000, 2}),
+        opcode_make_wide_instruction(OP_ADD, nullptr)
+    };
+
+    const char *expected_string = "0000 OP_WIDE OP_GET_LOCAL 300\n" \
+        "0004 OP_WIDE OP_JUMP 4\n" \
+        "0010 OP_WIDE OP_CLOSURE 70000 2\n" \
+        "0018 OP_ADD";
+
+    instructions *flat_ins = opcode_flatten_instructions(4, ins_array);
+    char *string = instructions_to_string(flat_ins);
+    print_test_separator_line();
+    printf("Testing wide instructions\n");
+    TEST_ASSERT_EQUAL_STRING(expected_string, string);
+    TEST_ASSERT_EQUAL_size_t(4, opcode_instruction_length(flat_ins->bytes));
+    TEST_ASSERT_EQUAL_size_t(1, opcode_instruction_length(flat_ins->bytes + 18));
+
+    size_t operands[MAX_OPERANDS];
+    TEST_ASSERT_EQUAL_INT(OP_CLOSURE, vm_instruction_decode(flat_ins->bytes + 10, operands));
+    TEST_ASSERT_EQUAL_size_t(70000, operands[0]);
+    TEST_ASSERT_EQUAL_size_t(2, operands[1]);
+
+    // too large for even the wide form
+    TEST_ASSERT_NULL(opcode_make_instruction(OP_CALL, (size_t[]){65536}));
+    free(string);
+    instructions_free(flat_ins);
+    for (size_t i = 0; i < 4; i++)
+        instructions_free(ins_array[i]);
+}
+
+void test_aligned_instructions(void) {
+    instructions *ins_array[6] = {
+        opcode_make_instruction(OP_TRUE, nullptr),
+        opcode_make_instruction(OP_JUMP_NOT_TRUTHY, (size_t[]){9}),
+        opcode_make_instruction(OP_GET_LOCAL, (size_t[]){300}),
+        opcode_make_instruction(OP_POP, nullptr),
+        opcode_make_instruction(OP_CLOSURE, (size_t[]){70000, 2}),
+        opcode_make_instruction(OP_CLOSURE, (size_t[]){3, 1})
+    };
+
+    // one word each, jumps go to words, and the closure too large for one word takes two
+    const char *expected_string = "0000 OP_TRUE\n" \
+        "0001 OP_JUMP_NOT_TRUTHY 4\n" \
+        "0002 OP_GET_LOCAL 300\n" \
+        "0003 OP_POP\n" \
+        "0004 OP_WIDE OP_CLOSURE 70000 2\n" \
+        "0006 OP_CLOSURE 3 1";
+
+    instructions *flat_ins = opcode_flatten_instructions(6, ins_array);
+    instructions *aligned  = opcode_align_instructions(flat_ins);
+    char *        string   = instructions_to_string(aligned);
+    print_test_separator_line();
+    printf("Testing aligned instructions\n");
+    TEST_ASSERT_EQUAL_STRING(expected_string, string);
+    TEST_ASSERT_EQUAL_INT(INSTRUCTIONS_ALIGNED, aligned->format);
+    TEST_ASSERT_EQUAL_size_t(7 * sizeof(uint32_t), aligned->length);
+
+    const uint32_t *words = (const uint32_t *) aligned->bytes;
+    TEST_ASSERT_EQUAL_INT(OP_GET_LOCAL, aligned_opcode(words[2]));
+    TEST_ASSERT_EQUAL_size_t(300, aligned_operand(words[2]));
+    TEST_ASSERT_EQUAL_UINT32(OP_CLOSURE | 3 << 8 | 1 << 24, words[6]);
+
+    size_t operands[MAX_OPERANDS];
+    size_t width;
+    TEST_ASSERT_EQUAL_INT(OP_CLOSURE, opcode_decode_aligned(words + 4, operands, &width));
+    TEST_ASSERT_EQUAL_size_t(2, width);
+    TEST_ASSERT_EQUAL_size_t(70000, operands[0]);
+    TEST_ASSERT_EQUAL_size_t(2, operands[1]);
+
+    // an operand too large for 24 bits can't be aligned
+    instructions *too_large = opcode_make_instruction(OP_CONSTANT, (size_t[]){1 << 24});
+    TEST_ASSERT_NULL(opcode_align_instructions(too_large));
+    instructions_free(too_large);
+    free(string);
+    instructions_free(aligned);
+    instructions_free(flat_ins);
+    for (size_t i = 0; i < 6; i++)
+        instructions_free(ins_array[i]);
+}
+
+void test_loop_instructions(void) {
+    instructions *ins_array[4] = {
+        opcode_make_instruction(OP_TRUE, nullptr),
+        opcode_make_instruction(OP_JUMP_NOT_TRUTHY, (size_t[]){8}),
+        opcode_make_instruction(OP_MOD, nullptr),
+        opcode_make_instruction(OP_LOOP, (size_t[]){0})
+    };
+
+    instructions *flat_ins = opcode_flatten_instructions(4, ins_array);
+    char *        string   = instructions_to_string(flat_ins);
+    print_test_separator_line();
+    printf("Testing loop instructions\n");
+    TEST_ASSERT_EQUAL_STRING("0000 OP_TRUE\n0001 OP_JUMP_NOT_TRUTHY 8\n0004 OP_MOD\n0005 OP_LOOP 0", string);
+    TEST_ASSERT_TRUE(opcode_is_jump(OP_LOOP));
+    free(string);
+
+    // the backward branch goes to a word like any other jump
+    instructions *aligned = opcode_align_instructions(flat_ins);
+    string                = instructions_to_string(aligned);
+    TEST_ASSERT_EQUAL_STRING("0000 OP_TRUE\n0001 OP_JUMP_NOT_TRUTHY 4\n0002 OP_MOD\n0003 OP_LOOP 0", string);
+    free(string);
+    instructions_free(aligned);
+    instructions_free(flat_ins);
+    for (size_t i = 0; i < 4; i++)
+        instructions_free(ins_array[i]);
+}
+
+void test_counted_loop_instructions(void) {
+    instructions *ins_array[4] = {
+        opcode_make_instruction(OP_LESS_THAN_LOCAL, (size_t[]){0, 1}),
+        opcode_make_instruction(OP_INCREMENT_LOCAL, (size_t[]){0, 300}),
+        opcode_make_instruction(OP_LESS_THAN_GLOBAL, (size_t[]){2, 3}),
+        opcode_make_instruction(OP_INCREMENT_GLOBAL, (size_t[]){2, 4})
+    };
+
+    instructions *flat_ins = opcode_flatten_instructions(4, ins_array);
+    char *        string   = instructions_to_string(flat_ins);
+    print_test_separator_line();
+    printf("Testing counted loop instructions\n");
+    TEST_ASSERT_EQUAL_STRING("0000 OP_LESS_THAN_LOCAL 0 1\n0003 OP_INCREMENT_LOCAL 0 300\n"
+                             "0007 OP_LESS_THAN_GLOBAL 2 3\n0012 OP_INCREMENT_GLOBAL 2 4", string);
+    free(string);
+
+    // a global and a constant don't fit in one word together, so those take two
+    instructions *aligned = opcode_align_instructions(flat_ins);
+    string                = instructions_to_string(aligned);
+    TEST_ASSERT_EQUAL_STRING("0000 OP_LESS_THAN_LOCAL 0 1\n0001 OP_INCREMENT_LOCAL 0 300\n"
+                             "0002 OP_WIDE OP_LESS_THAN_GLOBAL 2 3\n0004 OP_WIDE OP_INCREMENT_GLOBAL 2 4", string);
+    free(string);
+    instructions_free(aligned);
+    instructions_free(flat_ins);
+    for (size_t i = 0; i < 4; i++)
+        instructions_free(ins_array[i]);
+}
 
 int main(void) {
     UNITY_BEGIN();
@@ -187,6 +343,10 @@ int main(void) {
 //    RUN_TEST(test_invalid_opcode);
     RUN_TEST(test_instructions_string);
     RUN_TEST(test_instruction_init);
+    RUN_TEST(test_wide_instructions);
+    RUN_TEST(test_aligned_instructions);
+    RUN_TEST(test_loop_instructions);
+    RUN_TEST(test_counted_loop_instructions);
 
     return UNITY_END();
 }
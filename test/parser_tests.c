@@ -5,6 +5,7 @@
 #include <err.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "../../Unity/src/unity.h"
 #include "../src/ast/ast.h"
@@ -12,7 +13,9 @@
 #include "../src/datastructures/conversions.h"
 #include "../src/datastructures/linked_list.h"
 #include "../src/lexer/lexer.h"
+#include "../src/parser/parallel_parser.h"
 #include "../src/parser/parser.h"
+#include "../src/parser/parser_tracing.h"
 #include "../src/token/token.h"
 #include "test_utils.h"
 
@@ -109,7 +112,7 @@ void test_infix_expression(ast_expression *exp, const char *operator, const char
 
     test_literal_expression(infix_exp->left, left);
 
-    TEST_ASSERT_EQUAL_STRING(infix_exp->operator, operator);
+    TEST_ASSERT_EQUAL_STRING(ast_get_operator_literal(infix_exp->operator), operator);
     test_literal_expression(infix_exp->left, left);
     test_literal_expression(infix_exp->right, right);
 }
@@ -368,7 +371,7 @@ void test_parse_prefix_expression() {
         TEST_ASSERT_EQUAL_INT(exp_stmt->expression->expression_type, PREFIX_EXPRESSION);
 
         ast_prefix_expression *prefix_exp = (ast_prefix_expression *) exp_stmt->expression;
-        TEST_ASSERT_EQUAL_STRING(prefix_exp->operator, test.operator);
+        TEST_ASSERT_EQUAL_STRING(ast_get_operator_literal(prefix_exp->operator), test.operator);
 
         test_literal_expression(prefix_exp->right, test.value);
 
@@ -1087,6 +1090,162 @@ void test_parsing_while_expression(void) {
     parser_free(parser);
 }
 
+static void test_operators_resolved(void) {
+    print_test_separator_line();
+    printf("Testing operators are resolved to an enum\n");
+    const struct {
+        const char * input;
+        ast_operator operator;
+    } tests[] = {
+            {"a + b", OPERATOR_PLUS},
+            {"a - b", OPERATOR_MINUS},
+            {"a * b", OPERATOR_ASTERISK},
+            {"a / b", OPERATOR_SLASH},
+            {"a % b", OPERATOR_PERCENT},
+            {"a < b", OPERATOR_LT},
+            {"a > b", OPERATOR_GT},
+            {"a == b", OPERATOR_EQ},
+            {"a != b", OPERATOR_NOT_EQ},
+            {"a && b", OPERATOR_AND},
+            {"a || b", OPERATOR_OR},
+            {"-a", OPERATOR_MINUS},
+            {"!a", OPERATOR_BANG},
+    };
+    for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        lexer *      lexer   = lexer_init(tests[i].input);
+        parser *     parser  = parser_init(lexer);
+        ast_program *program = parse_program(parser);
+        check_parser_errors(parser);
+        const ast_expression *exp = ((ast_expression_statement *) program->statements[0])->expression;
+        if (exp->expression_type == INFIX_EXPRESSION)
+            TEST_ASSERT_EQUAL_INT(tests[i].operator, ((ast_infix_expression *) exp)->operator);
+        else
+            TEST_ASSERT_EQUAL_INT(tests[i].operator, ((ast_prefix_expression *) exp)->operator);
+        program_free(program);
+        parser_free(parser);
+    }
+}
+
+static void test_parser_next_statement(void) {
+    print_test_separator_line();
+    printf("Testing statements are parsed one at a time\n");
+    lexer *                      lexer  = lexer_init("let a = 1; a + 2;\nreturn fn(x) { x };");
+    parser *                     parser = parser_init(lexer);
+    const ast_statement_type     expected[] = {LET_STATEMENT, EXPRESSION_STATEMENT, RETURN_STATEMENT};
+    for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+        ast_statement *stmt = parser_next_statement(parser);
+        TEST_ASSERT_NOT_NULL(stmt);
+        TEST_ASSERT_EQUAL_INT(expected[i], stmt->statement_type);
+        free_statement(stmt);
+    }
+    TEST_ASSERT_NULL(parser_next_statement(parser));
+    TEST_ASSERT_NULL(parser_next_statement(parser));
+    check_parser_errors(parser);
+    parser_free(parser);
+}
+
+/**
+ * Parse the input serially and on four threads and check both give the same statements
+ * and the same errors in the same order.
+ */
+static void assert_parallel_parse_matches(const char *input) {
+    parser *     serial           = parser_init(lexer_init(input));
+    parser *     parallel         = parser_init(lexer_init(input));
+    ast_program *expected         = parse_program(serial);
+    ast_program *actual           = parse_program_parallel(parallel, 4);
+    TEST_ASSERT_EQUAL_size_t(expected->statement_count, actual->statement_count);
+    for (size_t i = 0; i < expected->statement_count; i++) {
+        char *expected_string = expected->statements[i]->node.string(expected->statements[i]);
+        char *actual_string   = actual->statements[i]->node.string(actual->statements[i]);
+        TEST_ASSERT_EQUAL_STRING(expected_string, actual_string);
+        free(expected_string);
+        free(actual_string);
+    }
+    TEST_ASSERT_EQUAL(serial->errors == NULL, parallel->errors == NULL);
+    if (serial->errors != NULL) {
+        TEST_ASSERT_EQUAL_size_t(serial->errors->size, parallel->errors->size);
+        const list_node *e = serial->errors->head;
+        const list_node *a = parallel->errors->head;
+        for (; e != NULL; e = e->next, a = a->next)
+            TEST_ASSERT_EQUAL_STRING(e->data, a->data);
+    }
+    program_free(expected);
+    program_free(actual);
+    parser_free(serial);
+    parser_free(parallel);
+}
+
+static void test_parse_program_parallel(void) {
+    print_test_separator_line();
+    printf("Testing parallel parsing matches serial parsing\n");
+    const char *statements[] = {
+            "let add%zu = fn(a, b) { let c = a + b; return c * %zu; };\n",
+            "let s%zu = \"str;ing %zu\"; \"after a semicolon\";\n",
+            "let n%zu = %zu\nlet m = [1, 2, {\"k\": 3}]\n",
+            "if (x < %zu) { return %zu } else { [1][0] };\n",
+            "return fn(x) { fn(y) { x + y } }(%zu)(%zu);\n",
+    };
+    const size_t count  = 4000;
+    const size_t size   = 100 * count;
+    char *       input  = malloc(size);
+    size_t       length = 0;
+    for (size_t i = 0; i < count; i++)
+        length += snprintf(input + length, size - length, statements[i % 5], i, i);
+    TEST_ASSERT_TRUE(length > 4 * PARALLEL_PARSE_MIN_CHUNK);
+    assert_parallel_parse_matches(input);
+
+    // errors spread through the input come out in source order
+    length = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (i % 700 == 0)
+            length += snprintf(input + length, size - length, "let = %zu; let x%zu %zu;\n", i, i, i);
+        length += snprintf(input + length, size - length, statements[i % 5], i, i);
+    }
+    assert_parallel_parse_matches(input);
+    free(input);
+}
+
+static char *read_trace(FILE *sink) {
+    static char contents[1024];
+    rewind(sink);
+    const size_t n = fread(contents, 1, sizeof(contents) - 1, sink);
+    contents[n]    = '\0';
+    return contents;
+}
+
+static void test_parser_trace(void) {
+    print_test_separator_line();
+    printf("Testing parser trace output\n");
+    FILE *sink = tmpfile();
+    TEST_ASSERT_NOT_NULL(sink);
+    parser_trace_start(sink, PARSER_TRACE_TEXT);
+    parser_trace_begin("parse_expression");
+    parser_trace_begin("parse_integer_expression");
+    parser_trace_end("parse_integer_expression");
+    parser_trace_end("parse_expression");
+    parser_trace_stop();
+    TEST_ASSERT_FALSE(parser_trace_enabled);
+    TEST_ASSERT_EQUAL_STRING("BEGIN parse_expression\n"
+                             "\tBEGIN parse_integer_expression\n"
+                             "\tEND parse_integer_expression\n"
+                             "END parse_expression\n",
+                             read_trace(sink));
+    fclose(sink);
+
+    sink = tmpfile();
+    TEST_ASSERT_NOT_NULL(sink);
+    parser_trace_start(sink, PARSER_TRACE_CHROME);
+    parser_trace_begin("parse_expression");
+    parser_trace_end("parse_expression");
+    parser_trace_stop();
+    const char *trace = read_trace(sink);
+    TEST_ASSERT_EQUAL_CHAR('[', trace[0]);
+    TEST_ASSERT_NOT_NULL(strstr(trace, "{\"name\":\"parse_expression\",\"cat\":\"parser\",\"ph\":\"B\""));
+    TEST_ASSERT_NOT_NULL(strstr(trace, "\"ph\":\"E\""));
+    TEST_ASSERT_NOT_NULL(strstr(trace, "\n]\n"));
+    fclose(sink);
+}
+
 int main() {
     UNITY_BEGIN();
     RUN_TEST(test_let_stmt);
@@ -1115,5 +1274,9 @@ int main() {
     RUN_TEST(test_parsing_hash_literal_bool_keys);
     RUN_TEST(test_parsing_while_expression);
     RUN_TEST(test_function_literal_with_name);
+    RUN_TEST(test_operators_resolved);
+    RUN_TEST(test_parser_next_statement);
+    RUN_TEST(test_parse_program_parallel);
+    RUN_TEST(test_parser_trace);
     return UNITY_END();
 }
@@ -0,0 +1,114 @@
+//
+// Created by dgood on 1/12/25.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include "../Unity/src/unity.h"
+#include "../src/datastructures/pvector.h"
+
+void setUp(void) {
+    // Set up code if needed
+}
+
+void tearDown(void) {
+    // Tear down code if needed
+}
+
+static void *copy_int(void *v) {
+    int *copy = malloc(sizeof(int));
+    *copy     = *(int *) v;
+    return copy;
+}
+
+static int *make_int(const int value) {
+    int *v = malloc(sizeof(int));
+    *v     = value;
+    return v;
+}
+
+static pvector *push_range(pvector *vector, const int start, const int end) {
+    for (int i = start; i < end; i++) {
+        pvector *next = pvector_push(vector, make_int(i));
+        pvector_free(vector);
+        vector = next;
+    }
+    return vector;
+}
+
+void test_pvector_create(void) {
+    pvector *vector = pvector_create(copy_int, free);
+    TEST_ASSERT_NOT_NULL(vector);
+    TEST_ASSERT_EQUAL_size_t(0, pvector_size(vector));
+    TEST_ASSERT_NULL(pvector_get(vector, 0));
+    pvector_free(vector);
+}
+
+void test_pvector_push_and_get(void) {
+    const int sizes[] = {1, 31, 32, 33, 1024, 1056, 1057, 40000};
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        pvector *vector = push_range(pvector_create(copy_int, free), 0, sizes[s]);
+        TEST_ASSERT_EQUAL_size_t(sizes[s], pvector_size(vector));
+        for (int i = 0; i < sizes[s]; i++) {
+            TEST_ASSERT_EQUAL_INT(i, *(int *) pvector_get(vector, i));
+        }
+        TEST_ASSERT_NULL(pvector_get(vector, sizes[s]));
+        pvector_free(vector);
+    }
+}
+
+void test_pvector_push_is_persistent(void) {
+    pvector *base  = push_range(pvector_create(copy_int, free), 0, 100);
+    pvector *left  = pvector_push(base, make_int(-1));
+    pvector *right = pvector_push(base, make_int(-2));
+    TEST_ASSERT_EQUAL_size_t(100, pvector_size(base));
+    TEST_ASSERT_EQUAL_size_t(101, pvector_size(left));
+    TEST_ASSERT_EQUAL_size_t(101, pvector_size(right));
+    TEST_ASSERT_EQUAL_INT(-1, *(int *) pvector_get(left, 100));
+    TEST_ASSERT_EQUAL_INT(-2, *(int *) pvector_get(right, 100));
+    pvector_free(base);
+    for (int i = 0; i < 100; i++) {
+        TEST_ASSERT_EQUAL_INT(i, *(int *) pvector_get(left, i));
+        TEST_ASSERT_EQUAL_INT(i, *(int *) pvector_get(right, i));
+    }
+    pvector_free(left);
+    pvector_free(right);
+}
+
+void test_pvector_rest(void) {
+    pvector *vector = push_range(pvector_create(copy_int, free), 0, 70);
+    pvector *rest   = pvector_rest(vector);
+    TEST_ASSERT_EQUAL_size_t(69, pvector_size(rest));
+    TEST_ASSERT_EQUAL_INT(1, *(int *) pvector_get(rest, 0));
+    TEST_ASSERT_EQUAL_INT(69, *(int *) pvector_get(rest, 68));
+    TEST_ASSERT_EQUAL_INT(0, *(int *) pvector_get(vector, 0));
+
+    pvector *pushed = pvector_push(rest, make_int(70));
+    TEST_ASSERT_EQUAL_size_t(70, pvector_size(pushed));
+    TEST_ASSERT_EQUAL_INT(70, *(int *) pvector_get(pushed, 69));
+    TEST_ASSERT_EQUAL_size_t(69, pvector_size(rest));
+    pvector_free(vector);
+    pvector_free(rest);
+    pvector_free(pushed);
+}
+
+void test_pvector_rest_until_empty(void) {
+    pvector *vector = push_range(pvector_create(copy_int, free), 0, 40);
+    for (int i = 0; i < 40; i++) {
+        TEST_ASSERT_EQUAL_INT(i, *(int *) pvector_get(vector, 0));
+        pvector *rest = pvector_rest(vector);
+        pvector_free(vector);
+        vector = rest;
+    }
+    TEST_ASSERT_EQUAL_size_t(0, pvector_size(vector));
+    pvector_free(vector);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_pvector_create);
+    RUN_TEST(test_pvector_push_and_get);
+    RUN_TEST(test_pvector_push_is_persistent);
+    RUN_TEST(test_pvector_rest);
+    RUN_TEST(test_pvector_rest_until_empty);
+    return UNITY_END();
+}
@@ -18,7 +18,7 @@ void tearDown(void) {
 // }
 
 void test_execute() {
-    execute_file("/home/dgood/Projects/C/compiler/test2.txt");
+    execute_file("/home/dgood/Projects/C/compiler/test2.txt", &(execute_options){false, 0, 1});
 }
 
 int main(const int argc, char **argv) {
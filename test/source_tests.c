@@ -0,0 +1,99 @@
+//
+// Created by dgood on 1/21/25.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../Unity/src/unity.h"
+#include "../src/source/source.h"
+
+void setUp(void) {
+    // Set up code if needed
+}
+
+void tearDown(void) {
+    // Tear down code if needed
+}
+
+/**
+ * Lex the whole source and return how many tokens it had, counting the EOF.
+ */
+static size_t count_tokens(source *src) {
+    lexer *l     = source_lexer(src);
+    size_t count = 0;
+    source_first_token(src);
+    for (token_span t = lexer_next_token(l);; t = lexer_next_token(l)) {
+        count++;
+        if (t.type == END_OF_FILE)
+            break;
+    }
+    source_finish(src, l);
+    lexer_free(l);
+    return count;
+}
+
+void test_source_mapped(void) {
+    // exactly one page so the mapping has no slack after the text for the terminator
+    const size_t size = (size_t) sysconf(_SC_PAGESIZE);
+    char         path[] = "/tmp/source_testXXXXXX";
+    const int    fd     = mkstemp(path);
+    TEST_ASSERT_TRUE(fd >= 0);
+    FILE *file = fdopen(fd, "w");
+    for (size_t i = 0; i < size / 4; i++)
+        fputs("1 ;\n", file);
+    fclose(file);
+
+    source *src = source_open(path);
+    TEST_ASSERT_NOT_NULL(src);
+    TEST_ASSERT_NOT_NULL(src->data);
+    TEST_ASSERT_EQUAL_size_t(size, src->length);
+    TEST_ASSERT_EQUAL_CHAR(0, src->data[src->length]);
+    TEST_ASSERT_EQUAL_size_t(size, src->stats.bytes);
+    TEST_ASSERT_EQUAL_size_t(2 * (size / 4) + 1, count_tokens(src));
+    TEST_ASSERT_TRUE(src->stats.first_token_ns >= src->stats.open_ns);
+    source_close(src);
+    unlink(path);
+}
+
+void test_source_empty(void) {
+    char      path[] = "/tmp/source_testXXXXXX";
+    const int fd     = mkstemp(path);
+    TEST_ASSERT_TRUE(fd >= 0);
+    close(fd);
+
+    source *src = source_open(path);
+    TEST_ASSERT_NOT_NULL(src->data);
+    TEST_ASSERT_EQUAL_size_t(0, src->length);
+    TEST_ASSERT_EQUAL_size_t(1, count_tokens(src));
+    source_close(src);
+    unlink(path);
+}
+
+void test_source_pipe(void) {
+    const char *input = "let x = 5; x + 10;";
+    int         fds[2];
+    TEST_ASSERT_EQUAL_INT(0, pipe(fds));
+    TEST_ASSERT_EQUAL_INT((int) strlen(input), write(fds[1], input, strlen(input)));
+    close(fds[1]);
+
+    source *src = source_from_fd(fds[0]);
+    TEST_ASSERT_NULL(src->data);
+    TEST_ASSERT_EQUAL_size_t(10, count_tokens(src));
+    TEST_ASSERT_EQUAL_size_t(strlen(input), src->stats.bytes);
+    source_close(src);
+    close(fds[0]);
+}
+
+void test_source_missing(void) {
+    TEST_ASSERT_NULL(source_open("/tmp/source_test_does_not_exist"));
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_source_mapped);
+    RUN_TEST(test_source_empty);
+    RUN_TEST(test_source_pipe);
+    RUN_TEST(test_source_missing);
+    return UNITY_END();
+}
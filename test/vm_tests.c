@@ -4,9 +4,13 @@
 #include <err.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
 #include "../src/object/object.h"
 #include "../Unity/src/unity.h"
 #include "../src/compiler/compiler_core.h"
+#include "../src/compiler/scope.h"
+#include "../src/ir/ir.h"
 #include "../src/lexer/lexer.h"
 #include "object_test_utils.h"
 #include "../src/parser/parser.h"
@@ -400,6 +404,40 @@ static void test_string_expressions(void) {
     }
 }
 
+static void test_string_concatenation_rope(void) {
+    char expected[801];
+    for (size_t i = 0; i < 100; i++) {
+        memcpy(expected + i * 8, "abcdefgh", 8);
+    }
+    expected[800]    = 0;
+    vm_testcase test = {
+            "let build = fn(s, n) { if (n == 0) { s } else { build(s + \"abcdefgh\", n - 1) } };"
+            "let s = build(\"\", 100); let t = s; t",
+            (object_object *) object_create_string(expected, 800)
+    };
+    print_test_separator_line();
+    printf("Testing string concatenation above the rope threshold\n");
+    run_vm_tests(1, &test);
+    object_free(test.expected);
+}
+
+static void test_string_index_expressions(void) {
+    vm_testcase tests[] = {
+            {"\"monkey\"[0]", (object_object *) object_create_string("m", 1)},
+            {"\"monkey\"[5]", (object_object *) object_create_string("y", 1)},
+            {"\"monkey\"[6]", (object_object *) object_create_null()},
+            {"let s = \"monkey\"; s[3] + s[4] + s[5]", (object_object *) object_create_string("key", 3)},
+            {"let s = \"monkey\"; {\"k\": 7}[s[3]]", (object_object *) object_create_int(7)},
+    };
+    print_test_separator_line();
+    printf("Testing string index expressions\n");
+    size_t ntests = sizeof(tests) / sizeof(tests[0]);
+    run_vm_tests(ntests, tests);
+    for (size_t i = 0; i < ntests; i++) {
+        object_free(tests[i].expected);
+    }
+}
+
 static object_array *create_monkey_int_array(size_t count, ...) {
     va_list ap;
     va_start(ap, count);
@@ -496,6 +534,26 @@ static void test_hash_expression_literal(void) {
     object_free(test.expected);
 }
 
+static void test_hash_large_literal(void) {
+    char *input = strdup("let h = {");
+    for (int i = 0; i < 100; i++) {
+        char *next = nullptr;
+        if (asprintf(&next, "%s%s%d: %d", input, i == 0 ? "" : ", ", i, i * 2) == -1)
+            err(EXIT_FAILURE, "malloc failed");
+        free(input);
+        input = next;
+    }
+    char *full = nullptr;
+    if (asprintf(&full, "%s}; let g = h; g[0] + g[42] + h[99] + len(h)", input) == -1)
+        err(EXIT_FAILURE, "malloc failed");
+    free(input);
+    vm_testcase test = {full, (object_object *) object_create_int(0 + 84 + 198 + 100)};
+    print_test_separator_line();
+    printf("Testing hash literal above the trie threshold\n");
+    run_vm_tests(1, &test);
+    object_free(test.expected);
+    free(full);
+}
 
 static void test_index_array_access(void) {
     vm_testcase test = {"[1, 2, 3][1]", (object_object *) object_create_int(2)};
@@ -931,6 +989,21 @@ static void test_push_to_empty_array(void) {
     object_free(test.expected);
 }
 
+static void test_push_and_rest_chained(void) {
+    vm_testcase tests[] = {
+            {"push(push(push([], 1), 2), 3)", (object_object *) create_int_array((int[]){1, 2, 3}, 3)},
+            {"rest(rest(push(push([1], 2), 3)))", (object_object *) create_int_array((int[]){3}, 1)},
+            {"let a = push([1, 2], 3); let b = push(a, 4); len(a) + len(b)", (object_object *) object_create_int(7)},
+            {"let a = rest([1, 2, 3]); let b = push(a, 4); first(b) + last(b) + b[1]", (object_object *) object_create_int(9)},
+            {"let build = fn(arr, n) { if (n == 0) { arr } else { build(push(arr, n), n - 1) } };"
+             "let a = build([], 100); a[0] + a[31] + a[32] + a[99] + len(rest(a))",
+             (object_object *) object_create_int(100 + 69 + 68 + 1 + 99)},
+    };
+    run_vm_tests(5, tests);
+    for (size_t i = 0; i < 5; i++)
+        object_free(tests[i].expected);
+}
+
 static void test_push_to_integer(void) {
     vm_testcase test = {
             "push(1, 1)",
@@ -940,6 +1013,39 @@ static void test_push_to_integer(void) {
     object_free(test.expected);
 }
 
+static void test_sum_min_max(void) {
+    vm_testcase tests[] = {
+            {"sum([1, 2, 3, 4, 5, 6, 7, 8, 9, 10])", (object_object *) object_create_int(55)},
+            {"sum([])", (object_object *) object_create_int(0)},
+            {"min([4, 8, -15, 16, 23, 42, 7])", (object_object *) object_create_int(-15)},
+            {"max([4, 8, -15, 16, 23, 42, 7])", (object_object *) object_create_int(42)},
+            {"max([])", (object_object *) object_create_null()},
+            {"let build = fn(arr, n) { if (n == 0) { arr } else { build(push(arr, n), n - 1) } };"
+             "let a = build([], 100); sum(a) + max(a) - min(rest(a))",
+             (object_object *) object_create_int(5050 + 100 - 1)},
+            {"len(push([1, 2], \"three\"))", (object_object *) object_create_int(3)},
+            {"min(\"abc\")", (object_object *) object_create_error("argument to `min` must be ARRAY, got STRING")},
+            {"sum(push([1, 2], true))",
+             (object_object *) object_create_error("`sum` expects an array of INTEGER, found BOOLEAN")},
+    };
+    const size_t ntests = sizeof(tests) / sizeof(tests[0]);
+    run_vm_tests(ntests, tests);
+    for (size_t i = 0; i < ntests; i++)
+        object_free(tests[i].expected);
+}
+
+static void test_array_arithmetic(void) {
+    vm_testcase tests[] = {
+            {"[1, 2, 3] + [4, 5, 6]", (object_object *) create_int_array((int[]){5, 7, 9}, 3)},
+            {"[10, 20, 30, 40, 50] - [1, 2, 3, 4, 5]", (object_object *) create_int_array((int[]){9, 18, 27, 36, 45}, 5)},
+            {"[1, 2, 3] * [3, 2, 1]", (object_object *) create_int_array((int[]){3, 4, 3}, 3)},
+            {"let a = push([1, 2], 3); let b = rest([0, 1, 2, 3]); sum(a + b)", (object_object *) object_create_int(12)},
+    };
+    const size_t ntests = sizeof(tests) / sizeof(tests[0]);
+    run_vm_tests(ntests, tests);
+    for (size_t i = 0; i < ntests; i++)
+        object_free(tests[i].expected);
+}
 
 static void test_calling_functions_with_bindings_simple() {
     vm_testcase test = {
@@ -1105,15 +1211,425 @@ static void test_closure_with_multiple_nested_functions(void) {
     object_free(test.expected);
 }
 
+static void test_inlined_calls(void) {
+    vm_testcase tests[] = {
+            {"let add = fn(a, b) { a + b }; add(1, 2) + add(3, 4)", (object_object *) object_create_int(10)},
+            {"let one = fn() { 1 }; let f = fn(x) { let y = x * 2; one() + y }; f(3) + f(4)",
+             (object_object *) object_create_int(16)},
+            {"let f = fn(n) { let k = n + 1; let g = fn(m) { m * k }; g(2) + g(3) }; f(1)",
+             (object_object *) object_create_int(10)},
+            {"let sign = fn(x) { if (x < 0) { return -1; } if (x > 0) { 1 } else { 0 } };"
+             "sign(-5) + sign(5) * 10 + sign(0) * 100",
+             (object_object *) object_create_int(9)},
+            {"let noop = fn(a) { }; noop(1)", (object_object *) object_create_null()},
+            {"let f = fn(a) { a }; let f = fn(a) { a * 2 }; f(5)", (object_object *) object_create_int(10)},
+            {"let inc = fn(x) { x + 1 }; let twice = fn(f, x) { f(f(x)) }; twice(inc, 1)",
+             (object_object *) object_create_int(3)},
+            {"let count = fn(n) { if (n == 0) { 0 } else { 1 + count(n - 1) } }; count(5)",
+             (object_object *) object_create_int(5)},
+    };
+    print_test_separator_line();
+    printf("Testing calls the optimizer inlines\n");
+    size_t ntests = sizeof(tests) / sizeof(tests[0]);
+    run_vm_tests(ntests, tests);
+    for (size_t i = 0; i < ntests; i++) {
+        object_free(tests[i].expected);
+    }
+}
+
+static void test_non_escaping_closures(void) {
+    vm_testcase tests[] = {
+            {"let f = fn(a, b) { let k = a * 2;"
+             "let g = fn(x) { let t = x + k; if (t > 10) { t - b - b - b - b - b - b } else { t + b + a } };"
+             "g(1) + g(20) };"
+             "f(3, 4)",
+             (object_object *) object_create_int(16)},
+            {"let f = fn(a) { let g = fn(x) { x + a + a + a + a + a + a + a + a + a }; g }; f(1)(2)",
+             (object_object *) object_create_int(11)},
+            {"let f = fn(n) { let m = 3; let g = fn(i) { if (i == 0) { m } else { g(i - 1) + m } }; g(n) }; f(4)",
+             (object_object *) object_create_int(15)},
+            {"let f = fn(a) { let v = a; let g = fn(x) { x + v + v + v + v + v + v + v + v + v };"
+             "let v = 100; g(1) + v }; f(1)",
+             (object_object *) object_create_int(110)},
+            {"let f = fn(a) { let g = fn(x) { x * a * a * a * a * a * a * a * a }; let h = fn() { g(1) }; h() }; f(2)",
+             (object_object *) object_create_int(256)},
+            {"let f = fn() { let g = fn(x) { x * 2 }; let h = fn(y) { g(y) + g(y) }; h }; f()(3) + f()(4)",
+             (object_object *) object_create_int(28)},
+    };
+    print_test_separator_line();
+    printf("Testing closures that can't escape the function they are made in\n");
+    size_t ntests = sizeof(tests) / sizeof(tests[0]);
+    run_vm_tests(ntests, tests);
+    for (size_t i = 0; i < ntests; i++) {
+        object_free(tests[i].expected);
+    }
+}
+
+static void test_streamed_program(void) {
+    // compile a program a statement at a time from a stream, freeing each statement's
+    // AST as soon as it is compiled; globals and constants carry over between them
+    const size_t count = 2000;
+    FILE *       file  = tmpfile();
+    TEST_ASSERT_NOT_NULL(file);
+    fprintf(file, "let add = fn(a, b) { a + b };\nlet v0 = 0;\n");
+    for (size_t i = 1; i < count; i++)
+        fprintf(file, "let v%zu = add(v%zu, %zu);\n", i, i - 1, i);
+    fprintf(file, "v%zu\n", count - 1);
+    fflush(file);
+    rewind(file);
+
+    lexer *        lexer    = lexer_init_stream(fileno(file));
+    parser *       parser   = parser_init(lexer);
+    compiler *     compiler = compiler_init();
+    ast_statement *statement;
+    size_t         statements = 0;
+    while ((statement = parser_next_statement(parser)) != NULL) {
+        const compiler_error error = compile(compiler, (ast_node *) statement);
+        TEST_ASSERT_EQUAL_INT(COMPILER_ERROR_NONE, error.error_code);
+        free_statement(statement);
+        statements++;
+    }
+    TEST_ASSERT_NULL(parser->errors);
+    TEST_ASSERT_EQUAL_size_t(count + 2, statements);
+
+    bytecode *       bytecode = get_bytecode(compiler);
+    virtual_machine *vm       = vm_init(bytecode);
+    TEST_ASSERT_EQUAL_INT(VM_ERROR_NONE, vm_run(vm).code);
+    object_object *expected = (object_object *) object_create_int((long) (count * (count - 1) / 2));
+    test_object_object(vm_last_popped_stack_elem(vm), expected);
+
+    object_free(expected);
+    vm_free(vm);
+    bytecode_free(bytecode);
+    compiler_free(compiler);
+    parser_free(parser);
+    fclose(file);
+}
+
+/** Compile `input` at an optimization level, returning the compiler's error code and freeing its message. */
+static compiler_error_code compile_at_level(const char *input, const int level, bytecode **bytecode) {
+    lexer *        lexer    = lexer_init(input);
+    parser *       parser   = parser_init(lexer);
+    ast_program *  program  = parse_program(parser);
+    compiler *     compiler = compiler_init();
+    compiler_set_optimization_level(compiler, level);
+    compiler_error error = compile_optimized(compiler, (ast_node *) program);
+    *bytecode            = error.error_code == COMPILER_ERROR_NONE ? get_bytecode(compiler) : nullptr;
+    free(error.msg);
+    compiler_free(compiler);
+    program_free(program);
+    parser_free(parser);
+    return error.error_code;
+}
+
+static void test_wide_operands(void) {
+    // more constants, locals and arguments than the compact operands can hold, with
+    // the code past where a compact jump reaches
+    const size_t constants = 70000;
+    const size_t locals    = 300;
+    char *       input     = nullptr;
+    size_t       length    = 0;
+    FILE *       stream    = open_memstream(&input, &length);
+    TEST_ASSERT_NOT_NULL(stream);
+    for (size_t i = 0; i < constants; i++)
+        fprintf(stream, "\"s%zu\";\n", i);
+    fprintf(stream, "let f = fn(x) { let a0 = x;");
+    for (size_t i = 1; i < locals; i++)
+        fprintf(stream, " let a%zu = a%zu + %zu;", i, i - 1, i);
+    fprintf(stream, " if (a%zu > 0) { a%zu } else { 0 } };\nlet g = fn(p0", locals - 1, locals - 1);
+    for (size_t i = 1; i < locals; i++)
+        fprintf(stream, ", p%zu", i);
+    fprintf(stream, ") { p0 + p%zu };\nf(1) + g(0", locals - 1);
+    for (size_t i = 1; i < locals; i++)
+        fprintf(stream, ", %zu", i);
+    fprintf(stream, ")\n");
+    fclose(stream);
+
+    print_test_separator_line();
+    printf("Testing wide operands\n");
+    object_object *expected = (object_object *) object_create_int(1 + 44850 + 299);
+    for (int level = 0; level <= 2; level++) {
+        bytecode *bytecode;
+        TEST_ASSERT_EQUAL_INT(COMPILER_ERROR_NONE, compile_at_level(input, level, &bytecode));
+        virtual_machine *vm = vm_init(bytecode);
+        TEST_ASSERT_EQUAL_INT(VM_ERROR_NONE, vm_run(vm).code);
+        test_object_object(vm_last_popped_stack_elem(vm), expected);
+        vm_free(vm);
+        bytecode_free(bytecode);
+    }
+    object_free(expected);
+    free(input);
+
+    // a closure can't hold more free variables than MAX_FREE_VARIABLES
+    stream = open_memstream(&input, &length);
+    TEST_ASSERT_NOT_NULL(stream);
+    fprintf(stream, "fn() {");
+    for (size_t i = 0; i <= MAX_FREE_VARIABLES; i++)
+        fprintf(stream, " let v%zu = %zu;", i, i);
+    fprintf(stream, " fn() { v0");
+    for (size_t i = 1; i <= MAX_FREE_VARIABLES; i++)
+        fprintf(stream, " + v%zu", i);
+    fprintf(stream, " } }");
+    fclose(stream);
+    for (int level = 0; level <= 2; level++) {
+        bytecode *bytecode;
+        TEST_ASSERT_EQUAL_INT(COMPILER_OPERAND_TOO_LARGE, compile_at_level(input, level, &bytecode));
+    }
+    free(input);
+}
+
+static void test_far_jumps(void) {
+    // an if and a while whose bodies start before where a compact jump reaches and end past it
+    const size_t statements = 17000;
+    char *       input      = nullptr;
+    size_t       length     = 0;
+    FILE *       stream     = open_memstream(&input, &length);
+    TEST_ASSERT_NOT_NULL(stream);
+    fprintf(stream, "let x = 1;\nlet f = fn(n) { let t = if (n > 0) {");
+    for (size_t i = 0; i < statements; i++)
+        fprintf(stream, " x;");
+    fprintf(stream, " n * 2 } else { 0 }; let i = 0; while (i < n) {");
+    for (size_t i = 0; i < statements; i++)
+        fprintf(stream, " x;");
+    fprintf(stream, " let i = i + 1; }; t + i };\nf(3) + if (x > 0) {");
+    for (size_t i = 0; i < statements; i++)
+        fprintf(stream, " x;");
+    fprintf(stream, " 5 } else { 6 }\n");
+    fclose(stream);
+
+    print_test_separator_line();
+    printf("Testing far jumps\n");
+    object_object *expected = (object_object *) object_create_int(6 + 3 + 5);
+    for (int level = 0; level <= 2; level++) {
+        bytecode *bytecode;
+        TEST_ASSERT_EQUAL_INT(COMPILER_ERROR_NONE, compile_at_level(input, level, &bytecode));
+        virtual_machine *vm = vm_init(bytecode);
+        TEST_ASSERT_EQUAL_INT(VM_ERROR_NONE, vm_run(vm).code);
+        test_object_object(vm_last_popped_stack_elem(vm), expected);
+        vm_free(vm);
+        bytecode_free(bytecode);
+    }
+    object_free(expected);
+    free(input);
+}
+
+static void test_while_loops(void) {
+    vm_testcase tests[] = {
+            {"let i = 0; let s = 0; while (i < 10) { let s = s + i; let i = i + 1; }; s",
+             (object_object *) object_create_int(45)},
+            {"let i = 0; while (i < 3) { let i = i + 1; i * 10 }", (object_object *) object_create_int(30)},
+            {"while (false) { 1 }", (object_object *) object_create_null()},
+            {"let i = 0; let f = fn() { i }; while (i < 5) { let i = i + 1; }; f() + i",
+             (object_object *) object_create_int(5)},
+            {"let f = fn(n) { let k = 0; let acc = 0;"
+             "while (k < n) { let j = 0; while (j < k) { let acc = acc + j; let j = j + 1; }; let k = k + 1; };"
+             "acc }; f(10)",
+             (object_object *) object_create_int(120)},
+            {"let f = fn(n) { let i = 0; while (true) { if (i == n) { return i * 2; }; let i = i + 1; } }; f(7)",
+             (object_object *) object_create_int(14)},
+            {"let n = 0; let g = fn() { while (n < 4) { let n = n + 1; }; n }; g() + n",
+             (object_object *) object_create_int(4)},
+            // an if whose branch ends in a let gives null, like one that doesn't run
+            {"let i = 0; while (i < 2) { if (true) { let a = 10; }; let i = i + 1; }; i",
+             (object_object *) object_create_int(2)},
+            {"let s = 0; let j = 0;"
+             "while (j < 3) { if (j == 1) { let s = s + 1; } else { let s = s + 10; }; let j = j + 1; }; s",
+             (object_object *) object_create_int(21)},
+            {"let f = fn(n) { let k = 0; let t = 0;"
+             "while (k < n) { if (k > 1) { let t = t + k; } else { }; let k = k + 1; }; t }; f(5)",
+             (object_object *) object_create_int(9)},
+    };
+    print_test_separator_line();
+    printf("Testing while loops\n");
+    size_t ntests = sizeof(tests) / sizeof(tests[0]);
+    run_vm_tests(ntests, tests);
+    for (size_t i = 0; i < ntests; i++) {
+        object_free(tests[i].expected);
+    }
+}
+
+static void test_logical_and_modulo_operators(void) {
+    vm_testcase tests[] = {
+            {"true && false", (object_object *) object_create_bool(false)},
+            {"true && true", (object_object *) object_create_bool(true)},
+            {"false || true", (object_object *) object_create_bool(true)},
+            {"false || false", (object_object *) object_create_bool(false)},
+            {"1 < 2 && 2 < 3 || false", (object_object *) object_create_bool(true)},
+            {"let f = fn() { 1 / 0 }; false && f()", (object_object *) object_create_bool(false)},
+            {"let f = fn() { 1 / 0 }; true || f()", (object_object *) object_create_bool(true)},
+            {"17 % 5", (object_object *) object_create_int(2)},
+            {"let a = -7; a % 3", (object_object *) object_create_int(-1)},
+    };
+    print_test_separator_line();
+    printf("Testing &&, || and %%\n");
+    size_t ntests = sizeof(tests) / sizeof(tests[0]);
+    run_vm_tests(ntests, tests);
+    for (size_t i = 0; i < ntests; i++) {
+        object_free(tests[i].expected);
+    }
+
+    bytecode *bytecode;
+    TEST_ASSERT_EQUAL_INT(COMPILER_ERROR_NONE, compile_at_level("let z = 0; 5 % z", 2, &bytecode));
+    virtual_machine *vm    = vm_init(bytecode);
+    const vm_error   error = vm_run(vm);
+    TEST_ASSERT_EQUAL_INT(VM_DIVISION_BY_ZERO, error.code);
+    TEST_ASSERT_EQUAL_STRING("division by 0 not allowed", error.msg);
+    free(error.msg);
+    vm_free(vm);
+    bytecode_free(bytecode);
+}
+
+static void test_loop_safepoint(void) {
+    // an interrupt is only noticed at a loop's backward branch, which also counts it
+    print_test_separator_line();
+    printf("Testing interrupting a loop\n");
+    bytecode *bytecode;
+    TEST_ASSERT_EQUAL_INT(COMPILER_ERROR_NONE, compile_at_level("while (true) { 1 }", 2, &bytecode));
+    virtual_machine *vm = vm_init(bytecode);
+    vm_interrupt(vm);
+    vm_error error = vm_run(vm);
+    TEST_ASSERT_EQUAL_INT(VM_INTERRUPTED, error.code);
+    TEST_ASSERT_EQUAL_size_t(1, vm->loop_count);
+    free(error.msg);
+    vm_free(vm);
+    bytecode_free(bytecode);
+
+    TEST_ASSERT_EQUAL_INT(COMPILER_ERROR_NONE,
+                          compile_at_level("let i = 0; while (i < 100) { let i = i + 1; }", 2, &bytecode));
+    vm    = vm_init(bytecode);
+    error = vm_run(vm);
+    TEST_ASSERT_EQUAL_INT(VM_ERROR_NONE, error.code);
+    TEST_ASSERT_EQUAL_size_t(100, vm->loop_count);
+    vm_free(vm);
+    bytecode_free(bytecode);
+}
+
+static void test_loop_invariant_code_motion(void) {
+    vm_testcase tests[] = {
+            {"let a = [1, 2, 3]; let i = 0; let s = 0;"
+             "while (i < len(a)) { let s = s + a[i] + len(push(a, 4)); let i = i + 1; }; s",
+             (object_object *) object_create_int(18)},
+            {"let h = {\"k\": 10}; let b = 7; let i = 0; let t = 0;"
+             "while (i < 4) { let x = h[\"k\"] * b; let t = t + x; let i = i + 2; }; t",
+             (object_object *) object_create_int(140)},
+            {"let h = {}; let i = 0; while (i < 0) { let y = h[[1]]; let i = i + 1; y }",
+             (object_object *) object_create_null()},
+            {"let f = fn(a) { let k = 0; let s = 0; while (k < 3) { let s = s + a[\"x\"] * 2; let k = k + 1; }; s };"
+             "f({\"x\": 4})",
+             (object_object *) object_create_int(24)},
+            {"let f = fn(n) { let i = 0; let s = 0;"
+             "while (i < n) { let j = 0; while (j < n) { let s = s + i * n + j; let j = j + 1; }; let i = i + 1; };"
+             "s }; f(3)",
+             (object_object *) object_create_int(36)},
+            {"let c = 0; let n = 3; while (c < n) { let n = n - 1; let c = c + 1; }; c * 10 + n",
+             (object_object *) object_create_int(21)},
+            {"let i = 7; while (10 > i) { let i = i + 2; }; i", (object_object *) object_create_int(11)},
+            // '!' fails on an int, so it stays in the branch that never runs
+            {"let n = 5; let i = 0; while (i < 3) { if (i > 10) { puts(!n); } let i = i + 1; }; i",
+             (object_object *) object_create_int(3)},
+            {"let f = fn(n) { let i = 0; while (i < 3) { if (i > 10) { puts(!n); } let i = i + 1; }; i }; f(5)",
+             (object_object *) object_create_int(3)},
+            {"let i = 0; let t = 0; while (i < 3) { let t = t + if (!!true) { 2 } else { 0 }; let i = i + 1; }; t",
+             (object_object *) object_create_int(6)},
+    };
+    print_test_separator_line();
+    printf("Testing loop invariant code motion\n");
+    size_t ntests = sizeof(tests) / sizeof(tests[0]);
+    run_vm_tests(ntests, tests);
+    for (size_t i = 0; i < ntests; i++) {
+        object_free(tests[i].expected);
+    }
+
+    // the counted loop instructions fail the same way the code they replace does
+    const char *failing[] = {
+            "let i = \"a\"; while (i < 2) { 1 }",
+            "let i = \"a\"; while (true) { let i = i + 1; }",
+    };
+    for (size_t i = 0; i < sizeof(failing) / sizeof(failing[0]); i++) {
+        bytecode *bytecode;
+        TEST_ASSERT_EQUAL_INT(COMPILER_ERROR_NONE, compile_at_level(failing[i], 0, &bytecode));
+        virtual_machine *vm       = vm_init(bytecode);
+        const vm_error   expected = vm_run(vm);
+        vm_free(vm);
+        bytecode_free(bytecode);
+
+        TEST_ASSERT_EQUAL_INT(COMPILER_ERROR_NONE, compile_at_level(failing[i], 2, &bytecode));
+        vm                    = vm_init(bytecode);
+        const vm_error actual = vm_run(vm);
+        TEST_ASSERT_EQUAL_INT(VM_UNSUPPORTED_OPERAND, actual.code);
+        TEST_ASSERT_EQUAL_INT(expected.code, actual.code);
+        TEST_ASSERT_EQUAL_STRING(expected.msg, actual.msg);
+        free(expected.msg);
+        free(actual.msg);
+        vm_free(vm);
+        bytecode_free(bytecode);
+    }
+}
+
+static void test_incremental_inputs(void) {
+    // run one input at a time as the REPL does, the compiler and VM keep their state
+    // between inputs and each run only sees the new input's instructions
+    const char *inputs[] = {
+            "let a = 1;",
+            "let add = fn(x, y) { x + y };",
+            "let makeAdder = fn(x) { fn(y) { add(x, y) } };",
+            "let addTen = makeAdder(10);",
+            "undefined_name;",
+            "let s = \"mon\" + \"key\";",
+            "addTen(a) + len(s);",
+    };
+    compiler *       compiler = compiler_init();
+    virtual_machine *vm       = nullptr;
+    for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++) {
+        lexer *        lexer   = lexer_init(inputs[i]);
+        parser *       parser  = parser_init(lexer);
+        ast_program *  program = parse_program(parser);
+        compiler_error error   = compile(compiler, (ast_node *) program);
+        if (error.error_code != COMPILER_ERROR_NONE) {
+            // a failed input leaves nothing behind for the next one
+            TEST_ASSERT_EQUAL_INT(COMPILER_UNDEFINED_VARIABLE, error.error_code);
+            free(error.msg);
+        } else {
+            const bytecode bytecode = {get_top_scope(compiler)->instructions, compiler->constants_pool};
+            if (vm == NULL)
+                vm = vm_init(&bytecode);
+            else
+                vm_load(vm, &bytecode);
+            TEST_ASSERT_EQUAL_INT(VM_ERROR_NONE, vm_run(vm).code);
+        }
+        compiler_reset(compiler);
+        TEST_ASSERT_EQUAL_size_t(0, get_top_scope(compiler)->instructions->length);
+        program_free(program);
+        parser_free(parser);
+    }
+    TEST_ASSERT_EQUAL_size_t(compiler->constants_pool->size, vm->constants->size);
+
+    object_object *expected = (object_object *) object_create_int(17);
+    test_object_object(vm_last_popped_stack_elem(vm), expected);
+
+    object_free(expected);
+    vm_free(vm);
+    compiler_free(compiler);
+}
+
+/**
+ * Run each test case at each optimization level, from -O0 to -O2, none of which may
+ * change any result.
+ */
 static void run_vm_tests(size_t test_count, vm_testcase test_cases[test_count]) {
-    for (size_t i = 0; i < test_count; i++) {
-        vm_testcase t = test_cases[i];
-        printf("Testing vm test for input %s\n", t.input);
-        lexer *        lexer    = lexer_init(t.input);
-        parser *       parser   = parser_init(lexer);
-        ast_program *  program  = parse_program(parser);
-        compiler *     compiler = compiler_init();
-        compiler_error error    = compile(compiler, (ast_node *) program);
+    // at each optimization level, and then at -O2 as aligned instructions
+    for (size_t i = 0; i < 4 * test_count; i++) {
+        vm_testcase  t       = test_cases[i % test_count];
+        const size_t level   = i / test_count < 2 ? i / test_count : 2;
+        const bool   aligned = i / test_count == 3;
+        printf("Testing vm test for input %s at -O%zu%s\n", t.input, level, aligned ? " aligned" : "");
+        lexer *      lexer    = lexer_init(t.input);
+        parser *     parser   = parser_init(lexer);
+        ast_program *program  = parse_program(parser);
+        compiler *   compiler = compiler_init();
+        compiler_set_optimization_level(compiler, (int) level);
+        compiler_set_instruction_format(compiler, aligned ? INSTRUCTIONS_ALIGNED : INSTRUCTIONS_BYTES);
+        compiler_error error = compile_optimized(compiler, (ast_node *) program);
         if (error.error_code != COMPILER_ERROR_NONE) {
             err(EXIT_FAILURE, "compilation failed for input %s with error %s\n",
                 t.input, error.msg);
@@ -1173,12 +1689,15 @@ int main() {
     RUN_TEST(test_if_1_greater_2);
     RUN_TEST(test_global_let_stmts);
     RUN_TEST(test_string_expressions);
+    RUN_TEST(test_string_concatenation_rope);
+    RUN_TEST(test_string_index_expressions);
     RUN_TEST(test_empty_array_literal);
     RUN_TEST(test_simple_array_literal);
     RUN_TEST(test_array_with_expressions);
     RUN_TEST(test_hash_empty_literal);
     RUN_TEST(test_hash_simple_literal);
     RUN_TEST(test_hash_expression_literal);
+    RUN_TEST(test_hash_large_literal);
     RUN_TEST(test_index_array_access);
     RUN_TEST(test_index_array_expression);
     RUN_TEST(test_nested_array_access);
@@ -1223,7 +1742,10 @@ int main() {
     RUN_TEST(test_rest_with_array);
     RUN_TEST(test_rest_with_empty_array);
     RUN_TEST(test_push_to_empty_array);
+    RUN_TEST(test_push_and_rest_chained);
     RUN_TEST(test_push_to_integer);
+    RUN_TEST(test_sum_min_max);
+    RUN_TEST(test_array_arithmetic);
     RUN_TEST(test_calling_functions_with_bindings_global_seed);
     RUN_TEST(test_recursive_closures);
     RUN_TEST(test_recursive_fibonacci);
@@ -1233,6 +1755,16 @@ int main() {
     RUN_TEST(test_nested_closures);
     RUN_TEST(test_closure_with_outer_variable);
     RUN_TEST(test_closure_with_multiple_nested_functions);
+    RUN_TEST(test_inlined_calls);
+    RUN_TEST(test_non_escaping_closures);
+    RUN_TEST(test_streamed_program);
+    RUN_TEST(test_incremental_inputs);
+    RUN_TEST(test_wide_operands);
+    RUN_TEST(test_far_jumps);
+    RUN_TEST(test_while_loops);
+    RUN_TEST(test_logical_and_modulo_operators);
+    RUN_TEST(test_loop_safepoint);
+    RUN_TEST(test_loop_invariant_code_motion);
 
 
     return UNITY_END();